@@ -0,0 +1,198 @@
+#include "offline.h"
+#include "wavfile.h"
+#include "timing.h"
+#include "rtarena.h"
+#include "microbench.h"
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <iterator>
+
+// Renders a project headless as fast as possible and reports the cost per stage and per plugin.
+// The MIDI input is a fixed chord pattern, so two runs with the same arguments produce the same audio;
+// the WAV output can be compared against a known good render after changes to the audio path.
+
+namespace
+{
+    class TOptions
+    {
+    public:
+        std::string m_ProjectDir;
+        double m_Seconds = 10.0;
+        uint32_t m_BlockSize = 256;
+        uint32_t m_SampleRate = 48000;
+        size_t m_Polyphony = 4;
+        std::string m_OutFile;
+        std::string m_Micro;
+    };
+
+    [[noreturn]] void Usage(const char *argv0)
+    {
+        std::cerr << "Usage: " << argv0 << " [--project dir] [--seconds s] [--blocksize n] [--samplerate hz] [--polyphony n] [--out file.wav]\n";
+        std::cerr << "       " << argv0 << " [--project dir] --micro name\n";
+        std::cerr << "The project defaults to ~/.config/jnlive-data, the block size must be a multiple of 8.\n";
+        std::cerr << "--micro runs one micro benchmark instead of rendering a project: " << microbench::Names() << ".\n";
+        exit(1);
+    }
+
+    TOptions ParseOptions(int argc, char** argv)
+    {
+        TOptions result;
+        auto home = getenv("HOME");
+        result.m_ProjectDir = std::string(home? home : "") + "/.config/jnlive-data";
+        for(int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            if(i + 1 >= argc)
+            {
+                Usage(argv[0]);
+            }
+            std::string value = argv[++i];
+            if(arg == "--project") result.m_ProjectDir = value;
+            else if(arg == "--seconds") result.m_Seconds = std::stod(value);
+            else if(arg == "--blocksize") result.m_BlockSize = (uint32_t)std::stoul(value);
+            else if(arg == "--samplerate") result.m_SampleRate = (uint32_t)std::stoul(value);
+            else if(arg == "--polyphony") result.m_Polyphony = std::stoul(value);
+            else if(arg == "--out") result.m_OutFile = value;
+            else if(arg == "--micro") result.m_Micro = value;
+            else Usage(argv[0]);
+        }
+        if( (result.m_BlockSize == 0) || ((result.m_BlockSize & 7) != 0) || (result.m_Seconds <= 0.0) || (result.m_SampleRate == 0) )
+        {
+            Usage(argv[0]);
+        }
+        return result;
+    }
+
+    // Every part plays the same progression: a chord of m_Polyphony notes every half second, released just before the next one.
+    class TScriptedMidi
+    {
+    public:
+        TScriptedMidi(offline::THost &host, size_t polyphony) : m_Host(host), m_Polyphony(polyphony)
+        {
+            m_ChordFrames = host.SampleRate() / 2;
+        }
+        // queues the events for the block starting at frame:
+        void QueueBlock(uint64_t frame, uint32_t nframes)
+        {
+            static constexpr int sRoots[] = {48, 53, 55, 50, 57, 52, 55, 48};
+            static constexpr int sIntervals[] = {0, 4, 7, 12, 16, 19, 24, 28};
+            for(uint64_t f = frame; f < frame + nframes; f++)
+            {
+                if(f % m_ChordFrames != 0) continue;
+                auto chord = f / m_ChordFrames;
+                auto offset = (uint32_t)(f - frame);
+                for(size_t partindex = 0; partindex < m_Host.Project().Parts().size(); partindex++)
+                {
+                    if(chord > 0)
+                    {
+                        int prevroot = sRoots[(chord - 1) % std::size(sRoots)];
+                        for(size_t i = 0; i < std::min(m_Polyphony, std::size(sIntervals)); i++)
+                        {
+                            uint8_t noteoff[3] = {0x80, (uint8_t)(prevroot + sIntervals[i]), 64};
+                            m_Host.SendMidiToPart(partindex, offset, noteoff, 3);
+                        }
+                    }
+                    int root = sRoots[chord % std::size(sRoots)];
+                    for(size_t i = 0; i < std::min(m_Polyphony, std::size(sIntervals)); i++)
+                    {
+                        uint8_t noteon[3] = {0x90, (uint8_t)(root + sIntervals[i]), (uint8_t)(80 + 8 * (i % 4))};
+                        m_Host.SendMidiToPart(partindex, offset, noteon, 3);
+                    }
+                }
+            }
+        }
+
+    private:
+        offline::THost &m_Host;
+        size_t m_Polyphony;
+        uint64_t m_ChordFrames;
+    };
+
+    void PrintRow(const std::string &name, const timing::TStats &stats, double blockUs)
+    {
+        std::cout << std::left << std::setw(32) << name << std::right << std::fixed << std::setprecision(1)
+            << std::setw(10) << stats.AvgUs() << std::setw(10) << stats.P99Us() << std::setw(10) << stats.MaxUs()
+            << std::setw(9) << (100.0 * stats.AvgUs() / blockUs) << "%\n";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        auto options = ParseOptions(argc, argv);
+        if(!options.m_Micro.empty())
+        {
+            if(!microbench::Run(options.m_Micro, options.m_ProjectDir))
+            {
+                Usage(argv[0]);
+            }
+            return 0;
+        }
+        offline::THost host(std::string(options.m_ProjectDir), options.m_SampleRate, options.m_BlockSize, argc, argv);
+        // one window for the whole run, flushed at the end:
+        host.RtProcessor().SetTimingWindowNs(UINT64_MAX);
+        std::unique_ptr<wavfile::TWriter> writer;
+        if(!options.m_OutFile.empty())
+        {
+            writer = std::make_unique<wavfile::TWriter>(options.m_OutFile, options.m_SampleRate, 2);
+        }
+        TScriptedMidi midi(host, options.m_Polyphony);
+        uint64_t totalframes = (uint64_t)std::llround(options.m_Seconds * options.m_SampleRate);
+        uint64_t numblocks = (totalframes + options.m_BlockSize - 1) / options.m_BlockSize;
+        uint64_t renderNs = 0;
+        for(uint64_t block = 0; block < numblocks; block++)
+        {
+            midi.QueueBlock(block * options.m_BlockSize, options.m_BlockSize);
+            auto start = timing::NowNs();
+            host.Process(options.m_BlockSize);
+            renderNs += timing::NowNs() - start;
+            if(writer)
+            {
+                const float* channels[2] = {host.Output(0), host.Output(1)};
+                writer->Write(channels, options.m_BlockSize);
+            }
+        }
+        host.RtProcessor().FlushTiming();
+        host.RtProcessor().ProcessMessagesInMainThread();
+        if(writer)
+        {
+            writer->Close();
+        }
+
+        const auto &report = host.RtProcessor().TimingReport();
+        double audioSeconds = (double)(numblocks * options.m_BlockSize) / options.m_SampleRate;
+        double blockUs = 1e6 * options.m_BlockSize / options.m_SampleRate;
+        std::cout << "Rendered " << std::fixed << std::setprecision(2) << audioSeconds << " s in " << (double)renderNs / 1e9 << " s, "
+            << numblocks << " blocks of " << options.m_BlockSize << " frames at " << options.m_SampleRate << " Hz\n";
+        std::cout << "Realtime factor: " << std::setprecision(1) << (renderNs > 0? audioSeconds * 1e9 / (double)renderNs : 0.0) << "x\n\n";
+        std::cout << std::left << std::setw(32) << "" << std::right << std::setw(10) << "avg us" << std::setw(10) << "p99 us" << std::setw(10) << "max us" << std::setw(10) << "of block" << "\n";
+        PrintRow("Cycle", report.m_Cycle, blockUs);
+        std::vector<std::pair<std::string, timing::TStats>> instances;
+        for(const auto &[instance, stats]: report.m_Instances)
+        {
+            instances.emplace_back(host.InstanceName(instance), stats);
+        }
+        std::stable_sort(instances.begin(), instances.end(), [](const auto &a, const auto &b){
+            return a.second.AvgUs() > b.second.AvgUs();
+        });
+        for(const auto &[name, stats]: instances)
+        {
+            PrintRow(name, stats, blockUs);
+        }
+        for(size_t stage = 0; stage < realtimethread::sNumStages; stage++)
+        {
+            PrintRow(std::string("Stage: ") + realtimethread::StageName((realtimethread::TStage)stage), report.m_Stages[stage], blockUs);
+        }
+        std::cout << "\n" << rtarena::Report() << "\n";
+    }
+    catch(std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
@@ -1,5 +1,7 @@
 #include "engine.h"
 #include <filesystem>
+#include "threads.h"
+#include "rtarena.h"
 
 import project;
 
@@ -134,6 +136,58 @@ namespace engine
         }
     }
 
+    // How a project edit affects the plugins. Names are only shown in the GUIs. The amplitude factors and the reverb
+    // mix level only go into the realtime data, the plugin instances stay as they are.
+    TProjectChange ClassifyProjectChange(const project::TProject &oldproject, const project::TProject &newproject)
+    {
+        if(oldproject == newproject)
+        {
+            return TProjectChange::None;
+        }
+        if( (oldproject.Instruments().size() != newproject.Instruments().size())
+         || (oldproject.Parts().size() != newproject.Parts().size())
+         || (oldproject.Presets().size() != newproject.Presets().size())
+         || (oldproject.Reverb().ChangeMixLevel(0.0f) != newproject.Reverb().ChangeMixLevel(0.0f)) )
+        {
+            return TProjectChange::Plugins;
+        }
+        for(size_t i = 0; i < oldproject.Instruments().size(); i++)
+        {
+            if(oldproject.Instruments()[i].ChangeName({}) != newproject.Instruments()[i].ChangeName({}))
+            {
+                return TProjectChange::Plugins;
+            }
+        }
+        for(size_t i = 0; i < oldproject.Parts().size(); i++)
+        {
+            if(oldproject.Parts()[i].ChangeName({}).ChangeAmplitudeFactor(1.0f) != newproject.Parts()[i].ChangeName({}).ChangeAmplitudeFactor(1.0f))
+            {
+                return TProjectChange::Plugins;
+            }
+        }
+        for(size_t i = 0; i < oldproject.Presets().size(); i++)
+        {
+            const auto &oldpreset = oldproject.Presets()[i];
+            const auto &newpreset = newproject.Presets()[i];
+            if( (oldpreset.has_value() != newpreset.has_value()) || (oldpreset && (oldpreset->ChangeName({}) != newpreset->ChangeName({}))) )
+            {
+                return TProjectChange::Plugins;
+            }
+        }
+        if(oldproject.Reverb().MixLevel() != newproject.Reverb().MixLevel())
+        {
+            return TProjectChange::Mix;
+        }
+        for(size_t i = 0; i < oldproject.Parts().size(); i++)
+        {
+            if(oldproject.Parts()[i].AmplitudeFactor() != newproject.Parts()[i].AmplitudeFactor())
+            {
+                return TProjectChange::Mix;
+            }
+        }
+        return TProjectChange::None;
+    }
+
     void Engine::SetData(TData &&data)
     {
         auto olddata = std::move(m_Data);
@@ -194,17 +248,26 @@ namespace engine
                 m_JackConnectionsToSave = std::make_unique<project::TJackConnections>(m_Data.JackConnections());
             }
         }
-        if( (olddata.Project() != m_Data.Project())
+        auto projectchange = ClassifyProjectChange(olddata.Project(), m_Data.Project());
+        if( (projectchange == TProjectChange::Plugins)
           || (olddata.ShowUi()  != m_Data.ShowUi())
             || (olddata.ShowReverbUi() != m_Data.ShowReverbUi()) 
             || (olddata.GuiFocusedPart() != m_Data.GuiFocusedPart()) )
         {
             SyncPlugins();
         }
+        else if(projectchange == TProjectChange::Mix)
+        {
+            SyncRtData();
+        }
         if(olddata.HammondData() != m_Data.HammondData())
         {
             UpdateHammondPlugins(olddata.HammondData(), false);
         }
+        if(olddata.JackConnections() != m_Data.JackConnections())
+        {
+            ApplyJackConnections();
+        }
         OnDataChanged().Notify();
     }
     void Engine::UpdateHammondPlugins(const project::THammondData &olddata, bool forceNow)
@@ -257,17 +320,12 @@ namespace engine
         }
 
     }
-    void Engine::ApplyJackConnections(bool forceNow)
+    void Engine::ApplyJackConnections()
     {
-        auto now = std::chrono::steady_clock::now();
-        if(m_LastApplyJackConnectionTime && !forceNow)
-        {
-            if(now - *m_LastApplyJackConnectionTime < std::chrono::milliseconds(1000))
-            {
-                return;
-            }
-        }
-        m_LastApplyJackConnectionTime = now;
+        // the connections are made by m_JackConnectionReconciler in a background thread
+        using TRule = jackutils::ConnectionReconciler::TRule;
+        using TMode = jackutils::ConnectionReconciler::TMode;
+        std::vector<TRule> rules;
         size_t partindex = 0;
         for(const auto &midiInPortNames: Data().JackConnections().MidiInputs())
         {
@@ -276,20 +334,22 @@ namespace engine
                 break;
             }
             const auto &part = m_Parts[partindex];
-            part.MidiInPort()->LinkToAnyPortByPattern(midiInPortNames);
+            auto patterns = midiInPortNames;
+            rules.emplace_back(part.MidiInPort()->FullName(), jackutils::PortDirection::Input, std::move(patterns), TMode::ConnectToAny);
             partindex++;
         }
         for(size_t portindex = 0; portindex < m_AudioOutPorts.size(); ++portindex)
         {
             if(portindex < Data().JackConnections().AudioOutputs().size())
             {
-                const auto &audioportnames = Data().JackConnections().AudioOutputs()[portindex];
-                m_AudioOutPorts[portindex]->LinkToAllPortsByPattern(audioportnames);
+                auto patterns = Data().JackConnections().AudioOutputs()[portindex];
+                rules.emplace_back(m_AudioOutPorts[portindex]->FullName(), jackutils::PortDirection::Output, std::move(patterns), TMode::ConnectToAll);
             }
         }
         if(m_VocoderInPort)
         {
-            m_VocoderInPort->LinkToAnyPortByPattern(Data().JackConnections().VocoderInput());
+            auto patterns = Data().JackConnections().VocoderInput();
+            rules.emplace_back(m_VocoderInPort->FullName(), jackutils::PortDirection::Input, std::move(patterns), TMode::ConnectToAny);
         }
         for(const auto &auxinport: m_AuxInPorts)
         {
@@ -300,7 +360,8 @@ namespace engine
                 {
                     if(portpair.first == name)
                     {
-                        auxinport->Port().LinkToAnyPortByPattern(portpair.second);
+                        auto patterns = portpair.second;
+                        rules.emplace_back(auxinport->Port().FullName(), jackutils::PortDirection::Input, std::move(patterns), TMode::ConnectToAny);
                     }
                 }
             }
@@ -314,11 +375,13 @@ namespace engine
                 {
                     if(portpair.first == name)
                     {
-                        auxOutport->Port().LinkToAllPortsByPattern(portpair.second);
+                        auto patterns = portpair.second;
+                        rules.emplace_back(auxOutport->Port().FullName(), jackutils::PortDirection::Output, std::move(patterns), TMode::ConnectToAll);
                     }
                 }
             }
         }
+        m_JackConnectionReconciler.SetRules(std::move(rules));
     }
 
     realtimethread::Data Engine::CalcRtData() const
@@ -334,36 +397,44 @@ namespace engine
             }
         }
 
+        // after the jack buffer size grew, plugins whose buffers have not been reallocated yet are left out:
+        auto buffersfit = [this](const lilvutils::Instance &instance){
+            return instance.AudioBufferLength() >= m_LilvWorld.AudioBufferLength();
+        };
         std::vector<std::optional<size_t>> ownedPluginIndex2RtPluginIndex;
         std::vector<realtimethread::Data::Plugin> plugins;
+        // rt plugin index of the instrument, part of the insert chain, amplitude:
+        std::vector<std::tuple<size_t, std::optional<size_t>, float>> chains;
         for(size_t ownedPluginIndex = 0; ownedPluginIndex < m_OwnedPlugins.size(); ownedPluginIndex++)
         {
             const auto &ownedplugin = m_OwnedPlugins[ownedPluginIndex];
             const auto &instrument = Project().Instruments().at(ownedplugin->OwningInstrumentIndex());
             bool isActive = activePluginIndices.find(ownedPluginIndex) != activePluginIndices.end();
-            for(const auto &presetLoader: m_PresetLoaders)
+            if(IsPluginLoading(ownedplugin.get()) || (!ownedplugin->pluginInstance()) || (!buffersfit(ownedplugin->pluginInstance()->Instance())))
             {
-                if(&presetLoader->PluginInstance() == ownedplugin.get())
-                {
-                    isActive = false;
-                }
+                isActive = false;
             }
             if(isActive)
             {
                 float amplitude = 0.0f;
                 bool doOverridePort;
+                // the part whose insert effects process this instrument; for a shared instrument the first part playing it:
+                std::optional<size_t> chainpart;
                 if(ownedplugin->OwningPart())
                 {
                     amplitude = Project().Parts()[*ownedplugin->OwningPart()].AmplitudeFactor();
                     doOverridePort = false;
+                    chainpart = ownedplugin->OwningPart();
                 }
                 else
                 {
-                    for(const auto &part: Project().Parts())
+                    for(size_t partindex = 0; partindex < Project().Parts().size(); ++partindex)
                     {
+                        const auto &part = Project().Parts()[partindex];
                         if(part.ActiveInstrumentIndex() == ownedplugin->OwningInstrumentIndex())
                         {
                             amplitude = std::max(part.AmplitudeFactor(), amplitude);
+                            if(!chainpart) chainpart = partindex;
                         }
                         doOverridePort = true;
                     }
@@ -371,13 +442,37 @@ namespace engine
                 int transpose = 0;
                 auto midiInBuf = ownedplugin->pluginInstance()->GetMidiInBuf();
                 ownedPluginIndex2RtPluginIndex.push_back(plugins.size());
-                plugins.emplace_back(&ownedplugin->pluginInstance()->Instance(), amplitude, doOverridePort, midiInBuf, transpose, instrument.HasVocoderInput());
+                chains.emplace_back(plugins.size(), chainpart, amplitude);
+                plugins.emplace_back(&ownedplugin->pluginInstance()->Instance(), doOverridePort, midiInBuf, transpose, instrument.HasVocoderInput(), !instrument.AlwaysRun());
             }
             else
             {
                 ownedPluginIndex2RtPluginIndex.push_back(std::nullopt);
             }
         }
+        // the insert effects and the reverb come after the instruments, so the plugin indices of the midi ports stay valid:
+        realtimethread::TMixGraph mixgraph;
+        for(const auto &[instrumentpluginindex, chainpart, amplitude]: chains)
+        {
+            std::vector<size_t> insertpluginindices;
+            if(chainpart && (*chainpart < m_PartInsertEffects.size()))
+            {
+                for(const auto &insert: m_PartInsertEffects[*chainpart])
+                {
+                    // bypassed while its preset loads:
+                    if(m_PresetLoaderPool.IsLoading(insert.m_Instance.get()) || (!buffersfit(insert.m_Instance->Instance()))) continue;
+                    insertpluginindices.push_back(plugins.size());
+                    plugins.emplace_back(&insert.m_Instance->Instance(), false, nullptr, 0, false, true);
+                }
+            }
+            mixgraph.AddChain(instrumentpluginindex, std::move(insertpluginindices), amplitude, chainpart);
+        }
+        if(m_ReverbInstance && buffersfit(m_ReverbInstance->Instance()))
+        {
+            mixgraph.SetReverb(plugins.size(), Project().Reverb().MixLevel());
+            plugins.emplace_back(&m_ReverbInstance->Instance(), false, nullptr, 0, false, true);
+        }
+
         std::vector<realtimethread::Data::TMidiKeyboardPort> midiPorts;
         for(size_t partindex = 0; partindex < m_Parts.size(); ++partindex)
         {
@@ -402,7 +497,7 @@ namespace engine
         std::vector<realtimethread::Data::TMidiAuxInPort> auxInPorts;
         for(const auto &auxport: m_AuxInPorts)
         {
-            auxInPorts.emplace_back(auxport->Port().get(), auxport->OnMidiCallback());
+            auxInPorts.emplace_back(auxport->Port().get(), &auxport->MidiRing());
         }
 
         std::vector<realtimethread::Data::TMidiAuxOutPort> auxOutPorts;
@@ -411,11 +506,7 @@ namespace engine
             auxOutPorts.emplace_back(auxport->Port().get());
         }
 
-        auto reverbinstance = m_ReverbInstance? &m_ReverbInstance->Instance() : nullptr;
-        auto reverblevel = Project().Reverb().MixLevel();
-        float levelmeter_flowpass = 50.0f; // hz
-        float levelMeterTimeConstant = std::exp(-2.0f * 3.14159265358979323846f * levelmeter_flowpass / 48000.0f);
-        return realtimethread::Data(std::move(plugins), std::move(midiPorts), std::move(auxInPorts), std::move(auxOutPorts), std::move(outputAudioPorts), reverbinstance, reverblevel, vocoderInPort, levelMeterTimeConstant);
+        return realtimethread::Data(std::move(plugins), mixgraph.Nodes(), std::move(midiPorts), std::move(auxInPorts), std::move(auxOutPorts), std::move(outputAudioPorts), vocoderInPort, m_JackClient.SampleRate());
     }
 
     void Engine::OnMidiFromPlugin(PluginInstanceForPart *sender, const midi::TMidiOrSysexEvent &evt)
@@ -484,9 +575,30 @@ namespace engine
         }
     }
 
-    void Engine::SyncPlugins(std::vector<std::unique_ptr<jackutils::Port>> &midiInPortsToDiscard, std::vector<std::unique_ptr<PluginInstance>> &pluginsToDiscard)
+    void Engine::SyncPlugins(std::vector<std::unique_ptr<jackutils::Port>> &midiInPortsToDiscard, std::vector<std::unique_ptr<PluginInstance>> &pluginsToDiscard, std::vector<std::tuple<PluginInstance*, std::string, int>> &presetLoads)
     {
         std::optional<jack_nframes_t> jacksamplerate;
+        auto getsamplerate = [&jacksamplerate](){
+            if(!jacksamplerate)
+            {
+                jacksamplerate = jack_get_sample_rate(jackutils::Client::Static().get());
+            }
+            return *jacksamplerate;
+        };
+        TPluginSyncStats stats;
+
+        // Existing plugins are matched by (uri, instrument id, part id). This way an instance survives when instruments
+        // or parts are inserted or deleted, or when an unrelated part of the project changes.
+        std::map<PluginInstanceForPart::TKey, std::unique_ptr<PluginInstanceForPart>> existingplugins;
+        for(auto &plugin: m_OwnedPlugins)
+        {
+            if(plugin)
+            {
+                auto key = plugin->Key();
+                existingplugins.emplace(std::move(key), std::move(plugin));
+            }
+        }
+
         std::vector<std::unique_ptr<PluginInstanceForPart>> ownedPlugins;
         std::vector<std::vector<size_t>> partindex2instrumentindex2ownedpluginindex(Project().Parts().size());
         for(size_t instrumentindex = 0; instrumentindex < Project().Instruments().size(); ++instrumentindex)
@@ -497,9 +609,11 @@ namespace engine
             {
                 auto &instrumentindex2ownedpluginindex = partindex2instrumentindex2ownedpluginindex[partindex];
                 std::optional<size_t> owningpart;
+                std::optional<uint64_t> owningpartid;
                 if(!instrument.IsHammond())
                 {
                     owningpart = partindex;
+                    owningpartid = Project().Parts()[partindex].Id();
                 }
                 if(instrument.IsHammond() && (partindex > 0))
                 {
@@ -507,29 +621,25 @@ namespace engine
                 }
                 else
                 {
+                    PluginInstanceForPart::TKey key {instrument.Lv2Uri(), instrument.Id(), owningpartid};
                     std::unique_ptr<PluginInstanceForPart> plugin_uq;
-                    auto pluginindex = ownedPlugins.size();
-                    sharedpluginindex = pluginindex;
-                    if(m_OwnedPlugins.size() > pluginindex)
+                    if(auto it = existingplugins.find(key); it != existingplugins.end())
                     {
-                        auto &existingownedplugin = m_OwnedPlugins[pluginindex];
-                        if(existingownedplugin && (existingownedplugin->pluginInstance()->Lv2Uri() == instrument.Lv2Uri()) && (existingownedplugin->OwningPart() == owningpart) && (existingownedplugin->OwningInstrumentIndex() == instrumentindex) )
-                        {
-                            // re-use:
-                            plugin_uq = std::move(existingownedplugin);
-                        }
+                        // re-use:
+                        plugin_uq = std::move(it->second);
+                        existingplugins.erase(it);
+                        plugin_uq->SetOwner(owningpart, instrumentindex);
+                        stats.m_Reused++;
                     }
-                    if(!plugin_uq)
+                    else
                     {
-                        if(!jacksamplerate)
-                        {
-                            jacksamplerate = jack_get_sample_rate(jackutils::Client::Static().get());
-                        }
                         auto lv2uri = instrument.Lv2Uri();
-                        plugin_uq = std::make_unique<PluginInstanceForPart>(std::move(lv2uri), *jacksamplerate, owningpart, instrumentindex, m_RtProcessor, [this](PluginInstanceForPart *sender, const midi::TMidiOrSysexEvent &evt){
+                        plugin_uq = std::make_unique<PluginInstanceForPart>(std::move(lv2uri), getsamplerate(), owningpart, instrumentindex, std::move(key), m_RtProcessor, [this](PluginInstanceForPart *sender, const midi::TMidiOrSysexEvent &evt){
                             OnMidiFromPlugin(sender, evt);
                         });
+                        stats.m_Created++;
                     }
+                    sharedpluginindex = ownedPlugins.size();
                     instrumentindex2ownedpluginindex.push_back(ownedPlugins.size());
                     ownedPlugins.push_back(std::move(plugin_uq));
                 }
@@ -547,12 +657,7 @@ namespace engine
             {
                 midiInPort = std::make_unique<jackutils::Port>("midi_in_" + std::to_string(partindex), jackutils::PortKind::Midi, jackutils::PortDirection::Input);
             }
-            std::vector<size_t> pluginindices;
-            for(size_t instrumentindex = 0; instrumentindex < Project().Instruments().size(); ++instrumentindex)
-            {
-                pluginindices.push_back(partindex2instrumentindex2ownedpluginindex[partindex][instrumentindex]);
-            }
-            newparts.push_back(Part(std::move(pluginindices), std::move(midiInPort)));
+            newparts.push_back(Part(std::move(partindex2instrumentindex2ownedpluginindex[partindex]), std::move(midiInPort)));
         }
         for(auto &part: m_Parts)
         {
@@ -561,14 +666,14 @@ namespace engine
                 midiInPortsToDiscard.push_back(std::move(part.MidiInPort()));
             }
         }
-        for(auto &plugin: m_OwnedPlugins)
+        // plugins that were not matched:
+        for(auto &[key, plugin]: existingplugins)
         {
-            if(plugin)
-            {
-                m_Plugin2LoadQueue.erase(plugin.get());
-                m_OwnedPluginsToBeDiscardedAfterLoad.push_back(std::move(plugin));
-            }
+            m_PresetLoaderPool.Cancel(plugin->pluginInstance().get());
+            m_OwnedPluginsToBeDiscardedAfterLoad.push_back(std::move(plugin));
+            stats.m_Destroyed++;
         }
+        m_LastPluginSyncStats = stats;
 
         decltype(m_OwnedPluginsToBeDiscardedAfterLoad) newOwnedPluginsToBeDiscardedAfterLoad;
         for(auto &plugin: m_OwnedPluginsToBeDiscardedAfterLoad)
@@ -590,6 +695,70 @@ namespace engine
         }
         m_OwnedPluginsToBeDiscardedAfterLoad = std::move(newOwnedPluginsToBeDiscardedAfterLoad);
 
+        // The active instruments, the shared instruments and the instruments of the quick presets of each part are
+        // resident and activated. The others are deactivated and unloaded later by UpdateResidency().
+        auto now = std::chrono::steady_clock::now();
+        std::vector<bool> playedplugins(ownedPlugins.size(), false);
+        std::vector<bool> wantedplugins(ownedPlugins.size(), false);
+        // owned plugin index to the preset directory of the first quick preset using it:
+        std::map<size_t, std::string> prefetchpresets;
+        for(size_t partindex = 0; partindex < Project().Parts().size(); ++partindex)
+        {
+            const auto &part = Project().Parts()[partindex];
+            const auto &pluginindices = newparts[partindex].PluginIndices();
+            if(part.ActiveInstrumentIndex())
+            {
+                auto pluginindex = pluginindices.at(*part.ActiveInstrumentIndex());
+                playedplugins[pluginindex] = true;
+                wantedplugins[pluginindex] = true;
+            }
+            if(m_ResidencyPolicy.m_PrefetchQuickPresets)
+            {
+                for(const auto &quickpreset: part.QuickPresets())
+                {
+                    if(quickpreset && (*quickpreset < Project().Presets().size()) && Project().Presets()[*quickpreset])
+                    {
+                        const auto &preset = *Project().Presets()[*quickpreset];
+                        auto pluginindex = pluginindices.at(preset.InstrumentIndex());
+                        wantedplugins[pluginindex] = true;
+                        prefetchpresets.try_emplace(pluginindex, PresetsDir() + "/" + preset.PresetSubDir());
+                    }
+                }
+            }
+        }
+        for(size_t pluginindex = 0; pluginindex < ownedPlugins.size(); ++pluginindex)
+        {
+            auto &plugin = ownedPlugins[pluginindex];
+            bool played = playedplugins[pluginindex];
+            bool wanted = wantedplugins[pluginindex] || (!plugin->OwningPart());
+            if(plugin->Played())
+            {
+                // the user may have changed its state while playing:
+                plugin->SetPristinePresetDir({});
+            }
+            plugin->SetPlayed(played);
+            plugin->SetWanted(wanted);
+            if(wanted)
+            {
+                plugin->SetLastWanted(now);
+                if(auto restoredir = plugin->MakeResident())
+                {
+                    if(!restoredir->empty())
+                    {
+                        presetLoads.emplace_back(plugin->pluginInstance().get(), std::move(*restoredir), played? 0 : -1);
+                    }
+                    else if(auto it = prefetchpresets.find(pluginindex); (it != prefetchpresets.end()) && (!played))
+                    {
+                        // a fresh instance, give it the preset it will most likely be played with:
+                        auto presetdir = it->second;
+                        plugin->SetPristinePresetDir(std::move(presetdir));
+                        presetLoads.emplace_back(plugin->pluginInstance().get(), it->second, -1);
+                    }
+                }
+                plugin->pluginInstance()->Instance().SetActivated(true);
+            }
+        }
+
         for(const auto &ownedplugin: ownedPlugins)
         {
             bool isfocused = false;
@@ -604,7 +773,8 @@ namespace engine
                     }
                 }
             }
-            bool showgui = isfocused && Data().ShowUi();
+            // the active instrument is resident, but be safe:
+            bool showgui = isfocused && Data().ShowUi() && ownedplugin->pluginInstance();
             if(showgui)
             {
                 if(!ownedplugin->pluginInstance()->Ui())
@@ -658,7 +828,7 @@ namespace engine
             }
             if(!m_ReverbInstance)
             {
-                m_ReverbInstance = std::make_unique<PluginInstance>(std::move(uri), *jacksamplerate, m_RtProcessor, lilvutils::Instance::TMidiCallback());
+                m_ReverbInstance = std::make_unique<PluginInstance>(std::move(uri), getsamplerate(), m_RtProcessor, lilvutils::Instance::TMidiCallback());
             }
         }
         else
@@ -713,6 +883,66 @@ namespace engine
                 }
             }
         }
+        // insert effects, matched by part id, position and uri:
+        std::map<TInsertEffectInstance::TKey, TInsertEffectInstance> existinginserts;
+        for(auto &partinserts: m_PartInsertEffects)
+        {
+            for(auto &insert: partinserts)
+            {
+                auto key = insert.m_Key;
+                existinginserts.emplace(std::move(key), std::move(insert));
+            }
+        }
+        std::vector<std::vector<TInsertEffectInstance>> newinserts;
+        for(const auto &part: Project().Parts())
+        {
+            std::vector<TInsertEffectInstance> partinserts;
+            for(size_t position = 0; position < part.InsertEffects().size(); ++position)
+            {
+                const auto &effect = part.InsertEffects()[position];
+                TInsertEffectInstance::TKey key {part.Id(), position, effect.Lv2Uri()};
+                if(auto it = existinginserts.find(key); it != existinginserts.end())
+                {
+                    partinserts.push_back(std::move(it->second));
+                    existinginserts.erase(it);
+                }
+                else
+                {
+                    auto uri = effect.Lv2Uri();
+                    partinserts.emplace_back(std::make_unique<PluginInstance>(std::move(uri), getsamplerate(), m_RtProcessor, lilvutils::Instance::TMidiCallback()), std::move(key));
+                }
+                auto &insert = partinserts.back();
+                if(insert.m_LoadedPresetSubDir != effect.PresetSubDir())
+                {
+                    // the insert may be in the audio graph, so it is loaded by the pool, which takes it out while loading:
+                    if(!effect.PresetSubDir().empty())
+                    {
+                        presetLoads.emplace_back(insert.m_Instance.get(), PresetsDir() + "/" + effect.PresetSubDir(), 0);
+                    }
+                    insert.m_LoadedPresetSubDir = effect.PresetSubDir();
+                }
+            }
+            newinserts.push_back(std::move(partinserts));
+        }
+        for(auto &[key, insert]: existinginserts)
+        {
+            m_PresetLoaderPool.Cancel(insert.m_Instance.get());
+            m_InsertEffectsToBeDiscardedAfterLoad.push_back(std::move(insert.m_Instance));
+        }
+        decltype(m_InsertEffectsToBeDiscardedAfterLoad) newInsertEffectsToBeDiscardedAfterLoad;
+        for(auto &insert: m_InsertEffectsToBeDiscardedAfterLoad)
+        {
+            if(m_PresetLoaderPool.IsLoading(insert.get()))
+            {
+                newInsertEffectsToBeDiscardedAfterLoad.push_back(std::move(insert));
+            }
+            else
+            {
+                pluginsToDiscard.push_back(std::move(insert));
+            }
+        }
+        m_InsertEffectsToBeDiscardedAfterLoad = std::move(newInsertEffectsToBeDiscardedAfterLoad);
+        m_PartInsertEffects = std::move(newinserts);
         m_OwnedPlugins = std::move(ownedPlugins);
         m_Parts = std::move(newparts);
     }
@@ -763,8 +993,20 @@ namespace engine
                             if(ownedplugin)
                             {
                                 std::string presetdir = PresetsDir() + "/" + preset->PresetSubDir();
-                                m_Plugin2LoadQueue[ownedplugin.get()] = presetdir;
-                                StartLoading();
+                                if(ownedplugin->MakeResident())
+                                {
+                                    // it had been unloaded; a fresh instance always needs the preset:
+                                    ownedplugin->pluginInstance()->Instance().SetActivated(true);
+                                    ownedplugin->SetPristinePresetDir({});
+                                }
+                                // no need to load it again if it was prefetched and not played since:
+                                if(ownedplugin->PristinePresetDir() != presetdir)
+                                {
+                                    // the part being edited loads first:
+                                    int priority = (ownedplugin->OwningPart() && (ownedplugin->OwningPart() == Data().GuiFocusedPart()))? 1 : 0;
+                                    m_PresetLoaderPool.Load(*ownedplugin->pluginInstance(), std::move(presetdir), priority);
+                                }
+                                ownedplugin->SetPristinePresetDir({});
                                 // ownedplugin->pluginInstance()->Instance().LoadState(presetdir);
                             }
                         }
@@ -819,6 +1061,7 @@ namespace engine
             {
                 std::string presetdir = PresetsDir() + "/" + presetSubdir;
                 m_ReverbInstance->Instance().LoadState(presetdir);
+                m_ReverbInstance->Instance().ApplyRestoredControlValues();
             }
         }
     }
@@ -921,6 +1164,10 @@ namespace engine
                     {
                         throw std::runtime_error("Cannot save, plugin is loading");
                     }
+                    if(!ownedplugin->pluginInstance())
+                    {
+                        throw std::runtime_error("Cannot save, plugin is not loaded");
+                    }
                     auto presetDir = SavePresetForInstance(ownedplugin->pluginInstance()->Instance());
                     auto dirToDelete = presetDir;
                     utils::finally fin1([&](){
@@ -960,12 +1207,14 @@ namespace engine
 
     Engine::Engine(uint32_t maxBlockSize, int argc, char** argv, std::string &&projectdir, utils::TEventLoop &eventLoop) :  m_JackClient {"JN Live", [this](jack_nframes_t nframes){
         m_RtProcessor.Process(nframes);
-    }}, m_LilvWorld(m_JackClient.SampleRate(), maxBlockSize, argc, argv), m_ProjectDir(std::move(projectdir)), m_EventLoop(eventLoop), m_CleanupPresetLoadersAction(m_EventLoop, [this](){CleanupPresetLoaders();})
+    }}, m_LilvWorld(m_JackClient.SampleRate(), maxBlockSize, argc, argv, utils::CacheDir() + "/pluginindex.json"), m_ProjectDir(std::move(projectdir)), m_EventLoop(eventLoop)
     {
         if(!std::filesystem::exists(m_ProjectDir))
         {
             std::filesystem::create_directory(m_ProjectDir);
         }
+        LoadThreadSettings();
+        logger::InstallLevelSignalHandler();
         LoadJackConnections();
         {
             auto errcode = jack_set_buffer_size(jackutils::Client::Static().get(), Data().JackConnections().BufferSize());
@@ -973,13 +1222,21 @@ namespace engine
             {
                 throw std::runtime_error("jack_set_buffer_size failed");
             }
+            // the plugin audio buffers are sized to the actual buffer size instead of the largest we could handle:
+            m_LilvWorld.SetAudioBufferLength(m_JackClient.BufferSize());
+            m_RtProcessor.SetBufsize(m_LilvWorld.AudioBufferLength());
+            m_ResizedAudioBufferLength = m_LilvWorld.AudioBufferLength();
+            m_JackClient.SetOnBufferSizeChanged([this](jack_nframes_t){
+                m_JackBufferSizeChangedAction.Signal();
+            });
         }
         m_AudioOutPorts.push_back(std::make_unique<jackutils::Port>("out_l", jackutils::PortKind::Audio, jackutils::PortDirection::Output));
         m_AudioOutPorts.push_back(std::make_unique<jackutils::Port>("out_r", jackutils::PortKind::Audio, jackutils::PortDirection::Output));
         m_VocoderInPort = std::make_unique<jackutils::Port>("vocoder_in", jackutils::PortKind::Audio, jackutils::PortDirection::Input);
+        // a plugin that has been silent this long without held notes is not run until it receives midi again:
+        m_RtProcessor.SetSleepTailFrames(2 * m_JackClient.SampleRate());
         LoadProject();
         SyncPlugins();
-        ApplyJackConnections(true);
 
         {
             auto errcode = jack_activate(jackutils::Client::Static().get());
@@ -988,13 +1245,15 @@ namespace engine
                 throw std::runtime_error("jack_activate failed");
             }
         }
+        // connections could not be made before activation:
+        m_JackConnectionReconciler.Rescan();
 
         auto presetsdir = PresetsDir();
         if(!std::filesystem::exists(presetsdir))
         {
             std::filesystem::create_directory(presetsdir);
         }
-        m_ProjectSaveThread = std::thread([this](){
+        m_ProjectSaveThread = threads::Spawn(threads::TClass::Io, "project save", [this](){
             while(true)
             {
                 std::this_thread::sleep_for(std::chrono::milliseconds(100));
@@ -1007,6 +1266,17 @@ namespace engine
         });
         LoadFirstHammondPreset();
     }
+    void Engine::LoadThreadSettings()
+    {
+        // optional; without it the threads keep the cpus and priorities they were created with. The cpus and priorities
+        // depend on the machine, so the file is not part of the project:
+        std::string threadsfile = utils::ConfigDir() + "/threads.json";
+        if(std::filesystem::exists(threadsfile))
+        {
+            threads::SetSettings(threads::TSettings::FromFile(threadsfile));
+        }
+        threads::InstallReportSignalHandler();
+    }
     void Engine::LoadJackConnections()
     {
         std::string jackconnectionfile = ProjectDir() + "/jackconnection.json";
@@ -1034,9 +1304,14 @@ namespace engine
                     const auto &ownedplugin = m_OwnedPlugins.at(pluginindex);
                     if(ownedplugin)
                     {
+                        if(ownedplugin->MakeResident())
+                        {
+                            // it was not resident; the preset loaded below replaces any state to restore:
+                            ownedplugin->pluginInstance()->Instance().SetActivated(true);
+                        }
+                        // the instrument is in the audio graph already, so load it like any other preset:
                         std::string presetdir = PresetsDir() + "/" + preset->PresetSubDir();
-                        auto &instance = ownedplugin->pluginInstance()->Instance();
-                        ownedplugin->pluginInstance()->Instance().LoadState(presetdir);
+                        m_PresetLoaderPool.Load(*ownedplugin->pluginInstance(), std::move(presetdir), 1);
                     }
                     break;
                 }
@@ -1044,7 +1319,7 @@ namespace engine
         }
         for(const auto &ownedplugin: m_OwnedPlugins)
         {
-            if(ownedplugin && Project().Instruments().at(ownedplugin->OwningInstrumentIndex()).IsHammond())
+            if(ownedplugin && ownedplugin->OwningPart() && Project().Instruments().at(ownedplugin->OwningInstrumentIndex()).IsHammond())
             {
                 LoadPresetForPart(*ownedplugin->OwningPart());
             }
@@ -1157,14 +1432,15 @@ namespace engine
     }
     Engine::~Engine()
     {
+        m_JackClient.SetOnBufferSizeChanged({});
         {
             std::unique_lock<std::mutex> lock(m_ProjectSaveMutex);
             m_Quitting = true;
         }
         m_ProjectSaveThread.join();
 
-        m_Plugin2LoadQueue.clear();
-        while(!m_PresetLoaders.empty())
+        m_PresetLoaderPool.CancelAll();
+        while(!m_PresetLoaderPool.Idle())
         {
             m_EventLoop.ProcessPendingMessages();
             std::this_thread::sleep_for(std::chrono::milliseconds(2));
@@ -1195,6 +1471,7 @@ namespace engine
         {
             ProcessMessages();
         }
+        m_JackConnectionReconciler.Stop();
         m_JackClient.ShutDown();
     }
     std::string Engine::ReverbPluginName() const
@@ -1205,6 +1482,70 @@ namespace engine
         }
         return {};
     }
+    std::string Engine::LoadSummary() const
+    {
+        const auto &report = TimingReport();
+        return "DSP " + std::to_string((int)std::lround(100.0f * report.m_DspLoad)) + "%  peak " + std::to_string((int)std::lround(100.0f * report.m_PeakDspLoad)) + "%  JACK " + std::to_string((int)std::lround(JackDspLoad())) + "%  xruns " + std::to_string(NumXruns()) + "  plugins " + std::to_string(NumResidentPlugins()) + "/" + std::to_string(m_OwnedPlugins.size());
+    }
+    std::vector<std::array<std::string, 4>> Engine::LoadTable() const
+    {
+        auto microsecondsToText = [](double us) {
+            return std::to_string((long)std::lround(us)) + " us";
+        };
+        auto makerow = [&](std::string &&name, const timing::TStats &stats) {
+            return std::array<std::string, 4> {std::move(name), microsecondsToText(stats.AvgUs()), microsecondsToText(stats.P99Us()), microsecondsToText(stats.MaxUs())};
+        };
+        const auto &report = TimingReport();
+        std::vector<std::pair<double, std::array<std::string, 4>>> pluginrows;
+        for(const auto &ownedplugin: m_OwnedPlugins)
+        {
+            if( (!ownedplugin) || (!ownedplugin->pluginInstance()) ) continue;
+            auto it = report.m_Instances.find(&ownedplugin->pluginInstance()->Instance());
+            if(it == report.m_Instances.end()) continue;
+            std::string name = ownedplugin->pluginInstance()->Plugin().Name();
+            if(ownedplugin->OwningInstrumentIndex() < Project().Instruments().size())
+            {
+                name = Project().Instruments().at(ownedplugin->OwningInstrumentIndex()).Name();
+            }
+            if(ownedplugin->OwningPart() && (*ownedplugin->OwningPart() < Project().Parts().size()))
+            {
+                name += " (" + Project().Parts().at(*ownedplugin->OwningPart()).Name() + ")";
+            }
+            pluginrows.emplace_back(it->second.P99Us(), makerow(std::move(name), it->second));
+        }
+        for(size_t partindex = 0; partindex < std::min(m_PartInsertEffects.size(), Project().Parts().size()); ++partindex)
+        {
+            for(const auto &insert: m_PartInsertEffects[partindex])
+            {
+                auto it = report.m_Instances.find(&insert.m_Instance->Instance());
+                if(it == report.m_Instances.end()) continue;
+                std::string name = insert.m_Instance->Plugin().Name() + " (" + Project().Parts()[partindex].Name() + ")";
+                pluginrows.emplace_back(it->second.P99Us(), makerow(std::move(name), it->second));
+            }
+        }
+        if(m_ReverbInstance)
+        {
+            auto it = report.m_Instances.find(&m_ReverbInstance->Instance());
+            if(it != report.m_Instances.end())
+            {
+                pluginrows.emplace_back(it->second.P99Us(), makerow("Reverb", it->second));
+            }
+        }
+        std::stable_sort(pluginrows.begin(), pluginrows.end(), [](const auto &a, const auto &b){
+            return a.first > b.first;
+        });
+        std::vector<std::array<std::string, 4>> result;
+        result.push_back(makerow("Cycle", report.m_Cycle));
+        for(auto &row: pluginrows)
+        {
+            result.push_back(std::move(row.second));
+        }
+        for(size_t stage = 0; stage < realtimethread::sNumStages; stage++)
+        {
+            result.push_back(makerow(std::string("Stage: ") + realtimethread::StageName((realtimethread::TStage)stage), report.m_Stages[stage]));
+        }
+        return result;
+    }
     void Engine::SetProject(project::TProject &&project)
     {
         auto newdata = Data().ChangeProject(std::move(project));
@@ -1214,7 +1555,8 @@ namespace engine
     {
         std::vector<std::unique_ptr<jackutils::Port>> midiInPortsToDiscard;
         std::vector<std::unique_ptr<PluginInstance>> pluginsToDiscard;
-        SyncPlugins(midiInPortsToDiscard, pluginsToDiscard);
+        std::vector<std::tuple<PluginInstance*, std::string, int>> presetLoads;
+        SyncPlugins(midiInPortsToDiscard, pluginsToDiscard, presetLoads);
         std::vector<std::unique_ptr<TAuxInPortLink>> newAuxInPorts, auxInPortsToDiscard;
         for(auto &auxport: m_AuxInPorts)
         {
@@ -1242,6 +1584,11 @@ namespace engine
         }
         m_AuxOutPorts = std::move(newAuxOutPorts);
         SyncRtData();
+        ApplyJackConnections();
+        for(auto &[plugin, presetdir, priority]: presetLoads)
+        {
+            m_PresetLoaderPool.Load(*plugin, std::move(presetdir), priority);
+        }
         /*
         After syncing, we may have plugins and midi in ports that are no longer needed. We cannot delete these right now, because the real-time thread may still be accessing them. Therefore, we post a message to the realtime thread indicating the objects that can be discarded. The realtime thread will simply post the messages back to the main thread. When we receive those messages in ProcessMessages(), we know it's safe to delete the objects.
         */
@@ -1274,60 +1621,66 @@ namespace engine
             });  
         }
     }
-    void Engine::PresetLoaderFinished(TPresetLoader *loader)
+    void Engine::PresetLoadsFinished()
     {
-        m_CleanupPresetLoadersAction.Signal();
+        // called once for a batch of completed loads. Plugins that were loading when the buffer size grew can be resized now:
+        ResizeAudioBuffers();
+        SyncPlugins();
     }
-    void Engine::CleanupPresetLoaders()
+
+    void Engine::OnJackBufferSizeChanged()
     {
-        std::vector<std::unique_ptr<TPresetLoader>> newPresetLoaders;
-        bool changed = false;
-        for(auto &loader: m_PresetLoaders)
+        auto buffersize = m_JackClient.BufferSize();
+        if(buffersize <= m_LilvWorld.AudioBufferLength())
         {
-            if(loader->Finished())
-            {
-                changed = true;
-            }
-            else
-            {
-                newPresetLoaders.push_back(std::move(loader));
-            }
+            // the buffers are large enough:
+            return;
         }
-        m_PresetLoaders = std::move(newPresetLoaders);
-        if(changed)
+        if(buffersize > m_LilvWorld.MaxBlockLength())
         {
-            SyncPlugins();
-            SyncRtData();
-            StartLoading();
+            std::cerr << "JACK buffer size " << buffersize << " exceeds the maximum of " << m_LilvWorld.MaxBlockLength() << ", the output is muted" << '\n';
+            return;
         }
+        // The plugins with smaller buffers leave the realtime data (see CalcRtData), new instances get the new size. Once
+        // the realtime thread no longer uses the old plugins their buffers are reallocated and they return:
+        m_LilvWorld.SetAudioBufferLength(buffersize);
+        SyncRtData();
+        m_RtProcessor.DeferredExecuteAfterRoundTrip([this, buffersize](){
+            m_ResizedAudioBufferLength = std::max(m_ResizedAudioBufferLength, buffersize);
+            ResizeAudioBuffers();
+            m_RtProcessor.SetBufsize(std::max(m_RtProcessor.Bufsize(), buffersize));
+            // also when the data did not change, the graph must be compiled again for the larger bus buffers:
+            auto rtdata = CalcRtData();
+            m_CurrentRtData = rtdata;
+            m_RtProcessor.SetDataFromMainThread(std::move(rtdata));
+        });
     }
 
-    bool Engine::IsPluginLoading(PluginInstanceForPart *plugin) const
-    {
-        return (std::find_if(m_PresetLoaders.begin(), m_PresetLoaders.end(), [&plugin](const std::unique_ptr<TPresetLoader> &presetLoader){
-            return &presetLoader->PluginInstance() == plugin;
-        }) != m_PresetLoaders.end());
-
-    }
-    void Engine::StartLoading()
+    void Engine::ResizeAudioBuffers()
     {
-    again:
-        for(auto it = m_Plugin2LoadQueue.begin(); it != m_Plugin2LoadQueue.end(); it++)
+        auto resize = [this](const PluginInstance &plugin){
+            if( (plugin.Instance().AudioBufferLength() < m_ResizedAudioBufferLength) && (!m_PresetLoaderPool.IsLoading(&plugin)) )
+            {
+                plugin.Instance().SetAudioBufferLength(m_ResizedAudioBufferLength);
+            }
+        };
+        for(const auto &ownedplugin: m_OwnedPlugins)
         {
-            auto plugin = it->first;
-            if(!IsPluginLoading(plugin))
+            if(ownedplugin && ownedplugin->pluginInstance()) resize(*ownedplugin->pluginInstance());
+        }
+        for(const auto &partinserts: m_PartInsertEffects)
+        {
+            for(const auto &insert: partinserts)
             {
-                auto presetdir = it->second;
-                m_Plugin2LoadQueue.erase(it);
-                auto loader_uq = std::make_unique<TPresetLoader>(*this, *plugin, presetdir);
-                auto loader = loader_uq.get();
-                m_PresetLoaders.push_back(std::move(loader_uq));
-                SyncRtData();
-                loader->Start();
-                goto again; // because it is no longer valid
+                resize(*insert.m_Instance);
             }
         }
+        if(m_ReverbInstance) resize(*m_ReverbInstance);
+    }
 
+    bool Engine::IsPluginLoading(PluginInstanceForPart *plugin) const
+    {
+        return plugin->pluginInstance() && m_PresetLoaderPool.IsLoading(plugin->pluginInstance().get());
     }
     std::optional<size_t> Engine::GuiActivePartIndex() const
     {
@@ -1369,7 +1722,16 @@ namespace engine
     void Engine::ProcessMessages()
     {
         m_RtProcessor.ProcessMessagesInMainThread();
-        ApplyJackConnections(false);
+        if(threads::TakeReportRequest())
+        {
+            std::cerr << "Thread placement:\n" << threads::PlacementReport() << rtarena::Report() << '\n';
+        }
+        // by index: a controller may remove its port from the callback, which reassigns m_AuxInPorts. The link itself
+        // is only deleted after a round trip through the realtime thread.
+        for(size_t i = 0; i < m_AuxInPorts.size(); i++)
+        {
+            m_AuxInPorts[i]->DrainMidi();
+        }
         for(const auto &plugin: OwnedPlugins())
         {
             if(plugin->pluginInstance() && plugin->pluginInstance()->Ui() && plugin->pluginInstance()->Ui()->ui())
@@ -1382,6 +1744,60 @@ namespace engine
             m_ReverbInstance->Ui()->ui()->CallIdle();
         }
         SendControllerForPartIfNecessary();
+        auto now = std::chrono::steady_clock::now();
+        if(now - m_LastResidencyUpdate >= std::chrono::seconds(1))
+        {
+            m_LastResidencyUpdate = now;
+            UpdateResidency();
+        }
+    }
+    void Engine::UpdateResidency()
+    {
+        // an instance that just left the realtime data may still be run until the realtime thread has switched:
+        if(!m_RtProcessor.PreviousDataRetired()) return;
+        std::vector<PluginInstanceForPart*> candidates;
+        for(const auto &plugin: m_OwnedPlugins)
+        {
+            if(plugin && plugin->pluginInstance() && (!plugin->Wanted()) && (!IsPluginLoading(plugin.get())))
+            {
+                plugin->pluginInstance()->Instance().SetActivated(false);
+                candidates.push_back(plugin.get());
+            }
+        }
+        auto now = std::chrono::steady_clock::now();
+        std::vector<PluginInstanceForPart*> toevict;
+        for(auto plugin: candidates)
+        {
+            if(now - plugin->LastWanted() >= m_ResidencyPolicy.m_IdleTimeout)
+            {
+                toevict.push_back(plugin);
+            }
+        }
+        if(toevict.empty() && (!candidates.empty()) && (m_ResidencyPolicy.m_MemoryBudget > 0))
+        {
+            if(utils::ResidentSetSize() > m_ResidencyPolicy.m_MemoryBudget)
+            {
+                // one per call, the memory is released after the round trip:
+                toevict.push_back(*std::min_element(candidates.begin(), candidates.end(), [](const PluginInstanceForPart *a, const PluginInstanceForPart *b){
+                    return a->LastWanted() < b->LastWanted();
+                }));
+            }
+        }
+        for(auto plugin: toevict)
+        {
+            // the UI of an instrument that is not played is hidden:
+            plugin->pluginInstance()->SetUi({});
+            auto ptr = plugin->Evict().release();
+            m_RtProcessor.DeferredExecuteAfterRoundTrip([ptr](){
+                delete ptr;
+            });
+        }
+    }
+    size_t Engine::NumResidentPlugins() const
+    {
+        return (size_t)std::count_if(m_OwnedPlugins.begin(), m_OwnedPlugins.end(), [](const std::unique_ptr<PluginInstanceForPart> &plugin){
+            return plugin && plugin->pluginInstance();
+        });
     }
     void Engine::SyncRtData()
     {
@@ -1471,9 +1887,9 @@ namespace engine
         }
     }
 
-    void TController::TInPort::OnMidi(const midi::TMidiOrSysexEvent &event)
+    void TController::TInPort::OnMidi(std::span<const realtimethread::TMidiInEvent> events)
     {
-        m_Controller.OnMidiIn(event);
+        m_Controller.OnMidiIn(events);
     }
 
     void TController::SendMidi(const midi::TMidiOrSysexEvent &event) const
@@ -1487,37 +1903,246 @@ namespace engine
         m_LastData = Engine().Data();
     }
 
-    TPresetLoader::TPresetLoader(Engine &engine, PluginInstanceForPart &pluginInstance, const std::string &presetdir) : m_Engine(engine), m_PluginInstance(pluginInstance), m_DidRoundTripAction(m_LoaderThread, [this](){StartLoad();}),  m_LoadDoneAction(m_Engine.EventLoop(), [this](){LoadDone();}), m_PresetDir(presetdir)
+    TPresetLoaderPool::TPresetLoaderPool(Engine &engine) : m_Engine(engine), m_LoadsDoneAction(m_Engine.EventLoop(), [this](){LoadsDone();})
     {
+        for(size_t i = 0; i < sNumThreads; i++)
+        {
+            m_Threads.push_back(threads::Spawn(threads::TClass::Io, "preset loader " + std::to_string(i), [this](){
+                WorkerThread();
+            }));
+        }
     }
 
-    void TPresetLoader::Start()
+    TPresetLoaderPool::~TPresetLoaderPool()
     {
-        m_Engine.RtProcessor().DeferredExecuteAfterRoundTrip([this](){
-            m_DidRoundTripAction.Signal();
-        });  
-        m_LoaderThread.Run();
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_Quit = true;
+            m_WakeCondition.notify_all();
+        }
+        for(auto &thread: m_Threads)
+        {
+            thread.join();
+        }
     }
 
-    void TPresetLoader::StartLoad()
+    void TPresetLoaderPool::Load(PluginInstance &plugin, std::string &&presetdir, int priority)
+    {
+        std::optional<uint64_t> newjobid;
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            auto [it, inserted] = m_Jobs.try_emplace(&plugin);
+            auto &job = it->second;
+            job.m_PresetDir = std::move(presetdir);
+            job.m_Priority = priority;
+            job.m_Sequence = m_NextSequence++;
+            // if the job is running, it will be restarted when the current load completes:
+            job.m_Finished = false;
+            if(inserted)
+            {
+                job.m_Id = m_NextJobId++;
+                newjobid = job.m_Id;
+            }
+            else if(job.m_Ready)
+            {
+                m_WakeCondition.notify_one();
+            }
+        }
+        if(newjobid)
+        {
+            // The plugin must be deactivated in the realtime thread before we can load it. IsLoading() returns true now, so
+            // SyncRtData will deactivate it. Once the message has made a round trip the audio thread is no longer using the plugin:
+            m_Engine.SyncRtData();
+            m_Engine.RtProcessor().DeferredExecuteAfterRoundTrip([this, plugin = &plugin, jobid = *newjobid](){
+                DidRoundTrip(plugin, jobid);
+            });
+        }
+    }
+
+    void TPresetLoaderPool::DidRoundTrip(PluginInstance *plugin, uint64_t jobid)
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        auto it = m_Jobs.find(plugin);
+        if( (it != m_Jobs.end()) && (it->second.m_Id == jobid) )
+        {
+            it->second.m_Ready = true;
+            m_WakeCondition.notify_one();
+        }
+    }
+
+    void TPresetLoaderPool::Cancel(PluginInstance *plugin)
     {
-        // called from loader thread after we have made a round trip to the audio thread
-        try
-        {    
-            m_PluginInstance.pluginInstance()->Instance().LoadState(m_PresetDir);
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        auto it = m_Jobs.find(plugin);
+        if(it != m_Jobs.end())
+        {
+            if(it->second.m_Running)
+            {
+                // will be collected by LoadsDone():
+                it->second.m_Finished = true;
+            }
+            else
+            {
+                m_Jobs.erase(it);
+            }
         }
-        catch(const std::exception& e)
+    }
+
+    void TPresetLoaderPool::CancelAll()
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        std::erase_if(m_Jobs, [](const auto &item){
+            return !item.second.m_Running;
+        });
+        for(auto &[plugin, job]: m_Jobs)
         {
-            std::cerr << e.what() << '\n';
+            job.m_Finished = true;
         }
-        m_LoadDoneAction.Signal();
     }
 
-    void TPresetLoader::LoadDone()
+    bool TPresetLoaderPool::IsLoading(const PluginInstance *plugin) const
     {
-        m_LoaderThread.Stop();
-        m_Finished = true;
-        m_Engine.PresetLoaderFinished(this);
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        return m_Jobs.contains(plugin);
+    }
+
+    bool TPresetLoaderPool::Idle() const
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        return m_Jobs.empty();
+    }
+
+    void TPresetLoaderPool::WorkerThread()
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        while(true)
+        {
+            const PluginInstance *plugin = nullptr;
+            TJob *job = nullptr;
+            for(auto &[p, j]: m_Jobs)
+            {
+                if(j.m_Ready && (!j.m_Running) && (!j.m_Finished))
+                {
+                    if( (!job) || (j.m_Priority > job->m_Priority) || ((j.m_Priority == job->m_Priority) && (j.m_Sequence < job->m_Sequence)) )
+                    {
+                        plugin = p;
+                        job = &j;
+                    }
+                }
+            }
+            if(!job)
+            {
+                if(m_Quit) break;
+                m_WakeCondition.wait(lock);
+                continue;
+            }
+            // Jobs are not erased while running, so job remains valid:
+            job->m_Running = true;
+            auto presetdir = job->m_PresetDir;
+            auto sequence = job->m_Sequence;
+            lock.unlock();
+            try
+            {    
+                plugin->Instance().LoadState(presetdir);
+            }
+            catch(const std::exception& e)
+            {
+                std::cerr << e.what() << '\n';
+            }
+            lock.lock();
+            job->m_Running = false;
+            if(job->m_Sequence == sequence)
+            {
+                job->m_Finished = true;
+            }
+            // else: another preset was requested while we were loading, the job will be picked up again.
+            if(job->m_Finished)
+            {
+                m_LoadsDoneAction.Signal();
+            }
+        }
+    }
+
+    void TPresetLoaderPool::LoadsDone()
+    {
+        bool anyfinished = false;
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            anyfinished = std::erase_if(m_Jobs, [](const auto &item){
+                if(item.second.m_Finished && (!item.second.m_Running))
+                {
+                    // the loader thread is done with the instance:
+                    item.first->Instance().ApplyRestoredControlValues();
+                    return true;
+                }
+                return false;
+            }) > 0;
+        }
+        if(anyfinished)
+        {
+            m_Engine.PresetLoadsFinished();
+        }
+    }
+
+    PluginInstanceForPart::~PluginInstanceForPart()
+    {
+        RemoveSavedState();
+    }
+
+    std::optional<std::string> PluginInstanceForPart::MakeResident()
+    {
+        if(m_PluginInstance)
+        {
+            return std::nullopt;
+        }
+        auto uri = m_Uri;
+        m_PluginInstance = std::make_unique<PluginInstance>(std::move(uri), m_SampleRate, m_Processor, [this](const midi::TMidiOrSysexEvent &event) {
+            if(m_MidiCallback) {m_MidiCallback(this, event);}
+        });
+        auto restoredir = std::move(m_RestoreDir);
+        m_RestoreDir.clear();
+        return restoredir;
+    }
+
+    std::unique_ptr<PluginInstance> PluginInstanceForPart::Evict()
+    {
+        if(m_PluginInstance)
+        {
+            RemoveSavedState();
+            m_RestoreDir = m_PristinePresetDir;
+            if(m_RestoreDir.empty())
+            {
+                // the state may differ from every preset:
+                auto dir = utils::generate_random_tempdir();
+                try
+                {
+                    if(dir.empty())
+                    {
+                        throw std::runtime_error("Failed to create temporary directory");
+                    }
+                    m_PluginInstance->Instance().SaveState(dir);
+                    m_SavedStateDir = dir;
+                    m_RestoreDir = std::move(dir);
+                }
+                catch(std::exception &e)
+                {
+                    std::cerr << "Failed to save the state of " << m_Uri << " before unloading: " << e.what() << '\n';
+                    if(!dir.empty()) std::filesystem::remove_all(dir);
+                }
+            }
+        }
+        return std::move(m_PluginInstance);
+    }
+
+    void PluginInstanceForPart::RemoveSavedState()
+    {
+        if(!m_SavedStateDir.empty())
+        {
+            std::error_code ec;
+            std::filesystem::remove_all(m_SavedStateDir, ec);
+            if(m_RestoreDir == m_SavedStateDir) m_RestoreDir.clear();
+            m_SavedStateDir.clear();
+        }
     }
 
     LV2_Evbuf_Iterator* PluginInstance::GetMidiInBuf() const
@@ -64,18 +64,103 @@ namespace engine
     {
     public:
         using TMidiCallback = std::function<void(PluginInstanceForPart *, const midi::TMidiOrSysexEvent &event)>;
-        PluginInstanceForPart(std::string &&uri, uint32_t samplerate, const std::optional<size_t> &owningPart, size_t owningInstrumentIndex, const realtimethread::Processor &processor, TMidiCallback &&midiCallback) : m_PluginInstance(std::make_unique<PluginInstance>(std::move(uri), samplerate,  processor, [this, midiCallback = std::move(midiCallback)](const midi::TMidiOrSysexEvent &event) mutable { if(midiCallback) {midiCallback(this, event);}})), m_OwningInstrumentIndex(owningInstrumentIndex), m_OwningPart(owningPart)
+        // lv2 uri, instrument id, part id (nullopt for shared instruments). Used to match instances across project edits.
+        using TKey = std::tuple<std::string, uint64_t, std::optional<uint64_t>>;
+        PluginInstanceForPart(const PluginInstanceForPart&) = delete;
+        PluginInstanceForPart& operator=(const PluginInstanceForPart&) = delete;
+        PluginInstanceForPart(PluginInstanceForPart&&) = delete;
+        PluginInstanceForPart& operator=(PluginInstanceForPart&&) = delete;
+        // The plugin is not instantiated until MakeResident() is called.
+        PluginInstanceForPart(std::string &&uri, uint32_t samplerate, const std::optional<size_t> &owningPart, size_t owningInstrumentIndex, TKey &&key, const realtimethread::Processor &processor, TMidiCallback &&midiCallback) : m_Uri(std::move(uri)), m_SampleRate(samplerate), m_Processor(processor), m_MidiCallback(std::move(midiCallback)), m_OwningPart(owningPart), m_OwningInstrumentIndex(owningInstrumentIndex), m_Key(std::move(key))
         {
         }
+        ~PluginInstanceForPart();
+        // null while the plugin is not resident:
         const std::unique_ptr<PluginInstance>& pluginInstance() const { return m_PluginInstance; }
         std::unique_ptr<PluginInstance>& pluginInstance() { return m_PluginInstance; }
         const size_t& OwningInstrumentIndex() const { return m_OwningInstrumentIndex; }
         const std::optional<size_t>& OwningPart() const { return m_OwningPart; }
+        const TKey& Key() const { return m_Key; }
+        // the indices change when instruments or parts are inserted or deleted:
+        void SetOwner(const std::optional<size_t> &owningPart, size_t owningInstrumentIndex)
+        {
+            m_OwningPart = owningPart;
+            m_OwningInstrumentIndex = owningInstrumentIndex;
+        }
+        // Instantiates the plugin if it is not resident. Returns nullopt if it already was, otherwise the directory holding
+        // the state to restore if the plugin was evicted before, or an empty string for a fresh instance.
+        std::optional<std::string> MakeResident();
+        // Keeps the state of the plugin (the preset, if it is unmodified) and hands over the instance for deferred deletion.
+        std::unique_ptr<PluginInstance> Evict();
+        // The preset loaded into the plugin while it is not played. Empty once the plugin has been active, since the user may
+        // have changed its state. Loading that preset again can be skipped.
+        const std::string& PristinePresetDir() const { return m_PristinePresetDir; }
+        void SetPristinePresetDir(std::string &&dir) { m_PristinePresetDir = std::move(dir); }
+        // last time the plugin was active or prefetched:
+        std::chrono::steady_clock::time_point LastWanted() const { return m_LastWanted; }
+        void SetLastWanted(std::chrono::steady_clock::time_point t) { m_LastWanted = t; }
+        // wanted: resident and activated; played: in the realtime data
+        bool Wanted() const { return m_Wanted; }
+        void SetWanted(bool wanted) { m_Wanted = wanted; }
+        bool Played() const { return m_Played; }
+        void SetPlayed(bool played) { m_Played = played; }
+
+    private:
+        void RemoveSavedState();
 
     private:
+        std::string m_Uri;
+        uint32_t m_SampleRate;
+        const realtimethread::Processor &m_Processor;
+        TMidiCallback m_MidiCallback;
         std::unique_ptr<PluginInstance> m_PluginInstance;
         std::optional<size_t> m_OwningPart;
         size_t m_OwningInstrumentIndex;
+        TKey m_Key;
+        std::string m_PristinePresetDir;
+        // state to restore when the plugin becomes resident again:
+        std::string m_RestoreDir;
+        // temporary directory written by Evict(), removed when no longer needed:
+        std::string m_SavedStateDir;
+        std::chrono::steady_clock::time_point m_LastWanted = std::chrono::steady_clock::now();
+        bool m_Wanted = false;
+        bool m_Played = false;
+    };
+    // When the instances of instruments that are not played are unloaded. The active instrument of each part and the
+    // instruments of its quick presets are resident; other instances are deactivated and unloaded after a while. Their
+    // state is kept on disk, so they come back as they were.
+    class TResidencyPolicy
+    {
+    public:
+        // an instance that is no longer wanted is unloaded after this time:
+        std::chrono::seconds m_IdleTimeout {300};
+        // while the resident set size of the process exceeds this, unwanted instances are unloaded earlier, least recently
+        // used first. 0 for no limit.
+        size_t m_MemoryBudget = utils::PhysicalMemorySize() / 2;
+        // keep the instruments of the quick presets of each part resident, with the first quick preset loaded:
+        bool m_PrefetchQuickPresets = true;
+    };
+    // Number of plugin instances affected by the last call to Engine::SyncPlugins
+    enum class TProjectChange { None, Mix, Plugins };
+    TProjectChange ClassifyProjectChange(const project::TProject &oldproject, const project::TProject &newproject);
+    class TPluginSyncStats
+    {
+    public:
+        size_t m_Created = 0;
+        size_t m_Reused = 0;
+        size_t m_Destroyed = 0;
+    };
+    // An insert effect of a part. Matched by (part id, position in the chain, lv2 uri) across project edits, so the
+    // instance keeps its state when unrelated parts of the project change.
+    class TInsertEffectInstance
+    {
+    public:
+        using TKey = std::tuple<uint64_t, size_t, std::string>;
+        TInsertEffectInstance(std::unique_ptr<PluginInstance> &&instance, TKey &&key) : m_Instance(std::move(instance)), m_Key(std::move(key)) {}
+        std::unique_ptr<PluginInstance> m_Instance;
+        TKey m_Key;
+        // the preset is loaded again when the project refers to a different one:
+        std::string m_LoadedPresetSubDir;
     };
     class TAuxInPortBase
     {
@@ -90,7 +175,8 @@ namespace engine
         const std::string &Name() const { return m_Name; }
         Engine* engine() const { return m_Engine; }
     protected:
-        virtual void OnMidi(const midi::TMidiOrSysexEvent &event) = 0;  // called in main thread
+        // called in main thread, with all events that have arrived since the previous call:
+        virtual void OnMidi(std::span<const realtimethread::TMidiInEvent> events) = 0;
 
     private:
         Engine* m_Engine;
@@ -103,17 +189,21 @@ namespace engine
         TAuxInPortLink& operator=(TAuxInPortLink&&) = delete;
         TAuxInPortLink(const TAuxInPortLink&) = delete;
         TAuxInPortLink& operator=(const TAuxInPortLink&) = delete;
-        TAuxInPortLink(TAuxInPortBase *inport) : m_AuxInPort(inport), m_Port(std::string(inport->Name()), jackutils::PortKind::Midi, jackutils::PortDirection::Input), m_OnMidiCallback([this](const midi::TMidiOrSysexEvent &event){ this->OnMidi(event); })
+        TAuxInPortLink(TAuxInPortBase *inport) : m_AuxInPort(inport), m_Port(std::string(inport->Name()), jackutils::PortKind::Midi, jackutils::PortDirection::Input)
         {
         }
         jackutils::Port& Port() { return m_Port; }
         const jackutils::Port& Port() const { return m_Port; }
-        void OnMidi(const midi::TMidiOrSysexEvent &event)
+        realtimethread::TMidiInRing& MidiRing() { return m_MidiRing; }
+        // main thread: passes the events received since the last call to the port
+        void DrainMidi()
         {
-            if(m_AuxInPort)
-            {
-                m_AuxInPort->OnMidi(event);
-            }
+            m_MidiRing.Drain([this](std::span<const realtimethread::TMidiInEvent> events){
+                if(m_AuxInPort)
+                {
+                    m_AuxInPort->OnMidi(events);
+                }
+            });
         }
         void Detach()
         {
@@ -121,12 +211,11 @@ namespace engine
         }
         TAuxInPortBase* AuxInPort() const { return m_AuxInPort; }
         bool IsAttached() const { return m_AuxInPort != nullptr; }
-        const std::function<void(const midi::TMidiOrSysexEvent &event)>* OnMidiCallback() const { return &m_OnMidiCallback; }
 
     private:
         jackutils::Port m_Port;
         TAuxInPortBase *m_AuxInPort;
-        std::function<void(const midi::TMidiOrSysexEvent &event)> m_OnMidiCallback;
+        realtimethread::TMidiInRing m_MidiRing;
     };
 
     class TAuxOutPortBase
@@ -170,30 +259,55 @@ namespace engine
         Engine &m_Engine;
     };
 
-    class TPresetLoader
+    // Loads presets on a fixed number of worker threads, into instruments and insert effects alike.
+    // Loads for the same plugin are serialized. A load request for a plugin that has not started loading yet
+    // replaces the pending request, so if the user scrolls through a list of presets only the last one is loaded.
+    class TPresetLoaderPool
     {
     public:
-        TPresetLoader(TPresetLoader&&) = delete;
-        TPresetLoader& operator=(TPresetLoader&&) = delete;
-        TPresetLoader(const TPresetLoader&) = delete;
-        TPresetLoader& operator=(const TPresetLoader&) = delete;
-        TPresetLoader(Engine &engine, PluginInstanceForPart &pluginInstance, const std::string &presetdir);
-        bool Finished() const { return m_Finished; }
-        PluginInstanceForPart& PluginInstance() { return m_PluginInstance; }
-        void Start();
+        static constexpr size_t sNumThreads = 2;
+        TPresetLoaderPool(TPresetLoaderPool&&) = delete;
+        TPresetLoaderPool& operator=(TPresetLoaderPool&&) = delete;
+        TPresetLoaderPool(const TPresetLoaderPool&) = delete;
+        TPresetLoaderPool& operator=(const TPresetLoaderPool&) = delete;
+        TPresetLoaderPool(Engine &engine);
+        ~TPresetLoaderPool();
+        // higher priority loads are started first
+        void Load(PluginInstance &plugin, std::string &&presetdir, int priority);
+        // drops the pending load for the plugin. A load in progress cannot be interrupted, but its plugin will not be loaded again.
+        void Cancel(PluginInstance *plugin);
+        void CancelAll();
+        bool IsLoading(const PluginInstance *plugin) const;
+        bool Idle() const;
 
     private:
-        void StartLoad();
-        void LoadDone();
-    
+        class TJob
+        {
+        public:
+            uint64_t m_Id = 0;
+            std::string m_PresetDir;
+            int m_Priority = 0;
+            uint64_t m_Sequence = 0; // increments for each request, loads with the same priority are started in order
+            bool m_Ready = false; // set after the round trip to the audio thread
+            bool m_Running = false;
+            bool m_Finished = false;
+        };
+        void WorkerThread();
+        void DidRoundTrip(PluginInstance *plugin, uint64_t jobid);
+        void LoadsDone();
+
     private:
         Engine &m_Engine;
-        utils::TThreadWithEventLoop m_LoaderThread;
-        utils::TEventLoopAction m_DidRoundTripAction;
-        utils::TEventLoopAction m_LoadDoneAction;
-        PluginInstanceForPart &m_PluginInstance;
-        std::string m_PresetDir;
-        bool m_Finished = false;
+        mutable std::mutex m_Mutex;
+        // protected by mutex:
+        std::condition_variable m_WakeCondition;
+        std::map<const PluginInstance*, TJob> m_Jobs;
+        uint64_t m_NextJobId = 1;
+        uint64_t m_NextSequence = 1;
+        bool m_Quit = false;
+
+        utils::TEventLoopAction m_LoadsDoneAction;
+        std::vector<std::thread> m_Threads;
     };
 
     class Engine
@@ -201,6 +315,7 @@ namespace engine
         friend TAuxInPortBase;
         friend TAuxOutPortBase;
         friend TAuxOutPortLink;
+        friend TPresetLoaderPool;
     public:
         class TData
         {
@@ -347,7 +462,7 @@ namespace engine
         void SetData(TData &&data);
         void UpdateHammondPlugins(const project::THammondData &olddata, bool forceNow);
         void ProcessMessages();
-        void ApplyJackConnections(bool forceNow);
+        void ApplyJackConnections();
         utils::NotifySource& OnDataChanged() { return m_OnDataChanged; }
         const std::string& ProjectDir() const { return m_ProjectDir; }
         std::string PresetsDir() const { return m_ProjectDir + "/presets"; }
@@ -370,17 +485,31 @@ namespace engine
         void SendMidiToPartInstrument(const midi::TMidiOrSysexEvent &event, size_t partindex, size_t instrumentindex); // midi channel is ignored!
         realtimethread::Processor& RtProcessor() { return m_RtProcessor; }
         utils::TEventLoop &EventLoop() const { return m_EventLoop; }
-        void PresetLoaderFinished(TPresetLoader *loader);
         bool IsPluginLoading(PluginInstanceForPart *plugin) const;
+        const TPluginSyncStats& LastPluginSyncStats() const { return m_LastPluginSyncStats; }
+        const TResidencyPolicy& ResidencyPolicy() const { return m_ResidencyPolicy; }
+        void SetResidencyPolicy(const TResidencyPolicy &policy) { m_ResidencyPolicy = policy; }
+        size_t NumResidentPlugins() const;
+        const realtimethread::TTimingReport& TimingReport() const { return m_RtProcessor.TimingReport(); }
+        utils::NotifySource& OnTimingUpdate() { return m_RtProcessor.OnTimingUpdate(); }
+        float JackDspLoad() const { return m_JackClient.CpuLoad(); }
+        uint64_t NumXruns() const { return m_JackClient.NumXruns(); }
+        // for the load pages in the GUIs:
+        std::string LoadSummary() const;
+        // rows of name, avg, p99 and max run time: the whole cycle, the plugins (slowest first) and the stages of the cycle
+        std::vector<std::array<std::string, 4>> LoadTable() const;
         std::optional<size_t> GuiActivePartIndex() const;
         std::optional<size_t> GuiActivePresetIndex() const;
         std::optional<size_t> GuiActiveInstrumentIndex() const;
 
     private:
         void LoadPresetForPart(size_t partindex);
+        void UpdateResidency();
         void SyncRtData();
         void SyncPlugins();
-        void SyncPlugins(std::vector<std::unique_ptr<jackutils::Port>> &midiInPortsToDiscard, std::vector<std::unique_ptr<PluginInstance>> &pluginsToDiscard);
+        // presetLoads: states to load into instances that were made resident and presets for insert effects (plugin,
+        // directory, priority), to be started once the new plugins are in place
+        void SyncPlugins(std::vector<std::unique_ptr<jackutils::Port>> &midiInPortsToDiscard, std::vector<std::unique_ptr<PluginInstance>> &pluginsToDiscard, std::vector<std::tuple<PluginInstance*, std::string, int>> &presetLoads);
         realtimethread::Data CalcRtData() const;
         const std::vector<std::unique_ptr<PluginInstanceForPart>>& OwnedPlugins() const { return m_OwnedPlugins; }
         const std::vector<Part>& Parts() const { return m_Parts; }
@@ -392,19 +521,27 @@ namespace engine
         bool DoProjectSaveThread();
         void OnMidiFromPlugin(PluginInstanceForPart *sender, const midi::TMidiOrSysexEvent &evt);
         void LoadFirstHammondPreset();
-        void CleanupPresetLoaders();
-        void StartLoading();
+        void PresetLoadsFinished();
+        // main thread, after the jack buffer size changed:
+        void OnJackBufferSizeChanged();
+        // gives the plugins that are not in the realtime data the buffer length of m_ResizedAudioBufferLength:
+        void ResizeAudioBuffers();
+        void LoadThreadSettings();
         void LoadJackConnections();
         void SendControllerForPartIfNecessary();
         bool IsPartLoading(size_t partindex) const;
 
     private:
         jackutils::Client m_JackClient;
+        jackutils::ConnectionReconciler m_JackConnectionReconciler {m_JackClient};
         lilvutils::World m_LilvWorld;
         realtimethread::Processor m_RtProcessor {8192};
         std::vector<std::unique_ptr<PluginInstanceForPart>> m_OwnedPlugins;
         std::vector<std::unique_ptr<PluginInstanceForPart>> m_OwnedPluginsToBeDiscardedAfterLoad;
+        std::vector<std::unique_ptr<PluginInstance>> m_InsertEffectsToBeDiscardedAfterLoad;
         std::unique_ptr<PluginInstance> m_ReverbInstance;
+        // indexed by part:
+        std::vector<std::vector<TInsertEffectInstance>> m_PartInsertEffects;
         std::vector<Part> m_Parts;
         TData m_Data;
 //        std::unique_ptr<OptionalUI> m_Ui;
@@ -412,7 +549,6 @@ namespace engine
         realtimethread::Data m_CurrentRtData;
         std::vector<std::unique_ptr<jackutils::Port>> m_AudioOutPorts;
         std::unique_ptr<jackutils::Port> m_VocoderInPort;
-        std::optional<std::chrono::steady_clock::time_point> m_LastApplyJackConnectionTime;
         utils::NotifySource m_OnDataChanged;
         bool m_SafeToDestroy = false;
         std::string m_ProjectDir;
@@ -430,9 +566,13 @@ namespace engine
         bool m_Quitting = false;
         std::set<PluginInstance*> m_ProcessingDataFromPlugin;
         utils::TEventLoop &m_EventLoop;
-        utils::TEventLoopAction m_CleanupPresetLoadersAction;
-        std::vector<std::unique_ptr<TPresetLoader>> m_PresetLoaders;
-        std::map<PluginInstanceForPart*, std::string> m_Plugin2LoadQueue;
+        TPresetLoaderPool m_PresetLoaderPool {*this};
+        utils::TEventLoopAction m_JackBufferSizeChangedAction {m_EventLoop, [this](){ OnJackBufferSizeChanged(); }};
+        // the audio buffer length the plugins can be given: the realtime thread no longer uses plugins with smaller buffers
+        uint32_t m_ResizedAudioBufferLength = 0;
+        TPluginSyncStats m_LastPluginSyncStats;
+        TResidencyPolicy m_ResidencyPolicy;
+        std::chrono::steady_clock::time_point m_LastResidencyUpdate;
         std::vector<std::vector<std::optional<int>>> m_LastSentPart2ControllerValues;
         std::chrono::steady_clock::time_point m_LastControllerSendTime;
     };
@@ -446,7 +586,7 @@ namespace engine
             TInPort(TController &controller, engine::Engine &m_Engine, std::string &&name) : m_Controller(controller), TAuxInPortBase(m_Engine, std::move(name))
             {
             }
-            void OnMidi(const midi::TMidiOrSysexEvent &event) override;
+            void OnMidi(std::span<const realtimethread::TMidiInEvent> events) override;
 
         private:
             TController &m_Controller;
@@ -475,7 +615,8 @@ namespace engine
         }
         void SendMidi(const midi::TMidiOrSysexEvent &event) const;
     protected:
-        virtual void OnMidiIn(const midi::TMidiOrSysexEvent &event) = 0;
+        // the events of the input port, in batches; see TAuxInPortBase::OnMidi()
+        virtual void OnMidiIn(std::span<const realtimethread::TMidiInEvent> events) = 0;
         virtual void OnDataChanged(const engine::Engine::TData &prevData) {}
     
     private:
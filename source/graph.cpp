@@ -0,0 +1,230 @@
+#include "graph.h"
+#include <stdexcept>
+#include <algorithm>
+#include <pthread.h>
+#include "threads.h"
+#include <immintrin.h>
+
+namespace
+{
+    bool IsRealtimePolicy(int policy)
+    {
+        return (policy == SCHED_FIFO) || (policy == SCHED_RR);
+    }
+}
+
+namespace graph
+{
+    TSchedule::TSchedule(const std::vector<std::vector<size_t>> &dependencies) : m_Dependents(dependencies.size()), m_NumDependencies(dependencies.size())
+    {
+        std::vector<size_t> level(dependencies.size(), 0);
+        for(size_t task = 0; task < dependencies.size(); task++)
+        {
+            for(auto dependency: dependencies[task])
+            {
+                if(dependency >= task)
+                {
+                    throw std::runtime_error("graph::TSchedule: tasks are not in topological order");
+                }
+                m_Dependents[dependency].push_back(task);
+                level[task] = std::max(level[task], level[dependency] + 1);
+            }
+            m_NumDependencies[task] = dependencies[task].size();
+        }
+        // follow the chains: a task continues the chain of its dependency if each is the other's only one
+        std::vector<size_t> chainstart(dependencies.size());
+        std::vector<size_t> chainlength(dependencies.size(), 1);
+        std::vector<size_t> numChainsPerLevel;
+        for(size_t task = 0; task < dependencies.size(); task++)
+        {
+            chainstart[task] = task;
+            if(dependencies[task].size() == 1)
+            {
+                auto dependency = dependencies[task][0];
+                if(m_Dependents[dependency].size() == 1)
+                {
+                    chainstart[task] = chainstart[dependency];
+                    chainlength[task] = chainlength[dependency] + 1;
+                }
+            }
+            bool chainends = (m_Dependents[task].size() != 1) || (dependencies[m_Dependents[task][0]].size() != 1);
+            if(chainends && (chainlength[task] >= 2))
+            {
+                auto startlevel = level[chainstart[task]];
+                if(startlevel >= numChainsPerLevel.size())
+                {
+                    numChainsPerLevel.resize(startlevel + 1, 0);
+                }
+                numChainsPerLevel[startlevel]++;
+            }
+        }
+        for(auto n: numChainsPerLevel)
+        {
+            m_NumParallelChains = std::max(m_NumParallelChains, n);
+        }
+        m_Remaining = std::make_unique<std::atomic<size_t>[]>(NumTasks());
+    }
+
+    TWorkerPool::TWorkerPool(size_t numWorkers) : m_TaskStates(std::make_unique<std::atomic<uint64_t>[]>(sMaxTasks))
+    {
+        for(size_t i = 0; i < numWorkers; i++)
+        {
+            auto worker = std::make_unique<TWorker>();
+            worker->m_Thread = threads::Spawn(threads::TClass::RtWorker, "rt worker " + std::to_string(i), [this, w = worker.get()](){
+                WorkerThreadFunc(w->m_Wake);
+            });
+            m_Workers.push_back(std::move(worker));
+        }
+    }
+    TWorkerPool::~TWorkerPool()
+    {
+        m_Quit = true;
+        for(auto &worker: m_Workers)
+        {
+            worker->m_Wake.release();
+            worker->m_Thread.join();
+        }
+    }
+    size_t TWorkerPool::DefaultNumWorkers()
+    {
+        auto numcores = (size_t)std::thread::hardware_concurrency();
+        return std::clamp<size_t>(numcores, 1, 8) - 1;
+    }
+    void TWorkerPool::Run(TSchedule &schedule, const TTaskFunc &func)
+    {
+        if(!m_PolicyKnown)
+        {
+            m_PolicyKnown = true;
+            int policy;
+            sched_param param;
+            if(pthread_getschedparam(pthread_self(), &policy, &param) == 0)
+            {
+                m_Priority = param.sched_priority;
+                m_Policy = policy;
+                // wake the workers to take over the policy before they are needed:
+                for(auto &worker: m_Workers)
+                {
+                    worker->m_Wake.release();
+                }
+            }
+        }
+        auto numtasks = schedule.NumTasks();
+        auto numWorkers = std::min(m_Workers.size(), schedule.NumParallelChains() > 0? schedule.NumParallelChains() - 1 : 0);
+        if( (numtasks > sMaxTasks) || (m_NumWorkersKeepingUp.load(std::memory_order_acquire) < m_Workers.size()) )
+        {
+            numWorkers = 0;
+        }
+        m_LastNumWorkers = numWorkers;
+        if(numWorkers == 0)
+        {
+            for(size_t task = 0; task < numtasks; task++)
+            {
+                func(task);
+            }
+            return;
+        }
+        // all tasks of the previous cycle are finished, so no thread can claim one anymore. Prepare the new cycle and
+        // publish it:
+        auto generation = ++m_Generation;
+        m_Schedule = &schedule;
+        m_Func = &func;
+        m_NumClaimed.store(0, std::memory_order_relaxed);
+        m_NumFinished.store(0, std::memory_order_relaxed);
+        for(size_t task = 0; task < numtasks; task++)
+        {
+            schedule.m_Remaining[task].store(schedule.m_NumDependencies[task], std::memory_order_relaxed);
+            m_TaskStates[task].store(TaskState(generation, schedule.m_NumDependencies[task] == 0? sReady : sWaiting), std::memory_order_relaxed);
+        }
+        auto cycle = (generation << 16) | numtasks;
+        m_Cycle.store(cycle, std::memory_order_release);
+        for(size_t i = 0; i < numWorkers; i++)
+        {
+            m_Workers[i]->m_Wake.release();
+        }
+        while(m_NumFinished.load(std::memory_order_acquire) < numtasks)
+        {
+            if(!RunReadyTask(cycle))
+            {
+                // the remaining tasks are running on the workers, or wait for one that is:
+                _mm_pause();
+            }
+        }
+    }
+    bool TWorkerPool::RunReadyTask(uint64_t cycle)
+    {
+        auto generation = cycle >> 16;
+        auto numtasks = (size_t)(cycle & 0xffff);
+        auto ready = TaskState(generation, sReady);
+        for(size_t task = 0; task < numtasks; task++)
+        {
+            auto state = m_TaskStates[task].load(std::memory_order_relaxed);
+            if( (state == ready) && m_TaskStates[task].compare_exchange_strong(state, TaskState(generation, sClaimed), std::memory_order_acquire) )
+            {
+                // the cycle cannot end before this task is finished, so the schedule and func are still valid:
+                m_NumClaimed.fetch_add(1, std::memory_order_relaxed);
+                auto &schedule = *m_Schedule;
+                (*m_Func)(task);
+                for(auto dependent: schedule.m_Dependents[task])
+                {
+                    if(schedule.m_Remaining[dependent].fetch_sub(1, std::memory_order_acq_rel) == 1)
+                    {
+                        m_TaskStates[dependent].store(ready, std::memory_order_release);
+                    }
+                }
+                m_NumFinished.fetch_add(1, std::memory_order_release);
+                return true;
+            }
+        }
+        return false;
+    }
+    void TWorkerPool::WorkerThreadFunc(std::counting_semaphore<> &wake)
+    {
+        int appliedPolicy = -1;
+        int appliedPriority = 0;
+        bool keepingUp = false;
+        while(true)
+        {
+            wake.acquire();
+            if(m_Quit) break;
+            int policy = m_Policy;
+            int priority = m_Priority;
+            if( (policy >= 0) && ((policy != appliedPolicy) || (priority != appliedPriority)) )
+            {
+                // a priority configured for the class takes precedence:
+                if(!threads::HasRtPriority(threads::TClass::RtWorker))
+                {
+                    sched_param param {};
+                    param.sched_priority = priority;
+                    pthread_setschedparam(pthread_self(), policy, &param);
+                }
+                appliedPolicy = policy;
+                appliedPriority = priority;
+                // without rtprio permission the policy could not be set. Then Run() does not use the workers:
+                int actualPolicy;
+                sched_param actualParam;
+                bool nowKeepingUp = (pthread_getschedparam(pthread_self(), &actualPolicy, &actualParam) == 0) && ( (!IsRealtimePolicy(policy)) || IsRealtimePolicy(actualPolicy) );
+                if(nowKeepingUp != keepingUp)
+                {
+                    keepingUp = nowKeepingUp;
+                    if(keepingUp)
+                    {
+                        m_NumWorkersKeepingUp.fetch_add(1, std::memory_order_release);
+                    }
+                    else
+                    {
+                        m_NumWorkersKeepingUp.fetch_sub(1, std::memory_order_release);
+                    }
+                }
+            }
+            // run tasks until all of the cycle are claimed; a late wake up finds nothing to do and sleeps again:
+            while(true)
+            {
+                auto cycle = m_Cycle.load(std::memory_order_acquire);
+                if(RunReadyTask(cycle)) continue;
+                if(m_NumClaimed.load(std::memory_order_relaxed) >= (cycle & 0xffff)) break;
+                if(m_Cycle.load(std::memory_order_relaxed) != cycle) continue;
+                _mm_pause();
+            }
+        }
+    }
+}
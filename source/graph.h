@@ -0,0 +1,108 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <semaphore>
+#include <functional>
+#include <cstdint>
+
+namespace graph
+{
+    // A DAG of tasks, executed once per cycle by TWorkerPool. Built in the main thread; the per cycle state is
+    // preallocated, so running it does not allocate.
+    class TSchedule
+    {
+        friend class TWorkerPool;
+    public:
+        TSchedule(const TSchedule&) = delete;
+        TSchedule& operator=(const TSchedule&) = delete;
+        TSchedule(TSchedule&&) = delete;
+        TSchedule& operator=(TSchedule&&) = delete;
+        // dependencies[i] are the tasks that must be finished before task i starts. They must all be smaller than i,
+        // i.e. the tasks are in topological order.
+        TSchedule(const std::vector<std::vector<size_t>> &dependencies);
+        size_t NumTasks() const { return m_NumDependencies.size(); }
+        // A chain is a task followed by the task that depends on it alone, and so on. This is the largest number of
+        // chains of two or more tasks that start on the same topological level, i.e. that can run at the same time.
+        // Single tasks (an instrument without insert effects) are too short to be worth waking a worker for.
+        size_t NumParallelChains() const { return m_NumParallelChains; }
+
+    private:
+        std::vector<std::vector<size_t>> m_Dependents;
+        std::vector<size_t> m_NumDependencies;
+        size_t m_NumParallelChains = 0;
+        // per cycle, the number of unfinished dependencies:
+        std::unique_ptr<std::atomic<size_t>[]> m_Remaining;
+    };
+
+    // Runs a TSchedule on the calling thread plus a number of worker threads. Independent tasks run concurrently.
+    // The workers sleep on a semaphore between cycles and take over the scheduling policy and priority of the
+    // thread calling Run(), so they are realtime threads if that one is.
+    // A task is claimed by the thread that starts it, only once all its dependencies are finished, and the cycle
+    // ends as soon as all tasks are finished. So the calling thread never waits for a worker that has not woken up
+    // yet or has nothing to do; it only waits for tasks that are actually running on a worker.
+    class TWorkerPool
+    {
+    public:
+        using TTaskFunc = std::function<void(size_t task)>;
+        // the per task state is kept here rather than in the schedule, so a worker that wakes up late never touches a
+        // schedule that may have been deleted already. Larger schedules run on the calling thread.
+        static constexpr size_t sMaxTasks = 256;
+        TWorkerPool(const TWorkerPool&) = delete;
+        TWorkerPool& operator=(const TWorkerPool&) = delete;
+        TWorkerPool(TWorkerPool&&) = delete;
+        TWorkerPool& operator=(TWorkerPool&&) = delete;
+        TWorkerPool(size_t numWorkers);
+        ~TWorkerPool();
+        // one less than the number of cores, at most 7:
+        static size_t DefaultNumWorkers();
+        size_t NumWorkers() const { return m_Workers.size(); }
+        // Calls func for every task and returns when all are done. func is called from several threads at once (for
+        // different tasks). Realtime safe: nothing is allocated and the workers are woken without taking a lock.
+        // Everything runs on the calling thread, in task order, if the schedule has less than two parallel chains, or
+        // if the calling thread is a realtime thread and the workers could not get realtime priority: it must not
+        // wait for a thread that can be preempted.
+        void Run(TSchedule &schedule, const TTaskFunc &func);
+        // the number of workers woken by the last Run():
+        size_t LastNumWorkers() const { return m_LastNumWorkers; }
+
+    private:
+        void WorkerThreadFunc(std::counting_semaphore<> &wake);
+        // claims a task of the cycle that is ready and runs it. Returns false if there was none.
+        bool RunReadyTask(uint64_t cycle);
+        static uint64_t TaskState(uint64_t generation, uint64_t state) { return (generation << 2) | state; }
+
+    private:
+        static constexpr uint64_t sWaiting = 0;
+        static constexpr uint64_t sReady = 1;
+        static constexpr uint64_t sClaimed = 2;
+        // a semaphore per worker, so a wake up cannot be taken by another worker:
+        struct TWorker
+        {
+            std::counting_semaphore<> m_Wake {0};
+            std::thread m_Thread;
+        };
+        std::vector<std::unique_ptr<TWorker>> m_Workers;
+        std::atomic<bool> m_Quit = false;
+        // (generation << 16) | number of tasks; a new generation for every cycle. Released after the state below:
+        alignas(64) std::atomic<uint64_t> m_Cycle {0};
+        // only read by a thread that has claimed a task of the current cycle:
+        TSchedule *m_Schedule = nullptr;
+        const TTaskFunc *m_Func = nullptr;
+        // TaskState(generation, sWaiting / sReady / sClaimed) per task:
+        std::unique_ptr<std::atomic<uint64_t>[]> m_TaskStates;
+        alignas(64) std::atomic<size_t> m_NumClaimed {0};
+        alignas(64) std::atomic<size_t> m_NumFinished {0};
+        // calling thread only:
+        uint64_t m_Generation = 0;
+        size_t m_LastNumWorkers = 0;
+        // scheduling of the thread calling Run(), taken over by the workers:
+        std::atomic<int> m_Policy = -1;
+        std::atomic<int> m_Priority = 0;
+        bool m_PolicyKnown = false;
+        // workers with a realtime policy if the calling thread has one:
+        std::atomic<size_t> m_NumWorkersKeepingUp {0};
+    };
+}
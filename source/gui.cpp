@@ -325,23 +325,51 @@ public:
         m_PluginList.set_model(m_ListStore);
         m_PluginList.append_column("Name", m_Columns.m_Name);
         m_PluginList.append_column("Class", m_Columns.m_Class);
-        Populate();
-        if(!selectedplugin.empty())
-        {
-            for(auto iter = m_ListStore->children().begin(); iter != m_ListStore->children().end(); iter++)
+        // the list comes from the plugin index cache; refresh it in the background and repopulate if anything changed:
+        m_RescanFinishedDispatcher.connect([this](){
+            if(lilvutils::World::Static().ApplyPluginRescan())
             {
-                const auto &row = *iter;
-                if((std::string)row[m_Columns.m_Lv2Uri] == selectedplugin)
+                auto selectedplugin = m_SelectedPluginUri;
+                m_ListStore->clear();
+                Populate();
+                if(selectedplugin)
                 {
-                    m_PluginList.get_selection()->select(iter);
-                    m_PluginList.scroll_to_row(m_ListStore->get_path(iter), 0.5);
-                    break;
+                    SelectPlugin(*selectedplugin);
                 }
+                m_SelectedPluginUri = selectedplugin;
+                enableItems();
             }
+        });
+        lilvutils::World::Static().SetOnPluginRescanFinished([this](){
+            m_RescanFinishedDispatcher.emit();
+        });
+        lilvutils::World::Static().ApplyPluginRescan();
+        lilvutils::World::Static().RescanPluginsInBackground();
+        Populate();
+        if(!selectedplugin.empty())
+        {
+            SelectPlugin(selectedplugin);
         }
         enableItems();
         show_all();
     }
+    ~PluginSelectorDialog()
+    {
+        lilvutils::World::Static().SetOnPluginRescanFinished(nullptr);
+    }
+    void SelectPlugin(const std::string &uri)
+    {
+        for(auto iter = m_ListStore->children().begin(); iter != m_ListStore->children().end(); iter++)
+        {
+            const auto &row = *iter;
+            if((std::string)row[m_Columns.m_Lv2Uri] == uri)
+            {
+                m_PluginList.get_selection()->select(iter);
+                m_PluginList.scroll_to_row(m_ListStore->get_path(iter), 0.5);
+                break;
+            }
+        }
+    }
     void enableItems()
     {
         bool canok = true;
@@ -393,6 +421,7 @@ private:
     Glib::RefPtr<Gtk::ListStore> m_ListStore {Gtk::ListStore::create(m_Columns)};
     Gtk::TreeView m_PluginList;
     Gtk::Button *m_OkButton = nullptr;
+    Glib::Dispatcher m_RescanFinishedDispatcher;
 };
 
 class TEditParametersPanel : public Gtk::Frame {
@@ -806,6 +835,7 @@ public:
         m_NameLabel("Name:"),
         m_IsHammondCheckButton("Hammond organ mode"),
         m_HasVocoderInputCheckButton("Has vocoder input"),
+        m_AlwaysRunCheckButton("Keep running when silent"),
         m_ParametersPanel(std::vector<project::TInstrument::TParameter>(m_Instrument.Parameters())),
         m_Lv2UriEntry(),
         m_NameEntry(),
@@ -824,6 +854,7 @@ public:
         m_NameEntry.set_text(m_Instrument.Name());
         m_IsHammondCheckButton.set_active(m_Instrument.IsHammond());
         m_HasVocoderInputCheckButton.set_active(m_Instrument.HasVocoderInput());
+        m_AlwaysRunCheckButton.set_active(m_Instrument.AlwaysRun());
 
         // Set up the grid layout
         m_Grid.attach(m_Lv2UriLabel, 0, 0, 1, 1);
@@ -844,11 +875,12 @@ public:
         m_Grid.set_row_spacing(5);
         m_Grid.attach(m_IsHammondCheckButton, 1, 2, 2, 1);
         m_Grid.attach(m_HasVocoderInputCheckButton, 1, 3, 2, 1);
+        m_Grid.attach(m_AlwaysRunCheckButton, 1, 4, 2, 1);
 
         // Add the parameters panel to the grid
-        m_Grid.attach(m_ControllersLabel, 0, 4, 1, 1);
-        m_Grid.attach(m_ParametersPanel, 1, 4, 2, 1);
-        m_Grid.attach(m_ErrorLabel, 0, 5, 3, 1);
+        m_Grid.attach(m_ControllersLabel, 0, 5, 1, 1);
+        m_Grid.attach(m_ParametersPanel, 1, 5, 2, 1);
+        m_Grid.attach(m_ErrorLabel, 0, 6, 3, 1);
         // make red:
         m_ErrorLabel.override_color(Gdk::RGBA("red"));
 
@@ -906,6 +938,10 @@ public:
             Update();
         });
 
+        m_AlwaysRunCheckButton.signal_toggled().connect([this]() {
+            Update();
+        });
+
         m_ParametersPanel.onchange().connect([this]() {
             Update();
         });
@@ -930,7 +966,7 @@ public:
 
     void Update()
     {
-        m_Instrument = m_Instrument.ChangeHasVocoderInput(m_HasVocoderInputCheckButton.get_active()).ChangeIsHammond(m_IsHammondCheckButton.get_active()).ChangeLv2Uri(m_Lv2UriEntry.get_text()).ChangeName(utils::trim(m_NameEntry.get_text())).ChangeParameters(std::vector<project::TInstrument::TParameter>{m_ParametersPanel.Parameters()});
+        m_Instrument = m_Instrument.ChangeHasVocoderInput(m_HasVocoderInputCheckButton.get_active()).ChangeAlwaysRun(m_AlwaysRunCheckButton.get_active()).ChangeIsHammond(m_IsHammondCheckButton.get_active()).ChangeLv2Uri(m_Lv2UriEntry.get_text()).ChangeName(utils::trim(m_NameEntry.get_text())).ChangeParameters(std::vector<project::TInstrument::TParameter>{m_ParametersPanel.Parameters()});
         try
         {
             if(m_Instrument.Lv2Uri().empty())
@@ -972,6 +1008,7 @@ private:
     Gtk::Label m_ErrorLabel;
     Gtk::CheckButton m_IsHammondCheckButton;
     Gtk::CheckButton m_HasVocoderInputCheckButton;
+    Gtk::CheckButton m_AlwaysRunCheckButton;
     Gtk::Button m_ChooseLv2UriButton;
     Gtk::Button m_OkButton;
     Gtk::Button m_CancelButton;
@@ -1136,7 +1173,7 @@ private:
 class ApplicationWindow : public Gtk::ApplicationWindow
 {
 public:
-    enum class FocusedTab { Presets, Instruments, Reverb };
+    enum class FocusedTab { Presets, Instruments, Reverb, Load };
     class PartsContainer : public Gtk::Box
     {
     public:
@@ -1798,6 +1835,79 @@ public:
         Gtk::MenuItem m_EditInstrumentItem {"Edit Instrument"};
         Gtk::CheckMenuItem m_ShowGuiMenuItem{"Show plugin GUI"};
     };
+    class LoadPanel : public Gtk::Box
+    {
+    public:
+        LoadPanel(LoadPanel&&) = delete;
+        LoadPanel(engine::Engine &engine) : m_Engine(engine), Gtk::Box(Gtk::ORIENTATION_VERTICAL)
+        {
+            set_spacing(5);
+            pack_start(m_SummaryLabel, Gtk::PACK_SHRINK);
+            pack_start(m_ScrolledWindow, Gtk::PACK_EXPAND_WIDGET);
+            m_ScrolledWindow.set_policy(Gtk::POLICY_AUTOMATIC, Gtk::POLICY_AUTOMATIC);
+            m_ScrolledWindow.add(m_TreeView);
+            m_TreeView.set_model(m_ListStore);
+            m_TreeView.append_column("", m_Columns.m_Name);
+            m_TreeView.append_column("avg", m_Columns.m_Avg);
+            m_TreeView.append_column("p99", m_Columns.m_P99);
+            m_TreeView.append_column("max", m_Columns.m_Max);
+            show_all_children();
+            Update();
+        }
+        void Update()
+        {
+            if(!get_mapped()) return;
+            m_SummaryLabel.set_text(m_Engine.LoadSummary());
+            auto table = m_Engine.LoadTable();
+            if(m_ListStore->children().size() != table.size())
+            {
+                m_ListStore->clear();
+                for(size_t i = 0; i < table.size(); i++)
+                {
+                    m_ListStore->append();
+                }
+            }
+            size_t rowindex = 0;
+            for(auto iter = m_ListStore->children().begin(); iter != m_ListStore->children().end(); iter++, rowindex++)
+            {
+                auto row = *iter;
+                const auto &tablerow = table.at(rowindex);
+                row[m_Columns.m_Name] = tablerow[0];
+                row[m_Columns.m_Avg] = tablerow[1];
+                row[m_Columns.m_P99] = tablerow[2];
+                row[m_Columns.m_Max] = tablerow[3];
+            }
+        }
+    protected:
+        void on_map() override
+        {
+            Gtk::Box::on_map();
+            Update();
+        }
+    private:
+        class Columns : public Gtk::TreeModel::ColumnRecord
+        {
+        public:
+            Columns()
+            {
+                add(m_Name);
+                add(m_Avg);
+                add(m_P99);
+                add(m_Max);
+            }
+            Gtk::TreeModelColumn<std::string> m_Name;
+            Gtk::TreeModelColumn<std::string> m_Avg;
+            Gtk::TreeModelColumn<std::string> m_P99;
+            Gtk::TreeModelColumn<std::string> m_Max;
+        };
+        engine::Engine &m_Engine;
+        Gtk::Label m_SummaryLabel {"", Gtk::ALIGN_START};
+        Gtk::ScrolledWindow m_ScrolledWindow;
+        Columns m_Columns;
+        Glib::RefPtr<Gtk::ListStore> m_ListStore {Gtk::ListStore::create(m_Columns)};
+        Gtk::TreeView m_TreeView;
+        utils::NotifySink m_OnTimingUpdate {m_Engine.OnTimingUpdate(), [this](){Update();}};
+    };
     class TopBar : public Gtk::Box
     {
     public:
@@ -1817,16 +1927,22 @@ public:
                 m_ApplicationWindow.SetFocusedTab(FocusedTab::Reverb);
                 Update();
             });
+            m_ModeLoadButton.signal_clicked().connect([this](){
+                m_ApplicationWindow.SetFocusedTab(FocusedTab::Load);
+                Update();
+            });
             m_MenuButton.set_popup(applicationWindow.PopupMenu());
             m_MenuButton.set_image(m_MenuButtonImage);
             pack_start(m_ModePresetButton, Gtk::PACK_SHRINK);
             pack_start(m_ModeInstrumentsButton, Gtk::PACK_SHRINK);
             pack_start(m_ModeReverbButton, Gtk::PACK_SHRINK);
+            pack_start(m_ModeLoadButton, Gtk::PACK_SHRINK);
             pack_end(m_MenuButton, Gtk::PACK_SHRINK);
             pack_end(m_SetOutputPortsHint, Gtk::PACK_SHRINK);
             m_ModePresetButton.show();
             m_ModeInstrumentsButton.show();
             m_ModeReverbButton.show();
+            m_ModeLoadButton.show();
             m_MenuButton.show();
             Update();
         }
@@ -1836,12 +1952,14 @@ public:
             m_ModePresetButton.set_state_flags(focusedTab == FocusedTab::Presets?  Gtk::STATE_FLAG_CHECKED : Gtk::STATE_FLAG_NORMAL, true);
             m_ModeInstrumentsButton.set_state_flags(focusedTab == FocusedTab::Instruments?  Gtk::STATE_FLAG_CHECKED : Gtk::STATE_FLAG_NORMAL, true);
             m_ModeReverbButton.set_state_flags(focusedTab == FocusedTab::Reverb?  Gtk::STATE_FLAG_CHECKED : Gtk::STATE_FLAG_NORMAL, true);
+            m_ModeLoadButton.set_state_flags(focusedTab == FocusedTab::Load?  Gtk::STATE_FLAG_CHECKED : Gtk::STATE_FLAG_NORMAL, true);
             m_SetOutputPortsHint.set_visible(m_ApplicationWindow.m_Engine.Data().JackConnections().AudioOutputs()[0].empty() && m_ApplicationWindow.m_Engine.Data().JackConnections().AudioOutputs()[1].empty());
         }
     private:
         Gtk::ToggleButton m_ModePresetButton {"Presets"};
         Gtk::ToggleButton m_ModeInstrumentsButton {"Instruments"};
         Gtk::ToggleButton m_ModeReverbButton {"Reverb"};
+        Gtk::ToggleButton m_ModeLoadButton {"Load"};
         Gtk::MenuButton m_MenuButton;
         Gtk::Image m_MenuButtonImage {"open-menu-symbolic", Gtk::ICON_SIZE_MENU};
         Gtk::Label m_SetOutputPortsHint {"Configure audio output in Settings ➡"};
@@ -1872,6 +1990,7 @@ public:
         m_MainPanelStack.add(*m_PresetsPanel);
         m_MainPanelStack.add(*m_InstrumentsPanel);
         m_MainPanelStack.add(*m_ReverbPanel);
+        m_MainPanelStack.add(*m_LoadPanel);
         m_TopBar->show();
         m_Box1.show();
         m_Box2.show();
@@ -1881,6 +2000,7 @@ public:
         m_PresetsPanel->show();
         m_InstrumentsPanel->show();
         m_ReverbPanel->show();
+        m_LoadPanel->show();
         m_SettingsMenuItem.signal_activate().connect([this](){
             DoAndShowException([this](){
                 auto jackconnections = m_Engine.Data().JackConnections();
@@ -1911,6 +2031,10 @@ public:
         {
             m_MainPanelStack.set_visible_child(*m_ReverbPanel);
         }
+        else if(m_FocusedTab == FocusedTab::Load)
+        {
+            m_MainPanelStack.set_visible_child(*m_LoadPanel);
+        }
         m_TopBar->Update();
     }
     const FocusedTab& focusedTab() const { return m_FocusedTab; }
@@ -1937,6 +2061,7 @@ private:
     std::unique_ptr<PresetsPanel> m_PresetsPanel { std::make_unique<PresetsPanel>(m_Engine) };
     std::unique_ptr<InstrumentsPanel> m_InstrumentsPanel { std::make_unique<InstrumentsPanel>(m_Engine) };
     std::unique_ptr<ReverbPanel> m_ReverbPanel { std::make_unique<ReverbPanel>(m_Engine) };
+    std::unique_ptr<LoadPanel> m_LoadPanel { std::make_unique<LoadPanel>(m_Engine) };
     Gtk::Stack m_MainPanelStack;
     Glib::RefPtr<Gtk::CssProvider> m_CssProvider {Gtk::CssProvider::create()};
 };
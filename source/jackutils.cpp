@@ -1,5 +1,6 @@
 #include "jackutils.h"
 #include <iostream>
+#include "threads.h"
 
 namespace jackutils
 {
@@ -44,13 +45,26 @@ namespace jackutils
             }
         });
         jack_set_process_callback(jackclient, &Client::processStatic, this);
-        jack_set_xrun_callback 	(jackclient, [](void*) -> int {
-            std::cout << "XRUN!\n";
+        jack_set_thread_init_callback(jackclient, [](void *arg){
+            threads::RegisterCurrentThread(threads::TClass::RtAudio, "jack process");
+        }, nullptr);
+        jack_set_xrun_callback 	(jackclient, [](void *arg) -> int {
+            ((Client*)arg)->m_NumXruns.fetch_add(1, std::memory_order_relaxed);
             return 0;
         }, this);
 
         jack_set_port_registration_callback(jackclient, [] (jack_port_id_t port, int reg, void *arg){
-            // std::cout << "port registration: "  << reg << "\n";
+            ((Client*)arg)->GraphChanged(true);
+        }, this);
+        jack_set_port_rename_callback(jackclient, [] (jack_port_id_t port, const char *oldname, const char *newname, void *arg){
+            ((Client*)arg)->GraphChanged(true);
+        }, this);
+        jack_set_port_connect_callback(jackclient, [] (jack_port_id_t a, jack_port_id_t b, int connect, void *arg){
+            ((Client*)arg)->GraphChanged(false);
+        }, this);
+        jack_set_buffer_size_callback(jackclient, [] (jack_nframes_t nframes, void *arg) -> int {
+            ((Client*)arg)->BufferSizeChanged(nframes);
+            return 0;
         }, this);
 
         // jack_on_shutdown(jackclient, [](void* arg){
@@ -230,4 +244,258 @@ namespace jackutils
         }
     }
 
-}
+
+    void Client::SetOnGraphChanged(std::function<void(bool portsChanged)> &&callback)
+    {
+        std::unique_lock<std::mutex> lock(m_GraphCallbackMutex);
+        m_OnGraphChanged = std::move(callback);
+    }
+
+    void Client::GraphChanged(bool portsChanged)
+    {
+        std::unique_lock<std::mutex> lock(m_GraphCallbackMutex);
+        if(m_OnGraphChanged)
+        {
+            m_OnGraphChanged(portsChanged);
+        }
+    }
+
+    void Client::SetOnBufferSizeChanged(std::function<void(jack_nframes_t nframes)> &&callback)
+    {
+        std::unique_lock<std::mutex> lock(m_BufferSizeCallbackMutex);
+        m_OnBufferSizeChanged = std::move(callback);
+    }
+
+    void Client::BufferSizeChanged(jack_nframes_t nframes)
+    {
+        std::unique_lock<std::mutex> lock(m_BufferSizeCallbackMutex);
+        if(m_OnBufferSizeChanged)
+        {
+            m_OnBufferSizeChanged(nframes);
+        }
+    }
+
+    ConnectionReconciler::ConnectionReconciler(Client &client) : m_Client(client)
+    {
+        m_Client.SetOnGraphChanged([this](bool portsChanged){
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            if(portsChanged)
+            {
+                m_PortsChanged = true;
+            }
+            m_ConnectionsChanged = true;
+            m_WakeCondition.notify_one();
+        });
+        m_Thread = threads::Spawn(threads::TClass::Background, "jack connect", [this](){
+            Run();
+        });
+    }
+
+    ConnectionReconciler::~ConnectionReconciler()
+    {
+        Stop();
+    }
+
+    void ConnectionReconciler::Stop()
+    {
+        if(m_Thread.joinable())
+        {
+            m_Client.SetOnGraphChanged({});
+            {
+                std::unique_lock<std::mutex> lock(m_Mutex);
+                m_Quit = true;
+                m_WakeCondition.notify_one();
+            }
+            m_Thread.join();
+        }
+    }
+
+    void ConnectionReconciler::SetRules(std::vector<TRule> &&rules)
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        if(rules != m_Rules)
+        {
+            m_Rules = std::move(rules);
+            m_RulesChanged = true;
+            m_WakeCondition.notify_one();
+        }
+    }
+
+    void ConnectionReconciler::Rescan()
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        m_PortsChanged = true;
+        m_WakeCondition.notify_one();
+    }
+
+    void ConnectionReconciler::Run()
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        bool satisfied = true;
+        while(true)
+        {
+            auto wakeup = [this](){
+                return m_Quit || m_RulesChanged || m_PortsChanged || m_ConnectionsChanged;
+            };
+            if(satisfied)
+            {
+                m_WakeCondition.wait(lock, wakeup);
+            }
+            else if(!m_WakeCondition.wait_for(lock, sRetryInterval, wakeup))
+            {
+                // Not every JACK server reports every new port, and jack_connect can fail temporarily. Retry with a
+                // fresh port list:
+                m_PortsChanged = true;
+            }
+            if(m_Quit) break;
+            auto rules = m_Rules;
+            bool portsChanged = m_PortsChanged;
+            bool connectionsChanged = m_ConnectionsChanged || m_RulesChanged;
+            m_RulesChanged = false;
+            m_PortsChanged = false;
+            m_ConnectionsChanged = false;
+            lock.unlock();
+            try
+            {
+                satisfied = Reconcile(rules, portsChanged, connectionsChanged);
+            }
+            catch(const std::exception& e)
+            {
+                std::cerr << "Failed to apply jack connections: " << e.what() << '\n';
+                satisfied = false;
+            }
+            lock.lock();
+        }
+    }
+
+    const std::vector<std::string>& ConnectionReconciler::MatchingPorts(const std::string &pattern)
+    {
+        auto it = m_Pattern2MatchingPorts.find(pattern);
+        if(it == m_Pattern2MatchingPorts.end())
+        {
+            auto regexit = m_Pattern2Regex.find(pattern);
+            if(regexit == m_Pattern2Regex.end())
+            {
+                regexit = m_Pattern2Regex.emplace(pattern, utils::makeSimpleRegex(pattern)).first;
+            }
+            std::vector<std::string> matchingports;
+            for(const auto &port: m_AllPorts)
+            {
+                if(std::regex_match(port, regexit->second))
+                {
+                    matchingports.push_back(port);
+                }
+            }
+            it = m_Pattern2MatchingPorts.emplace(pattern, std::move(matchingports)).first;
+        }
+        return it->second;
+    }
+
+    bool ConnectionReconciler::Reconcile(const std::vector<TRule> &rules, bool portsChanged, bool connectionsChanged)
+    {
+        auto jackclient = m_Client.get();
+        if(!jackclient) return true;
+        bool satisfied = true;
+        if(portsChanged)
+        {
+            m_AllPorts.clear();
+            m_Pattern2MatchingPorts.clear();
+            auto ports = jack_get_ports(jackclient, nullptr, nullptr, 0);
+            if(ports)
+            {
+                utils::finally fin1([&](){
+                    jack_free(ports);
+                });
+                for(size_t index = 0; ports[index]; index++)
+                {
+                    m_AllPorts.push_back(ports[index]);
+                }
+            }
+        }
+        if(portsChanged || connectionsChanged)
+        {
+            m_OwnPort2Connections.clear();
+            for(const auto &rule: rules)
+            {
+                auto &connections = m_OwnPort2Connections[rule.OwnPortName()];
+                auto port = jack_port_by_name(jackclient, rule.OwnPortName().c_str());
+                if(!port)
+                {
+                    satisfied = false;
+                    continue;
+                }
+                auto connectednames = jack_port_get_all_connections(jackclient, port);
+                if(connectednames)
+                {
+                    utils::finally fin1([&](){
+                        jack_free(connectednames);
+                    });
+                    for(size_t index = 0; connectednames[index]; index++)
+                    {
+                        connections.insert(connectednames[index]);
+                    }
+                }
+            }
+        }
+        for(const auto &rule: rules)
+        {
+            auto &connections = m_OwnPort2Connections[rule.OwnPortName()];
+            std::vector<std::string> candidates;
+            // a pattern without ports may be for a port that does not exist yet:
+            bool missingports = false;
+            for(const auto &pattern: rule.Patterns())
+            {
+                const auto &matchingports = MatchingPorts(pattern);
+                missingports = missingports || matchingports.empty();
+                for(const auto &portname: matchingports)
+                {
+                    if(std::find(candidates.begin(), candidates.end(), portname) == candidates.end())
+                    {
+                        candidates.push_back(portname);
+                    }
+                }
+            }
+            if(rule.Mode() == TMode::ConnectToAny)
+            {
+                bool connected = std::any_of(candidates.begin(), candidates.end(), [&connections](const std::string &portname){
+                    return connections.contains(portname);
+                });
+                if(connected) continue;
+            }
+            if(missingports)
+            {
+                satisfied = false;
+            }
+            bool failed = false;
+            bool connectedany = false;
+            for(const auto &portname: candidates)
+            {
+                if(connections.contains(portname)) continue;
+                int result;
+                if(rule.Direction() == PortDirection::Input)
+                {
+                    result = jack_connect(jackclient, portname.c_str(), rule.OwnPortName().c_str());
+                }
+                else
+                {
+                    result = jack_connect(jackclient, rule.OwnPortName().c_str(), portname.c_str());
+                }
+                if( (result == 0) || (result == EEXIST) )
+                {
+                    connections.insert(portname);
+                    connectedany = true;
+                    if(rule.Mode() == TMode::ConnectToAny) break;
+                }
+                else
+                {
+                    failed = true;
+                }
+            }
+            if(failed && ( (rule.Mode() == TMode::ConnectToAll) || (!connectedany) ) )
+            {
+                satisfied = false;
+            }
+        }
+        return satisfied;
+    }
+}
\ No newline at end of file
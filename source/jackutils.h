@@ -7,6 +7,9 @@
 #include <mutex>
 #include <condition_variable>
 #include <regex>
+#include <map>
+#include <set>
+#include <chrono>
 
 namespace jackutils
 {
@@ -66,6 +69,21 @@ namespace jackutils
         {
             return jack_get_buffer_size(m_Client);
         }
+        // DSP load of the whole JACK graph in percent, as measured by JACK:
+        float CpuLoad() const
+        {
+            return jack_cpu_load(m_Client);
+        }
+        uint64_t NumXruns() const
+        {
+            return m_NumXruns.load(std::memory_order_relaxed);
+        }
+        // Called from the JACK notification thread when a port is (un)registered or renamed (portsChanged == true),
+        // or when ports are (dis)connected (portsChanged == false).
+        void SetOnGraphChanged(std::function<void(bool portsChanged)> &&callback);
+        // Called from a JACK thread when the buffer size changes, before the first cycle with the new size:
+        void SetOnBufferSizeChanged(std::function<void(jack_nframes_t nframes)> &&callback);
+
     private:
         static Client*& staticptr()
         {
@@ -86,10 +104,17 @@ namespace jackutils
             m_ProcessCallback(nframes);
             return 0;
         }
+        void GraphChanged(bool portsChanged);
+        void BufferSizeChanged(jack_nframes_t nframes);
 
     private:
         jack_client_t *m_Client = nullptr;
         std::function<void(jack_nframes_t nframes)> m_ProcessCallback;
+        std::mutex m_GraphCallbackMutex;
+        std::function<void(bool portsChanged)> m_OnGraphChanged;
+        std::mutex m_BufferSizeCallbackMutex;
+        std::function<void(jack_nframes_t nframes)> m_OnBufferSizeChanged;
+        std::atomic<uint64_t> m_NumXruns {0};
     };
     class Port
     {
@@ -114,6 +139,11 @@ namespace jackutils
         {
             return m_Name;
         }
+        // including the client name
+        std::string FullName() const
+        {
+            return jack_port_name(m_Port);
+        }
         // returns true on success
         bool LinkToPortByName(const std::string &portname);
         bool LinkToAnyPortByPattern(const std::vector<std::string> &portnames);
@@ -128,4 +158,67 @@ namespace jackutils
         std::string m_Name;
         PortDirection m_Direction;
     };
+
+    // Makes the connections between our own ports and other JACK ports in a background thread.
+    // The thread sleeps until the rules change or JACK reports a change in the port graph. It keeps a cached list
+    // of ports and connections and the compiled patterns, and only calls jack_connect for missing connections.
+    // While a rule cannot be satisfied (a connection failed or a pattern matches no port) it retries every second.
+    class ConnectionReconciler
+    {
+    public:
+        enum class TMode {ConnectToAny, ConnectToAll};
+        class TRule
+        {
+        public:
+            TRule(std::string &&ownPortName, PortDirection direction, std::vector<std::string> &&patterns, TMode mode) : m_OwnPortName(std::move(ownPortName)), m_Direction(direction), m_Patterns(std::move(patterns)), m_Mode(mode)
+            {
+            }
+            const std::string& OwnPortName() const { return m_OwnPortName; }
+            PortDirection Direction() const { return m_Direction; }
+            const std::vector<std::string>& Patterns() const { return m_Patterns; }
+            TMode Mode() const { return m_Mode; }
+            bool operator==(const TRule&) const = default;
+
+        private:
+            std::string m_OwnPortName;
+            PortDirection m_Direction;
+            std::vector<std::string> m_Patterns; // wildcard patterns, see utils::makeSimpleRegex
+            TMode m_Mode;
+        };
+        ConnectionReconciler(const ConnectionReconciler&) = delete;
+        ConnectionReconciler& operator=(const ConnectionReconciler&) = delete;
+        ConnectionReconciler(ConnectionReconciler&&) = delete;
+        ConnectionReconciler& operator=(ConnectionReconciler&&) = delete;
+        ConnectionReconciler(Client &client);
+        ~ConnectionReconciler();
+        void SetRules(std::vector<TRule> &&rules);
+        // re-reads the port graph and retries all connections
+        void Rescan();
+        void Stop();
+
+    private:
+        void Run();
+        // returns false if a rule is not satisfied
+        bool Reconcile(const std::vector<TRule> &rules, bool portsChanged, bool connectionsChanged);
+        const std::vector<std::string>& MatchingPorts(const std::string &pattern);
+
+    private:
+        static constexpr std::chrono::seconds sRetryInterval {1};
+        Client &m_Client;
+        std::thread m_Thread;
+        std::mutex m_Mutex;
+        // protected by mutex:
+        std::condition_variable m_WakeCondition;
+        std::vector<TRule> m_Rules;
+        bool m_RulesChanged = false;
+        bool m_PortsChanged = true;
+        bool m_ConnectionsChanged = true;
+        bool m_Quit = false;
+
+        // only accessed by the reconciler thread:
+        std::vector<std::string> m_AllPorts;
+        std::map<std::string, std::regex> m_Pattern2Regex;
+        std::map<std::string, std::vector<std::string>> m_Pattern2MatchingPorts;
+        std::map<std::string, std::set<std::string>> m_OwnPort2Connections;
+    };
 }
\ No newline at end of file
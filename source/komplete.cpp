@@ -483,23 +483,30 @@ namespace komplete
                     header.hstride = std::byteswap((uint16_t)480);
                     header.unknown1 = std::byteswap((uint16_t)1);
                     std::copy((unsigned char*)&header, (unsigned char*)&header + sizeof(header), std::back_inserter(buf));
-                    for(const auto &vrange: regionfordisplay.VertRanges())
-                    {
+                    std::vector<utils::TIntRegion::THorizontalRange> modifiedhorzranges;
+                    regionfordisplay.ForEachVertRange([&](const utils::TIntRegion::TVerticalRange &vrange) {
                         // we can only start and end at even pixel coordinates:
                         nhAssert(vrange.Top() >= 0);
                         nhAssert(vrange.Bottom() <= sHeight);
-                        utils::TIntRegion::TVerticalRange modifiedverticalrange(vrange.Top(), vrange.Bottom());
+                        modifiedhorzranges.clear();
                         for(const auto &hrange: vrange.HorzRanges())
                         {
                             int left = hrange.Left() & (~1);
                             int right = (hrange.Right() + 1) & (~1);
                             nhAssert(left >= displayrect.Left());
                             nhAssert(right <= displayrect.Left() + sWidth / 2);
-                            modifiedverticalrange.AppendHorzRange({left, right});
+                            if( (!modifiedhorzranges.empty()) && (modifiedhorzranges.back().Right() == left) )
+                            {
+                                modifiedhorzranges.back() = {modifiedhorzranges.back().Left(), right};
+                            }
+                            else
+                            {
+                                modifiedhorzranges.push_back({left, right});
+                            }
                         }
-                        for(int y = modifiedverticalrange.Top(); y < modifiedverticalrange.Bottom(); y++)
+                        for(int y = vrange.Top(); y < vrange.Bottom(); y++)
                         {
-                            for(const auto &hrange: modifiedverticalrange.HorzRanges())
+                            for(const auto &hrange: modifiedhorzranges)
                             {
                                 size_t numwords = (size_t)(hrange.Right() - hrange.Left()) / 2;
                                 size_t startwordindex = (y * sWidth / 2 + hrange.Left() - displayrect.Left()) / 2;
@@ -520,7 +527,7 @@ namespace komplete
                                 }
                             }
                         }
-                    } // for vrange
+                    }); // for vrange
                     Footer footer;
                     std::copy((unsigned char*)&footer, (unsigned char*)&footer + sizeof(footer), std::back_inserter(buf));
                     m_LastPing = std::chrono::system_clock::now();
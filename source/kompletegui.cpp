@@ -3,6 +3,8 @@
 #include "kompletegui.h"
 #include "simplegui.h"
 #include <hidapi.h>
+#include <algorithm>
+#include "threads.h"
 
 using std::chrono_literals::operator""ms;
 
@@ -220,10 +222,10 @@ namespace komplete
         }
     }
 
-    Gui::Gui(const TDeviceParams &deviceParams, engine::Engine &engine) : m_DeviceParams(deviceParams), m_Engine(engine), m_Hid(DeviceParams().VidPid(), DeviceParams().Serial(), [this](Hid::TButtonIndex button, int delta) { OnButton(button, delta); }), m_OnProjectChanged {m_Engine.OnDataChanged(), [this](){OnDataChanged();}}, m_OnOutputLevelUpdate(m_Engine.RtProcessor().OnOutputLevelChange(), [this](){OnOutputLevelChanged();})
+    Gui::Gui(const TDeviceParams &deviceParams, engine::Engine &engine) : m_DeviceParams(deviceParams), m_Engine(engine), m_Hid(DeviceParams().VidPid(), DeviceParams().Serial(), [this](Hid::TButtonIndex button, int delta) { OnButton(button, delta); }), m_OnProjectChanged {m_Engine.OnDataChanged(), [this](){OnDataChanged();}}, m_OnOutputLevelUpdate(m_Engine.RtProcessor().OnOutputLevelChange(), [this](){OnOutputLevelChanged();}), m_OnTimingUpdate(m_Engine.OnTimingUpdate(), [this](){OnTimingUpdate();})
     {
         m_DisplayConnected = true;
-        m_GuiThread = std::thread([this]() {
+        m_GuiThread = threads::Spawn(threads::TClass::Io, "komplete gui", [this]() {
             RunGuiThread(DeviceParams().VidPid(), DeviceParams().Serial());
         });
         auto guistate = GuiState();
@@ -275,6 +277,14 @@ namespace komplete
             guistate.m_Shift = false;
             SetGuiState(std::move(guistate));
         }
+        if( (button == Hid::TButtonIndex::Setup) && (delta > 0) )
+        {
+            auto guistate = GuiState();
+            guistate.m_Mode = TGuiState::TMode::Load;
+            guistate.m_Shift = false;
+            SetGuiState(std::move(guistate));
+            OnTimingUpdate();
+        }
         if( (button == Hid::TButtonIndex::Arp) && (delta > 0) )
         {
             if(GuiState().m_FocusedPart)
@@ -589,13 +599,76 @@ namespace komplete
 
     void Gui::OnOutputLevelChanged()
     {
-        auto newoutputlevel = m_Engine.RtProcessor().OutputPeakLevelDb();
-        auto newguistate = GuiState();
-        if(newguistate.m_OutputLevel != newoutputlevel)
+        // only the overlay is updated, the gui state and the window tree stay as they are:
+        m_OutputLevel = m_Engine.RtProcessor().OutputPeakLevelDb();
+        UpdateOverlays();
+    }
+
+    void Gui::UpdateOverlays()
+    {
+        auto overlays = CreateOverlays(GuiState(), m_OutputLevel, m_OutputPeakLevel, m_Engine.RtProcessor().PartLevels());
+        if(overlays != m_Overlays)
+        {
+            m_Overlays = overlays;
+            SetOverlays(std::move(overlays));
+        }
+    }
+
+    std::vector<TOverlaySlider> Gui::CreateOverlays(const TGuiState &state, float outputLevel, float outputPeakLevel, const std::vector<realtimethread::TStereoLevel> &partLevels)
+    {
+        std::vector<TOverlaySlider> overlays;
+        if(state.m_Mode == TGuiState::TMode::Performance)
         {
-            newguistate.m_OutputLevel = newoutputlevel;
-            SetGuiState(std::move(newguistate));
+            // output level:
+            int levelmetertop = 80;
+            int levelmeterheight = 20;
+            int levelmeterleft = 0;
+            int levelmeterwidth = 200;
+            overlays.push_back(TOverlaySlider {
+                utils::TIntRect::FromTopLeftAndSize({levelmeterleft, levelmetertop}, {levelmeterwidth, levelmeterheight}),
+                engine::dbToText(outputPeakLevel),
+                engine::dbToSliderValue(outputLevel),
+                utils::TFloatColor(0.8, 0.8, 0.8)
+            });
+
+            // part levels, between the labels and the volume sliders; red when the true peak exceeds full scale:
+            auto sliderrange = state.VisiblePartVolumeSliders();
+            int numvolumesliders = sliderrange.second - sliderrange.first;
+            int metertop = 272 - 30 - 5;
+            int meterheight = 4;
+            int meterwidth = 120 - 10;
+            for(int sliderindex = 0; sliderindex < numvolumesliders; sliderindex++)
+            {
+                int rotaryindex = 8 - numvolumesliders + sliderindex;
+                size_t partindex = size_t(sliderrange.first + sliderindex);
+                float db = - std::numeric_limits<float>::infinity();
+                bool over = false;
+                if(partindex < partLevels.size())
+                {
+                    const auto &level = partLevels[partindex];
+                    db = std::max(level.RmsDb(0), level.RmsDb(1));
+                    over = std::max(level.m_TruePeak[0], level.m_TruePeak[1]) > 1.0f;
+                }
+                // in whole pixels, so the overlay only changes when the bar does:
+                double value = std::round(engine::dbToSliderValue(db) * meterwidth) / meterwidth;
+                overlays.push_back(TOverlaySlider {
+                    utils::TIntRect::FromTopLeftAndSize({rotaryindex * 120 + 5, metertop}, {meterwidth, meterheight}),
+                    "",
+                    value,
+                    over? utils::TFloatColor(1, 0, 0) : colorForPart(partindex)
+                });
+            }
         }
+        return overlays;
+    }
+
+    void Gui::OnTimingUpdate()
+    {
+        if(GuiState().m_Mode != TGuiState::TMode::Load) return;
+        auto newguistate = GuiState();
+        newguistate.m_LoadSummary = m_Engine.LoadSummary() + "  LCD " + std::to_string(m_LastLcdUpdateTimeMs.load()) + " ms, meter " + std::to_string(m_LastOverlayUpdateTimeUs.load()) + " us";
+        newguistate.m_LoadTable = m_Engine.LoadTable();
+        SetGuiState(std::move(newguistate));
     }
 
     void Gui::Run()
@@ -604,22 +677,16 @@ namespace komplete
         m_Hid.Run();
         auto now = std::chrono::steady_clock::now();
         constexpr auto peaklevelrefreshtime = std::chrono::milliseconds(500);
-        auto newguistate = GuiState();
-        bool guistatechanged = false;
         if(now >= m_LastPeakLevelUpdate + peaklevelrefreshtime)
         {
             m_LastPeakLevelUpdate = now;
             auto peaklevel = m_Engine.RtProcessor().OutputPeakLevelDb();
-            if(GuiState().m_OutputPeakLevel != peaklevel)
+            if(m_OutputPeakLevel != peaklevel)
             {
-                newguistate.m_OutputPeakLevel = peaklevel;
-                guistatechanged = true;
+                m_OutputPeakLevel = peaklevel;
+                UpdateOverlays();
             }
         }
-        if(guistatechanged)
-        {
-            SetGuiState(std::move(newguistate));
-        }
         if(m_NextScheduledLcdRefresh)
         {
             if(now >= *m_NextScheduledLcdRefresh)
@@ -633,9 +700,11 @@ namespace komplete
     void Gui::RunGuiThread(std::pair<int, int> vidPid, std::string_view serial)
     {
         Display display(vidPid, serial);
+        TLcdPainter painter;
         while(true)
         {
             std::unique_ptr<simplegui::Window> window;
+            std::optional<std::vector<TOverlaySlider>> overlays;
             {
                 std::unique_lock<std::mutex> lock(m_Mutex);
                 m_WakeGuiThreadCondition.wait_for(lock, 10ms);
@@ -645,20 +714,28 @@ namespace komplete
                     break;
                 }
                 window = std::move(m_NewWindow);
+                overlays = std::move(m_NewOverlays);
+                m_NewOverlays = std::nullopt;
             }
-            if(window)
+            if(window || overlays)
             {
                 auto starttime = std::chrono::steady_clock::now();
-                utils::TIntRegion dirtyregion;
-                window->GetUpdateRegion(m_PrevWindow.get(), dirtyregion, {0, 0}, {0, 0});
-                PaintWindow(display, *window, dirtyregion);
-                m_PrevWindow = std::move(window);
-                // display.SendPixels(0, 0, Display::sWidth, Display::sHeight);
-                dirtyregion = dirtyregion.Intersection(utils::TIntRect::FromSize({Display::sWidth, Display::sHeight}));
-                display.SendPixels(dirtyregion);
+                bool onlyoverlays = false;
+                auto dirtyregion = painter.Update(display.DisplayBuffer(), std::move(window), std::move(overlays), onlyoverlays);
+                if(!dirtyregion.empty())
+                {
+                    display.SendPixels(dirtyregion);
+                }
                 auto endtime = std::chrono::steady_clock::now();
-                [[maybe_unused]] auto elapsed = endtime - starttime;
-                // std::cout << "Painting took " << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << "ms" << std::endl;
+                auto elapsed = endtime - starttime;
+                if(onlyoverlays)
+                {
+                    m_LastOverlayUpdateTimeUs = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+                }
+                else
+                {
+                    m_LastLcdUpdateTimeMs = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+                }
                 std::this_thread::sleep_for(2ms);  // limit update rate
             }
             display.PingSometimes();
@@ -674,9 +751,75 @@ namespace komplete
         m_WakeGuiThreadCondition.notify_one();
     }
 
-    void Gui::PaintWindow(Display &display, const simplegui::Window &window, const utils::TIntRegion &dirtyregion)
+    void Gui::SetOverlays(std::vector<TOverlaySlider> &&overlays)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_NewOverlays = std::move(overlays);
+        }
+        m_WakeGuiThreadCondition.notify_one();
+    }
+
+    TLcdPainter::TLcdPainter()
+    {
+    }
+
+    TLcdPainter::~TLcdPainter()
+    {
+    }
+
+    utils::TIntRegion TLcdPainter::Update(uint16_t *pixelbuf, std::unique_ptr<simplegui::Window> &&window, std::optional<std::vector<TOverlaySlider>> &&overlays, bool &onlyoverlays)
+    {
+        // part of the window tree to repaint:
+        utils::TIntRegion dirtyregion;
+        if(window)
+        {
+            window->GetUpdateRegion(m_PrevWindow.get(), dirtyregion, {0, 0}, {0, 0});
+            m_PrevWindow = std::move(window);
+        }
+        utils::TIntRegion overlayregion;
+        if(overlays)
+        {
+            for(const auto &overlay: m_PaintedOverlays)
+            {
+                if(std::ranges::none_of(*overlays, [&](const TOverlaySlider &o){ return o.m_Rect == overlay.m_Rect; }))
+                {
+                    // the window tree shows again where an overlay has gone:
+                    dirtyregion.UnionWith(overlay.m_Rect);
+                }
+            }
+            for(const auto &overlay: *overlays)
+            {
+                if(std::ranges::find(m_PaintedOverlays, overlay) == m_PaintedOverlays.end())
+                {
+                    overlayregion.UnionWith(overlay.m_Rect);
+                }
+            }
+            m_PaintedOverlays = std::move(*overlays);
+        }
+        if( (!dirtyregion.empty()) && m_PrevWindow)
+        {
+            PaintWindow(pixelbuf, *m_PrevWindow, dirtyregion);
+        }
+        // overlays are painted on top of the tree, so also repaint those that the tree has just painted over:
+        for(const auto &overlay: m_PaintedOverlays)
+        {
+            utils::TIntRegion overlayrect(overlay.m_Rect);
+            if(overlayregion.Intersects(overlayrect) || dirtyregion.Intersects(overlayrect))
+            {
+                simplegui::TSlider slider(nullptr, overlay.m_Rect, overlay.m_Text, overlay.m_Value, overlay.m_Color);
+                PaintWindow(pixelbuf, slider, overlayrect);
+                overlayregion.UnionWith(overlayrect);
+            }
+        }
+        onlyoverlays = dirtyregion.empty();
+        dirtyregion.UnionWith(overlayregion);
+        dirtyregion.IntersectWith(utils::TIntRect::FromSize({Display::sWidth, Display::sHeight}));
+        return dirtyregion;
+    }
+
+    void TLcdPainter::PaintWindow(uint16_t *pixelbuf, const simplegui::Window &window, const utils::TIntRegion &dirtyregion)
     {
-        uint16_t* pixelbuf = display.DisplayBuffer(0, 0);
         auto surface = Cairo::ImageSurface::create((unsigned char*)pixelbuf, Cairo::Format::FORMAT_RGB16_565, Display::sWidth, Display::sHeight, Display::sDisplayBufferStride);
         auto cr = Cairo::Context::create(surface);
 
@@ -720,28 +863,18 @@ namespace komplete
             SetGuiState(std::move(newstate));
         }
     }
-    void Gui::PaintPerformanceWindow(simplegui::Window &window) const
+    void Gui::PaintPerformanceWindow(const TGuiState &state, simplegui::Window &window)
     {
-        const auto &project = GuiState().EngineData().Project();
+        const auto &project = state.EngineData().Project();
 
         int lineheight = sFontSize + 2;
-        {
-            // output level:
-            int levelmetertop = 80;
-            int levelmeterheight = 20;
-            int levelmeterleft = 0;
-            int levelmeterwidth = 200;
+        // the output level meter is an overlay, see UpdateOverlays()
 
-            auto text = engine::dbToText(GuiState().m_OutputPeakLevel);
-            auto slidervalue = engine::dbToSliderValue(GuiState().m_OutputLevel);
-            window.AddChild<simplegui::TSlider>(utils::TIntRect::FromTopLeftAndSize({levelmeterleft, levelmetertop}, {levelmeterwidth, levelmeterheight}), text, slidervalue, utils::TFloatColor(0.8, 0.8, 0.8));
-        }
-
-        if(GuiState().m_FocusedPart)
+        if(state.m_FocusedPart)
         {
-            auto focusedpartindex = GuiState().m_FocusedPart.value();
+            auto focusedpartindex = state.m_FocusedPart.value();
             auto partcolor = colorForPart(focusedpartindex);
-            auto quickPresetPage = GuiState().m_Part2QuickPresetPage.at(focusedpartindex);
+            auto quickPresetPage = state.m_Part2QuickPresetPage.at(focusedpartindex);
 
             {
                 // Pager:
@@ -796,7 +929,7 @@ namespace komplete
                     {
                         presetName = "(empty)";
                     }
-                    auto boxcolor = GuiState().m_Shift? utils::TFloatColor(0.8, 0.8, 0.8): partcolor;
+                    auto boxcolor = state.m_Shift? utils::TFloatColor(0.8, 0.8, 0.8): partcolor;
                     auto quickPresetBox = quickPresetsBar->AddChild<simplegui::PlainWindow>(utils::TIntRect::FromTopLeftAndSize({(int)quickPresetOffset * 120 + quickPresetHorzPadding, 0}, {120 - 2*quickPresetHorzPadding, quickPresetsBoxHeight}), boxcolor);
                     quickPresetBox->AddChild<simplegui::TextWindow>(utils::TIntRect::FromSize(quickPresetBox->Rectangle().Size()).SymmetricalExpand({-1}), presetName, utils::TFloatColor(0, 0, 0), sFontSize, simplegui::TextWindow::THalign::Left);
                 }
@@ -813,7 +946,7 @@ namespace komplete
             int sliderbottom = 272;
             int sliderheight = 30;
             int sliderlabeltop = sliderbottom - sliderheight - lineheight;
-            auto sliderrange = GuiState().VisiblePartVolumeSliders();
+            auto sliderrange = state.VisiblePartVolumeSliders();
             int numvolumesliders = sliderrange.second - sliderrange.first;
             
             for(int sliderindex = -1; sliderindex < numvolumesliders; sliderindex++)
@@ -846,7 +979,7 @@ namespace komplete
                 window.AddChild<simplegui::TextWindow>(utils::TIntRect::FromTopLeftAndSize({sliderleft, sliderlabeltop}, {sliderright - sliderleft, lineheight}), label, slidercolor, sFontSize, simplegui::TextWindow::THalign::Left);
 
                 window.AddChild<simplegui::TSlider>(utils::TIntRect::FromTopLeftAndSize({sliderleft, sliderbottom - sliderheight}, {sliderright - sliderleft, sliderheight}), slidertext, slidervalue, slidercolor);
-                bool isfocused = GuiState().m_TouchingRotary.at(rotaryindex);
+                bool isfocused = state.m_TouchingRotary.at(rotaryindex);
                 if(isfocused && (!hasfocusedslider))
                 {
                     hasfocusedslider = true;
@@ -866,7 +999,7 @@ namespace komplete
         }
         {
             // Active preset indicator:
-            auto partrange = GuiState().VisiblePartPresetNames();
+            auto partrange = state.VisiblePartPresetNames();
             int top = lineheight + 20;
             int fontsize = 3 * sFontSize /2;
             int presetlineheight = fontsize + 5;
@@ -878,9 +1011,9 @@ namespace komplete
                 auto partcolor = colorForPart(partindex);
                 std::string label;
                 std::optional<size_t> presetindex = part.ActivePresetIndex();
-                if(partindex == GuiState().m_FocusedPart)
+                if(partindex == state.m_FocusedPart)
                 {
-                    presetindex = GuiState().GetSelectedPresetIndex();
+                    presetindex = state.GetSelectedPresetIndex();
                 }
                 bool presetOverridden = part.ActivePresetIndex() != presetindex;
                 if(presetindex)
@@ -898,7 +1031,7 @@ namespace komplete
                 simplegui::Window *boxwindow = nullptr;
                 auto boxrect = utils::TIntRect::FromTopLeftAndSize({boxleft, top + presetlineheight * ((int)partindex - partrange.first)}, {boxwidth, presetlineheight});
                 utils::TFloatColor textcolor = partcolor;
-                if(partindex == GuiState().m_FocusedPart)
+                if(partindex == state.m_FocusedPart)
                 {
                     auto outerwindow = window.AddChild<simplegui::PlainWindow>(boxrect, partcolor);
                     if(presetOverridden)
@@ -919,10 +1052,10 @@ namespace komplete
             }
         }
 
-        if( (GuiState().m_TouchingRotary[8]) && (!project.Presets().empty()) )
+        if( (state.m_TouchingRotary[8]) && (!project.Presets().empty()) )
         {
             // Big preset popup selector:
-            window.AddChild<simplegui::TListBox>(utils::TIntRect::FromTopLeftAndSize({490, 272/2 - 100}, {400, 272/2+100}), utils::TFloatColor(1,1,1), 25, project.Presets().size(), GuiState().GetSelectedPresetIndex(), GuiState().GetSelectedPresetIndex().value_or(0), [this, &project](size_t index) -> std::string {
+            window.AddChild<simplegui::TListBox>(utils::TIntRect::FromTopLeftAndSize({490, 272/2 - 100}, {400, 272/2+100}), utils::TFloatColor(1,1,1), 25, project.Presets().size(), state.GetSelectedPresetIndex(), state.GetSelectedPresetIndex().value_or(0), [&project](size_t index) -> std::string {
                 auto result = std::to_string(index) + ": ";
                 if(index < project.Presets().size())
                 {
@@ -936,21 +1069,21 @@ namespace komplete
             });
         }
     }
-    void Gui::PaintMidiWindow(simplegui::Window &window) const
+    void Gui::PaintMidiWindow(const TGuiState &state, simplegui::Window &window)
     {
         int lineheight = sFontSize + 2;
-        const auto &project = GuiState().EngineData().Project();
+        const auto &project = state.EngineData().Project();
         int presetboxheight = 2*lineheight + sLineSpacing + 2;
         auto presetnamebox = window.AddChild<simplegui::PlainWindow>(utils::TIntRect::FromTopLeftAndSize({0, 272-presetboxheight}, {120, presetboxheight}), utils::TFloatColor(0.2, 0.2, 0.2));
 
         presetnamebox->AddChild<simplegui::TextWindow>(utils::TIntRect::FromTopLeftAndSize({1, 1}, {presetnamebox->Rectangle().Width() - 2, lineheight}), "Program", utils::TFloatColor(1, 1, 1), sFontSize, simplegui::TextWindow::THalign::Left);
 
-        presetnamebox->AddChild<simplegui::TextWindow>(utils::TIntRect::FromTopLeftAndSize({1, 1 + lineheight + sLineSpacing}, {presetnamebox->Rectangle().Width() - 2, lineheight}), std::to_string(GuiState().m_ProgramChange), utils::TFloatColor(1, 1, 1), sFontSize, simplegui::TextWindow::THalign::Left);            
+        presetnamebox->AddChild<simplegui::TextWindow>(utils::TIntRect::FromTopLeftAndSize({1, 1 + lineheight + sLineSpacing}, {presetnamebox->Rectangle().Width() - 2, lineheight}), std::to_string(state.m_ProgramChange), utils::TFloatColor(1, 1, 1), sFontSize, simplegui::TextWindow::THalign::Left);            
     }
-    void Gui::PaintHammondControllerWindow(simplegui::Window &window, size_t part) const
+    void Gui::PaintHammondControllerWindow(const TGuiState &state, simplegui::Window &window, size_t part)
     {
         int lineheight = sFontSize + 2;
-        const auto &hammonddata = GuiState().EngineData().HammondData();
+        const auto &hammonddata = state.EngineData().HammondData();
         const auto &hammondpart = hammonddata.Part(part);
         int drawbartop = 50;
         int drawbarbottom = 250;
@@ -988,20 +1121,20 @@ namespace komplete
             }
         }
     }
-    void Gui::PaintControllerWindow(simplegui::Window &window) const
+    void Gui::PaintControllerWindow(const TGuiState &state, simplegui::Window &window)
     {
-        auto partOrNull = GuiState().ActivePartIsHammond();
+        auto partOrNull = state.ActivePartIsHammond();
         if(partOrNull)
         {
-            PaintHammondControllerWindow(window, *partOrNull);            
+            PaintHammondControllerWindow(state, window, *partOrNull);            
         }
         else
         {
-            if(GuiState().m_FocusedPart)
+            if(state.m_FocusedPart)
             {
-                auto partcolor = colorForPart(GuiState().m_FocusedPart.value());
-                auto parameters = GuiState().EngineData().Project().ParametersForPart(*GuiState().m_FocusedPart);
-                const auto &controllervalues = GuiState().EngineData().Part2ControllerValues().at(*GuiState().m_FocusedPart);
+                auto partcolor = colorForPart(state.m_FocusedPart.value());
+                auto parameters = state.EngineData().Project().ParametersForPart(*state.m_FocusedPart);
+                const auto &controllervalues = state.EngineData().Part2ControllerValues().at(*state.m_FocusedPart);
                 auto numcontrollers = std::min({controllervalues.size(), parameters.size(), (size_t)8});
                 int lineheight = sFontSize + 2;
                 int sliderbottom = 272;
@@ -1024,27 +1157,56 @@ namespace komplete
             }
         }
     }
+    void Gui::PaintLoadWindow(const TGuiState &state, simplegui::Window &window)
+    {
+        int lineheight = sFontSize + 2;
+        utils::TFloatColor white(1, 1, 1);
+        utils::TFloatColor grey(0.6, 0.6, 0.6);
+        window.AddChild<simplegui::TextWindow>(utils::TIntRect::FromTopLeftAndSize({0, 0}, {Display::sWidth, lineheight}), state.m_LoadSummary, white, sFontSize, simplegui::TextWindow::THalign::Left);
+        std::array<std::string, 4> header {"", "avg", "p99", "max"};
+        std::array<int, 5> columnedges {0, 480, 600, 720, 840};
+        int top = lineheight + sLineSpacing;
+        auto paintrow = [&](const std::array<std::string, 4> &row, const utils::TFloatColor &color) {
+            for(size_t column = 0; column < 4; column++)
+            {
+                int right = (column + 1 < 4)? columnedges[column + 1] : Display::sWidth;
+                window.AddChild<simplegui::TextWindow>(utils::TIntRect::FromTopLeftAndSize({columnedges[column], top}, {right - columnedges[column] - 5, lineheight}), row[column], color, sFontSize, column == 0? simplegui::TextWindow::THalign::Left : simplegui::TextWindow::THalign::Right);
+            }
+            top += lineheight;
+        };
+        paintrow(header, grey);
+        for(const auto &row: state.m_LoadTable)
+        {
+            if(top + lineheight > Display::sHeight) break;
+            paintrow(row, white);
+        }
+    }
     void Gui::RefreshLcd()
     {
         m_NextScheduledLcdRefresh = GuiState().NextScreenUpdateNeeded();
+        SetWindow(CreateWindow(GuiState()));
+        UpdateOverlays();
+    }
+    std::unique_ptr<simplegui::Window> Gui::CreateWindow(const TGuiState &state)
+    {
         auto mainwindow = std::make_unique<simplegui::PlainWindow>(nullptr, utils::TIntRect::FromTopLeftAndSize({0, 0}, {Display::sWidth, Display::sWidth}), utils::TFloatColor::Black());
-        int lineheight = sFontSize + 2;
-
-        const auto &project = GuiState().EngineData().Project();
-
-        if(GuiState().m_Mode == TGuiState::TMode::Performance)
+        if(state.m_Mode == TGuiState::TMode::Performance)
         {
-            PaintPerformanceWindow(*mainwindow);
+            PaintPerformanceWindow(state, *mainwindow);
         }
-        else if(GuiState().m_Mode == TGuiState::TMode::Midi)
+        else if(state.m_Mode == TGuiState::TMode::Midi)
         {
-            PaintMidiWindow(*mainwindow);
+            PaintMidiWindow(state, *mainwindow);
         }
-        if(GuiState().m_Mode == TGuiState::TMode::Controller)
+        if(state.m_Mode == TGuiState::TMode::Controller)
+        {
+            PaintControllerWindow(state, *mainwindow);
+        }
+        else if(state.m_Mode == TGuiState::TMode::Load)
         {
-            PaintControllerWindow(*mainwindow);
+            PaintLoadWindow(state, *mainwindow);
         }
-        SetWindow(std::move(mainwindow));
+        return mainwindow;
     }
     void Gui::RefreshLeds()
     {
@@ -1055,6 +1217,7 @@ namespace komplete
         m_Hid.SetLed(Hid::TButtonIndex::Browser, GuiState().m_Mode == TGuiState::TMode::Performance? 4:2);
         m_Hid.SetLed(Hid::TButtonIndex::Arp, GuiState().EngineData().ShowUi()? 4:2);
         m_Hid.SetLed(Hid::TButtonIndex::Plugin, GuiState().m_Mode == TGuiState::TMode::Controller? 4:2);
+        m_Hid.SetLed(Hid::TButtonIndex::Setup, GuiState().m_Mode == TGuiState::TMode::Load? 4:2);
 
         if( (GuiState().m_Mode == TGuiState::TMode::Performance) && (GuiState().m_FocusedPart) )
         {
@@ -1068,7 +1231,7 @@ namespace komplete
             m_Hid.SetLed(Hid::TButtonIndex::Right, 0);
         }
 
-        if(GuiState().m_Mode == TGuiState::TMode::Midi)
+        if( (GuiState().m_Mode == TGuiState::TMode::Midi) || (GuiState().m_Mode == TGuiState::TMode::Load) )
         {
             for(size_t btnIndex = 0; btnIndex < 8; btnIndex++)
             {
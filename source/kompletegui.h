@@ -5,6 +5,7 @@
 #include "utils.h"
 #include <thread>
 #include <mutex>
+#include <atomic>
 
 namespace simplegui
 {
@@ -18,7 +19,7 @@ namespace komplete
     {
     public:
         static constexpr auto sDiscardSelectedPresetIndexAfter = std::chrono::seconds(10);
-        enum class TMode {Performance, Midi, Controller};
+        enum class TMode {Performance, Midi, Controller, Load};
 
         std::optional<size_t> m_FocusedPart;
         bool m_Shift = false;
@@ -33,8 +34,6 @@ namespace komplete
         bool m_ShowPresetList = false;
         //size_t m_QuickPresetPage = 0;
         std::vector<size_t> m_Part2QuickPresetPage;
-        float m_OutputLevel = - std::numeric_limits<float>::infinity();
-        float m_OutputPeakLevel = - std::numeric_limits<float>::infinity();
 
         std::pair<int, int> VisiblePartVolumeSliders() const
         {
@@ -49,6 +48,10 @@ namespace komplete
         // Midi mode:
         int m_ProgramChange = 0;
 
+        // Load mode:
+        std::string m_LoadSummary;
+        std::vector<std::array<std::string, 4>> m_LoadTable;
+
         const engine::Engine::TData &EngineData() const
         {
             return m_EngineData;
@@ -74,6 +77,40 @@ namespace komplete
 
     };
 
+    // A slider that is painted on top of the window tree, for widgets that change at a high rate (the output level
+    // meter). It owns its rectangle of the LCD: when only overlays change, the gui thread repaints just their
+    // rectangles, without rebuilding the window tree or copying the engine data into the gui state.
+    class TOverlaySlider
+    {
+    public:
+        utils::TIntRect m_Rect;
+        std::string m_Text;
+        double m_Value = 0.0;
+        utils::TFloatColor m_Color;
+        bool operator==(const TOverlaySlider &other) const = default;
+    };
+
+    // The part of the gui thread that does not need the device: paints a new window tree and/or new overlays into a
+    // buffer with the layout of Display::DisplayBuffer() and returns the region that changed, to be sent to the display.
+    class TLcdPainter
+    {
+    public:
+        TLcdPainter(const TLcdPainter&) = delete;
+        TLcdPainter& operator=(const TLcdPainter&) = delete;
+        TLcdPainter(TLcdPainter&&) = delete;
+        TLcdPainter& operator=(TLcdPainter&&) = delete;
+        TLcdPainter();
+        ~TLcdPainter();
+        // window and overlays may be empty if they did not change. onlyoverlays is set if the window tree was not repainted.
+        utils::TIntRegion Update(uint16_t *pixelbuf, std::unique_ptr<simplegui::Window> &&window, std::optional<std::vector<TOverlaySlider>> &&overlays, bool &onlyoverlays);
+        static void PaintWindow(uint16_t *pixelbuf, const simplegui::Window &window, const utils::TIntRegion &dirtyregion);
+
+    private:
+        std::unique_ptr<simplegui::Window> m_PrevWindow;
+        // overlays currently on the display:
+        std::vector<TOverlaySlider> m_PaintedOverlays;
+    };
+
     class TDeviceParams
     {
     public:
@@ -99,20 +136,26 @@ namespace komplete
         void SetGuiState(TGuiState &&state);
         bool Connected() const;
         const TDeviceParams DeviceParams() const {return m_DeviceParams;}
+        // the window tree and the overlays for a gui state, without a device (used by jnlive_bench):
+        static std::unique_ptr<simplegui::Window> CreateWindow(const TGuiState &state);
+        static std::vector<TOverlaySlider> CreateOverlays(const TGuiState &state, float outputLevel, float outputPeakLevel, const std::vector<realtimethread::TStereoLevel> &partLevels);
 
     private:
         void SetWindow(std::unique_ptr<simplegui::Window> window);
-        void PaintWindow(Display &display, const simplegui::Window &window, const utils::TIntRegion &dirtyregion);
+        void SetOverlays(std::vector<TOverlaySlider> &&overlays);
+        void UpdateOverlays();
         void RunGuiThread(std::pair<int, int> vidPid, std::string_view serial);
         void OnButton(Hid::TButtonIndex button, int delta);
         void OnDataChanged();
         void RefreshLcd();
         void RefreshLeds();
-        void PaintPerformanceWindow(simplegui::Window &window) const;
-        void PaintMidiWindow(simplegui::Window &window) const;
-        void PaintControllerWindow(simplegui::Window &window) const;
-        void PaintHammondControllerWindow(simplegui::Window &window, size_t part) const;
+        static void PaintPerformanceWindow(const TGuiState &state, simplegui::Window &window);
+        static void PaintMidiWindow(const TGuiState &state, simplegui::Window &window);
+        static void PaintControllerWindow(const TGuiState &state, simplegui::Window &window);
+        static void PaintHammondControllerWindow(const TGuiState &state, simplegui::Window &window, size_t part);
+        static void PaintLoadWindow(const TGuiState &state, simplegui::Window &window);
         void OnOutputLevelChanged();
+        void OnTimingUpdate();
 
     private:
         TDeviceParams m_DeviceParams;
@@ -124,7 +167,7 @@ namespace komplete
         bool m_DisplayConnected = false;
         std::condition_variable m_WakeGuiThreadCondition;
         std::unique_ptr<simplegui::Window> m_NewWindow;
-        std::unique_ptr<simplegui::Window> m_PrevWindow;
+        std::optional<std::vector<TOverlaySlider>> m_NewOverlays;
         bool m_AbortRequested = false;
 
         engine::Engine &m_Engine;
@@ -132,6 +175,15 @@ namespace komplete
         TGuiState m_GuiState1;
         bool m_GuiStateNoRecurse = false;
         utils::NotifySink m_OnOutputLevelUpdate;
+        utils::NotifySink m_OnTimingUpdate;
+        // time it took to paint and send the last LCD update, written by the gui thread:
+        std::atomic<int64_t> m_LastLcdUpdateTimeMs {0};
+        // same for the last update in which only overlays changed:
+        std::atomic<int64_t> m_LastOverlayUpdateTimeUs {0};
+        // last overlays passed to SetOverlays():
+        std::vector<TOverlaySlider> m_Overlays;
+        float m_OutputLevel = - std::numeric_limits<float>::infinity();
+        float m_OutputPeakLevel = - std::numeric_limits<float>::infinity();
 
         utils::THysteresis m_SelectedPresetHysteresis {10, 20};
         utils::THysteresis m_ProgramChangeHysteresis {10, 20};
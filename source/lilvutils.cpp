@@ -12,6 +12,9 @@
 #include "lv2_external_ui.h"
 #include <iostream>
 #include <cstring>
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
 
 import midi;
 
@@ -27,19 +30,26 @@ namespace
         return LV2UI_INVALID_PORT_INDEX;
     }
 
-/*
     uint32_t SuilPortSubscribe(SuilController controller, uint32_t port_index, uint32_t protocol, const LV2_Feature *const *features)
     {
-        return 0;
-
+        auto ui = (lilvutils::UI *)(controller);
+        if(ui)
+        {
+            return ui->PortSubscribe(port_index, protocol, true);
+        }
+        return 1;
     }
 
     uint32_t SuilPortUnsubscribe(SuilController controller, uint32_t port_index, uint32_t protocol, const LV2_Feature *const *features)
     {
-        return 0;
-
+        auto ui = (lilvutils::UI *)(controller);
+        if(ui)
+        {
+            return ui->PortSubscribe(port_index, protocol, false);
+        }
+        return 1;
     }
-*/
+
     void SuilPortWrite(SuilController controller, uint32_t port_index, uint32_t buffer_size, uint32_t protocol, void const *buffer)
     {
         auto ui = (lilvutils::UI *)(controller);
@@ -204,10 +214,16 @@ namespace
         }
         return result;
     }
+
+    // every audio buffer starts on a cache line, so in a slab (64 byte aligned) all are aligned for SIMD:
+    size_t AudioBufferStride(uint32_t length)
+    {
+        return ((size_t)length + 15) & ~(size_t)15;
+    }
 }
 namespace lilvutils
 {
-    World::World(uint32_t sample_rate, uint32_t maxBlockSize, int argc, char** argv) : m_OptionSampleRate((float)sample_rate), m_OptionMaxBlockLength(maxBlockSize)
+    World::World(uint32_t sample_rate, uint32_t maxBlockSize, int argc, char** argv, std::string &&pluginIndexFile) : m_OptionSampleRate((float)sample_rate), m_OptionMaxBlockLength(maxBlockSize), m_PluginIndex(std::move(pluginIndexFile))
     {
         if(staticptr())
         {
@@ -225,8 +241,7 @@ namespace lilvutils
             }
         });
         suil_init(&argc, &argv, SUIL_ARG_NONE);
-        // auto suilhost = suil_host_new(&SuilPortWrite, &SuilPortIndex, &SuilPortSubscribe, &SuilPortUnsubscribe);
-        auto suilhost = suil_host_new(&SuilPortWrite, &SuilPortIndex, nullptr, nullptr);
+        auto suilhost = suil_host_new(&SuilPortWrite, &SuilPortIndex, &SuilPortSubscribe, &SuilPortUnsubscribe);
         utils::finally fin2([&](){
             if(suilhost)
             {
@@ -234,7 +249,11 @@ namespace lilvutils
             }
         });
 
-        lilv_world_load_all(world);
+        // Bundles are loaded on demand by LoadPluginBundle(). Only the first run needs a full scan to build the index:
+        if(m_PluginIndex.Empty())
+        {
+            m_PluginIndex.RescanSync();
+        }
         auto plugins = lilv_world_get_all_plugins(world); // result must not be freed
         if(!plugins)
         {
@@ -254,7 +273,7 @@ namespace lilvutils
         m_UridUnmap.handle = this;
         m_UridUnmap.unmap = [](LV2_URID_Unmap_Handle handle, LV2_URID urid) -> const char* {
             auto world = (World*)handle;
-            return world->UriMapReverseLookup(urid).c_str();
+            return world->UriMapReverseLookup(urid);
         };
 
         m_MapFeature.data = &m_UridMap;
@@ -330,7 +349,6 @@ namespace lilvutils
         m_ThreadSafeRestoreFeature.data = nullptr;
         m_Features.push_back(&m_ThreadSafeRestoreFeature);
         lv2_atom_forge_init(&m_AtomForge, &m_UridMap);  
-        m_PluginList = BuildPluginList(world);      
         m_World = world;
         m_Plugins = plugins;
         m_SuilHost = suilhost;
@@ -339,57 +357,82 @@ namespace lilvutils
         suilhost = nullptr;
         staticptr() = this;
     }
-    TPluginList World::BuildPluginList(const LilvWorld* world)
+    void World::LoadBundle(const std::string &path)
     {
-        //const LilvPluginClasses *lilvpluginclasses = lilv_world_get_plugin_classes(world); // Returned list is owned by world and must not be freed by the caller
-        std::map<const LilvPluginClass*, size_t> class2Index;
-        std::vector<TPluginList::TClass> classes;
-        auto addpluginclass = [&](const LilvPluginClass *lilvpluginclass){
-            std::string uri = lilv_node_as_uri(lilv_plugin_class_get_uri(lilvpluginclass));
-            std::string label = lilv_node_as_string(lilv_plugin_class_get_label(lilvpluginclass));
-            class2Index.emplace(lilvpluginclass, classes.size());
-            classes.emplace_back(std::move(uri), std::move(label));
-        };
-/*
-        LILV_FOREACH(plugin_classes, i, lilvpluginclasses)
+        if(!m_LoadedBundles.insert(path).second)
+        {
+            return;
+        }
+        auto bundlenode = lilv_new_file_uri(m_World, nullptr, (path + "/").c_str());
+        if(bundlenode)
+        {
+            utils::finally fin1([&](){
+                lilv_node_free(bundlenode);
+            });
+            lilv_world_load_bundle(m_World, bundlenode);
+        }
+    }
+    void World::LoadSpecifications()
+    {
+        if(m_LoadedSpecifications)
         {
-            auto lilvpluginclass = lilv_plugin_classes_get(lilvpluginclasses, i);
-            if(lilvpluginclass)
+            return;
+        }
+        m_LoadedSpecifications = true;
+        for(const auto &path: m_PluginIndex.SpecificationBundles())
+        {
+            LoadBundle(path);
+        }
+        // lilv_world_load_bundle() only reads the manifest of a specification, the data files are loaded explicitly
+        // (as lilv_world_load_all() does):
+        Uri rdftype("http://www.w3.org/1999/02/22-rdf-syntax-ns#type");
+        Uri specificationclass("http://lv2plug.in/ns/lv2core#Specification");
+        auto specs = lilv_world_find_nodes(m_World, nullptr, rdftype.get(), specificationclass.get());
+        if(specs)
+        {
+            utils::finally fin1([&](){
+                lilv_nodes_free(specs);
+            });
+            LILV_FOREACH(nodes, i, specs)
             {
-                std::string uri = lilv_node_as_uri(lilv_plugin_class_get_uri(lilvpluginclass));
-                std::string label = lilv_node_as_string(lilv_plugin_class_get_label(lilvpluginclass));
-                class2Index.emplace(lilvpluginclass, classes.size());
-                classes.emplace_back(std::move(uri), std::move(label));
+                lilv_world_load_resource(m_World, lilv_nodes_get(specs, i));
             }
         }
-    
-    */
-        auto lilvplugis = lilv_world_get_all_plugins(world); // Returned list is owned by world and must not be freed by the caller
-        std::vector<TPluginList::TPlugin> plugins;
-        LILV_FOREACH(plugins, i, lilvplugis)
+    }
+    void World::LoadPluginBundle(const std::string &uri)
+    {
+        if(m_LoadedAll)
         {
-            auto plugin = lilv_plugins_get(lilvplugis, i);
-            if(plugin)
+            return;
+        }
+        Uri urinode {std::string(uri)};
+        if(lilv_plugins_get_by_uri(m_Plugins, urinode.get()))
+        {
+            return;
+        }
+        auto bundles = m_PluginIndex.BundlesForPlugin(uri);
+        if(!bundles.empty())
+        {
+            LoadSpecifications();
+            for(const auto &bundle: bundles)
             {
-                auto lilvpluginclass = lilv_plugin_get_class(plugin);
-                auto it = class2Index.find(lilvpluginclass);
-                if(it == class2Index.end())
-                {
-                    addpluginclass(lilvpluginclass);
-                }
-                auto classindex = class2Index.at(lilvpluginclass);
-                std::string uri = lilv_node_as_uri(lilv_plugin_get_uri(plugin));
-                std::string label = lilv_node_as_string(lilv_plugin_get_name(plugin));
-                plugins.emplace_back(std::move(label), std::move(uri), classindex);
+                LoadBundle(bundle);
+            }
+            if(lilv_plugins_get_by_uri(m_Plugins, urinode.get()))
+            {
+                return;
             }
         }
-        return TPluginList(std::move(classes), std::move(plugins));
+        // not in the index (installed after the last scan?), or the index is stale:
+        lilv_world_load_all(m_World);
+        m_LoadedAll = true;
     }
 
     Plugin::Plugin(const Uri &uri) : m_Uri(uri.str())
     {
         auto lilvworld = World::Static().get();
         auto plugins = World::Static().Plugins();
+        World::Static().LoadPluginBundle(m_Uri);
         auto urinode = uri.get();
         m_Plugin = lilv_plugins_get_by_uri(plugins, urinode); // return value must not be freed
         if(!m_Plugin)
@@ -502,8 +545,32 @@ namespace lilvutils
         }
     }
 
+    void TConnection<TAudioPort>::SetBuffer(float *buffer)
+    {
+        m_Buffer = buffer;
+        m_ConnectedBuffer = buffer;
+        lilv_instance_connect_port(m_Instance.get(), (uint32_t)m_Port.Index(), buffer);
+    }
+
+    void TConnection<TCvPort>::SetBuffer(float *buffer)
+    {
+        m_Buffer = buffer;
+        lilv_instance_connect_port(m_Instance.get(), (uint32_t)m_Port.Index(), buffer);
+    }
+
+    void TConnection<TAudioPort>::ConnectTo(const float *buffer)
+    {
+        if(!buffer) buffer = m_Buffer;
+        if(buffer != m_ConnectedBuffer)
+        {
+            // connect_port is realtime safe. Inputs are not written by the plugin, so the buffer of the source can be shared:
+            lilv_instance_connect_port(m_Instance.get(), (uint32_t)m_Port.Index(), const_cast<float*>(buffer));
+            m_ConnectedBuffer = buffer;
+        }
+    }
+
 
-    Instance::Instance(const Plugin &plugin, double sample_rate, const RealtimeThreadInterface &realtimeThreadInterface, TMidiCallback &&midiCallback) : m_Plugin(plugin), m_RealtimeThreadInterface(realtimeThreadInterface), m_MidiCallback(std::move(midiCallback))
+    Instance::Instance(const Plugin &plugin, double sample_rate, const RealtimeThreadInterface &realtimeThreadInterface, TMidiCallback &&midiCallback) : m_Plugin(plugin), m_Logger(std::string(plugin.Name())), m_RealtimeThreadInterface(realtimeThreadInterface), m_MidiCallback(std::move(midiCallback))
     {
         if(!plugin.CanInstantiate())
         {
@@ -540,7 +607,27 @@ namespace lilvutils
         {
             throw std::runtime_error("could not instantiate plugin");
         }
-        auto audiobufsize = World::Static().MaxBlockLength();
+        m_AudioBufferLength = World::Static().AudioBufferLength();
+        auto audiobufstride = AudioBufferStride(m_AudioBufferLength);
+        size_t numAudioPorts = 0;
+        size_t numOutputControlPorts = 0;
+        for(const auto &port: m_Plugin.Ports())
+        {
+            if(dynamic_cast<const TAudioPort*>(port.get()) || dynamic_cast<const TCvPort*>(port.get()))
+            {
+                numAudioPorts++;
+            }
+            else if(dynamic_cast<const TControlPort*>(port.get()) && (port->Direction() == TPortBase::TDirection::Output))
+            {
+                numOutputControlPorts++;
+            }
+        }
+        m_AudioBuffers.assign(numAudioPorts * audiobufstride, 0.0f);
+        size_t audiobufindex = 0;
+        m_OutputControlValues.assign((numOutputControlPorts + 3) & ~(size_t)3, 0.0f);
+        m_OutputControlLastValues.assign(m_OutputControlValues.size(), 0.0f);
+        m_OutputControlChanges.resize(numOutputControlPorts);
+        m_OutputControlScanInterval = (uint32_t)(sample_rate / std::max(1.0f, World::Static().UiUpdateRate()));
         for(size_t portindex = 0; portindex < m_Plugin.Ports().size(); portindex++)
         {
             const auto *port = m_Plugin.Ports()[portindex].get();
@@ -549,13 +636,13 @@ namespace lilvutils
             {
                 if(auto audioport = dynamic_cast<const TAudioPort*>(port); audioport)
                 {
-                    auto audioconnection = std::make_unique<TConnection<TAudioPort>>(*this, *audioport, audiobufsize);
+                    auto audioconnection = std::make_unique<TConnection<TAudioPort>>(*this, *audioport, m_AudioBuffers.data() + audiobufstride * audiobufindex++);
                     lilv_instance_connect_port(m_Instance, (uint32_t)portindex, audioconnection->Buffer());
                     connection = std::move(audioconnection);
                 }
                 else if(auto cvport = dynamic_cast<const TCvPort*>(port); cvport)
                 {
-                    auto audioconnection = std::make_unique<TConnection<TCvPort>>(*this, *cvport, audiobufsize);
+                    auto audioconnection = std::make_unique<TConnection<TCvPort>>(*this, *cvport, m_AudioBuffers.data() + audiobufstride * audiobufindex++);
                     lilv_instance_connect_port(m_Instance, (uint32_t)portindex, audioconnection->Buffer());
                     connection = std::move(audioconnection);
                 }
@@ -568,11 +655,26 @@ namespace lilvutils
                     lv2_evbuf_reset(atomconnection->Buffer(), atomport->Direction() == TAtomPort::TDirection::Input);
                     auto actualbuf = lv2_evbuf_get_buffer(atomconnection->Buffer());
                     lilv_instance_connect_port(m_Instance, (uint32_t)portindex, actualbuf);
+                    if(atomport->Direction() == TPortBase::TDirection::Output)
+                    {
+                        m_OutputAtomConnections.push_back(atomconnection.get());
+                    }
                     connection = std::move(atomconnection);
                 }
                 else if(auto controlport = dynamic_cast<const TControlPort*>(port); controlport)
                 {
-                    auto controlconnection = std::make_unique<TConnection<TControlPort>>(*this, *controlport, controlport->DefaultValue());
+                    std::unique_ptr<TConnection<TControlPort>> controlconnection;
+                    if(controlport->Direction() == TPortBase::TDirection::Output)
+                    {
+                        auto index = m_OutputControlConnections.size();
+                        controlconnection = std::make_unique<TConnection<TControlPort>>(*this, *controlport, controlport->DefaultValue(), &m_OutputControlValues[index]);
+                        m_OutputControlLastValues[index] = controlport->DefaultValue();
+                        m_OutputControlConnections.push_back(controlconnection.get());
+                    }
+                    else
+                    {
+                        controlconnection = std::make_unique<TConnection<TControlPort>>(*this, *controlport, controlport->DefaultValue());
+                    }
                     lilv_instance_connect_port(m_Instance, (uint32_t)portindex, controlconnection->Buffer());
                     connection = std::move(controlconnection);
                 }
@@ -583,12 +685,13 @@ namespace lilvutils
             }
             m_Connections.push_back(std::move(connection));
         }
+        UpdateOutputAtomForwarding();
         if (needsWorker)
         {
             auto worker_iface = (const LV2_Worker_Interface*)lilv_instance_get_extension_data(m_Instance, LV2_WORKER__interface);
             m_ScheduleWorker->Start(worker_iface);
         }
-        lilv_instance_activate(m_Instance);
+        SetActivated(true);
     }
     Instance::~Instance()
     {
@@ -599,7 +702,7 @@ namespace lilvutils
         }
         if(m_Instance)
         {
-            lilv_instance_deactivate(m_Instance);
+            SetActivated(false);
             lilv_instance_free(m_Instance);
         }
     }
@@ -651,6 +754,8 @@ namespace lilvutils
                 {
                     throw std::runtime_error("unsupported type");
                 }
+                // this may run in a preset loader thread; the UI is notified by ApplyRestoredControlValues():
+                m_RestoredControlValues.emplace_back(controlconnection, fvalue);
                 realtimeThreadInterface().SendControlValueFunc(controlconnection, fvalue);
                 return;
             }
@@ -679,9 +784,39 @@ namespace lilvutils
             self->SetPortValueBySymbol(port_symbol, value, size, type);
         };
         uint32_t flags = 0;
+        m_RestoredControlValues.clear();
         lilv_state_restore(state, m_Instance, set_port_value, this, flags, m_StateRestoreFeatures.data());
     }
 
+    void Instance::ApplyRestoredControlValues()
+    {
+        for(const auto &[connection, value]: m_RestoredControlValues)
+        {
+            connection->SetValueInMainThread(value, true);
+        }
+        m_RestoredControlValues.clear();
+    }
+
+    void Instance::SetAudioBufferLength(uint32_t length)
+    {
+        auto stride = AudioBufferStride(length);
+        rtarena::TVector<float> buffers(m_AudioBuffers.size() / AudioBufferStride(m_AudioBufferLength) * stride, 0.0f);
+        size_t bufindex = 0;
+        for(const auto &connection: m_Connections)
+        {
+            if(auto audioconnection = dynamic_cast<TConnection<TAudioPort>*>(connection.get()); audioconnection)
+            {
+                audioconnection->SetBuffer(buffers.data() + stride * bufindex++);
+            }
+            else if(auto cvconnection = dynamic_cast<TConnection<TCvPort>*>(connection.get()); cvconnection)
+            {
+                cvconnection->SetBuffer(buffers.data() + stride * bufindex++);
+            }
+        }
+        m_AudioBuffers = std::move(buffers);
+        m_AudioBufferLength = length;
+    }
+
     void Instance::SaveState(const std::string &dir)
     {
         // generate a random tempdir in the system temporary dir:
@@ -720,6 +855,95 @@ namespace lilvutils
         }
     }
 
+    std::span<const TOutputControlChange> Instance::ScanOutputControlPorts(uint32_t nframes)
+    {
+        m_FramesSinceOutputControlScan += nframes;
+        if( (m_FramesSinceOutputControlScan < m_OutputControlScanInterval) || (!m_UiOpen.load(std::memory_order_relaxed)) )
+        {
+            // the last returned values are kept, so changes in between are reported at the next scan:
+            return {};
+        }
+        m_FramesSinceOutputControlScan = 0;
+        size_t numchanges = 0;
+        const float *values = m_OutputControlValues.data();
+        float *lastvalues = m_OutputControlLastValues.data();
+        for(size_t i = 0; i < m_OutputControlValues.size(); i += 4)
+        {
+#ifdef __SSE2__
+            auto v = _mm_loadu_ps(values + i);
+            auto last = _mm_loadu_ps(lastvalues + i);
+            auto mask = _mm_movemask_ps(_mm_cmpneq_ps(v, last));
+            if(mask == 0) continue;
+            _mm_storeu_ps(lastvalues + i, v);
+#else
+            int mask = 0;
+            for(size_t j = 0; j < 4; j++)
+            {
+                if(values[i + j] != lastvalues[i + j])
+                {
+                    mask |= 1 << j;
+                    lastvalues[i + j] = values[i + j];
+                }
+            }
+            if(mask == 0) continue;
+#endif
+            for(size_t j = 0; j < 4; j++)
+            {
+                // the padding never changes, so the index is always that of a real port:
+                if(mask & (1 << j))
+                {
+                    m_OutputControlChanges[numchanges++] = TOutputControlChange {(uint32_t)(i + j), values[i + j]};
+                }
+            }
+        }
+        return std::span<const TOutputControlChange>(m_OutputControlChanges.data(), numchanges);
+    }
+
+    void Instance::OnOutputControlsChanged(std::span<const TOutputControlChange> changes)
+    {
+        for(const auto &change: changes)
+        {
+            m_OutputControlConnections.at(change.m_Index)->SetValueInMainThread(change.m_Value, true);
+        }
+    }
+
+    void Instance::UpdateOutputAtomForwarding()
+    {
+        for(auto connection: m_OutputAtomConnections)
+        {
+            bool formidi = m_MidiCallback && connection->Port().SupportsMidi();
+            bool forui = m_Ui && connection->SubscribedByUi();
+            connection->SetForwarded(formidi || forui);
+        }
+    }
+
+    bool Instance::SetOutputAtomPortSubscribed(uint32_t portindex, bool subscribed)
+    {
+        for(auto connection: m_OutputAtomConnections)
+        {
+            if(connection->Port().Index() == portindex)
+            {
+                connection->SetSubscribedByUi(subscribed);
+                UpdateOutputAtomForwarding();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Instance::ReportDroppedAtomEvents()
+    {
+        for(auto connection: m_OutputAtomConnections)
+        {
+            auto numdropped = connection->NumDropped();
+            if(numdropped != connection->NumDroppedReported())
+            {
+                m_Logger.Log(logger::TLevel::Warning, "%llu events of output port %s dropped", (unsigned long long)(numdropped - connection->NumDroppedReported()), connection->Port().Symbol().c_str());
+                connection->NumDroppedReported() = numdropped;
+            }
+        }
+    }
+
     void Instance::OnAtomPortMessage(TConnection<TAtomPort> &connection, uint32_t frames, uint32_t subframes, LV2_URID type, uint32_t datasize, const void *data)
     {
         if(m_Ui)
@@ -802,7 +1026,7 @@ namespace lilvutils
         return TUiToShow{}; // with m_Ui == nullptr
     }
 
-    UI::UI(Instance &instance) : m_Instance(instance)
+    UI::UI(Instance &instance) : m_Instance(instance), m_Logger(instance.plugin().Name() + " (UI)")
     {
         auto uis = lilv_plugin_get_uis(m_Instance.plugin().get());
         utils::finally fin1([&]() {  if(uis) lilv_uis_free(uis); });
@@ -922,6 +1146,14 @@ namespace lilvutils
         suilinstance = nullptr;
         containerWindow = nullptr;
         m_Instance.UiOpened(this);
+        // output control ports are not reported while no UI is open, so send the UI the values we have:
+        for(const auto &connection: m_Instance.Connections())
+        {
+            if(auto controlconnection = dynamic_cast<TConnection<TControlPort>*>(connection.get()); controlconnection && (controlconnection->Port().Direction() == TPortBase::TDirection::Output))
+            {
+                OnControlValueChanged((uint32_t)controlconnection->Port().Index(), controlconnection->ValueInMainThread());
+            }
+        }
     }
 
     UI::~UI()
@@ -955,6 +1187,20 @@ namespace lilvutils
         }
 
     }
+    uint32_t UI::PortSubscribe(uint32_t port_index, uint32_t protocol, bool subscribe)
+    {
+        // control ports are always reported while the UI is open:
+        if( (protocol == 0) && (port_index < m_Instance.Connections().size()) && dynamic_cast<TConnection<TControlPort>*>(m_Instance.Connections()[port_index].get()) )
+        {
+            return 0;
+        }
+        if( (protocol == m_Uridatom_eventTransfer) && m_Instance.SetOutputAtomPortSubscribed(port_index, subscribe) )
+        {
+            return 0;
+        }
+        return 1;
+    }
+
     void UI::OnAtomPortMessage(uint32_t portindex, LV2_URID type, uint32_t datasize, const void *data)
     {
         if(m_SuilInstance)
@@ -2,6 +2,7 @@
 
 #include <stdexcept>	
 #include "utils.h"
+#include "rtarena.h"
 #include "schedule.h"
 #include <lilv/lilv.h>
 #include <mutex>
@@ -12,6 +13,8 @@
 #include "lv2/atom/forge.h"
 #include "lv2_evbuf.h"
 #include "log.h"
+#include "urimap.h"
+#include "pluginindex.h"
 #include "lv2/log/log.h"
 #include "lv2/options/options.h"
 #include "lv2/parameters/parameters.h"
@@ -29,42 +32,6 @@ namespace lilvutils
 {
     class Instance;
     class UI;
-    class TPluginList
-    {
-    public:
-        class TClass
-        {
-        public:
-            TClass() = default;
-            TClass(std::string &&uri, std::string &&description) : m_Description(std::move(description)), m_Uri(std::move(uri)) {}
-            const std::string& Description() const { return m_Description; }
-            const std::string& Uri() const { return m_Uri; }
-
-        private:
-            std::string m_Uri;
-            std::string m_Description;
-        };
-        class TPlugin
-        {
-        public:
-            TPlugin(std::string &&name, std::string &&uri, size_t classIndex) : m_Name(std::move(name)), m_Uri(std::move(uri)), m_ClassIndex(classIndex) {}
-            const std::string& Name() const { return m_Name; }
-            const std::string& Uri() const { return m_Uri; }
-            size_t ClassIndex() const { return m_ClassIndex; }
-        private:
-            std::string m_Name;
-            std::string m_Uri;
-            size_t m_ClassIndex;
-        };
-    public:
-        TPluginList() = default;
-        TPluginList(std::vector<TClass> &&classes, std::vector<TPlugin> &&plugins) : m_Classes(std::move(classes)), m_Plugins(std::move(plugins)) {}
-        const std::vector<TClass>& Classes() const { return m_Classes; }
-        const std::vector<TPlugin>& Plugins() const { return m_Plugins; }
-    private:
-        std::vector<TClass> m_Classes;
-        std::vector<TPlugin> m_Plugins;
-    };
     class World
     {
     public:
@@ -72,7 +39,7 @@ namespace lilvutils
         World& operator=(const World&) = delete;
         World(World&&) = delete;
         World& operator=(World&&) = delete;
-        World(uint32_t sample_rate, uint32_t maxBlockSize, int argc, char** argv);
+        World(uint32_t sample_rate, uint32_t maxBlockSize, int argc, char** argv, std::string &&pluginIndexFile);
         ~World()
         {
             if(m_World) lilv_world_free(m_World);
@@ -95,52 +62,56 @@ namespace lilvutils
             }
             return *staticptr();
         }
-        LV2_URID UriMapLookup(const std::string &str)
+        // realtime safe for URIs that have been mapped before. Returns 0 if the map is full.
+        LV2_URID UriMapLookup(std::string_view str)
         {
-            std::unique_lock<std::mutex> lock(m_Mutex);
-            auto it = m_UriMap.find(str);
-            if(it != m_UriMap.end())
+            auto urid = m_UriMap.Map(str);
+            if(!urid)
             {
-                return (LV2_URID)it->second;
-            }
-            else
-            {
-                auto index = m_UriMapReverse.size() + 1;
-                // m_UriMap[str] = index;
-                m_UriMap.emplace(str, index);
-                m_UriMapReverse.push_back(str);
-                if(index > std::numeric_limits<LV2_URID>::max())
-                {
-                    throw std::runtime_error("LV2_URID overflow");
-                }
-                return (LV2_URID)index;
+                m_HostLogger.Log(logger::TLevel::Error, "URID map full, cannot map %.*s", (int)str.size(), str.data());
             }
+            return urid;
         }
-        const std::string & UriMapReverseLookup(size_t index)
+        // returns nullptr for unknown urids
+        const char* UriMapReverseLookup(LV2_URID urid) const
         {
-            std::unique_lock<std::mutex> lock(m_Mutex);
-            return m_UriMapReverse.at(index - 1);
+            return m_UriMap.Unmap(urid);
         }
         const std::vector<const LV2_Feature*>& Features() const { return m_Features; }
         uint32_t MaxBlockLength() const { return m_OptionMaxBlockLength; }
+        // The length of the audio buffers of new instances: the JACK buffer size, at most MaxBlockLength(). Instances
+        // made before it grew must be resized with Instance::SetAudioBufferLength().
+        uint32_t AudioBufferLength() const { return m_AudioBufferLength; }
+        void SetAudioBufferLength(uint32_t length) { m_AudioBufferLength = std::min(length, m_OptionMaxBlockLength); }
+        float UiUpdateRate() const { return m_OptionUiUpdateRate; }
         SuilHost* suilHost() const { return m_SuilHost; }
         LV2_URID_Map& UridMap() { return m_UridMap; }   
         LV2_URID_Unmap& UridUnmap() { return m_UridUnmap; }
         LV2_Atom_Forge& AtomForge() { return m_AtomForge; }
-        const TPluginList& PluginList() const { return m_PluginList; }
+        const TPluginList& PluginList() const { return m_PluginIndex.PluginList(); }
+        // loads the bundle containing the plugin, the bundles of its UIs and presets and the LV2 specifications
+        // into the lilv world, if not done already
+        void LoadPluginBundle(const std::string &uri);
+        void RescanPluginsInBackground() { m_PluginIndex.RescanInBackground(); }
+        void SetOnPluginRescanFinished(std::function<void()> &&callback) { m_PluginIndex.SetOnRescanFinished(std::move(callback)); }
+        bool ApplyPluginRescan() { return m_PluginIndex.ApplyRescanResult(); }
+        logger::LogDrain& LogDrain() { return m_LogDrain; }
+        urimap::UriMap& Uris() { return m_UriMap; }
+        // for messages of the host itself, rate limited like those of the plugins:
+        logger::Logger& HostLogger() { return m_HostLogger; }
 
     private:
+        void LoadBundle(const std::string &path);
+        void LoadSpecifications();
         static World*& staticptr()
         {
             static World *s_World = nullptr;
             return s_World;
         }
-        static TPluginList BuildPluginList(const LilvWorld* m_World);
-
     private:
-        std::mutex m_Mutex;
-        std::map<std::string, size_t> m_UriMap;
-        std::vector<std::string> m_UriMapReverse;
+        urimap::UriMap m_UriMap;
+        logger::LogDrain m_LogDrain;
+        logger::Logger m_HostLogger {"jnlive", m_LogDrain, m_UriMap};
         LilvWorld* m_World = nullptr;
         SuilHost* m_SuilHost = nullptr;
         const LilvPlugins *m_Plugins = nullptr;
@@ -160,11 +131,15 @@ namespace lilvutils
         float m_OptionSampleRate = 0.0f;
         uint32_t m_OptionMinBlockLength = 16;
         uint32_t m_OptionMaxBlockLength = 4096;
+        uint32_t m_AudioBufferLength = 4096;
         uint32_t m_OptionSequenceSize = 4096;
         float m_OptionUiUpdateRate = 30.0f;
         float m_OptionUiScaleFactor = 2.0f;
         LV2_Atom_Forge m_AtomForge;
-        TPluginList m_PluginList;
+        PluginIndex m_PluginIndex;
+        std::set<std::string> m_LoadedBundles;
+        bool m_LoadedSpecifications = false;
+        bool m_LoadedAll = false;
     };
     class Uri
     {
@@ -310,16 +285,20 @@ namespace lilvutils
     class TConnection<TAudioPort> : public TConnectionBase
     {
     public:
-        TConnection(Instance &instance, const TAudioPort &port, size_t bufsize) : m_Instance(instance), m_Buffer(bufsize), m_Port(port)
-        {
-            std::fill(m_Buffer.begin(), m_Buffer.end(), 0.0f);
-        }
+        // buffer: the slice of the audio buffer slab of the instance for this port
+        TConnection(Instance &instance, const TAudioPort &port, float *buffer) : m_Instance(instance), m_Buffer(buffer), m_ConnectedBuffer(buffer), m_Port(port) {}
         virtual ~TConnection() {}
-        float *Buffer() { return &m_Buffer[0]; }
+        float *Buffer() { return m_Buffer; }
+        // replaces Buffer() and connects the port to it. Only while the realtime thread does not use the instance.
+        void SetBuffer(float *buffer);
+        // Realtime thread, input ports: lets the plugin read from another buffer (the output of the plugin or bus
+        // feeding it) instead of copying that into Buffer(). nullptr connects the port to Buffer() again.
+        void ConnectTo(const float *buffer);
         const TAudioPort& Port() const { return m_Port; }
         Instance &instance() const {return m_Instance;}
     private:
-        std::vector<float> m_Buffer;
+        float *m_Buffer;
+        const float *m_ConnectedBuffer;
         const TAudioPort &m_Port;
         Instance &m_Instance;
     };
@@ -327,16 +306,15 @@ namespace lilvutils
     class TConnection<TCvPort> : public TConnectionBase
     {
     public:
-        TConnection(Instance &instance, const TCvPort &port, size_t bufsize) : m_Buffer(bufsize), m_Port(port), m_Instance(instance)
-        {
-            std::fill(m_Buffer.begin(), m_Buffer.end(), 0.0f);
-        }
+        TConnection(Instance &instance, const TCvPort &port, float *buffer) : m_Buffer(buffer), m_Port(port), m_Instance(instance) {}
         virtual ~TConnection() {}
-        float *Buffer() { return &m_Buffer[0]; }
+        float *Buffer() { return m_Buffer; }
+        // replaces Buffer() and connects the port to it. Only while the realtime thread does not use the instance.
+        void SetBuffer(float *buffer);
         const TCvPort& Port() const { return m_Port; }
         Instance &instance() const {return m_Instance;}
     private:
-        std::vector<float> m_Buffer;
+        float *m_Buffer;
         const TCvPort& m_Port;
         Instance &m_Instance;
     };
@@ -348,15 +326,12 @@ namespace lilvutils
         {
             auto urid_chunk = lilvutils::World::Static().UriMapLookup(LV2_ATOM__Chunk);
             auto urid_sequence = lilvutils::World::Static().UriMapLookup(LV2_ATOM__Sequence);
-            m_EvBuf = lv2_evbuf_new(bufsize, urid_chunk, urid_sequence);
+            m_EvBuf = lv2_evbuf_init(rtarena::TArena::Static().Allocate(lv2_evbuf_memory_size(bufsize)), bufsize, urid_chunk, urid_sequence);
             ResetEvBuf();
         }
         virtual ~TConnection()
         {
-            if(m_EvBuf)
-            {
-                lv2_evbuf_free(m_EvBuf);
-            }
+            rtarena::TArena::Static().Free(m_EvBuf);
         }
         LV2_Evbuf* Buffer() const { return m_EvBuf; }
         Instance &instance() const {return m_Instance;}
@@ -369,9 +344,25 @@ namespace lilvutils
             BufferIterator() = lv2_evbuf_begin(Buffer());
 
         }
+        // output ports: whether the realtime thread should pass the events on to the main thread. Set by
+        // Instance::UpdateOutputAtomForwarding.
+        bool Forwarded() const { return m_Forwarded.load(std::memory_order_relaxed); }
+        void SetForwarded(bool forwarded) { m_Forwarded.store(forwarded, std::memory_order_relaxed); }
+        // main thread; a UI receives the events of all ports unless it unsubscribes:
+        bool SubscribedByUi() const { return m_SubscribedByUi; }
+        void SetSubscribedByUi(bool subscribed) { m_SubscribedByUi = subscribed; }
+        // events that could not be passed on because the ring buffer was full, or were too large:
+        uint64_t NumDropped() const { return m_NumDropped.load(std::memory_order_relaxed); }
+        void AddDropped(uint64_t num) { m_NumDropped.fetch_add(num, std::memory_order_relaxed); }
+        // main thread, for reporting:
+        uint64_t& NumDroppedReported() { return m_NumDroppedReported; }
     private:
         LV2_Evbuf* m_EvBuf = nullptr;
         LV2_Evbuf_Iterator m_EvBufIterator;
+        std::atomic<bool> m_Forwarded = false;
+        bool m_SubscribedByUi = true;
+        std::atomic<uint64_t> m_NumDropped = 0;
+        uint64_t m_NumDroppedReported = 0;
         const TAtomPort &m_Port;
         Instance &m_Instance;
     };
@@ -382,8 +373,14 @@ namespace lilvutils
         TConnection(Instance &instance, const TControlPort &port, const float &defaultvalue) : m_Value(defaultvalue), m_OrigValue(defaultvalue), m_Instance(instance), m_ValueInMainThread(defaultvalue), m_Port(port)
         {
         }
+        // the value lives in storage owned by the instance (used for the output ports, see Instance::ScanOutputControlPorts):
+        TConnection(Instance &instance, const TControlPort &port, const float &defaultvalue, float *buffer) : TConnection(instance, port, defaultvalue)
+        {
+            m_Buffer = buffer;
+            *m_Buffer = defaultvalue;
+        }
         virtual ~TConnection() {}
-        float* Buffer() { return &m_Value; }
+        float* Buffer() { return m_Buffer; }
         float& OrigValue() { return m_OrigValue;}
         Instance &instance() const {return m_Instance;}
         const float& ValueInMainThread() const { return m_ValueInMainThread; }
@@ -395,11 +392,20 @@ namespace lilvutils
         const TControlPort& Port() const { return m_Port; }
     private:
         float m_Value;      // accessed from realtime thread
+        float *m_Buffer = &m_Value;
         float m_OrigValue; // accessed from realtime thread
         float m_ValueInMainThread; // accessed from main thread
         const TControlPort& m_Port;
         Instance &m_Instance;
     };
+    // a changed output control port, reported by Instance::ScanOutputControlPorts:
+    class TOutputControlChange
+    {
+    public:
+        // index into the output control ports of the instance, not the port index:
+        uint32_t m_Index;
+        float m_Value;
+    };
     struct RealtimeThreadInterface
     {
         /* interface for sending notifications to the plugin instance in the audio processing thread. These should be implemented externally, and passed to the constructor of Instance. */
@@ -432,25 +438,77 @@ namespace lilvutils
         LilvInstance* get() { return m_Instance; }
         const Plugin& plugin() const { return m_Plugin; }
         const std::vector<std::unique_ptr<TConnectionBase>>& Connections() const { return m_Connections; }
+        // output atom ports, for forwarding their events from the realtime thread:
+        const std::vector<TConnection<TAtomPort>*>& OutputAtomConnections() const { return m_OutputAtomConnections; }
+        // Main thread. The events of an output atom port are only passed on by the realtime thread if someone listens:
+        // the midi callback for midi ports, or the UI if it has not unsubscribed from the port.
+        void UpdateOutputAtomForwarding();
+        // returns false if the UI cannot subscribe to the port:
+        bool SetOutputAtomPortSubscribed(uint32_t portindex, bool subscribed);
+        // writes the number of output atom events dropped since the previous call to std::cerr
+        void ReportDroppedAtomEvents();
+        // Realtime thread, call after every run: returns the output control ports whose value changed since they were
+        // last returned. Their values are only needed by the UI, so nothing is returned while no UI is open, and at most
+        // World::UiUpdateRate() times per second; in between the changes coalesce to the latest value per port.
+        // The result stays valid until the next call.
+        std::span<const TOutputControlChange> ScanOutputControlPorts(uint32_t nframes);
+        // Main thread: applies the changes returned by ScanOutputControlPorts
+        void OnOutputControlsChanged(std::span<const TOutputControlChange> changes);
         void UiOpened(UI *ui)
         {
             if(m_Ui) throw std::runtime_error("UI already opened");
             m_Ui = ui;
+            m_UiOpen = true;
+            UpdateOutputAtomForwarding();
         }
         void UiClosed(UI *ui)
         {
             if(m_Ui != ui) throw std::runtime_error("UI not opened");
             m_Ui = nullptr;
+            m_UiOpen = false;
+            // the next UI starts out subscribed to everything:
+            for(auto connection: m_OutputAtomConnections)
+            {
+                connection->SetSubscribedByUi(true);
+            }
+            UpdateOutputAtomForwarding();
         }
         const RealtimeThreadInterface& realtimeThreadInterface() const { return m_RealtimeThreadInterface; }
         void Reset()
         {
             if(m_Ui) throw std::runtime_error("UI is open");
-            lilv_instance_deactivate(m_Instance);
-            lilv_instance_activate(m_Instance);
+            if(m_Activated)
+            {
+                lilv_instance_deactivate(m_Instance);
+                lilv_instance_activate(m_Instance);
+            }
+        }
+        // An inactive instance must not be run. Only call while the realtime thread is not using the instance.
+        void SetActivated(bool activated)
+        {
+            if(activated != m_Activated)
+            {
+                if(activated)
+                {
+                    lilv_instance_activate(m_Instance);
+                }
+                else
+                {
+                    lilv_instance_deactivate(m_Instance);
+                }
+                m_Activated = activated;
+            }
         }
+        bool Activated() const { return m_Activated; }
+        // frames in each audio and cv port buffer:
+        uint32_t AudioBufferLength() const { return m_AudioBufferLength; }
+        // Reallocates the audio and cv port buffers, cleared. Only call while the realtime thread is not using the instance.
+        void SetAudioBufferLength(uint32_t length);
         void SaveState(const std::string &dir);
         void LoadState(const std::string &dir);
+        // Sets the input control values restored by the last LoadState() in the main thread and notifies the UI.
+        // LoadState() may run in another thread; call this in the main thread once it has returned.
+        void ApplyRestoredControlValues();
 
     private:
         void* GetPortValueBySymbol(const char *port_symbol, uint32_t *size, uint32_t *type);
@@ -461,14 +519,32 @@ namespace lilvutils
         std::vector<const LV2_Feature*> m_Features;
         std::vector<const LV2_Feature*> m_StateRestoreFeatures;
         LilvInstance *m_Instance = nullptr;
+        // The buffers of all audio and cv ports, one after the other. Each starts on a cache line and holds
+        // m_AudioBufferLength frames:
+        rtarena::TVector<float> m_AudioBuffers;
+        uint32_t m_AudioBufferLength = 0;
         std::vector<std::unique_ptr<TConnectionBase>> m_Connections;
         std::vector<size_t> m_PortIndicesOfAtomPorts;
+        // The values of the output control ports are packed here so they can be compared a vector at a time. Sized
+        // before the ports are connected and never resized. Padded to a multiple of 4 with zeros:
+        rtarena::TVector<float> m_OutputControlValues;
+        rtarena::TVector<float> m_OutputControlLastValues;
+        std::vector<TConnection<TControlPort>*> m_OutputControlConnections;
+        std::vector<TOutputControlChange> m_OutputControlChanges;
+        uint32_t m_OutputControlScanInterval = 0;
+        uint32_t m_FramesSinceOutputControlScan = 0;
+        // m_Ui != nullptr, for the realtime thread:
+        std::atomic<bool> m_UiOpen = false;
+        std::vector<TConnection<TAtomPort>*> m_OutputAtomConnections;
         logger::Logger m_Logger;
         std::unique_ptr<schedule::Worker> m_ScheduleWorker;
         std::unique_ptr<schedule::Worker> m_StateRestoreWorker;
         UI *m_Ui = nullptr;
         const RealtimeThreadInterface &m_RealtimeThreadInterface;
         bool m_SupportsThreadSafeRestore = false;
+        // collected by LoadState(), for ApplyRestoredControlValues():
+        std::vector<std::pair<TConnection<TControlPort>*, float>> m_RestoredControlValues;
+        bool m_Activated = false;
         LV2_URID m_UridMidiEvent;
         TMidiCallback m_MidiCallback;
     };
@@ -520,6 +596,8 @@ namespace lilvutils
         void OnAtomPortMessage(uint32_t portindex, LV2_URID type, uint32_t datasize, const void *data);
         uint32_t PortIndex(const char *port_symbol) const;
         void PortWrite(uint32_t port_index, uint32_t buffer_size, uint32_t protocol, void const *buffer);
+        // returns 0 on success, as LV2UI_Port_Subscribe:
+        uint32_t PortSubscribe(uint32_t port_index, uint32_t protocol, bool subscribe);
         bool IsShown() const;
         void SetShown(bool shown);
         bool CanHide() const;  // we can only hide native UIs. External UIs must be destroyed in order to hide them.
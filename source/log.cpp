@@ -1,18 +1,53 @@
 #include "log.h"
 #include "lilvutils.h"
+#include "urimap.h"
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <csignal>
+#include "threads.h"
+
+namespace
+{
+    const char* LevelName(logger::TLevel level)
+    {
+        switch(level)
+        {
+            case logger::TLevel::Trace: return "trace";
+            case logger::TLevel::Warning: return "warning";
+            case logger::TLevel::Error: return "error";
+            default: return "note";
+        }
+    }
+    std::atomic<bool> sToggleTraceRequested = false;
+}
 
 namespace logger
 {
-        Logger::Logger() 
+        Logger::Logger(std::string &&source) : Logger(std::move(source), lilvutils::World::Static().LogDrain(), lilvutils::World::Static().Uris())
         {
-            m_Urid_Log_Error = lilvutils::World::Static().UriMapLookup(LV2_LOG__Error);
-            m_Urid_Log_Trace = lilvutils::World::Static().UriMapLookup(LV2_LOG__Trace);
-            m_Urid_Log_Warning = lilvutils::World::Static().UriMapLookup(LV2_LOG__Warning);
+        }
+
+        Logger::Logger(std::string &&source, LogDrain &drain, urimap::UriMap &urimap) : m_Source(std::move(source)), m_Drain(drain)
+        {
+            m_Urid_Log_Error = urimap.Map(LV2_LOG__Error);
+            m_Urid_Log_Trace = urimap.Map(LV2_LOG__Trace);
+            m_Urid_Log_Warning = urimap.Map(LV2_LOG__Warning);
             m_Log.handle  = this;
             m_Log.printf  = &logger::Logger::printf_static;
             m_Log.vprintf = &logger::Logger::vprintf_static;
             m_LogFeature.data = &m_Log;
             m_LogFeature.URI = LV2_LOG__log;
+            for(size_t i = 0; i < sNumSlots; i++)
+            {
+                m_Slots[i].m_Sequence.store(i, std::memory_order_relaxed);
+            }
+            m_Drain.Register(this);
+        }
+
+        Logger::~Logger()
+        {
+            m_Drain.Unregister(this);
         }
 
         int Logger::vprintf_static(LV2_Log_Handle handle, LV2_URID type, const char* fmt, va_list ap)
@@ -20,7 +55,7 @@ namespace logger
             auto logger = (Logger*)handle;
             return logger->vprintf(type, fmt, ap);
         }
-        
+
         int Logger::printf_static(LV2_Log_Handle handle, LV2_URID type, const char* fmt, ...)
         {
             va_list args;
@@ -32,31 +67,223 @@ namespace logger
 
         int Logger::vprintf(LV2_URID type, const char* fmt, va_list ap)
         {
-            if ( (type == m_Urid_Log_Trace) && m_EnableTracing)            
+            TLevel level = TLevel::Note;
+            if (type == m_Urid_Log_Trace)
             {
-                fprintf(stderr, "trace: ");
-                vfprintf(stderr, fmt, ap);
-                fprintf(stderr, "\n");
+                level = TLevel::Trace;
             }
-            else if (type == m_Urid_Log_Error) 
+            else if (type == m_Urid_Log_Error)
             {
-                fprintf(stderr, "error: ");
-                vfprintf(stderr, fmt, ap);
-                fprintf(stderr, "\n");
+                level = TLevel::Error;
             }
             else if (type == m_Urid_Log_Warning)
             {
-                fprintf(stderr, "error: ");
-                vfprintf(stderr, fmt, ap);
-                fprintf(stderr, "\n");
+                level = TLevel::Warning;
+            }
+            return VLog(level, fmt, ap);
+        }
+
+        int Logger::Log(TLevel level, const char* fmt, ...)
+        {
+            va_list args;
+            va_start(args, fmt);
+            const int ret = VLog(level, fmt, args);
+            va_end(args);
+            return ret;
+        }
+
+        int Logger::VLog(TLevel level, const char* fmt, va_list ap)
+        {
+            if(level < m_Drain.Level())
+            {
+                return 0;
+            }
+            // bounded multi producer queue: a slot is free for write position pos if its sequence equals pos,
+            // and is ready for reading when its sequence equals pos + 1.
+            size_t pos = m_WritePos.load(std::memory_order_relaxed);
+            while(true)
+            {
+                auto &slot = m_Slots[pos % sNumSlots];
+                size_t sequence = slot.m_Sequence.load(std::memory_order_acquire);
+                auto diff = (intptr_t)sequence - (intptr_t)pos;
+                if(diff == 0)
+                {
+                    if(m_WritePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        // vsnprintf into a fixed buffer does not allocate or lock for the usual formats
+                        int result = vsnprintf(slot.m_Text, sMaxMessageLength, fmt, ap);
+                        slot.m_Level = level;
+                        slot.m_Sequence.store(pos + 1, std::memory_order_release);
+                        return result;
+                    }
+                }
+                else if(diff < 0)
+                {
+                    // full:
+                    m_NumDropped.fetch_add(1, std::memory_order_relaxed);
+                    return 0;
+                }
+                else
+                {
+                    pos = m_WritePos.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        bool Logger::Pop(TLevel &level, std::string &text)
+        {
+            auto &slot = m_Slots[m_ReadPos % sNumSlots];
+            if(slot.m_Sequence.load(std::memory_order_acquire) != m_ReadPos + 1)
+            {
+                return false;
+            }
+            level = slot.m_Level;
+            text.assign(slot.m_Text, strnlen(slot.m_Text, sMaxMessageLength));
+            slot.m_Sequence.store(m_ReadPos + sNumSlots, std::memory_order_release);
+            m_ReadPos++;
+            return true;
+        }
+
+        LogDrain::LogDrain()
+        {
+            auto level = getenv("JNLIVE_LOG_LEVEL");
+            if(level)
+            {
+                for(auto l: {TLevel::Trace, TLevel::Note, TLevel::Warning, TLevel::Error})
+                {
+                    if(strcmp(level, LevelName(l)) == 0)
+                    {
+                        m_InitialLevel = l;
+                    }
+                }
+            }
+            m_Level = m_InitialLevel;
+            auto file = getenv("JNLIVE_LOG_FILE");
+            if(file && *file)
+            {
+                SetOutputFile(file);
+            }
+            m_Thread = threads::Spawn(threads::TClass::Background, "log drain", [this](){
+                Run();
+            });
+        }
+
+        LogDrain::~LogDrain()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_Mutex);
+                m_Quit = true;
+            }
+            m_Cv.notify_all();
+            m_Thread.join();
+            if(m_File)
+            {
+                fclose(m_File);
             }
-            else // note:
+        }
+
+        void LogDrain::Register(Logger *logger)
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            logger->m_RateWindowStart = std::chrono::steady_clock::now();
+            m_Loggers.push_back(logger);
+        }
+
+        void LogDrain::Unregister(Logger *logger)
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            Drain(*logger, false);
+            m_Loggers.erase(std::remove(m_Loggers.begin(), m_Loggers.end(), logger), m_Loggers.end());
+        }
+
+        void LogDrain::SetLevel(TLevel level)
+        {
+            m_Level.store(level, std::memory_order_relaxed);
+        }
+
+        void LogDrain::SetOutputFile(const std::string &filename)
+        {
+            FILE *file = nullptr;
+            if(!filename.empty())
             {
-                fprintf(stderr, "note: ");
-                vfprintf(stderr, fmt, ap);
-                fprintf(stderr, "\n");
+                file = fopen(filename.c_str(), "a");
+                if(!file)
+                {
+                    throw std::runtime_error("Could not open log file: " + filename);
+                }
             }
-            return 0;
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            if(m_File)
+            {
+                fclose(m_File);
+            }
+            m_File = file;
+        }
+
+        void LogDrain::Run()
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            while(!m_Quit)
+            {
+                // the realtime thread cannot notify us, so poll:
+                m_Cv.wait_for(lock, std::chrono::milliseconds(20));
+                if(sToggleTraceRequested.exchange(false, std::memory_order_relaxed))
+                {
+                    SetLevel( (Level() == TLevel::Trace)? m_InitialLevel : TLevel::Trace );
+                    fprintf(Output(), "note: [log] level %s\n", LevelName(Level()));
+                }
+                for(auto logger: m_Loggers)
+                {
+                    Drain(*logger, true);
+                }
+                fflush(Output());
+            }
+        }
+
+        // must be called with the mutex locked
+        void LogDrain::Drain(Logger &logger, bool ratelimit)
+        {
+            auto out = Output();
+            auto now = std::chrono::steady_clock::now();
+            if(now - logger.m_RateWindowStart >= std::chrono::seconds(1))
+            {
+                if(logger.m_NumSuppressed > 0)
+                {
+                    fprintf(out, "warning: [%s] %llu messages suppressed\n", logger.Source().c_str(), (unsigned long long)logger.m_NumSuppressed);
+                    logger.m_NumSuppressed = 0;
+                }
+                logger.m_RateWindowStart = now;
+                logger.m_NumInRateWindow = 0;
+            }
+            auto numdropped = logger.NumDropped();
+            if(numdropped != logger.m_NumDroppedReported)
+            {
+                fprintf(out, "warning: [%s] %llu messages dropped, log buffer full\n", logger.Source().c_str(), (unsigned long long)(numdropped - logger.m_NumDroppedReported));
+                logger.m_NumDroppedReported = numdropped;
+            }
+            TLevel level;
+            std::string text;
+            while(logger.Pop(level, text))
+            {
+                if(ratelimit && (logger.m_NumInRateWindow >= sMaxMessagesPerSecond))
+                {
+                    logger.m_NumSuppressed++;
+                    continue;
+                }
+                logger.m_NumInRateWindow++;
+                while( (!text.empty()) && (text.back() == '\n') )
+                {
+                    text.pop_back();
+                }
+                fprintf(out, "%s: [%s] %s\n", LevelName(level), logger.Source().c_str(), text.c_str());
+            }
+        }
+
+        void InstallLevelSignalHandler()
+        {
+            std::signal(SIGUSR2, [](int){
+                sToggleTraceRequested.store(true, std::memory_order_relaxed);
+            });
         }
 
 }
@@ -2,6 +2,14 @@
 
 #include <stdarg.h>
 #include <stdio.h>
+#include <string>
+#include <vector>
+#include <array>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
 #include "lv2.h"
 #include "lv2/log/log.h"
 
@@ -9,25 +17,122 @@ namespace lilvutils
 {
     class Instance;
 }
+namespace urimap
+{
+    class UriMap;
+}
 
 namespace logger
 {
+    enum class TLevel
+    {
+        Trace,
+        Note,
+        Warning,
+        Error
+    };
+    class LogDrain;
+
+    // LV2 log feature for a single plugin instance or UI. Plugins may log from run(), so vprintf() does not do
+    // any I/O: messages are formatted into a bounded lock-free ring and written out by the LogDrain thread.
+    // If the ring is full the message is dropped and counted.
     class Logger
     {
     public:
-        Logger();
+        static constexpr size_t sNumSlots = 64;
+        static constexpr size_t sMaxMessageLength = 256;
+        Logger(const Logger&) = delete;
+        Logger& operator=(const Logger&) = delete;
+        Logger(Logger&&) = delete;
+        Logger& operator=(Logger&&) = delete;
+        // logs to the drain of lilvutils::World::Static()
+        Logger(std::string &&source);
+        Logger(std::string &&source, LogDrain &drain, urimap::UriMap &urimap);
+        ~Logger();
         const LV2_Feature* Feature() const { return &m_LogFeature; }
         static int vprintf_static(LV2_Log_Handle handle, LV2_URID type, const char* fmt, va_list ap);
         static int printf_static(LV2_Log_Handle handle, LV2_URID type, const char* fmt, ...);
+        // realtime safe, can be called from multiple threads:
         int vprintf(LV2_URID type, const char* fmt, va_list ap);
+        // for messages of the host itself; realtime safe as well:
+        int Log(TLevel level, const char* fmt, ...) __attribute__((format(printf, 3, 4)));
+        const std::string& Source() const { return m_Source; }
+        uint64_t NumDropped() const { return m_NumDropped.load(std::memory_order_relaxed); }
+
+    private:
+        friend class LogDrain;
+        class TSlot
+        {
+        public:
+            std::atomic<size_t> m_Sequence {0};
+            TLevel m_Level = TLevel::Note;
+            char m_Text[sMaxMessageLength];
+        };
+        int VLog(TLevel level, const char* fmt, va_list ap);
+        // drain thread only:
+        bool Pop(TLevel &level, std::string &text);
 
     private:
-        bool m_EnableTracing = true;
+        std::string m_Source;
+        LogDrain &m_Drain;
         LV2_URID m_Urid_Log_Error = 0;
         LV2_URID m_Urid_Log_Warning = 0;
         LV2_URID m_Urid_Log_Trace = 0;
         LV2_Log_Log m_Log;
         LV2_Feature m_LogFeature;
+        std::array<TSlot, sNumSlots> m_Slots;
+        std::atomic<size_t> m_WritePos {0};
+        std::atomic<uint64_t> m_NumDropped {0};
+        // drain thread only:
+        size_t m_ReadPos = 0;
+        uint64_t m_NumDroppedReported = 0;
+        std::chrono::steady_clock::time_point m_RateWindowStart;
+        size_t m_NumInRateWindow = 0;
+        uint64_t m_NumSuppressed = 0;
+    };
 
+    // Writes the messages of all Loggers to stderr or to a file, from a background thread.
+    // Limits the number of messages per second per Logger, so a chatty plugin cannot flood the output.
+    // The initial level and the output file are taken from the JNLIVE_LOG_LEVEL (trace, note, warning, error) and
+    // JNLIVE_LOG_FILE environment variables when the drain is created. The level can be changed while running.
+    class LogDrain
+    {
+    public:
+        LogDrain(const LogDrain&) = delete;
+        LogDrain& operator=(const LogDrain&) = delete;
+        LogDrain(LogDrain&&) = delete;
+        LogDrain& operator=(LogDrain&&) = delete;
+        LogDrain();
+        ~LogDrain();
+        void Register(Logger *logger);
+        // writes out the remaining messages of the logger:
+        void Unregister(Logger *logger);
+        // realtime safe; messages below the level are not even formatted:
+        TLevel Level() const { return m_Level.load(std::memory_order_relaxed); }
+        void SetLevel(TLevel level);
+
+    private:
+        // empty filename: log to stderr
+        void SetOutputFile(const std::string &filename);
+        void Run();
+        void Drain(Logger &logger, bool ratelimit);
+        FILE* Output() const { return m_File? m_File : stderr; }
+
+    private:
+        std::atomic<TLevel> m_Level = TLevel::Note;
+        // the level from the environment, restored when trace messages are toggled off:
+        TLevel m_InitialLevel = TLevel::Note;
+        static constexpr size_t sMaxMessagesPerSecond = 20;
+        std::mutex m_Mutex;
+        std::condition_variable m_Cv;
+        // protected by mutex:
+        std::vector<Logger*> m_Loggers;
+        FILE *m_File = nullptr;
+        bool m_Quit = false;
+        std::thread m_Thread;
     };
-}
\ No newline at end of file
+
+    // Sending SIGUSR2 to the process toggles trace messages on and off. The handler only sets a flag, the drain
+    // thread changes the level.
+    void InstallLevelSignalHandler();
+}
@@ -18,6 +18,27 @@ struct LV2_Evbuf_Impl {
   LV2_Atom_Sequence buf;
 };
 
+size_t
+lv2_evbuf_memory_size(uint32_t capacity)
+{
+  return sizeof(LV2_Evbuf) + sizeof(LV2_Atom_Sequence) + capacity;
+}
+
+LV2_Evbuf*
+lv2_evbuf_init(void*    memory,
+               uint32_t capacity,
+               uint32_t atom_Chunk,
+               uint32_t atom_Sequence)
+{
+  LV2_Evbuf* evbuf = (LV2_Evbuf*)memory;
+  assert((uintptr_t)evbuf % 8U == 0U);
+  memset(evbuf, 0, sizeof(*evbuf));
+  evbuf->capacity      = capacity;
+  evbuf->atom_Chunk    = atom_Chunk;
+  evbuf->atom_Sequence = atom_Sequence;
+  return evbuf;
+}
+
 LV2_Evbuf*
 lv2_evbuf_new(uint32_t capacity, uint32_t atom_Chunk, uint32_t atom_Sequence)
 {
@@ -4,6 +4,7 @@
 #ifndef LV2_EVBUF_H
 #define LV2_EVBUF_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -33,6 +34,22 @@ lv2_evbuf_new(uint32_t capacity, uint32_t atom_Chunk, uint32_t atom_Sequence);
 void
 lv2_evbuf_free(LV2_Evbuf* evbuf);
 
+/// Return the number of bytes of memory an event buffer needs
+size_t
+lv2_evbuf_memory_size(uint32_t capacity);
+
+/**
+   Initialize an event buffer in memory owned by the caller.
+
+   The memory must be 8 byte aligned and at least lv2_evbuf_memory_size()
+   bytes.  Such a buffer must not be passed to lv2_evbuf_free().
+*/
+LV2_Evbuf*
+lv2_evbuf_init(void*    memory,
+               uint32_t capacity,
+               uint32_t atom_Chunk,
+               uint32_t atom_Sequence);
+
 /**
    Clear and initialize an existing event buffer.
 
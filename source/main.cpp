@@ -6,6 +6,8 @@
 #include <filesystem>
 #include <gtkmm.h>
 #include "simplegui.h"
+#include "offline.h"
+#include <iostream>
 
 import project;
 
@@ -58,6 +60,62 @@ int main(int argc, char** argv)
         throw std::runtime_error("CPU does not support AVX2");
     }
 
+    if( (argc >= 2) && (std::string(argv[1]) == "--render") )
+    {
+        // jnlive --render [--blocksize n] [--samplerate hz] [--tail s] file.mid out.wav
+        try
+        {
+            offline::TRenderOptions options;
+            std::vector<std::string> files;
+            // std::stoul accepts "-1" and returns a huge value, so check the sign and the range:
+            auto parseuint32 = [](const std::string &arg, const std::string &value) {
+                size_t pos = 0;
+                unsigned long result = 0;
+                if(!value.starts_with('-'))
+                {
+                    result = std::stoul(value, &pos);
+                }
+                if( (pos == 0) || (pos != value.size()) || (result > UINT32_MAX) )
+                {
+                    throw std::runtime_error("invalid value for " + arg + ": " + value);
+                }
+                return (uint32_t)result;
+            };
+            for(int i = 2; i < argc; i++)
+            {
+                std::string arg = argv[i];
+                if( (arg.starts_with("--")) && (i + 1 < argc) )
+                {
+                    std::string value = argv[++i];
+                    if(arg == "--blocksize") options.m_BlockSize = parseuint32(arg, value);
+                    else if(arg == "--samplerate") options.m_SampleRate = parseuint32(arg, value);
+                    else if(arg == "--tail") options.m_TailSeconds = std::stod(value);
+                    else
+                    {
+                        files.clear();
+                        break;
+                    }
+                }
+                else
+                {
+                    files.push_back(arg);
+                }
+            }
+            if(files.size() != 2)
+            {
+                std::cerr << "Usage: " << argv[0] << " --render [--blocksize n] [--samplerate hz] [--tail s] file.mid out.wav\n";
+                return 1;
+            }
+            offline::RenderMidiFile(Application::GetProjectDir(), files[0], files[1], options, argc, argv);
+        }
+        catch(std::exception &e)
+        {
+            std::cerr << "Error: " << e.what() << '\n';
+            return 1;
+        }
+        return 0;
+    }
+
     // we must use X11, because the suil doesn't support wayland
     g_setenv("GDK_BACKEND", "x11", TRUE);
 
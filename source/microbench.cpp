@@ -0,0 +1,564 @@
+#include "microbench.h"
+#include "utils.h"
+#include "referenceregion.h"
+#include "timing.h"
+#include "urimap.h"
+#include "kompletegui.h"
+#include "simplegui.h"
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <vector>
+#include <set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <filesystem>
+#include <cmath>
+
+namespace
+{
+    // runs func repeatedly and returns the fastest run in ns, to filter out scheduling noise:
+    template <class Function>
+    uint64_t BestOfNs(size_t runs, const Function &func)
+    {
+        uint64_t best = UINT64_MAX;
+        for(size_t run = 0; run < runs; run++)
+        {
+            auto start = timing::NowNs();
+            func();
+            best = std::min(best, timing::NowNs() - start);
+        }
+        return best;
+    }
+
+    void PrintRow(const std::string &name, double value, const char *unit)
+    {
+        std::cout << std::left << std::setw(40) << name << std::right << std::fixed << std::setprecision(1) << std::setw(12) << value << " " << unit << "\n";
+    }
+
+    // Damage replay: the region work of one kompletegui display update, for a synthetic trace of updates.
+
+    // both Komplete Kontrol displays, side by side:
+    constexpr int sDisplayWidth = 960;
+    constexpr int sDisplayHeight = 272;
+
+    class TDamageFrame
+    {
+    public:
+        std::vector<utils::TIntRect> m_Damage;
+        std::vector<utils::TIntRect> m_Overlays;
+    };
+
+    // The screen is a grid of 8 x 4 cells, like the parameter pages. A typical update changes a few labels or values;
+    // one in ten repaints a whole display. There are 8 slider overlays along the top.
+    std::vector<TDamageFrame> DamageTrace(size_t numframes)
+    {
+        std::mt19937 rng(1);
+        constexpr int cellwidth = sDisplayWidth / 8;
+        constexpr int cellheight = sDisplayHeight / 4;
+        std::vector<TDamageFrame> result(numframes);
+        for(auto &frame: result)
+        {
+            if(rng() % 10 == 0)
+            {
+                int display = (int)(rng() % 2);
+                frame.m_Damage.push_back(utils::TIntRect::FromTopLeftAndBottomRight({display * sDisplayWidth / 2, 0}, {(display + 1) * sDisplayWidth / 2, sDisplayHeight}));
+            }
+            auto numchanges = 1 + rng() % 12;
+            for(size_t i = 0; i < numchanges; i++)
+            {
+                int left = cellwidth * (int)(rng() % 8);
+                int top = cellheight * (int)(rng() % 4);
+                // a label in the top half of the cell or a value in the bottom half:
+                int part = (int)(rng() % 2);
+                frame.m_Damage.push_back(utils::TIntRect::FromTopLeftAndBottomRight({left + 4, top + 4 + part * cellheight / 2}, {left + cellwidth - 4, top + (part + 1) * cellheight / 2}));
+            }
+            for(int i = 0; i < 8; i++)
+            {
+                frame.m_Overlays.push_back(utils::TIntRect::FromTopLeftAndBottomRight({i * cellwidth + 8, 20}, {(i + 1) * cellwidth - 8, 40}));
+            }
+        }
+        return result;
+    }
+
+    // returns the painted area, so both implementations can be checked to do the same work
+    int64_t ReplayDamage(const std::vector<TDamageFrame> &trace)
+    {
+        int64_t area = 0;
+        auto screen = utils::TIntRect::FromSize({sDisplayWidth, sDisplayHeight});
+        for(const auto &frame: trace)
+        {
+            utils::TIntRegion dirtyregion;
+            for(const auto &rect: frame.m_Damage)
+            {
+                dirtyregion.UnionWith(rect);
+            }
+            utils::TIntRegion overlayregion;
+            for(const auto &overlay: frame.m_Overlays)
+            {
+                utils::TIntRegion overlayrect(overlay);
+                if(dirtyregion.Intersects(overlayrect))
+                {
+                    overlayregion.UnionWith(overlayrect);
+                }
+            }
+            dirtyregion.UnionWith(overlayregion);
+            dirtyregion.IntersectWith(screen);
+            dirtyregion.ForEach([&](const utils::TIntRect &r){ area += (int64_t)r.Width() * r.Height(); });
+        }
+        return area;
+    }
+
+    // the same with the implementation before the flat region storage, as kompletegui used it then:
+    int64_t ReplayDamageReference(const std::vector<TDamageFrame> &trace)
+    {
+        int64_t area = 0;
+        auto screen = utils::TReferenceRegion<int>(utils::TIntRect::FromSize({sDisplayWidth, sDisplayHeight}));
+        for(const auto &frame: trace)
+        {
+            utils::TReferenceRegion<int> dirtyregion;
+            for(const auto &rect: frame.m_Damage)
+            {
+                dirtyregion = dirtyregion.Union(rect);
+            }
+            utils::TReferenceRegion<int> overlayregion;
+            for(const auto &overlay: frame.m_Overlays)
+            {
+                utils::TReferenceRegion<int> overlayrect(overlay);
+                if(dirtyregion.Intersects(overlayrect))
+                {
+                    overlayregion = overlayregion.Union(overlayrect);
+                }
+            }
+            dirtyregion = dirtyregion.Union(overlayregion);
+            dirtyregion = dirtyregion.Intersection(screen);
+            dirtyregion.ForEach([&](const utils::TIntRect &r){ area += (int64_t)r.Width() * r.Height(); });
+        }
+        return area;
+    }
+
+    void BenchRegion(const std::string &/*projectDir*/)
+    {
+        constexpr size_t numframes = 20000;
+        auto trace = DamageTrace(numframes);
+        size_t numrects = 0;
+        for(const auto &frame: trace) numrects += frame.m_Damage.size();
+        int64_t area = 0, referencearea = 0;
+        auto ns = BestOfNs(5, [&]{ area = ReplayDamage(trace); });
+        auto referencens = BestOfNs(5, [&]{ referencearea = ReplayDamageReference(trace); });
+        if(area != referencearea)
+        {
+            throw std::runtime_error("TTypedRegion and the reference region painted a different area");
+        }
+        std::cout << "Damage replay: " << numframes << " display updates, " << std::fixed << std::setprecision(1) << (double)numrects / numframes << " damaged rectangles per update\n";
+        PrintRow("TTypedRegion", (double)ns / numframes, "ns/update");
+        PrintRow("TReferenceRegion (before)", (double)referencens / numframes, "ns/update");
+        PrintRow("Speedup", (double)referencens / (double)ns, "x");
+    }
+
+    // Event loop contention: producer threads signal actions of one event loop thread as fast as they can.
+
+    // The queue of TThreadWithEventLoop before the lock-free queue: a mutex protected set of signaled actions and a
+    // condition variable to wake the thread.
+    class TReferenceEventLoop
+    {
+    public:
+        class TAction
+        {
+        public:
+            std::function<void(void)> m_Func;
+        };
+        void Run()
+        {
+            m_Thread = std::thread([this](){
+                while(true)
+                {
+                    TAction *action = nullptr;
+                    {
+                        std::unique_lock<std::mutex> lock(m_Mutex);
+                        m_QueueCond.wait(lock, [this](){
+                            return m_RequestTerminate || !m_SignaledActions.empty();
+                        });
+                        if(!m_SignaledActions.empty())
+                        {
+                            action = *m_SignaledActions.begin();
+                            m_SignaledActions.erase(m_SignaledActions.begin());
+                        }
+                        else if(m_RequestTerminate)
+                        {
+                            break;
+                        }
+                    }
+                    action->m_Func();
+                }
+            });
+        }
+        void Stop()
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_Mutex);
+                m_RequestTerminate = true;
+                m_QueueCond.notify_one();
+            }
+            m_Thread.join();
+        }
+        void Signal(TAction *action)
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            bool mustwakeup = m_SignaledActions.empty();
+            m_SignaledActions.insert(action);
+            if(mustwakeup)
+            {
+                m_QueueCond.notify_one();
+            }
+        }
+
+    private:
+        std::thread m_Thread;
+        std::mutex m_Mutex;
+        std::condition_variable m_QueueCond;
+        std::set<TAction*> m_SignaledActions;
+        bool m_RequestTerminate = false;
+    };
+
+    class TContentionResult
+    {
+    public:
+        double m_NsPerSignal = 0.0;
+        uint64_t m_Calls = 0;
+    };
+
+    constexpr size_t sSignalsPerProducer = 200000;
+    constexpr size_t sActionsPerProducer = 4;
+
+    // starts the producers together and returns the wall time until the last one has finished, per signal
+    template <class Function>
+    double RunProducers(size_t numproducers, const Function &producer)
+    {
+        std::atomic<bool> go = false;
+        std::vector<std::thread> threads;
+        for(size_t i = 0; i < numproducers; i++)
+        {
+            threads.emplace_back([&, i](){
+                while(!go.load(std::memory_order_acquire)) std::this_thread::yield();
+                producer(i);
+            });
+        }
+        auto start = timing::NowNs();
+        go.store(true, std::memory_order_release);
+        for(auto &thread: threads) thread.join();
+        return (double)(timing::NowNs() - start) / (double)(numproducers * sSignalsPerProducer);
+    }
+
+    TContentionResult EventLoopContention(size_t numproducers)
+    {
+        std::atomic<uint64_t> calls = 0;
+        utils::TThreadWithEventLoop eventloop;
+        std::vector<std::unique_ptr<utils::TEventLoopAction>> actions;
+        // actions are created and destroyed while this thread owns the event loop, i.e. before Run() and after Stop():
+        for(size_t i = 0; i < numproducers * sActionsPerProducer; i++)
+        {
+            actions.push_back(std::make_unique<utils::TEventLoopAction>(eventloop, [&](){ calls.fetch_add(1, std::memory_order_relaxed); }));
+        }
+        eventloop.Run();
+        TContentionResult result;
+        result.m_NsPerSignal = RunProducers(numproducers, [&](size_t producer){
+            for(size_t i = 0; i < sSignalsPerProducer; i++)
+            {
+                actions[producer * sActionsPerProducer + i % sActionsPerProducer]->Signal();
+            }
+        });
+        eventloop.Stop();
+        actions.clear();
+        result.m_Calls = calls;
+        return result;
+    }
+
+    TContentionResult ReferenceEventLoopContention(size_t numproducers)
+    {
+        std::atomic<uint64_t> calls = 0;
+        TReferenceEventLoop eventloop;
+        std::vector<TReferenceEventLoop::TAction> actions(numproducers * sActionsPerProducer);
+        for(auto &action: actions)
+        {
+            action.m_Func = [&](){ calls.fetch_add(1, std::memory_order_relaxed); };
+        }
+        eventloop.Run();
+        TContentionResult result;
+        result.m_NsPerSignal = RunProducers(numproducers, [&](size_t producer){
+            for(size_t i = 0; i < sSignalsPerProducer; i++)
+            {
+                eventloop.Signal(&actions[producer * sActionsPerProducer + i % sActionsPerProducer]);
+            }
+        });
+        eventloop.Stop();
+        result.m_Calls = calls;
+        return result;
+    }
+
+    void BenchEventLoop(const std::string &/*projectDir*/)
+    {
+        std::cout << "Event loop contention: " << sSignalsPerProducer << " signals per producer thread, spread over " << sActionsPerProducer << " actions per producer\n";
+        std::cout << "Signals of an action that is still queued coalesce, 'calls' is the number of actions actually run.\n\n";
+        std::cout << std::left << std::setw(12) << "producers" << std::right << std::setw(20) << "lock-free ns/signal" << std::setw(16) << "calls" << std::setw(20) << "mutex ns/signal" << std::setw(16) << "calls" << "\n";
+        auto maxproducers = std::max<size_t>(8, std::thread::hardware_concurrency());
+        for(size_t numproducers = 1; numproducers <= maxproducers; numproducers *= 2)
+        {
+            auto lockfree = EventLoopContention(numproducers);
+            auto reference = ReferenceEventLoopContention(numproducers);
+            std::cout << std::left << std::setw(12) << numproducers << std::right << std::fixed << std::setprecision(1)
+                << std::setw(20) << lockfree.m_NsPerSignal << std::setw(16) << lockfree.m_Calls
+                << std::setw(20) << reference.m_NsPerSignal << std::setw(16) << reference.m_Calls << "\n";
+        }
+    }
+
+    // URID map contention: threads look up URIs that are mostly mapped already, as plugins do from run().
+
+    // World::UriMapLookup before the lock-free map: a mutex and a std::map, with a std::string constructed per call.
+    class TReferenceUriMap
+    {
+    public:
+        LV2_URID Map(const std::string &str)
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            auto it = m_UriMap.find(str);
+            if(it != m_UriMap.end())
+            {
+                return (LV2_URID)it->second;
+            }
+            auto index = m_UriMapReverse.size() + 1;
+            m_UriMap.emplace(str, index);
+            m_UriMapReverse.push_back(str);
+            return (LV2_URID)index;
+        }
+
+    private:
+        std::mutex m_Mutex;
+        std::map<std::string, size_t> m_UriMap;
+        std::vector<std::string> m_UriMapReverse;
+    };
+
+    constexpr size_t sLookupsPerThread = 200000;
+    constexpr size_t sKnownUris = 256;
+    // spread over all threads, so the map does not fill up:
+    constexpr size_t sNewUris = 1024;
+
+    // per thread the URIs to map in order: mostly a fixed set, every now and then one that no thread has mapped yet
+    std::vector<std::vector<std::string>> UriLoad(size_t numthreads)
+    {
+        std::mt19937 rng(1);
+        std::vector<std::string> known;
+        for(size_t i = 0; i < sKnownUris; i++)
+        {
+            known.push_back("http://example.org/plugins/plugin" + std::to_string(i / 16) + "#parameter" + std::to_string(i % 16));
+        }
+        std::vector<std::vector<std::string>> result(numthreads);
+        auto newperthread = sNewUris / numthreads;
+        for(size_t thread = 0; thread < numthreads; thread++)
+        {
+            for(size_t i = 0; i < sLookupsPerThread; i++)
+            {
+                if(i % (sLookupsPerThread / newperthread) == 0)
+                {
+                    result[thread].push_back("http://example.org/new/thread" + std::to_string(thread) + "#uri" + std::to_string(i));
+                }
+                else
+                {
+                    result[thread].push_back(known[rng() % known.size()]);
+                }
+            }
+        }
+        return result;
+    }
+
+    // runs the threads together and returns the wall time until the last one has finished, per lookup
+    template <class Function>
+    double RunLookups(const std::vector<std::vector<std::string>> &load, const Function &map)
+    {
+        std::atomic<bool> go = false;
+        std::atomic<uint64_t> checksum = 0;
+        std::vector<std::thread> threads;
+        for(const auto &uris: load)
+        {
+            threads.emplace_back([&](){
+                while(!go.load(std::memory_order_acquire)) std::this_thread::yield();
+                uint64_t sum = 0;
+                for(const auto &uri: uris)
+                {
+                    // plugins pass a C string:
+                    sum += map(uri.c_str());
+                }
+                checksum += sum;
+            });
+        }
+        auto start = timing::NowNs();
+        go.store(true, std::memory_order_release);
+        for(auto &thread: threads) thread.join();
+        if(checksum == 0) throw std::runtime_error("URID map benchmark did not map anything");
+        return (double)(timing::NowNs() - start) / (double)(load.size() * sLookupsPerThread);
+    }
+
+    void BenchUriMap(const std::string &/*projectDir*/)
+    {
+        std::cout << "URID map contention: " << sLookupsPerThread << " lookups per thread from " << sKnownUris << " URIs, " << sNewUris << " new URIs spread over all threads\n\n";
+        std::cout << std::left << std::setw(12) << "threads" << std::right << std::setw(20) << "lock-free ns/map" << std::setw(20) << "mutex ns/map" << "\n";
+        auto maxthreads = std::max<size_t>(8, std::thread::hardware_concurrency());
+        for(size_t numthreads = 1; numthreads <= maxthreads; numthreads *= 2)
+        {
+            auto load = UriLoad(numthreads);
+            auto map = std::make_unique<urimap::UriMap>();
+            auto lockfree = RunLookups(load, [&](const char *uri){ return map->Map(uri); });
+            TReferenceUriMap referencemap;
+            auto reference = RunLookups(load, [&](const char *uri){ return referencemap.Map(uri); });
+            std::cout << std::left << std::setw(12) << numthreads << std::right << std::fixed << std::setprecision(1)
+                << std::setw(20) << lockfree << std::setw(20) << reference << "\n";
+        }
+    }
+
+    // Level meters: the work per meter frame (30 Hz) in kompletegui for the performance page of a project, without the
+    // USB transfer. Before the meters were overlays, each frame copied the gui state into Gui::SetGuiState(), which
+    // compared the engine data, rebuilt the window tree with the meters in it, diffed it against the previous tree and
+    // repainted the difference.
+
+    class TMeterFrame
+    {
+    public:
+        float m_OutputLevel;
+        float m_OutputPeakLevel;
+        std::vector<realtimethread::TStereoLevel> m_PartLevels;
+    };
+
+    std::vector<TMeterFrame> MeterFrames(size_t numframes, size_t numparts)
+    {
+        std::vector<TMeterFrame> result;
+        float peak = -100.0f;
+        for(size_t frame = 0; frame < numframes; frame++)
+        {
+            TMeterFrame meterframe;
+            meterframe.m_OutputLevel = -30.0f + 25.0f * (float)std::sin(0.3 * (double)frame);
+            // the peak level is refreshed every 500 ms:
+            if(frame % 15 == 0) peak = meterframe.m_OutputLevel + 3.0f;
+            meterframe.m_OutputPeakLevel = peak;
+            for(size_t part = 0; part < numparts; part++)
+            {
+                auto &level = meterframe.m_PartLevels.emplace_back();
+                float db = -35.0f + 30.0f * (float)std::sin(0.2 * (double)frame + (double)part);
+                level.m_MeanSquare = {std::pow(10.0f, db / 10.0f), std::pow(10.0f, (db - 2.0f) / 10.0f)};
+                level.m_TruePeak = {std::pow(10.0f, (db + 10.0f) / 20.0f), std::pow(10.0f, (db + 8.0f) / 20.0f)};
+            }
+            result.push_back(std::move(meterframe));
+        }
+        return result;
+    }
+
+    void BenchOverlays(const std::string &projectDir)
+    {
+        auto projectfile = projectDir + "/project.json";
+        if(!std::filesystem::exists(projectfile))
+        {
+            throw std::runtime_error("project file does not exist: " + projectfile);
+        }
+        komplete::TGuiState state;
+        state.SetEngineData(engine::Engine::TData().ChangeProject(project::ProjectFromFile(projectfile)));
+        auto numparts = state.EngineData().Project().Parts().size();
+        if(numparts > 0)
+        {
+            state.SetFocusedPart(0);
+        }
+        constexpr size_t numframes = 300;
+        auto frames = MeterFrames(numframes, numparts);
+        std::vector<unsigned char> pixels((size_t)komplete::Display::sHeight * komplete::Display::sDisplayBufferStride);
+        auto pixelbuf = (uint16_t*)pixels.data();
+        bool onlyoverlays = false;
+
+        // now: the window tree is painted once, each frame only changes the overlays
+        komplete::TLcdPainter painter;
+        painter.Update(pixelbuf, komplete::Gui::CreateWindow(state), std::nullopt, onlyoverlays);
+        std::vector<komplete::TOverlaySlider> prevoverlays;
+        int64_t area = 0;
+        auto start = timing::NowNs();
+        for(const auto &frame: frames)
+        {
+            auto overlays = komplete::Gui::CreateOverlays(state, frame.m_OutputLevel, frame.m_OutputPeakLevel, frame.m_PartLevels);
+            if(overlays != prevoverlays)
+            {
+                prevoverlays = overlays;
+                auto region = painter.Update(pixelbuf, nullptr, std::move(overlays), onlyoverlays);
+                region.ForEach([&](const utils::TIntRect &r){ area += (int64_t)r.Width() * r.Height(); });
+            }
+        }
+        auto ns = timing::NowNs() - start;
+
+        // before: the meters were part of the window tree
+        komplete::TLcdPainter referencepainter;
+        referencepainter.Update(pixelbuf, komplete::Gui::CreateWindow(state), std::nullopt, onlyoverlays);
+        int64_t referencearea = 0;
+        auto referencestart = timing::NowNs();
+        for(const auto &frame: frames)
+        {
+            auto newstate = state;
+            if(newstate.EngineData() != state.EngineData())
+            {
+                throw std::runtime_error("gui state copy differs");
+            }
+            auto window = komplete::Gui::CreateWindow(newstate);
+            for(const auto &overlay: komplete::Gui::CreateOverlays(newstate, frame.m_OutputLevel, frame.m_OutputPeakLevel, frame.m_PartLevels))
+            {
+                window->AddChild<simplegui::TSlider>(overlay.m_Rect, overlay.m_Text, overlay.m_Value, overlay.m_Color);
+            }
+            auto region = referencepainter.Update(pixelbuf, std::move(window), std::nullopt, onlyoverlays);
+            region.ForEach([&](const utils::TIntRect &r){ referencearea += (int64_t)r.Width() * r.Height(); });
+        }
+        auto referencens = timing::NowNs() - referencestart;
+
+        std::cout << "Level meters: " << numframes << " meter frames on the performance page of " << projectfile << " (" << numparts << " parts), without the USB transfer\n";
+        PrintRow("Overlays", (double)ns / 1000.0 / numframes, "us/frame");
+        PrintRow("Overlays, pixels sent", (double)area / numframes, "px/frame");
+        PrintRow("Window tree (before)", (double)referencens / 1000.0 / numframes, "us/frame");
+        PrintRow("Window tree, pixels sent", (double)referencearea / numframes, "px/frame");
+    }
+
+    class TBenchmark
+    {
+    public:
+        const char *m_Name;
+        void (*m_Func)(const std::string &projectDir);
+    };
+
+    constexpr TBenchmark sBenchmarks[] = {
+        {"region", BenchRegion},
+        {"eventloop", BenchEventLoop},
+        {"urimap", BenchUriMap},
+        {"overlays", BenchOverlays},
+    };
+}
+
+namespace microbench
+{
+    bool Run(const std::string &name, const std::string &projectDir)
+    {
+        for(const auto &benchmark: sBenchmarks)
+        {
+            if(name == benchmark.m_Name)
+            {
+                benchmark.m_Func(projectDir);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::string Names()
+    {
+        std::string result;
+        for(const auto &benchmark: sBenchmarks)
+        {
+            if(!result.empty()) result += ", ";
+            result += benchmark.m_Name;
+        }
+        return result;
+    }
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include <string>
+
+// Micro benchmarks of single components, run by jnlive_bench --micro <name>. They compare the current implementation
+// against the one it replaced where that is still available.
+
+namespace microbench
+{
+    // returns false if there is no benchmark of that name. Benchmarks that need a project read it from projectDir.
+    bool Run(const std::string &name, const std::string &projectDir);
+    std::string Names();
+}
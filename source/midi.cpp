@@ -2,9 +2,82 @@ module;
 
 #include <sstream>
 #include <optional>
+#include <array>
+#include <vector>
+#include <bit>
 
 module midi;
 
+namespace {
+    // Free lists of overflow blocks for long sysex messages, in power of two sizes. Each thread has its own pool, so no
+    // locking is needed; a block freed on another thread than it was allocated on simply moves to that thread's pool.
+    class TSysexPool
+    {
+    public:
+        static constexpr size_t sMinBlockSize = 64;
+        static constexpr size_t sNumClasses = 12; // up to 128 kB
+        static constexpr size_t sMaxFreePerClass = 32;
+        ~TSysexPool()
+        {
+            for(auto &freelist: m_Free)
+            {
+                for(auto block: freelist)
+                {
+                    delete[] block;
+                }
+            }
+        }
+        char* Allocate(size_t size, size_t &capacity)
+        {
+            auto sizeclass = SizeClass(size);
+            if(sizeclass >= sNumClasses)
+            {
+                // too large to keep around:
+                capacity = size;
+                return new char[size];
+            }
+            capacity = sMinBlockSize << sizeclass;
+            auto &freelist = m_Free[sizeclass];
+            if(!freelist.empty())
+            {
+                auto block = freelist.back();
+                freelist.pop_back();
+                return block;
+            }
+            return new char[capacity];
+        }
+        void Free(char *block, size_t capacity)
+        {
+            auto sizeclass = SizeClass(capacity);
+            if( (sizeclass < sNumClasses) && ((sMinBlockSize << sizeclass) == capacity) )
+            {
+                auto &freelist = m_Free[sizeclass];
+                if(freelist.capacity() == 0)
+                {
+                    freelist.reserve(sMaxFreePerClass);
+                }
+                if(freelist.size() < sMaxFreePerClass)
+                {
+                    freelist.push_back(block);
+                    return;
+                }
+            }
+            delete[] block;
+        }
+
+    private:
+        static size_t SizeClass(size_t size)
+        {
+            if(size <= sMinBlockSize) return 0;
+            return (size_t)std::bit_width((size - 1) / sMinBlockSize);
+        }
+
+    private:
+        std::array<std::vector<char*>, sNumClasses> m_Free;
+    };
+    thread_local TSysexPool tSysexPool;
+}
+
 namespace midi {
     bool SimpleEvent::IsSupported(const void *buf, size_t size)
     {
@@ -184,15 +257,91 @@ namespace midi {
         return str.str();
     }
 
+    TMidiOrSysexEvent::TMidiOrSysexEvent(const void *buf, size_t size)
+    {
+        if(!IsSupported(buf, size))
+        {
+            throw std::runtime_error("midi event not supported");
+        }
+        m_IsSysex = !SimpleEvent::IsSupported(buf, size);
+        Assign((const char*)buf, size);
+    }
+    TMidiOrSysexEvent::TMidiOrSysexEvent(const TMidiOrSysexEvent &other) : m_IsSysex(other.m_IsSysex)
+    {
+        auto span = other.Span();
+        Assign(span.data(), span.size());
+    }
+    TMidiOrSysexEvent::TMidiOrSysexEvent(TMidiOrSysexEvent &&other) noexcept : m_Overflow(other.m_Overflow), m_OverflowCapacity(other.m_OverflowCapacity), m_Size(other.m_Size), m_IsSysex(other.m_IsSysex), m_Inline(other.m_Inline)
+    {
+        other.m_Overflow = nullptr;
+        other.m_OverflowCapacity = 0;
+    }
+    TMidiOrSysexEvent& TMidiOrSysexEvent::operator=(const TMidiOrSysexEvent &other)
+    {
+        if(this != &other)
+        {
+            m_IsSysex = other.m_IsSysex;
+            auto span = other.Span();
+            Assign(span.data(), span.size());
+        }
+        return *this;
+    }
+    TMidiOrSysexEvent& TMidiOrSysexEvent::operator=(TMidiOrSysexEvent &&other) noexcept
+    {
+        if(this != &other)
+        {
+            ReleaseOverflow();
+            m_Overflow = other.m_Overflow;
+            m_OverflowCapacity = other.m_OverflowCapacity;
+            m_Size = other.m_Size;
+            m_IsSysex = other.m_IsSysex;
+            m_Inline = other.m_Inline;
+            other.m_Overflow = nullptr;
+            other.m_OverflowCapacity = 0;
+        }
+        return *this;
+    }
+    TMidiOrSysexEvent::~TMidiOrSysexEvent()
+    {
+        ReleaseOverflow();
+    }
+    void TMidiOrSysexEvent::Assign(const char *buf, size_t size)
+    {
+        if(size <= sInlineSize)
+        {
+            ReleaseOverflow();
+            std::copy(buf, buf + size, m_Inline.begin());
+        }
+        else
+        {
+            // keep the block we have if it is large enough:
+            if(m_OverflowCapacity < size)
+            {
+                ReleaseOverflow();
+                m_Overflow = tSysexPool.Allocate(size, m_OverflowCapacity);
+            }
+            std::copy(buf, buf + size, m_Overflow);
+        }
+        m_Size = (uint32_t)size;
+    }
+    void TMidiOrSysexEvent::ReleaseOverflow()
+    {
+        if(m_Overflow)
+        {
+            tSysexPool.Free(m_Overflow, m_OverflowCapacity);
+            m_Overflow = nullptr;
+            m_OverflowCapacity = 0;
+        }
+    }
     void TMidiOrSysexEvent::ToDebugStream(std::ostream &str) const
     {
-        if(m_Event)
+        if(!m_IsSysex)
         {
-            m_Event->ToDebugStream(str);
+            GetSimpleEvent().ToDebugStream(str);
         }
         else
         {
-            str << "sysex (" << m_SysexEvent.size() << " bytes)";
+            str << "sysex (" << m_Size << " bytes)";
         }
     }
     std::string TMidiOrSysexEvent::ToDebugString() const
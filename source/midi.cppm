@@ -77,9 +77,13 @@ export namespace midi
     private:
         std::array<char, 3> m_Data {0,0,0};
     };
+    // A midi message or a complete sysex message. Messages up to sInlineSize bytes are stored in the object itself,
+    // longer sysex messages in a block from a per thread pool, so creating and copying events does not touch the heap
+    // once the pool has warmed up.
     class TMidiOrSysexEvent
     {
     public:
+        static constexpr size_t sInlineSize = 32;
         static bool IsSupported(const void *buf, size_t size)
         {
             if(SimpleEvent::IsSupported(buf, size))
@@ -98,51 +102,47 @@ export namespace midi
             }
             return false; // illegal message
         }
-        TMidiOrSysexEvent(const SimpleEvent &event) : m_Event(event)
+        static bool IsSupported(std::span<const char> data)
         {
+            return IsSupported(data.data(), data.size());
         }
-        TMidiOrSysexEvent(const void *buf, size_t size)
+        TMidiOrSysexEvent(const SimpleEvent &event) : m_Size((uint32_t)event.Size())
+        {
+            std::copy(event.Buffer(), event.Buffer() + m_Size, m_Inline.begin());
+        }
+        TMidiOrSysexEvent(const void *buf, size_t size);
+        TMidiOrSysexEvent(std::span<const char> data) : TMidiOrSysexEvent(data.data(), data.size())
         {
-            if(!IsSupported(buf, size))
-            {
-                throw std::runtime_error("midi event not supported");
-            }
-            if(SimpleEvent::IsSupported(buf, size))
-            {
-                m_Event = SimpleEvent(buf, size);
-            }
-            else
-            {
-                m_SysexEvent.resize(size);
-                std::copy((const char*)buf, (const char*)buf + size, m_SysexEvent.begin());
-            }
         }
+        TMidiOrSysexEvent(const TMidiOrSysexEvent &other);
+        TMidiOrSysexEvent(TMidiOrSysexEvent &&other) noexcept;
+        TMidiOrSysexEvent& operator=(const TMidiOrSysexEvent &other);
+        TMidiOrSysexEvent& operator=(TMidiOrSysexEvent &&other) noexcept;
+        ~TMidiOrSysexEvent();
         bool IsSysex() const
         {
-            return !m_Event;
+            return m_IsSysex;
         }
-        const SimpleEvent& GetSimpleEvent() const
+        SimpleEvent GetSimpleEvent() const
         {
-            if(!m_Event)
+            if(m_IsSysex)
             {
                 throw std::runtime_error("It's a sysex event");
             }
-            return *m_Event;
+            return SimpleEvent(m_Inline.data(), m_Size);
         }
+        // empty if it is not a sysex event
         std::span<const char> GetSysexEvent() const
         {
-            return m_SysexEvent;
+            if(!m_IsSysex)
+            {
+                return {};
+            }
+            return Span();
         }
         std::span<const char> Span() const
         {
-            if(IsSysex())
-            {
-                return GetSysexEvent();
-            }
-            else
-            {
-                return GetSimpleEvent().Span();
-            }
+            return {m_Overflow? m_Overflow : m_Inline.data(), m_Size};
         }
         void ToDebugStream(std::ostream &str) const;
         std::string ToDebugString() const;
@@ -156,7 +156,15 @@ export namespace midi
         }
 
     private:
-        std::optional<SimpleEvent> m_Event;
-        std::vector<char> m_SysexEvent;
+        void Assign(const char *buf, size_t size);
+        void ReleaseOverflow();
+
+    private:
+        // null if the message fits in m_Inline:
+        char *m_Overflow = nullptr;
+        size_t m_OverflowCapacity = 0;
+        uint32_t m_Size = 0;
+        bool m_IsSysex = false;
+        std::array<char, sInlineSize> m_Inline;
     };
 }
\ No newline at end of file
@@ -0,0 +1,259 @@
+#include "midifile.h"
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <algorithm>
+#include <optional>
+
+namespace
+{
+    class TReader
+    {
+    public:
+        TReader(const uint8_t *begin, const uint8_t *end) : m_Pos(begin), m_End(end) {}
+        bool AtEnd() const { return m_Pos >= m_End; }
+        size_t Remaining() const { return (size_t)(m_End - m_Pos); }
+        uint8_t Peek() const
+        {
+            Need(1);
+            return *m_Pos;
+        }
+        uint8_t Byte()
+        {
+            Need(1);
+            return *m_Pos++;
+        }
+        uint32_t BigEndian(size_t numbytes)
+        {
+            uint32_t result = 0;
+            for(size_t i = 0; i < numbytes; i++)
+            {
+                result = (result << 8) | Byte();
+            }
+            return result;
+        }
+        uint32_t VarLen()
+        {
+            uint32_t result = 0;
+            for(int i = 0; i < 4; i++)
+            {
+                auto b = Byte();
+                result = (result << 7) | (b & 0x7F);
+                if((b & 0x80) == 0) return result;
+            }
+            throw std::runtime_error("invalid variable length quantity in MIDI file");
+        }
+        const uint8_t* Take(size_t size)
+        {
+            Need(size);
+            auto result = m_Pos;
+            m_Pos += size;
+            return result;
+        }
+
+    private:
+        void Need(size_t size) const
+        {
+            if(Remaining() < size)
+            {
+                throw std::runtime_error("unexpected end of MIDI file");
+            }
+        }
+
+    private:
+        const uint8_t *m_Pos;
+        const uint8_t *m_End;
+    };
+
+    class TTickEvent
+    {
+    public:
+        uint64_t m_Tick;
+        size_t m_Track;
+        // microseconds per quarter note for tempo events:
+        std::optional<uint32_t> m_Tempo;
+        std::vector<uint8_t> m_Data;
+    };
+
+    size_t ChannelMessageSize(uint8_t status)
+    {
+        switch(status & 0xF0)
+        {
+            case 0xC0:
+            case 0xD0:
+                return 2;
+            default:
+                return 3;
+        }
+    }
+
+    void ReadTrack(TReader reader, size_t track, std::vector<TTickEvent> &events)
+    {
+        uint64_t tick = 0;
+        uint8_t runningstatus = 0;
+        std::vector<uint8_t> pendingsysex;
+        while(!reader.AtEnd())
+        {
+            tick += reader.VarLen();
+            uint8_t status = reader.Peek();
+            if(status & 0x80)
+            {
+                reader.Byte();
+            }
+            else
+            {
+                if(runningstatus == 0)
+                {
+                    throw std::runtime_error("MIDI data without status byte");
+                }
+                status = runningstatus;
+            }
+            if(status == 0xFF)
+            {
+                auto type = reader.Byte();
+                auto len = reader.VarLen();
+                auto data = reader.Take(len);
+                if( (type == 0x51) && (len == 3) )
+                {
+                    uint32_t tempo = ((uint32_t)data[0] << 16) | ((uint32_t)data[1] << 8) | data[2];
+                    events.push_back(TTickEvent{tick, track, tempo, {}});
+                }
+                else if(type == 0x2F)
+                {
+                    break;
+                }
+            }
+            else if( (status == 0xF0) || (status == 0xF7) )
+            {
+                // F0 starts a sysex message, F7 continues a message split over several events:
+                auto len = reader.VarLen();
+                auto data = reader.Take(len);
+                if(status == 0xF0)
+                {
+                    pendingsysex.assign({0xF0});
+                }
+                pendingsysex.insert(pendingsysex.end(), data, data + len);
+                if( (!pendingsysex.empty()) && (pendingsysex.back() == 0xF7) )
+                {
+                    events.push_back(TTickEvent{tick, track, std::nullopt, std::move(pendingsysex)});
+                    pendingsysex.clear();
+                }
+                runningstatus = 0;
+            }
+            else if(status >= 0xF0)
+            {
+                throw std::runtime_error("unexpected system message in MIDI file");
+            }
+            else
+            {
+                runningstatus = status;
+                std::vector<uint8_t> data {status};
+                for(size_t i = 1; i < ChannelMessageSize(status); i++)
+                {
+                    data.push_back(reader.Byte() & 0x7F);
+                }
+                // note on with velocity 0 is a note off; make that explicit for the plugins:
+                if( ((status & 0xF0) == 0x90) && (data[2] == 0) )
+                {
+                    data[0] = 0x80 | (status & 0x0F);
+                    data[2] = 64;
+                }
+                events.push_back(TTickEvent{tick, track, std::nullopt, std::move(data)});
+            }
+        }
+    }
+}
+
+namespace midifile
+{
+    TMidiFile TMidiFile::FromFile(const std::string &filename)
+    {
+        std::ifstream ifs(filename, std::ios::binary);
+        if(!ifs)
+        {
+            throw std::runtime_error("Could not open file for reading: " + filename);
+        }
+        std::vector<uint8_t> content((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+        TReader reader(content.data(), content.data() + content.size());
+        auto readtag = [&reader]() {
+            auto tag = reader.Take(4);
+            return std::string((const char*)tag, 4);
+        };
+        if(readtag() != "MThd")
+        {
+            throw std::runtime_error("Not a MIDI file: " + filename);
+        }
+        auto headerlen = reader.BigEndian(4);
+        if(headerlen < 6)
+        {
+            throw std::runtime_error("Invalid MIDI file header: " + filename);
+        }
+        auto format = reader.BigEndian(2);
+        auto numtracks = reader.BigEndian(2);
+        auto division = reader.BigEndian(2);
+        reader.Take(headerlen - 6);
+        if(format > 1)
+        {
+            throw std::runtime_error("Only MIDI file formats 0 and 1 are supported: " + filename);
+        }
+        if(division == 0)
+        {
+            throw std::runtime_error("Invalid MIDI file division: " + filename);
+        }
+
+        std::vector<TTickEvent> events;
+        for(size_t track = 0; (track < numtracks) && (!reader.AtEnd()); )
+        {
+            auto tag = readtag();
+            auto len = reader.BigEndian(4);
+            auto data = reader.Take(len);
+            if(tag == "MTrk")
+            {
+                ReadTrack(TReader(data, data + len), track, events);
+                track++;
+            }
+        }
+        std::stable_sort(events.begin(), events.end(), [](const TTickEvent &a, const TTickEvent &b){
+            return a.m_Tick < b.m_Tick;
+        });
+
+        // apply the tempo map:
+        TMidiFile result;
+        double secondsPerTick;
+        bool smpte = (division & 0x8000) != 0;
+        if(smpte)
+        {
+            // frames per second in the upper byte (two's complement), ticks per frame in the lower byte:
+            auto framespersecond = -(int)(int8_t)(division >> 8);
+            auto ticksperframe = division & 0xFF;
+            if( (framespersecond <= 0) || (ticksperframe == 0) )
+            {
+                throw std::runtime_error("Invalid MIDI file division: " + filename);
+            }
+            secondsPerTick = 1.0 / (framespersecond * ticksperframe);
+        }
+        else
+        {
+            secondsPerTick = 0.5 / division; // 120 bpm until the first tempo event
+        }
+        uint64_t lasttick = 0;
+        double lasttime = 0.0;
+        for(auto &event: events)
+        {
+            lasttime += (double)(event.m_Tick - lasttick) * secondsPerTick;
+            lasttick = event.m_Tick;
+            if(event.m_Tempo)
+            {
+                if(!smpte)
+                {
+                    secondsPerTick = (double)*event.m_Tempo / 1e6 / division;
+                }
+            }
+            else
+            {
+                result.m_Events.emplace_back(lasttime, std::move(event.m_Data));
+            }
+        }
+        return result;
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace midifile
+{
+    // A Standard MIDI File (format 0 or 1), flattened to a single list of channel and sysex events sorted by time.
+    // Meta events are dropped after the tempo map has been applied.
+    class TMidiFile
+    {
+    public:
+        class TEvent
+        {
+        public:
+            TEvent(double time, std::vector<uint8_t> &&data) : m_Time(time), m_Data(std::move(data)) {}
+            // in seconds from the start of the file:
+            double Time() const { return m_Time; }
+            // complete message including the status byte; sysex messages start with 0xF0 and end with 0xF7
+            const std::vector<uint8_t>& Data() const { return m_Data; }
+            bool IsChannelMessage() const { return (!m_Data.empty()) && (m_Data[0] >= 0x80) && (m_Data[0] < 0xF0); }
+            int Channel() const { return m_Data[0] & 0x0F; }
+
+        private:
+            double m_Time;
+            std::vector<uint8_t> m_Data;
+        };
+
+    public:
+        static TMidiFile FromFile(const std::string &filename);
+        const std::vector<TEvent>& Events() const { return m_Events; }
+        double Duration() const { return m_Events.empty()? 0.0 : m_Events.back().Time(); }
+
+    private:
+        std::vector<TEvent> m_Events;
+    };
+}
@@ -0,0 +1,401 @@
+#include "offline.h"
+#include "wavfile.h"
+#include "timing.h"
+#include <filesystem>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+
+namespace offline
+{
+    jack_port_t* TMemoryPortIo::AddAudioPort()
+    {
+        auto port = std::make_unique<TPort>();
+        port->m_Audio.resize(m_MaxBlockSize, 0.0f);
+        auto result = HandleFromPort(*port);
+        m_Ports.push_back(std::move(port));
+        return result;
+    }
+    jack_port_t* TMemoryPortIo::AddMidiPort()
+    {
+        auto port = std::make_unique<TPort>();
+        port->m_IsMidi = true;
+        // Process() must not allocate, even headless, or the timings would be off:
+        port->m_Events.reserve(sMaxMidiEventsPerBlock);
+        port->m_MidiData.reserve(sMaxMidiBytesPerBlock);
+        auto result = HandleFromPort(*port);
+        m_Ports.push_back(std::move(port));
+        return result;
+    }
+    float* TMemoryPortIo::AudioBuffer(jack_port_t *port) const
+    {
+        auto &p = PortFromHandle(port);
+        if(p.m_IsMidi)
+        {
+            throw std::runtime_error("not an audio port");
+        }
+        return p.m_Audio.data();
+    }
+    void TMemoryPortIo::AddMidiEvent(jack_port_t *port, jack_nframes_t time, const void *data, size_t size)
+    {
+        auto &p = PortFromHandle(port);
+        if(!p.m_IsMidi)
+        {
+            throw std::runtime_error("not a midi port");
+        }
+        if(time >= m_MaxBlockSize)
+        {
+            throw std::runtime_error("midi event time out of range");
+        }
+        if(!InsertMidiEvent(p, time, data, size))
+        {
+            m_NumDroppedMidiEvents++;
+        }
+    }
+    bool TMemoryPortIo::InsertMidiEvent(TPort &port, jack_nframes_t time, const void *data, size_t size)
+    {
+        // within the reserved capacity, so the inserts below do not allocate:
+        if( (port.m_Events.size() >= sMaxMidiEventsPerBlock) || (size > sMaxMidiBytesPerBlock - port.m_MidiData.size()) )
+        {
+            return false;
+        }
+        auto offset = port.m_MidiData.size();
+        port.m_MidiData.insert(port.m_MidiData.end(), (const jack_midi_data_t*)data, (const jack_midi_data_t*)data + size);
+        auto it = std::upper_bound(port.m_Events.begin(), port.m_Events.end(), time, [](jack_nframes_t t, const TPort::TEvent &event){
+            return t < event.m_Time;
+        });
+        port.m_Events.insert(it, TPort::TEvent{time, offset, size});
+        return true;
+    }
+    void TMemoryPortIo::ClearMidi(jack_port_t *port)
+    {
+        MidiClearBuffer(&PortFromHandle(port));
+    }
+    void TMemoryPortIo::ClearAllMidi()
+    {
+        for(auto &port: m_Ports)
+        {
+            if(port->m_IsMidi)
+            {
+                MidiClearBuffer(port.get());
+            }
+        }
+    }
+    void* TMemoryPortIo::Buffer(jack_port_t *port, jack_nframes_t nframes)
+    {
+        auto &p = PortFromHandle(port);
+        if(p.m_IsMidi)
+        {
+            return &p;
+        }
+        return p.m_Audio.data();
+    }
+    uint32_t TMemoryPortIo::MidiEventCount(void *buf)
+    {
+        return (uint32_t)((TPort*)buf)->m_Events.size();
+    }
+    void TMemoryPortIo::MidiEventGet(jack_midi_event_t &event, void *buf, uint32_t index)
+    {
+        auto &p = *(TPort*)buf;
+        const auto &e = p.m_Events.at(index);
+        event.time = e.m_Time;
+        event.size = e.m_Size;
+        event.buffer = p.m_MidiData.data() + e.m_Offset;
+    }
+    void TMemoryPortIo::MidiClearBuffer(void *buf)
+    {
+        auto &p = *(TPort*)buf;
+        p.m_Events.clear();
+        p.m_MidiData.clear();
+    }
+    void TMemoryPortIo::MidiEventWrite(void *buf, jack_nframes_t time, const jack_midi_data_t *data, size_t size)
+    {
+        // called from Processor::Process, so drop instead of throwing:
+        if( (time >= m_MaxBlockSize) || (!InsertMidiEvent(*(TPort*)buf, time, data, size)) )
+        {
+            m_NumDroppedMidiEvents++;
+        }
+    }
+
+    THost::THost(std::string &&projectdir, uint32_t sampleRate, uint32_t maxBlockSize, int argc, char** argv) : m_ProjectDir(std::move(projectdir)), m_SampleRate(sampleRate), m_MaxBlockSize(maxBlockSize), m_LilvWorld(sampleRate, maxBlockSize, argc, argv, utils::CacheDir() + "/pluginindex.json")
+    {
+        m_Processor.SetPortIo(m_PortIo);
+        auto projectfile = m_ProjectDir + "/project.json";
+        if(!std::filesystem::exists(projectfile))
+        {
+            throw std::runtime_error("project file does not exist: " + projectfile);
+        }
+        m_Project = project::ProjectFromFile(projectfile);
+        m_OutputPorts = {m_PortIo.AddAudioPort(), m_PortIo.AddAudioPort()};
+        m_VocoderInPort = m_PortIo.AddAudioPort();
+        for(size_t partindex = 0; partindex < m_Project.Parts().size(); partindex++)
+        {
+            m_PartPorts.push_back(m_PortIo.AddMidiPort());
+            const auto &part = m_Project.Parts()[partindex];
+            auto &partinserts = m_PartInsertEffects.emplace_back();
+            for(const auto &effect: part.InsertEffects())
+            {
+                partinserts.push_back(std::make_unique<engine::PluginInstance>(std::string(effect.Lv2Uri()), m_SampleRate, m_Processor, lilvutils::Instance::TMidiCallback()));
+                if(!effect.PresetSubDir().empty())
+                {
+                    LoadPreset(*partinserts.back(), effect.PresetSubDir());
+                }
+            }
+            if(part.ActivePresetIndex() && m_Project.Presets().at(*part.ActivePresetIndex()))
+            {
+                SwitchToPreset(partindex, *part.ActivePresetIndex());
+            }
+            else if(part.ActiveInstrumentIndex())
+            {
+                PluginForPart(partindex, *part.ActiveInstrumentIndex());
+            }
+        }
+        if(!m_Project.Reverb().ReverbLv2Uri().empty())
+        {
+            m_ReverbInstance = std::make_unique<engine::PluginInstance>(std::string(m_Project.Reverb().ReverbLv2Uri()), m_SampleRate, m_Processor, lilvutils::Instance::TMidiCallback());
+            if(!m_Project.Reverb().ReverbPresetSubDir().empty())
+            {
+                LoadPreset(*m_ReverbInstance, m_Project.Reverb().ReverbPresetSubDir());
+            }
+        }
+    }
+    THost::~THost()
+    {
+        // let the processor release the plugins and run its deferred functions before they are destroyed:
+        m_Processor.SetDataFromMainThread(realtimethread::Data());
+        m_PortIo.ClearAllMidi();
+        m_Processor.Process(m_MaxBlockSize & ~7u);
+        m_Processor.ProcessMessagesInMainThread();
+    }
+    THost::TPlugin& THost::PluginForPart(size_t partindex, size_t instrumentindex)
+    {
+        const auto &instrument = m_Project.Instruments().at(instrumentindex);
+        // hammond instruments are shared by all parts, like in Engine::SyncPlugins:
+        std::optional<size_t> owningpart;
+        if(!instrument.IsHammond())
+        {
+            owningpart = partindex;
+        }
+        for(auto &plugin: m_Plugins)
+        {
+            if( (plugin.m_Part == owningpart) && (plugin.m_InstrumentIndex == instrumentindex) )
+            {
+                return plugin;
+            }
+        }
+        auto instance = std::make_unique<engine::PluginInstance>(std::string(instrument.Lv2Uri()), m_SampleRate, m_Processor, lilvutils::Instance::TMidiCallback());
+        m_Plugins.emplace_back(std::move(instance), owningpart, instrumentindex);
+        m_RtDataChanged = true;
+        return m_Plugins.back();
+    }
+    void THost::LoadPreset(engine::PluginInstance &plugin, const std::string &presetSubDir)
+    {
+        // the processor is not running while we are here, so this is safe even without threadSafeRestore:
+        plugin.Instance().LoadState(m_ProjectDir + "/presets/" + presetSubDir);
+    }
+    void THost::SwitchToPreset(size_t partindex, size_t presetindex)
+    {
+        const auto &preset = m_Project.Presets().at(presetindex);
+        if(!preset)
+        {
+            throw std::runtime_error("preset " + std::to_string(presetindex) + " does not exist");
+        }
+        m_Project = m_Project.SwitchToPreset(partindex, presetindex);
+        auto &plugin = PluginForPart(partindex, preset->InstrumentIndex());
+        if(!m_Project.Instruments().at(preset->InstrumentIndex()).IsHammond())
+        {
+            LoadPreset(*plugin.m_Instance, preset->PresetSubDir());
+        }
+        m_RtDataChanged = true;
+    }
+    void THost::SendMidiToPart(size_t partindex, uint32_t frame, const void *data, size_t size)
+    {
+        m_PortIo.AddMidiEvent(m_PartPorts.at(partindex), frame, data, size);
+    }
+    void THost::SyncRtData()
+    {
+        // same mapping as Engine::CalcRtData, without the jack ports:
+        std::vector<realtimethread::Data::Plugin> plugins;
+        std::vector<realtimethread::Data::TMidiKeyboardPort> midiPorts;
+        // rt plugin index of the instrument, part of the insert chain, amplitude:
+        std::vector<std::tuple<size_t, size_t, float>> chains;
+        for(size_t partindex = 0; partindex < m_Project.Parts().size(); partindex++)
+        {
+            const auto &part = m_Project.Parts()[partindex];
+            std::optional<int> rtpluginindex;
+            if(part.ActiveInstrumentIndex())
+            {
+                auto &plugin = PluginForPart(partindex, *part.ActiveInstrumentIndex());
+                auto instance = &plugin.m_Instance->Instance();
+                auto it = std::find_if(plugins.begin(), plugins.end(), [instance](const realtimethread::Data::Plugin &p){
+                    return &p.PluginInstance() == instance;
+                });
+                if(it == plugins.end())
+                {
+                    const auto &instrument = m_Project.Instruments().at(plugin.m_InstrumentIndex);
+                    float amplitude = part.AmplitudeFactor();
+                    if(!plugin.m_Part)
+                    {
+                        for(const auto &otherpart: m_Project.Parts())
+                        {
+                            if(otherpart.ActiveInstrumentIndex() == plugin.m_InstrumentIndex)
+                            {
+                                amplitude = std::max(otherpart.AmplitudeFactor(), amplitude);
+                            }
+                        }
+                    }
+                    chains.emplace_back(plugins.size(), partindex, amplitude);
+                    plugins.emplace_back(instance, !plugin.m_Part, plugin.m_Instance->GetMidiInBuf(), 0, instrument.HasVocoderInput(), !instrument.AlwaysRun());
+                    it = plugins.end() - 1;
+                }
+                rtpluginindex = (int)(it - plugins.begin());
+            }
+            midiPorts.emplace_back(m_PartPorts[partindex], rtpluginindex, part.MidiChannelForSharedInstruments());
+        }
+        realtimethread::TMixGraph mixgraph;
+        for(const auto &[instrumentpluginindex, chainpart, amplitude]: chains)
+        {
+            std::vector<size_t> insertpluginindices;
+            for(const auto &insert: m_PartInsertEffects.at(chainpart))
+            {
+                insertpluginindices.push_back(plugins.size());
+                plugins.emplace_back(&insert->Instance(), false, nullptr, 0, false, true);
+            }
+            mixgraph.AddChain(instrumentpluginindex, std::move(insertpluginindices), amplitude, chainpart);
+        }
+        if(m_ReverbInstance)
+        {
+            mixgraph.SetReverb(plugins.size(), m_Project.Reverb().MixLevel());
+            plugins.emplace_back(&m_ReverbInstance->Instance(), false, nullptr, 0, false, true);
+        }
+        realtimethread::Data data(plugins, mixgraph.Nodes(), midiPorts, {}, {}, m_OutputPorts, m_VocoderInPort, m_SampleRate);
+        m_Processor.SetDataFromMainThread(std::move(data));
+        m_RtDataChanged = false;
+    }
+    void THost::Process(uint32_t nframes)
+    {
+        if(m_RtDataChanged)
+        {
+            SyncRtData();
+        }
+        m_Processor.Process(nframes);
+        m_PortIo.ClearAllMidi();
+        m_Processor.ProcessMessagesInMainThread();
+    }
+    std::string THost::InstanceName(const lilvutils::Instance *instance) const
+    {
+        if(m_ReverbInstance && (instance == &m_ReverbInstance->Instance()))
+        {
+            return "Reverb";
+        }
+        for(size_t partindex = 0; partindex < m_PartInsertEffects.size(); partindex++)
+        {
+            for(const auto &insert: m_PartInsertEffects[partindex])
+            {
+                if(&insert->Instance() == instance)
+                {
+                    return insert->Plugin().Name() + " (" + m_Project.Parts().at(partindex).Name() + ")";
+                }
+            }
+        }
+        for(const auto &plugin: m_Plugins)
+        {
+            if(&plugin.m_Instance->Instance() == instance)
+            {
+                std::string name = m_Project.Instruments().at(plugin.m_InstrumentIndex).Name();
+                if(plugin.m_Part)
+                {
+                    name += " (" + m_Project.Parts().at(*plugin.m_Part).Name() + ")";
+                }
+                return name;
+            }
+        }
+        return "?";
+    }
+
+    void RenderMidiFile(std::string &&projectdir, const std::string &midifilename, const std::string &wavfilename, const TRenderOptions &options, int argc, char** argv)
+    {
+        if( (options.m_BlockSize == 0) || ((options.m_BlockSize & 7) != 0) )
+        {
+            throw std::runtime_error("block size must be a multiple of 8");
+        }
+        if(options.m_SampleRate == 0)
+        {
+            throw std::runtime_error("sample rate must be positive");
+        }
+        // also rejects NaN:
+        if(!(options.m_TailSeconds >= 0.0))
+        {
+            throw std::runtime_error("tail must not be negative");
+        }
+        auto midifile = midifile::TMidiFile::FromFile(midifilename);
+        THost host(std::move(projectdir), options.m_SampleRate, options.m_BlockSize, argc, argv);
+        host.RtProcessor().SetTimingWindowNs(UINT64_MAX);
+        wavfile::TWriter writer(wavfilename, options.m_SampleRate, 2);
+        const auto &events = midifile.Events();
+        auto numparts = host.Project().Parts().size();
+        auto eventframe = [&](const midifile::TMidiFile::TEvent &event) {
+            return (uint64_t)std::llround(event.Time() * options.m_SampleRate);
+        };
+        uint64_t totalframes = (uint64_t)std::llround((midifile.Duration() + options.m_TailSeconds) * options.m_SampleRate);
+        size_t eventindex = 0;
+        uint64_t renderNs = 0;
+        uint64_t frame = 0;
+        bool notesoff = false;
+        for(; frame < totalframes; frame += options.m_BlockSize)
+        {
+            for(; (eventindex < events.size()) && (eventframe(events[eventindex]) < frame + options.m_BlockSize); eventindex++)
+            {
+                const auto &event = events[eventindex];
+                if( (!event.IsChannelMessage()) || ((size_t)event.Channel() >= numparts) )
+                {
+                    continue;
+                }
+                auto partindex = (size_t)event.Channel();
+                const auto &data = event.Data();
+                if((data[0] & 0xF0) == 0xC0)
+                {
+                    // quick presets are switched before the block, like a button press on the keyboard:
+                    auto quickpresets = host.Project().Parts()[partindex].QuickPresets();
+                    if( (data[1] < quickpresets.size()) && quickpresets[data[1]] )
+                    {
+                        host.SwitchToPreset(partindex, *quickpresets[data[1]]);
+                        continue;
+                    }
+                }
+                auto offset = (uint32_t)(std::max(eventframe(event), frame) - frame);
+                host.SendMidiToPart(partindex, offset, data.data(), data.size());
+            }
+            if( (!notesoff) && (eventindex == events.size()) )
+            {
+                // release anything the file left hanging, so the tail is a real release tail:
+                notesoff = true;
+                for(size_t partindex = 0; partindex < numparts; partindex++)
+                {
+                    uint8_t allnotesoff[3] = {0xB0, 123, 0};
+                    host.SendMidiToPart(partindex, options.m_BlockSize - 1, allnotesoff, 3);
+                }
+            }
+            auto start = timing::NowNs();
+            host.Process(options.m_BlockSize);
+            renderNs += timing::NowNs() - start;
+            const float* channels[2] = {host.Output(0), host.Output(1)};
+            writer.Write(channels, options.m_BlockSize);
+        }
+        host.RtProcessor().FlushTiming();
+        host.RtProcessor().ProcessMessagesInMainThread();
+        writer.Close();
+
+        const auto &cycle = host.RtProcessor().TimingReport().m_Cycle;
+        double audioSeconds = (double)frame / options.m_SampleRate;
+        double blockUs = 1e6 * options.m_BlockSize / options.m_SampleRate;
+        std::cout << "Rendered " << std::fixed << std::setprecision(2) << audioSeconds << " s to " << wavfilename << " in " << (double)renderNs / 1e9 << " s";
+        std::cout << std::setprecision(1) << " (" << (renderNs > 0? audioSeconds * 1e9 / (double)renderNs : 0.0) << "x realtime)\n";
+        std::cout << "DSP load at " << options.m_BlockSize << " frames: avg " << (100.0 * cycle.AvgUs() / blockUs) << "%, p99 " << (100.0 * cycle.P99Us() / blockUs) << "%, max " << (100.0 * cycle.MaxUs() / blockUs) << "%\n";
+        if(host.PortIo().NumDroppedMidiEvents() > 0)
+        {
+            std::cerr << "Warning: " << host.PortIo().NumDroppedMidiEvents() << " midi events dropped, more than " << TMemoryPortIo::sMaxMidiEventsPerBlock << " events or " << TMemoryPortIo::sMaxMidiBytesPerBlock << " bytes per block" << '\n';
+        }
+    }
+}
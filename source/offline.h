@@ -0,0 +1,142 @@
+#pragma once
+#include "engine.h"
+#include "realtimethread.h"
+#include "midifile.h"
+#include <jack/midiport.h>
+#include <memory>
+#include <vector>
+#include <string>
+
+import project;
+
+namespace offline
+{
+    // Port buffers in memory, for running realtimethread::Processor without a jack server.
+    // The returned jack_port_t pointers are handles to our own ports and must only be passed back to this object.
+    class TMemoryPortIo : public realtimethread::TPortIo
+    {
+    public:
+        TMemoryPortIo(const TMemoryPortIo&) = delete;
+        TMemoryPortIo& operator=(const TMemoryPortIo&) = delete;
+        TMemoryPortIo(TMemoryPortIo&&) = delete;
+        TMemoryPortIo& operator=(TMemoryPortIo&&) = delete;
+        // the midi storage of a port is allocated up front; events that do not fit in a block are dropped and counted
+        static constexpr size_t sMaxMidiEventsPerBlock = 1024;
+        static constexpr size_t sMaxMidiBytesPerBlock = 65536;
+        TMemoryPortIo(uint32_t maxBlockSize) : m_MaxBlockSize(maxBlockSize) {}
+        jack_port_t* AddAudioPort();
+        jack_port_t* AddMidiPort();
+        float* AudioBuffer(jack_port_t *port) const;
+        // events are kept sorted by time, events with the same time stay in the order they were added
+        void AddMidiEvent(jack_port_t *port, jack_nframes_t time, const void *data, size_t size);
+        void ClearMidi(jack_port_t *port);
+        void ClearAllMidi();
+        uint64_t NumDroppedMidiEvents() const { return m_NumDroppedMidiEvents; }
+
+        void* Buffer(jack_port_t *port, jack_nframes_t nframes) override;
+        uint32_t MidiEventCount(void *buf) override;
+        void MidiEventGet(jack_midi_event_t &event, void *buf, uint32_t index) override;
+        void MidiClearBuffer(void *buf) override;
+        void MidiEventWrite(void *buf, jack_nframes_t time, const jack_midi_data_t *data, size_t size) override;
+
+    private:
+        class TPort
+        {
+        public:
+            class TEvent
+            {
+            public:
+                jack_nframes_t m_Time;
+                size_t m_Offset;
+                size_t m_Size;
+            };
+            bool m_IsMidi = false;
+            std::vector<float> m_Audio;
+            std::vector<TEvent> m_Events;
+            std::vector<jack_midi_data_t> m_MidiData;
+        };
+        // does not allocate; returns false if the event does not fit
+        static bool InsertMidiEvent(TPort &port, jack_nframes_t time, const void *data, size_t size);
+        static TPort& PortFromHandle(jack_port_t *port) { return *reinterpret_cast<TPort*>(port); }
+        static jack_port_t* HandleFromPort(TPort &port) { return reinterpret_cast<jack_port_t*>(&port); }
+
+    private:
+        uint32_t m_MaxBlockSize;
+        std::vector<std::unique_ptr<TPort>> m_Ports;
+        uint64_t m_NumDroppedMidiEvents = 0;
+    };
+
+    // Runs a project headless: instantiates the plugins of the active instruments of all parts, their insert effects and the reverb,
+    // loads their presets synchronously and renders blocks through realtimethread::Processor on the calling thread.
+    // The calling thread acts as both the main and the realtime thread, so state can be restored between blocks
+    // without any synchronization. Hammond drawbar data is not applied.
+    class THost
+    {
+    public:
+        THost(const THost&) = delete;
+        THost& operator=(const THost&) = delete;
+        THost(THost&&) = delete;
+        THost& operator=(THost&&) = delete;
+        THost(std::string &&projectdir, uint32_t sampleRate, uint32_t maxBlockSize, int argc, char** argv);
+        ~THost();
+        const project::TProject& Project() const { return m_Project; }
+        uint32_t SampleRate() const { return m_SampleRate; }
+        uint32_t MaxBlockSize() const { return m_MaxBlockSize; }
+        // instantiates the instrument of the preset if necessary and loads its state:
+        void SwitchToPreset(size_t partindex, size_t presetindex);
+        // the event is delivered in the next call to Process(); frame is relative to the start of that block.
+        // The midi channel is ignored, like in Engine::SendMidiToPart.
+        void SendMidiToPart(size_t partindex, uint32_t frame, const void *data, size_t size);
+        void Process(uint32_t nframes);
+        const float* Output(size_t channel) const { return m_PortIo.AudioBuffer(m_OutputPorts.at(channel)); }
+        realtimethread::Processor& RtProcessor() { return m_Processor; }
+        const TMemoryPortIo& PortIo() const { return m_PortIo; }
+        // for reports: instrument (part) name of an instance, or "Reverb"
+        std::string InstanceName(const lilvutils::Instance *instance) const;
+
+    private:
+        class TPlugin
+        {
+        public:
+            TPlugin(std::unique_ptr<engine::PluginInstance> &&instance, const std::optional<size_t> &part, size_t instrumentIndex) : m_Instance(std::move(instance)), m_Part(part), m_InstrumentIndex(instrumentIndex) {}
+            std::unique_ptr<engine::PluginInstance> m_Instance;
+            // nullopt for the shared hammond instance:
+            std::optional<size_t> m_Part;
+            size_t m_InstrumentIndex;
+        };
+        TPlugin& PluginForPart(size_t partindex, size_t instrumentindex);
+        void LoadPreset(engine::PluginInstance &plugin, const std::string &presetSubDir);
+        void SyncRtData();
+
+    private:
+        std::string m_ProjectDir;
+        uint32_t m_SampleRate;
+        uint32_t m_MaxBlockSize;
+        lilvutils::World m_LilvWorld;
+        TMemoryPortIo m_PortIo {m_MaxBlockSize};
+        realtimethread::Processor m_Processor {m_MaxBlockSize};
+        project::TProject m_Project;
+        std::vector<TPlugin> m_Plugins;
+        // indexed by part:
+        std::vector<std::vector<std::unique_ptr<engine::PluginInstance>>> m_PartInsertEffects;
+        std::unique_ptr<engine::PluginInstance> m_ReverbInstance;
+        std::vector<jack_port_t*> m_PartPorts;
+        std::array<jack_port_t*, 2> m_OutputPorts;
+        jack_port_t *m_VocoderInPort;
+        bool m_RtDataChanged = true;
+    };
+
+    class TRenderOptions
+    {
+    public:
+        uint32_t m_SampleRate = 48000;
+        uint32_t m_BlockSize = 256;
+        // rendered after the last event of the MIDI file, for reverb and release tails:
+        double m_TailSeconds = 3.0;
+    };
+
+    // Renders a Standard MIDI File through the project into a WAV file, as fast as possible. MIDI channel n
+    // goes to part n. A program change selects the part's quick preset with that number if it is assigned,
+    // otherwise it is passed on to the plugin. Prints the realtime factor and the cost per cycle when done.
+    void RenderMidiFile(std::string &&projectdir, const std::string &midifilename, const std::string &wavfilename, const TRenderOptions &options, int argc, char** argv);
+}
@@ -0,0 +1,520 @@
+#include "pluginindex.h"
+#include "utils.h"
+#include "threads.h"
+#include <lilv/lilv.h>
+#include "json/json.h"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <algorithm>
+#include <cstdlib>
+
+namespace
+{
+    // bump when the format changes, older caches are then ignored
+    constexpr int sCacheVersion = 2;
+
+    std::vector<std::string> Lv2Path()
+    {
+        std::string lv2path;
+        auto env = getenv("LV2_PATH");
+        if(env && *env)
+        {
+            lv2path = env;
+        }
+        else
+        {
+            // same default as lilv:
+            lv2path = "~/.lv2:/usr/local/lib/lv2:/usr/lib/lv2";
+        }
+        std::vector<std::string> result;
+        size_t pos = 0;
+        while(pos <= lv2path.size())
+        {
+            auto end = lv2path.find(':', pos);
+            if(end == std::string::npos) end = lv2path.size();
+            auto dir = lv2path.substr(pos, end - pos);
+            if( (!dir.empty()) && (dir[0] == '~') )
+            {
+                auto home = getenv("HOME");
+                dir = std::string(home? home : "") + dir.substr(1);
+            }
+            if(!dir.empty())
+            {
+                result.push_back(std::move(dir));
+            }
+            pos = end + 1;
+        }
+        return result;
+    }
+    std::string NormalizeBundlePath(std::string &&path)
+    {
+        while( (path.size() > 1) && (path.back() == '/') )
+        {
+            path.pop_back();
+        }
+        return std::move(path);
+    }
+    // the bundle directory of a file in it, or nullopt if the uri is not a local file
+    std::optional<std::string> BundleOfFileUri(const LilvNode *node)
+    {
+        if( (!node) || (!lilv_node_is_uri(node)) )
+        {
+            return std::nullopt;
+        }
+        auto filepath = lilv_file_uri_parse(lilv_node_as_uri(node), nullptr);
+        if(!filepath)
+        {
+            return std::nullopt;
+        }
+        std::string dir = std::filesystem::path(filepath).parent_path().string();
+        lilv_free(filepath);
+        if(dir.empty())
+        {
+            return std::nullopt;
+        }
+        return NormalizeBundlePath(std::move(dir));
+    }
+    void AddRelatedBundle(std::vector<std::string> &related, const std::string &ownBundle, std::optional<std::string> &&bundle)
+    {
+        if(bundle && (*bundle != ownBundle) && (std::find(related.begin(), related.end(), *bundle) == related.end()))
+        {
+            related.push_back(std::move(*bundle));
+        }
+    }
+    // The bundles containing the description of the plugin, its UIs and its presets, other than the plugin's own bundle
+    std::vector<std::string> FindRelatedBundles(LilvWorld *world, const LilvPlugin *plugin, const std::string &ownBundle, const LilvNode *presetClass, const LilvNode *seeAlso)
+    {
+        std::vector<std::string> result;
+        auto datauris = lilv_plugin_get_data_uris(plugin);
+        LILV_FOREACH(nodes, i, datauris)
+        {
+            AddRelatedBundle(result, ownBundle, BundleOfFileUri(lilv_nodes_get(datauris, i)));
+        }
+        auto uis = lilv_plugin_get_uis(plugin);
+        if(uis)
+        {
+            LILV_FOREACH(uis, i, uis)
+            {
+                auto bundleuri = lilv_ui_get_bundle_uri(lilv_uis_get(uis, i));
+                if(bundleuri)
+                {
+                    auto bundlepath = lilv_file_uri_parse(lilv_node_as_uri(bundleuri), nullptr);
+                    if(bundlepath)
+                    {
+                        AddRelatedBundle(result, ownBundle, NormalizeBundlePath(bundlepath));
+                        lilv_free(bundlepath);
+                    }
+                }
+            }
+            lilv_uis_free(uis);
+        }
+        auto presets = lilv_plugin_get_related(plugin, presetClass);
+        if(presets)
+        {
+            LILV_FOREACH(nodes, i, presets)
+            {
+                auto files = lilv_world_find_nodes(world, lilv_nodes_get(presets, i), seeAlso, nullptr);
+                if(files)
+                {
+                    LILV_FOREACH(nodes, j, files)
+                    {
+                        AddRelatedBundle(result, ownBundle, BundleOfFileUri(lilv_nodes_get(files, j)));
+                    }
+                    lilv_nodes_free(files);
+                }
+            }
+            lilv_nodes_free(presets);
+        }
+        return result;
+    }
+    // The bundles describing LV2 specifications (atom, urid, ...)
+    std::set<std::string> FindSpecificationBundles(LilvWorld *world, const LilvNode *rdfType, const LilvNode *specificationClass, const LilvNode *seeAlso)
+    {
+        std::set<std::string> result;
+        auto specs = lilv_world_find_nodes(world, nullptr, rdfType, specificationClass);
+        if(specs)
+        {
+            LILV_FOREACH(nodes, i, specs)
+            {
+                auto files = lilv_world_find_nodes(world, lilv_nodes_get(specs, i), seeAlso, nullptr);
+                if(files)
+                {
+                    LILV_FOREACH(nodes, j, files)
+                    {
+                        if(auto bundle = BundleOfFileUri(lilv_nodes_get(files, j)))
+                        {
+                            result.insert(std::move(*bundle));
+                        }
+                    }
+                    lilv_nodes_free(files);
+                }
+            }
+            lilv_nodes_free(specs);
+        }
+        return result;
+    }
+    // Editing a file in place does not update the mtime of the directory, so take the newest of the
+    // bundle directory itself and the files directly inside it.
+    std::optional<int64_t> BundleMTime(const std::string &path)
+    {
+        std::error_code ec;
+        auto dirtime = std::filesystem::last_write_time(path, ec);
+        if(ec)
+        {
+            return std::nullopt;
+        }
+        int64_t result = dirtime.time_since_epoch().count();
+        for(auto it = std::filesystem::directory_iterator(path, ec); (!ec) && (it != std::filesystem::directory_iterator()); it.increment(ec))
+        {
+            std::error_code ec2;
+            if(it->is_regular_file(ec2))
+            {
+                auto filetime = it->last_write_time(ec2);
+                if(!ec2)
+                {
+                    result = std::max<int64_t>(result, filetime.time_since_epoch().count());
+                }
+            }
+        }
+        return result;
+    }
+    std::map<std::string, int64_t> FindBundles()
+    {
+        std::map<std::string, int64_t> result;
+        for(const auto &dir: Lv2Path())
+        {
+            std::error_code ec;
+            for(auto it = std::filesystem::directory_iterator(dir, ec); (!ec) && (it != std::filesystem::directory_iterator()); it.increment(ec))
+            {
+                std::error_code ec2;
+                if(it->is_directory(ec2) && std::filesystem::exists(it->path() / "manifest.ttl", ec2))
+                {
+                    auto path = NormalizeBundlePath(it->path().string());
+                    auto mtime = BundleMTime(path);
+                    if(mtime)
+                    {
+                        result.emplace(std::move(path), *mtime);
+                    }
+                }
+            }
+        }
+        return result;
+    }
+}
+
+namespace lilvutils
+{
+    PluginIndex::PluginIndex(std::string &&cacheFile) : m_CacheFile(std::move(cacheFile))
+    {
+        try
+        {
+            SetBundles(LoadCache(m_CacheFile));
+        }
+        catch(std::exception &e)
+        {
+            std::cerr << "Ignoring plugin index " << m_CacheFile << ": " << e.what() << '\n';
+        }
+    }
+    PluginIndex::~PluginIndex()
+    {
+        if(m_RescanThread.joinable())
+        {
+            m_RescanThread.join();
+        }
+    }
+    std::vector<std::string> PluginIndex::BundlesForPlugin(const std::string &uri) const
+    {
+        std::vector<std::string> result;
+        auto it = m_Plugin2Entry.find(uri);
+        if(it != m_Plugin2Entry.end())
+        {
+            const auto &bundle = m_Bundles[it->second.first];
+            const auto &entry = bundle.Entries()[it->second.second];
+            result.reserve(entry.RelatedBundles().size() + 1);
+            result.push_back(bundle.Path());
+            result.insert(result.end(), entry.RelatedBundles().begin(), entry.RelatedBundles().end());
+        }
+        return result;
+    }
+    void PluginIndex::RescanSync()
+    {
+        auto bundles = Scan(m_Bundles);
+        try
+        {
+            SaveCache(bundles, m_CacheFile);
+        }
+        catch(std::exception &e)
+        {
+            std::cerr << "Failed to save plugin index: " << e.what() << '\n';
+        }
+        SetBundles(std::move(bundles));
+    }
+    void PluginIndex::RescanInBackground()
+    {
+        if(m_RescanStarted)
+        {
+            return;
+        }
+        m_RescanStarted = true;
+        m_RescanThread = threads::Spawn(threads::TClass::Background, "plugin rescan", [this, previous = m_Bundles](){
+            std::optional<std::vector<TBundle>> result;
+            try
+            {
+                result = Scan(previous);
+                SaveCache(*result, m_CacheFile);
+            }
+            catch(std::exception &e)
+            {
+                std::cerr << "Plugin rescan failed: " << e.what() << '\n';
+            }
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_RescanResult = std::move(result);
+            if(m_OnRescanFinished)
+            {
+                m_OnRescanFinished();
+            }
+        });
+    }
+    void PluginIndex::SetOnRescanFinished(std::function<void()> &&callback)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_OnRescanFinished = std::move(callback);
+    }
+    bool PluginIndex::ApplyRescanResult()
+    {
+        std::optional<std::vector<TBundle>> result;
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            result = std::move(m_RescanResult);
+            m_RescanResult.reset();
+        }
+        if(!result)
+        {
+            return false;
+        }
+        bool changed = result->size() != m_Bundles.size();
+        for(size_t i = 0; (!changed) && (i < m_Bundles.size()); i++)
+        {
+            changed = (result->at(i).Path() != m_Bundles[i].Path()) || (result->at(i).MTime() != m_Bundles[i].MTime());
+        }
+        if(changed)
+        {
+            SetBundles(std::move(*result));
+        }
+        return changed;
+    }
+    std::vector<PluginIndex::TBundle> PluginIndex::Scan(const std::vector<TBundle> &previous)
+    {
+        auto found = FindBundles();
+        bool unchanged = !previous.empty();
+        std::set<std::string> previousPaths;
+        for(const auto &bundle: previous)
+        {
+            previousPaths.insert(bundle.Path());
+            // bundles outside of the LV2 path (found by lilv through symlinks for example) are checked directly:
+            auto it = found.find(bundle.Path());
+            auto mtime = (it != found.end())? std::optional<int64_t>(it->second) : BundleMTime(bundle.Path());
+            if(mtime != bundle.MTime())
+            {
+                unchanged = false;
+            }
+        }
+        for(const auto &[path, mtime]: found)
+        {
+            if(!previousPaths.contains(path))
+            {
+                unchanged = false;
+            }
+        }
+        if(unchanged)
+        {
+            return previous;
+        }
+
+        // something was installed, removed or modified; parse everything in a private lilv world:
+        auto world = lilv_world_new();
+        if(!world)
+        {
+            throw std::runtime_error("lilv_world_new failed");
+        }
+        utils::finally fin1([&](){
+            lilv_world_free(world);
+        });
+        lilv_world_load_all(world);
+        auto presetClass = lilv_new_uri(world, "http://lv2plug.in/ns/ext/presets#Preset");
+        auto seeAlso = lilv_new_uri(world, "http://www.w3.org/2000/01/rdf-schema#seeAlso");
+        auto rdfType = lilv_new_uri(world, "http://www.w3.org/1999/02/22-rdf-syntax-ns#type");
+        auto specificationClass = lilv_new_uri(world, "http://lv2plug.in/ns/lv2core#Specification");
+        utils::finally fin2([&](){
+            lilv_node_free(presetClass);
+            lilv_node_free(seeAlso);
+            lilv_node_free(rdfType);
+            lilv_node_free(specificationClass);
+        });
+        auto specificationBundles = FindSpecificationBundles(world, rdfType, specificationClass, seeAlso);
+        std::map<std::string, std::vector<TBundle::TEntry>> bundle2Entries;
+        for(const auto &[path, mtime]: found)
+        {
+            bundle2Entries[path];
+        }
+        auto lilvplugins = lilv_world_get_all_plugins(world); // Returned list is owned by world and must not be freed by the caller
+        LILV_FOREACH(plugins, i, lilvplugins)
+        {
+            auto plugin = lilv_plugins_get(lilvplugins, i);
+            if(!plugin)
+            {
+                continue;
+            }
+            auto bundlepath = lilv_file_uri_parse(lilv_node_as_uri(lilv_plugin_get_bundle_uri(plugin)), nullptr);
+            if(!bundlepath)
+            {
+                continue;
+            }
+            std::string path = NormalizeBundlePath(bundlepath);
+            lilv_free(bundlepath);
+            std::string uri = lilv_node_as_uri(lilv_plugin_get_uri(plugin));
+            std::string name;
+            auto namenode = lilv_plugin_get_name(plugin);
+            if(namenode)
+            {
+                name = lilv_node_as_string(namenode);
+                lilv_node_free(namenode);
+            }
+            std::string classuri;
+            std::string classlabel;
+            auto lilvpluginclass = lilv_plugin_get_class(plugin);
+            if(lilvpluginclass)
+            {
+                classuri = lilv_node_as_uri(lilv_plugin_class_get_uri(lilvpluginclass));
+                auto labelnode = lilv_plugin_class_get_label(lilvpluginclass);
+                classlabel = labelnode? lilv_node_as_string(labelnode) : classuri;
+            }
+            auto related = FindRelatedBundles(world, plugin, path, presetClass, seeAlso);
+            bundle2Entries[path].emplace_back(std::move(uri), std::move(name), std::move(classuri), std::move(classlabel), std::move(related));
+        }
+        std::vector<TBundle> result;
+        for(const auto &path: specificationBundles)
+        {
+            bundle2Entries[path];
+        }
+        for(auto &[path, entries]: bundle2Entries)
+        {
+            auto it = found.find(path);
+            auto mtime = (it != found.end())? std::optional<int64_t>(it->second) : BundleMTime(path);
+            result.emplace_back(std::string(path), mtime.value_or(0), specificationBundles.contains(path), std::move(entries));
+        }
+        return result;
+    }
+    std::vector<PluginIndex::TBundle> PluginIndex::LoadCache(const std::string &cacheFile)
+    {
+        std::vector<TBundle> result;
+        if(!std::filesystem::exists(cacheFile))
+        {
+            return result;
+        }
+        Json::Value v;
+        std::ifstream ifs(cacheFile);
+        if (!ifs)
+        {
+            throw std::runtime_error("Could not open file for reading: " + cacheFile);
+        }
+        ifs >> v;
+        if(v["version"].asInt() != sCacheVersion)
+        {
+            // written by an older version; return nothing so that a full scan runs
+            return result;
+        }
+        for(const auto &bundlev: v["bundles"])
+        {
+            std::vector<TBundle::TEntry> entries;
+            for(const auto &pluginv: bundlev["plugins"])
+            {
+                std::vector<std::string> related;
+                for(const auto &relatedv: pluginv["related"])
+                {
+                    related.push_back(relatedv.asString());
+                }
+                entries.emplace_back(pluginv["uri"].asString(), pluginv["name"].asString(), pluginv["classuri"].asString(), pluginv["classlabel"].asString(), std::move(related));
+            }
+            result.emplace_back(bundlev["path"].asString(), bundlev["mtime"].asInt64(), bundlev["specification"].asBool(), std::move(entries));
+        }
+        return result;
+    }
+    void PluginIndex::SaveCache(const std::vector<TBundle> &bundles, const std::string &cacheFile)
+    {
+        Json::Value v;
+        v["version"] = sCacheVersion;
+        v["bundles"] = Json::Value(Json::arrayValue);
+        for(const auto &bundle: bundles)
+        {
+            Json::Value bundlev;
+            bundlev["path"] = bundle.Path();
+            bundlev["mtime"] = (Json::Int64)bundle.MTime();
+            bundlev["specification"] = bundle.IsSpecification();
+            bundlev["plugins"] = Json::Value(Json::arrayValue);
+            for(const auto &entry: bundle.Entries())
+            {
+                Json::Value pluginv;
+                pluginv["uri"] = entry.Uri();
+                pluginv["name"] = entry.Name();
+                pluginv["classuri"] = entry.ClassUri();
+                pluginv["classlabel"] = entry.ClassLabel();
+                pluginv["related"] = Json::Value(Json::arrayValue);
+                for(const auto &related: entry.RelatedBundles())
+                {
+                    pluginv["related"].append(related);
+                }
+                bundlev["plugins"].append(std::move(pluginv));
+            }
+            v["bundles"].append(std::move(bundlev));
+        }
+        auto dir = std::filesystem::path(cacheFile).parent_path();
+        if( (!dir.empty()) && (!std::filesystem::exists(dir)) )
+        {
+            std::filesystem::create_directories(dir);
+        }
+        std::ofstream ofs(cacheFile);
+        if (!ofs)
+        {
+            throw std::runtime_error("Could not open file for writing: " + cacheFile);
+        }
+        ofs << v;
+    }
+    void PluginIndex::SetBundles(std::vector<TBundle> &&bundles)
+    {
+        std::map<std::string, size_t> classuri2Index;
+        std::vector<TPluginList::TClass> classes;
+        std::vector<TPluginList::TPlugin> plugins;
+        std::unordered_map<std::string, std::pair<size_t, size_t>> plugin2Entry;
+        std::vector<std::string> specificationBundles;
+        for(size_t bundleindex = 0; bundleindex < bundles.size(); bundleindex++)
+        {
+            const auto &bundle = bundles[bundleindex];
+            if(bundle.IsSpecification())
+            {
+                specificationBundles.push_back(bundle.Path());
+            }
+            for(size_t entryindex = 0; entryindex < bundle.Entries().size(); entryindex++)
+            {
+                const auto &entry = bundle.Entries()[entryindex];
+                auto it = classuri2Index.find(entry.ClassUri());
+                if(it == classuri2Index.end())
+                {
+                    it = classuri2Index.emplace(entry.ClassUri(), classes.size()).first;
+                    classes.emplace_back(std::string(entry.ClassUri()), std::string(entry.ClassLabel()));
+                }
+                if(plugin2Entry.emplace(entry.Uri(), std::make_pair(bundleindex, entryindex)).second)
+                {
+                    plugins.emplace_back(std::string(entry.Name()), std::string(entry.Uri()), it->second);
+                }
+            }
+        }
+        m_Bundles = std::move(bundles);
+        m_PluginList = TPluginList(std::move(classes), std::move(plugins));
+        m_Plugin2Entry = std::move(plugin2Entry);
+        m_SpecificationBundles = std::move(specificationBundles);
+    }
+}
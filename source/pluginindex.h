@@ -0,0 +1,134 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <optional>
+#include <unordered_map>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <cstdint>
+
+namespace lilvutils
+{
+    class TPluginList
+    {
+    public:
+        class TClass
+        {
+        public:
+            TClass() = default;
+            TClass(std::string &&uri, std::string &&description) : m_Description(std::move(description)), m_Uri(std::move(uri)) {}
+            const std::string& Description() const { return m_Description; }
+            const std::string& Uri() const { return m_Uri; }
+
+        private:
+            std::string m_Uri;
+            std::string m_Description;
+        };
+        class TPlugin
+        {
+        public:
+            TPlugin(std::string &&name, std::string &&uri, size_t classIndex) : m_Name(std::move(name)), m_Uri(std::move(uri)), m_ClassIndex(classIndex) {}
+            const std::string& Name() const { return m_Name; }
+            const std::string& Uri() const { return m_Uri; }
+            size_t ClassIndex() const { return m_ClassIndex; }
+        private:
+            std::string m_Name;
+            std::string m_Uri;
+            size_t m_ClassIndex;
+        };
+    public:
+        TPluginList() = default;
+        TPluginList(std::vector<TClass> &&classes, std::vector<TPlugin> &&plugins) : m_Classes(std::move(classes)), m_Plugins(std::move(plugins)) {}
+        const std::vector<TClass>& Classes() const { return m_Classes; }
+        const std::vector<TPlugin>& Plugins() const { return m_Plugins; }
+    private:
+        std::vector<TClass> m_Classes;
+        std::vector<TPlugin> m_Plugins;
+    };
+
+    // Persistent index of all installed LV2 plugins, stored per bundle together with the bundle's mtime.
+    // This allows startup to skip lilv_world_load_all(): only the bundles of the plugins that are actually
+    // instantiated (with the bundles of their UIs and presets) and the LV2 specifications get loaded into the lilv world. A full rescan runs in a background thread on request and
+    // reparses the bundles only if any of them was added, removed or modified.
+    class PluginIndex
+    {
+    public:
+        class TBundle
+        {
+        public:
+            class TEntry
+            {
+            public:
+                TEntry(std::string &&uri, std::string &&name, std::string &&classUri, std::string &&classLabel, std::vector<std::string> &&relatedBundles) : m_Uri(std::move(uri)), m_Name(std::move(name)), m_ClassUri(std::move(classUri)), m_ClassLabel(std::move(classLabel)), m_RelatedBundles(std::move(relatedBundles)) {}
+                const std::string& Uri() const { return m_Uri; }
+                const std::string& Name() const { return m_Name; }
+                const std::string& ClassUri() const { return m_ClassUri; }
+                const std::string& ClassLabel() const { return m_ClassLabel; }
+                // other bundles with data about the plugin: its UIs, presets and extensions of its description
+                const std::vector<std::string>& RelatedBundles() const { return m_RelatedBundles; }
+
+            private:
+                std::string m_Uri;
+                std::string m_Name;
+                std::string m_ClassUri;
+                std::string m_ClassLabel;
+                std::vector<std::string> m_RelatedBundles;
+            };
+            TBundle(std::string &&path, int64_t mtime, bool isSpecification, std::vector<TEntry> &&entries) : m_Path(std::move(path)), m_MTime(mtime), m_IsSpecification(isSpecification), m_Entries(std::move(entries)) {}
+            const std::string& Path() const { return m_Path; }
+            int64_t MTime() const { return m_MTime; }
+            // an LV2 specification (atom, urid, ...), which lilv needs to know the port types and properties
+            bool IsSpecification() const { return m_IsSpecification; }
+            const std::vector<TEntry>& Entries() const { return m_Entries; }
+
+        private:
+            std::string m_Path;
+            int64_t m_MTime;
+            bool m_IsSpecification;
+            std::vector<TEntry> m_Entries;
+        };
+
+    public:
+        PluginIndex(const PluginIndex&) = delete;
+        PluginIndex& operator=(const PluginIndex&) = delete;
+        PluginIndex(PluginIndex&&) = delete;
+        PluginIndex& operator=(PluginIndex&&) = delete;
+        PluginIndex(std::string &&cacheFile);
+        ~PluginIndex();
+        // all functions below must be called from the main thread
+        const TPluginList& PluginList() const { return m_PluginList; }
+        bool Empty() const { return m_Bundles.empty(); }
+        // the bundle directory containing the plugin followed by its related bundles; empty if the plugin is not known
+        std::vector<std::string> BundlesForPlugin(const std::string &uri) const;
+        const std::vector<std::string>& SpecificationBundles() const { return m_SpecificationBundles; }
+        void RescanSync();
+        // starts a rescan once per session; does nothing if a rescan was started before
+        void RescanInBackground();
+        // callback is invoked from the rescan thread when the rescan is finished
+        void SetOnRescanFinished(std::function<void()> &&callback);
+        // replaces the index by the result of the background rescan. Returns true if the plugin list changed.
+        bool ApplyRescanResult();
+
+    private:
+        static std::vector<TBundle> Scan(const std::vector<TBundle> &previous);
+        static std::vector<TBundle> LoadCache(const std::string &cacheFile);
+        static void SaveCache(const std::vector<TBundle> &bundles, const std::string &cacheFile);
+        void SetBundles(std::vector<TBundle> &&bundles);
+
+    private:
+        std::string m_CacheFile;
+        std::vector<TBundle> m_Bundles;
+        TPluginList m_PluginList;
+        // index in m_Bundles and in its entries:
+        std::unordered_map<std::string, std::pair<size_t, size_t>> m_Plugin2Entry;
+        std::vector<std::string> m_SpecificationBundles;
+        std::thread m_RescanThread;
+        bool m_RescanStarted = false;
+        std::mutex m_Mutex;
+        // protected by mutex:
+        std::optional<std::vector<TBundle>> m_RescanResult;
+        std::function<void()> m_OnRescanFinished;
+    };
+}
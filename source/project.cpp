@@ -4,6 +4,7 @@ module;
 #include <vector>
 #include <string>
 #include <fstream>
+#include <unordered_map>
 #include "json/json.h"
 
 module project;
@@ -50,6 +51,7 @@ namespace project
     Json::Value ToJson(const TInstrument &instrument)
     {
         Json::Value result;
+        result["id"] = instrument.Id();
         result["lv2uri"] = instrument.Lv2Uri();
         result["ishammond"] = instrument.IsHammond();
         result["name"] = instrument.Name();
@@ -59,6 +61,7 @@ namespace project
             result["parameters"].append(ToJson(parameter));
         }
         result["hasvocoder"] = instrument.HasVocoderInput();
+        result["alwaysrun"] = instrument.AlwaysRun();
         return result;
     }
     TInstrument InstrumentFromJson(const Json::Value &v)
@@ -68,11 +71,23 @@ namespace project
         {
             parameters.push_back(InstrumentParameterFromJson(parameter));
         }
-        return TInstrument(v["lv2uri"].asString(), v["ishammond"].asBool(), v["name"].asString(), std::move(parameters), v["hasvocoder"].asBool());
+        return TInstrument(v["lv2uri"].asString(), v["ishammond"].asBool(), v["name"].asString(), std::move(parameters), v["hasvocoder"].asBool()).ChangeAlwaysRun(v["alwaysrun"].asBool()).ChangeId(v["id"].asUInt64());
+    }
+    Json::Value ToJson(const TInsertEffect &insertEffect)
+    {
+        Json::Value result;
+        result["pluginuri"] = insertEffect.Lv2Uri();
+        result["presetdir"] = insertEffect.PresetSubDir();
+        return result;
+    }
+    TInsertEffect InsertEffectFromJson(const Json::Value &v)
+    {
+        return TInsertEffect(v["pluginuri"].asString(), v["presetdir"].asString());
     }
     Json::Value ToJson(const TPart &part)
     {
         Json::Value result;
+        result["id"] = part.Id();
         result["name"] = part.Name();
         result["midichannelforsharedinstruments"] = part.MidiChannelForSharedInstruments();
         if(part.ActiveInstrumentIndex())
@@ -92,6 +107,10 @@ namespace project
             result["presetindex"] = Json::Value::null;
         }
         result["amplitudefactor"] = part.AmplitudeFactor();
+        for (const auto &insertEffect : part.InsertEffects())
+        {
+            result["inserteffects"].append(ToJson(insertEffect));
+        }
         for (const auto &quickpreset : part.QuickPresets())
         {
             if(quickpreset)
@@ -130,11 +149,17 @@ namespace project
                 quickPresets.push_back(preset.asUInt64());
             }
         }
-        return TPart(v["name"].asString(), v["midichannelforsharedinstruments"].asInt(), instrumentIndex, presetIndex, std::move(quickPresets), v["amplitudefactor"].asFloat());
+        std::vector<TInsertEffect> insertEffects;
+        for (const auto &insertEffect : v["inserteffects"])
+        {
+            insertEffects.push_back(InsertEffectFromJson(insertEffect));
+        }
+        return TPart(v["name"].asString(), v["midichannelforsharedinstruments"].asInt(), instrumentIndex, presetIndex, std::move(quickPresets), v["amplitudefactor"].asFloat()).ChangeInsertEffects(std::move(insertEffects)).ChangeId(v["id"].asUInt64());
     }
     Json::Value ToJson(const TPreset &preset)
     {
         Json::Value result;
+        result["id"] = preset.Id();
         result["instrumentindex"] = preset.InstrumentIndex();
         result["name"] = preset.Name();
         result["subdir"] = preset.PresetSubDir();
@@ -162,7 +187,7 @@ namespace project
                 overrideParameters->push_back(InstrumentParameterFromJson(p));
             }
         }
-        return TPreset(v["instrumentindex"].asInt(), v["name"].asString(), v["subdir"].asString(), std::move(overrideParameters));
+        return TPreset(v["instrumentindex"].asInt(), v["name"].asString(), v["subdir"].asString(), std::move(overrideParameters)).ChangeId(v["id"].asUInt64());
     }
     Json::Value ToJson(const TProject &project)
     {
@@ -412,7 +437,59 @@ namespace project
         result.m_Instruments = std::move(newInstruments);
         result.m_Parts = std::move(newparts);
         result.m_Presets = std::move(newPresets);
+        result.AssignIds();
         return result;
     }
 
-}
\ No newline at end of file
+    namespace
+    {
+        template<class T> T* Element(T &element) { return &element; }
+        template<class T> T* Element(std::optional<T> &element) { return element? &*element : nullptr; }
+
+        // A duplicate id means an element was copied (a preset duplicated into another slot for example). The element
+        // that had the id before keeps it, so the copy is the one that gets a new id, regardless of where it was placed.
+        template<class TElement> void AssignIdsTo(std::vector<TElement> &elements, std::unordered_map<uint64_t, size_t> &id2index, uint64_t &nextId)
+        {
+            auto previous = std::move(id2index);
+            id2index.clear();
+            for(size_t i = 0; i < elements.size(); i++)
+            {
+                auto element = Element(elements[i]);
+                if(element && (element->Id() != 0))
+                {
+                    auto it = previous.find(element->Id());
+                    if( (it != previous.end()) && (it->second == i) )
+                    {
+                        id2index[element->Id()] = i;
+                    }
+                }
+            }
+            for(size_t i = 0; i < elements.size(); i++)
+            {
+                auto element = Element(elements[i]);
+                if(!element)
+                {
+                    continue;
+                }
+                auto it = id2index.find(element->Id());
+                if( (element->Id() == 0) || ( (it != id2index.end()) && (it->second != i) ) )
+                {
+                    *element = element->ChangeId(nextId++);
+                }
+                id2index[element->Id()] = i;
+            }
+        }
+    }
+
+    void TProject::AssignIds()
+    {
+        // older project files have no ids; these are assigned when loading
+        for(const auto &instrument: m_Instruments) m_NextId = std::max(m_NextId, instrument.Id() + 1);
+        for(const auto &part: m_Parts) m_NextId = std::max(m_NextId, part.Id() + 1);
+        for(const auto &preset: m_Presets) if(preset) m_NextId = std::max(m_NextId, preset->Id() + 1);
+        AssignIdsTo(m_Instruments, m_InstrumentId2Index, m_NextId);
+        AssignIdsTo(m_Parts, m_PartId2Index, m_NextId);
+        AssignIdsTo(m_Presets, m_PresetId2Index, m_NextId);
+    }
+
+}
@@ -4,6 +4,8 @@ module;
 #include <string>
 #include <fstream>
 #include <optional>
+#include <cstdint>
+#include <unordered_map>
 #include "json/json.h"
 
 export module project;
@@ -176,14 +178,30 @@ export namespace project
         {
             return m_Parameters;
         }
+        // unique within the project, stays the same when instruments are added or deleted. 0 if not yet assigned by TProject.
+        uint64_t Id() const
+        {
+            return m_Id;
+        }
+        TInstrument ChangeId(uint64_t id) const
+        {
+            auto result = *this;
+            result.m_Id = id;
+            return result;
+        }
         auto Tuple() const
         {
-            return std::tie(m_Lv2Uri, m_Name, m_IsHammond, m_Parameters, m_HasVocoderInput);
+            return std::tie(m_Id, m_Lv2Uri, m_Name, m_IsHammond, m_Parameters, m_HasVocoderInput, m_AlwaysRun);
         }
         bool HasVocoderInput() const
         {
             return m_HasVocoderInput;
         }
+        // for plugins that make sound without midi input (arpeggiators, drones): never put to sleep when silent
+        bool AlwaysRun() const
+        {
+            return m_AlwaysRun;
+        }
         bool operator==(const TInstrument &other) const
         {
             return Tuple() == other.Tuple();
@@ -218,6 +236,12 @@ export namespace project
             result.m_HasVocoderInput = hasVocoderInput;
             return result;
         }
+        TInstrument ChangeAlwaysRun(bool alwaysRun) const
+        {
+            auto result = *this;
+            result.m_AlwaysRun = alwaysRun;
+            return result;
+        }
 
     private:
         std::string m_Lv2Uri;
@@ -225,6 +249,34 @@ export namespace project
         bool m_IsHammond = false;  // for hammond organ, etc: 2 keyboards per instrument
         std::vector<TParameter> m_Parameters;
         bool m_HasVocoderInput = false;
+        bool m_AlwaysRun = false;
+        uint64_t m_Id = 0;
+    };
+    // an LV2 effect in the insert chain of a part
+    class TInsertEffect
+    {
+    public:
+        TInsertEffect(std::string &&lv2Uri, std::string &&presetSubDir) : m_Lv2Uri(std::move(lv2Uri)), m_PresetSubDir(std::move(presetSubDir)) {}
+        const std::string& Lv2Uri() const { return m_Lv2Uri; }
+        const std::string& PresetSubDir() const { return m_PresetSubDir; }
+        TInsertEffect ChangePresetSubDir(std::string &&presetSubDir) const
+        {
+            auto result = *this;
+            result.m_PresetSubDir = std::move(presetSubDir);
+            return result;
+        }
+        auto Tuple() const
+        {
+            return std::tie(m_Lv2Uri, m_PresetSubDir);
+        }
+        bool operator==(const TInsertEffect &other) const
+        {
+            return Tuple() == other.Tuple();
+        }
+
+    private:
+        std::string m_Lv2Uri;
+        std::string m_PresetSubDir; // or empty for the default preset
     };
     class TPart  // one for each keyboard
     {
@@ -241,9 +293,18 @@ export namespace project
         {
             return m_MidiChannelForSharedInstruments;
         }
+        // the references to instruments and presets (also the quick presets) are indices, not ids. They are rewritten
+        // by TProject::DeleteInstrument and when deleting presets.
         const std::optional<size_t>& ActiveInstrumentIndex() const { return m_ActiveInstrumentIndex; }
         const std::optional<size_t>& ActivePresetIndex() const { return m_ActivePresetIndex; }
         float AmplitudeFactor() const { return m_AmplitudeFactor; }
+        uint64_t Id() const { return m_Id; }
+        TPart ChangeId(uint64_t id) const
+        {
+            auto result = *this;
+            result.m_Id = id;
+            return result;
+        }
         TPart ChangeActiveInstrumentIndex(std::optional<size_t> activeInstrumentIndex) const
         {
             auto result = *this;
@@ -285,9 +346,17 @@ export namespace project
             result.m_QuickPresets[quickpresetindex] = presetindex;
             return result;
         }
+        // applied in order to the output of the active instrument, before the amplitude factor:
+        const std::vector<TInsertEffect>& InsertEffects() const { return m_InsertEffects; }
+        TPart ChangeInsertEffects(std::vector<TInsertEffect> &&insertEffects) const
+        {
+            auto result = *this;
+            result.m_InsertEffects = std::move(insertEffects);
+            return result;
+        }
         auto Tuple() const
         {
-            return std::tie(m_Name, m_MidiChannelForSharedInstruments, m_ActiveInstrumentIndex, m_ActivePresetIndex, m_AmplitudeFactor, m_QuickPresets);
+            return std::tie(m_Id, m_Name, m_MidiChannelForSharedInstruments, m_ActiveInstrumentIndex, m_ActivePresetIndex, m_AmplitudeFactor, m_QuickPresets, m_InsertEffects);
         }
         bool operator==(const TPart &other) const
         {
@@ -301,14 +370,24 @@ export namespace project
         std::optional<size_t> m_ActivePresetIndex;
         float m_AmplitudeFactor = 1.0f;
         std::vector<std::optional<size_t>> m_QuickPresets;
+        std::vector<TInsertEffect> m_InsertEffects;
+        uint64_t m_Id = 0;
     };
     class TPreset
     {
     public:
         TPreset(size_t instrumentIndex, std::string &&name, std::string &&presetSubDir, std::optional<std::vector<TInstrument::TParameter>> &&overrideParameters) : m_InstrumentIndex(instrumentIndex), m_PresetSubDir(presetSubDir), m_Name(std::move(name)), m_OverrideParameters(std::move(overrideParameters)) {}
+        // index (not id) of the instrument, see TPart
         size_t InstrumentIndex() const { return m_InstrumentIndex; }
         const std::string &Name() const {return m_Name;}
         const std::string &PresetSubDir() const {return m_PresetSubDir;}
+        uint64_t Id() const { return m_Id; }
+        TPreset ChangeId(uint64_t id) const
+        {
+            auto result = *this;
+            result.m_Id = id;
+            return result;
+        }
         TPreset ChangeName(std::string &&name) const
         {
             auto result = *this;
@@ -336,7 +415,7 @@ export namespace project
         const std::optional<std::vector<TInstrument::TParameter>>& OverrideParameters() const {return m_OverrideParameters;}
         auto Tuple() const
         {
-            return std::tie(m_InstrumentIndex, m_Name, m_PresetSubDir, m_OverrideParameters);
+            return std::tie(m_Id, m_InstrumentIndex, m_Name, m_PresetSubDir, m_OverrideParameters);
         }
         bool operator==(const TPreset &other) const
         {
@@ -348,6 +427,7 @@ export namespace project
         std::string m_Name;
         std::string m_PresetSubDir;
         std::optional<std::vector<TInstrument::TParameter>> m_OverrideParameters;
+        uint64_t m_Id = 0;
     };
     class TReverb
     {
@@ -394,10 +474,16 @@ export namespace project
     {
     public:
         TProject() {}
-        TProject(std::vector<TInstrument>&& instruments, std::vector<TPart>&& parts, std::vector<std::optional<TPreset>> &&presets, TReverb &&reverb) : m_Instruments(std::move(instruments)), m_Parts(std::move(parts)), m_Presets(std::move(presets)), m_Reverb(std::move(reverb))  {}
+        TProject(std::vector<TInstrument>&& instruments, std::vector<TPart>&& parts, std::vector<std::optional<TPreset>> &&presets, TReverb &&reverb) : m_Instruments(std::move(instruments)), m_Parts(std::move(parts)), m_Presets(std::move(presets)), m_Reverb(std::move(reverb))
+        {
+            AssignIds();
+        }
         const std::vector<TInstrument>& Instruments() const { return m_Instruments; }
         const std::vector<TPart>& Parts() const { return m_Parts; }
         const std::vector<std::optional<TPreset>>& Presets() const { return m_Presets; }
+        std::optional<size_t> InstrumentIndexById(uint64_t id) const { return FindId(m_InstrumentId2Index, id); }
+        std::optional<size_t> PartIndexById(uint64_t id) const { return FindId(m_PartId2Index, id); }
+        std::optional<size_t> PresetIndexById(uint64_t id) const { return FindId(m_PresetId2Index, id); }
         bool HasAPreset() const;
         TProject ChangeReverb(TReverb &&reverb) const
         {
@@ -426,7 +512,12 @@ export namespace project
                         part = part.ChangeActiveInstrumentIndex(instrumentindex);
                     }
                 }
+                if(part.Id() == 0)
+                {
+                    part = part.ChangeId(oldpart.Id());
+                }
                 result.m_Parts[partIndex] = std::move(part);
+                result.AssignIds();
             }
             return result;
         }
@@ -434,6 +525,7 @@ export namespace project
         {
             auto result = *this;
             result.m_Parts.emplace_back(std::move(part));
+            result.AssignIds();
             return result;
         }
         TProject DeletePart(size_t partindex) const
@@ -442,6 +534,7 @@ export namespace project
             if(partindex < m_Parts.size())
             {
                 result.m_Parts.erase(result.m_Parts.begin() + partindex);
+                result.AssignIds();
             }
             return result;
         }
@@ -456,27 +549,35 @@ export namespace project
             {
                 result.m_Presets.resize(presetIndex+1);
             }
-            if(presetIndex < m_Presets.size())
+            if(presetIndex < result.m_Presets.size())
             {
                 result.m_Presets[presetIndex] = std::move(preset);
+                result.AssignIds();
             }
             return result;
         }
         void SetPresets(std::vector<std::optional<TPreset>> &&presets)
         {
             m_Presets = std::move(presets);
+            AssignIds();
         }
         const TReverb& Reverb() const { return m_Reverb; }
         TProject AddInstrument(TInstrument &&inst) const
         {
             auto result = *this;
             result.m_Instruments.push_back(std::move(inst));
+            result.AssignIds();
             return result;
         }
         TProject ChangeInstrument(size_t index, TInstrument &&inst) const
         {
             auto result = *this;
+            if(inst.Id() == 0)
+            {
+                inst = inst.ChangeId(m_Instruments.at(index).Id());
+            }
             result.m_Instruments.at(index) = std::move(inst);
+            result.AssignIds();
             return result;            
         }
         TProject DeleteInstrument(size_t index) const;
@@ -506,11 +607,27 @@ export namespace project
             return result;
         }
 
+    private:
+        // gives a new id to any instrument, part or preset that does not have one yet, or to the copy if an id is
+        // duplicated, and rebuilds the id to index maps
+        void AssignIds();
+        static std::optional<size_t> FindId(const std::unordered_map<uint64_t, size_t> &map, uint64_t id)
+        {
+            auto it = map.find(id);
+            if(it == map.end()) return std::nullopt;
+            return it->second;
+        }
+
     private:
         std::vector<TPart> m_Parts;
         std::vector<TInstrument> m_Instruments;
         std::vector<std::optional<TPreset>> m_Presets;
         TReverb m_Reverb;
+        // not part of Tuple(), these are derived from the ids:
+        uint64_t m_NextId = 1;
+        std::unordered_map<uint64_t, size_t> m_InstrumentId2Index;
+        std::unordered_map<uint64_t, size_t> m_PartId2Index;
+        std::unordered_map<uint64_t, size_t> m_PresetId2Index;
     };
     class TJackConnections
     {
@@ -579,6 +696,8 @@ export namespace project
     TReverb ReverbFromJson(const Json::Value &v);
     Json::Value ToJson(const TInstrument &instrument);
     TInstrument InstrumentFromJson(const Json::Value &v);
+    Json::Value ToJson(const TInsertEffect &insertEffect);
+    TInsertEffect InsertEffectFromJson(const Json::Value &v);
     Json::Value ToJson(const TPart &part);
     TPart PartFromJson(const Json::Value &v);
     Json::Value ToJson(const TPreset &preset);
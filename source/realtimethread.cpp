@@ -1,41 +1,329 @@
 #include "realtimethread.h"
+#include <iostream>
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
 
 #pragma clang optimize on
 
-namespace realtimethread
+namespace
 {
-    void Processor::Process(jack_nframes_t nframes)
+    // below -90 dB counts as silence:
+    constexpr float sSilenceThreshold = 3.16e-5f;
+
+    // largest absolute sample value
+    float PeakAbs(const float *buffer, size_t nframes)
+    {
+        float peak = 0.0f;
+        size_t i = 0;
+#ifdef __SSE2__
+        auto absmask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+        auto peak4 = _mm_setzero_ps();
+        for(; i + 4 <= nframes; i += 4)
+        {
+            peak4 = _mm_max_ps(peak4, _mm_and_ps(_mm_loadu_ps(buffer + i), absmask));
+        }
+        peak4 = _mm_max_ps(peak4, _mm_movehl_ps(peak4, peak4));
+        peak4 = _mm_max_ss(peak4, _mm_shuffle_ps(peak4, peak4, 1));
+        peak = _mm_cvtss_f32(peak4);
+#endif
+        for(; i < nframes; ++i)
+        {
+            peak = std::max(peak, std::abs(buffer[i]));
+        }
+        return peak;
+    }
+
+    constexpr size_t sOversampling = realtimethread::TLevelMeter::sOversampling;
+    constexpr size_t sTapsPerPhase = realtimethread::TLevelMeter::sTapsPerPhase;
+
+    // Hann windowed sinc interpolation filter for the true peak, split in its phases: sTruePeakFilter[k][phase] is tap
+    // k of that phase. Each phase is normalized to unity gain at DC.
+    const auto sTruePeakFilter = []() {
+        constexpr size_t numtaps = sOversampling * sTapsPerPhase;
+        constexpr double center = (numtaps - 1) / 2.0;
+        std::array<std::array<float, sOversampling>, sTapsPerPhase> result;
+        for(size_t phase = 0; phase < sOversampling; phase++)
+        {
+            std::array<double, sTapsPerPhase> taps;
+            double sum = 0.0;
+            for(size_t k = 0; k < sTapsPerPhase; k++)
+            {
+                size_t n = k * sOversampling + phase;
+                double x = ((double)n - center) / sOversampling;
+                double sinc = std::sin(std::numbers::pi * x) / (std::numbers::pi * x);
+                double window = 0.5 - 0.5 * std::cos(2.0 * std::numbers::pi * (double)(n + 1) / (numtaps + 1));
+                taps[k] = sinc * window;
+                sum += taps[k];
+            }
+            for(size_t k = 0; k < sTapsPerPhase; k++)
+            {
+                result[k][phase] = (float)(taps[k] / sum);
+            }
+        }
+        return result;
+    }();
+
+    // one pole lowpass filter y = b*x*x + a*y over the block, returns the new y
+    float SmoothedMeanSquare(const float *buffer, size_t nframes, float a, float y)
+    {
+        float b = 1.0f - a;
+        size_t i = 0;
+#ifdef __SSE2__
+        // four samples at a time: y4 = a^4 * y0 + b * (a^3 x0^2 + a^2 x1^2 + a x2^2 + x3^2)
+        float a2 = a * a;
+        float a4 = a2 * a2;
+        auto weights = _mm_set_ps(1.0f, a, a2, a2 * a);
+        for(; i + 4 <= nframes; i += 4)
+        {
+            auto x = _mm_loadu_ps(buffer + i);
+            auto weighted = _mm_mul_ps(_mm_mul_ps(x, x), weights);
+            weighted = _mm_add_ps(weighted, _mm_movehl_ps(weighted, weighted));
+            weighted = _mm_add_ss(weighted, _mm_shuffle_ps(weighted, weighted, 1));
+            y = a4 * y + b * _mm_cvtss_f32(weighted);
+        }
+#endif
+        for(; i < nframes; ++i)
+        {
+            y = b * buffer[i] * buffer[i] + a * y;
+        }
+        return y;
+    }
+
+    // largest absolute value of the 4x oversampled signal, and of the samples themselves. history holds the last samples
+    // of the previous block and is updated.
+    float TruePeak(const float *buffer, size_t nframes, std::array<float, sTapsPerPhase - 1> &history)
     {
-        if(nframes > m_Bufsize)
+        constexpr size_t numhistory = sTapsPerPhase - 1;
+        constexpr size_t chunksize = 64;
+        // work[numhistory + i] is sample i of the chunk, preceded by the history:
+        std::array<float, numhistory + chunksize> work;
+        std::copy(history.begin(), history.end(), work.begin());
+        float peak = PeakAbs(buffer, nframes);
+#ifdef __SSE2__
+        auto absmask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+        auto peak4 = _mm_setzero_ps();
+#endif
+        for(size_t start = 0; start < nframes; start += chunksize)
         {
-            throw std::runtime_error("nframes > bufsize");
+            size_t n = std::min(chunksize, nframes - start);
+            std::copy(buffer + start, buffer + start + n, work.begin() + numhistory);
+            for(size_t i = 0; i < n; i++)
+            {
+                const float *newest = work.data() + numhistory + i;
+#ifdef __SSE2__
+                // all phases at once:
+                auto sum = _mm_setzero_ps();
+                for(size_t k = 0; k < sTapsPerPhase; k++)
+                {
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(newest[-(ptrdiff_t)k]), _mm_loadu_ps(sTruePeakFilter[k].data())));
+                }
+                peak4 = _mm_max_ps(peak4, _mm_and_ps(sum, absmask));
+#else
+                std::array<float, sOversampling> sum = {};
+                for(size_t k = 0; k < sTapsPerPhase; k++)
+                {
+                    for(size_t phase = 0; phase < sOversampling; phase++)
+                    {
+                        sum[phase] += newest[-(ptrdiff_t)k] * sTruePeakFilter[k][phase];
+                    }
+                }
+                for(auto v: sum)
+                {
+                    peak = std::max(peak, std::abs(v));
+                }
+#endif
+            }
+            std::copy(work.begin() + n, work.begin() + n + numhistory, work.begin());
         }
+#ifdef __SSE2__
+        peak4 = _mm_max_ps(peak4, _mm_movehl_ps(peak4, peak4));
+        peak4 = _mm_max_ss(peak4, _mm_shuffle_ps(peak4, peak4, 1));
+        peak = std::max(peak, _mm_cvtss_f32(peak4));
+#endif
+        std::copy(work.begin(), work.begin() + numhistory, history.begin());
+        return peak;
+    }
+}
+
+namespace realtimethread
+{
+    void Processor::Process(jack_nframes_t nframes)
+    {
         if( (nframes & 7) != 0)
         {
             throw std::runtime_error("nframes not a multiple of 8");
         }
+        auto cyclestart = timing::NowNs();
+        auto stagestart = cyclestart;
+        auto endstage = [&](TStage stage) {
+            auto now = timing::NowNs();
+            m_StageHistograms[(size_t)stage].Add(now - stagestart);
+            stagestart = now;
+        };
         ClearOutputMidiBuffers(nframes);
+        endstage(TStage::ClearOutputMidiBuffers);
         ProcessMessagesInRealtimeThread(nframes);
+        endstage(TStage::ProcessMessages);
+        // After the jack buffer size was raised, the audio buffers are too small until the main thread has sent a graph
+        // with larger ones. Meanwhile the output is silent, but messages and midi keep flowing:
+        bool audiofits = (!m_GraphInRtThread) || (nframes <= m_GraphInRtThread->Bufsize());
         ProcessIncomingMidi(nframes);
-        ProcessIncomingAudio(nframes);
-        RunInstances(nframes);
-        ProcessOutgoingAudio(nframes);
-        RunReverbInstance(nframes);
-        AddReverb(nframes);
+        endstage(TStage::IncomingMidi);
+        if(audiofits)
+        {
+            ProcessIncomingAudio(nframes);
+        }
+        endstage(TStage::IncomingAudio);
+        if(audiofits)
+        {
+            RunGraph(nframes);
+        }
+        endstage(TStage::RunGraph);
+        if(audiofits)
+        {
+            ProcessOutgoingAudio(nframes);
+        }
+        else
+        {
+            for(auto buffer: OutputAudioBuffers(nframes))
+            {
+                if(buffer) std::fill(buffer, buffer + nframes, 0.0f);
+            }
+        }
+        endstage(TStage::OutgoingAudio);
         ProcessOutputLevel(nframes);
-        ProcessOutputPorts();
+        endstage(TStage::OutputLevel);
+        ProcessOutputPorts(nframes);
+        endstage(TStage::OutputPorts);
         ResetEvBufs();
+        endstage(TStage::ResetEvBufs);
         SendPendingAsyncFunctionMessages();
+        endstage(TStage::SendAsyncMessages);
+        m_CycleHistogram.Add(stagestart - cyclestart);
+        m_FrameTime += nframes;
+        SendTimingIfNeeded(stagestart);
+    }
+
+    const char* StageName(TStage stage)
+    {
+        switch(stage)
+        {
+            case TStage::ClearOutputMidiBuffers: return "Clear MIDI out";
+            case TStage::ProcessMessages: return "Messages";
+            case TStage::IncomingMidi: return "MIDI in";
+            case TStage::IncomingAudio: return "Audio in";
+            case TStage::RunGraph: return "Plugins and mix";
+            case TStage::OutgoingAudio: return "Audio out";
+            case TStage::OutputLevel: return "Level meter";
+            case TStage::OutputPorts: return "Output ports";
+            case TStage::ResetEvBufs: return "Reset event buffers";
+            case TStage::SendAsyncMessages: return "Async messages";
+            default: return "";
+        }
+    }
+
+    void Processor::SendTimingIfNeeded(uint64_t now)
+    {
+        if(m_TimingWindowStart == 0)
+        {
+            m_TimingWindowStart = now;
+        }
+        if(now - m_TimingWindowStart < m_TimingWindowNs) return;
+        SendTiming(now);
+    }
+
+    void Processor::FlushTiming()
+    {
+        auto now = timing::NowNs();
+        if(m_TimingWindowStart == 0)
+        {
+            m_TimingWindowStart = now;
+        }
+        SendTiming(now);
+    }
+
+    void Processor::SendTiming(uint64_t now)
+    {
+        auto windowNs = now - m_TimingWindowStart;
+        m_TimingWindowStart = now;
+        // the messages are dropped if the ring buffer is full, we don't want to throw in the realtime thread:
+        for(size_t stage = 0; stage < sNumStages; stage++)
+        {
+            RingBufFromRtThread().Write(TimingUpdateMessage(TimingUpdateMessage::TKind::Stage, stage, nullptr, windowNs, m_StageHistograms[stage]), false);
+            m_StageHistograms[stage].Reset();
+        }
+        if(m_DataInRtThread)
+        {
+            const auto &plugins = m_DataInRtThread->Plugins();
+            for(size_t pluginindex = 0; pluginindex < std::min(plugins.size(), sMaxTimedInstances); pluginindex++)
+            {
+                RingBufFromRtThread().Write(TimingUpdateMessage(TimingUpdateMessage::TKind::Instance, 0, &plugins[pluginindex].PluginInstance(), windowNs, m_InstanceHistograms[pluginindex]), false);
+            }
+        }
+        for(auto &histogram: m_InstanceHistograms)
+        {
+            histogram.Reset();
+        }
+        // must be last, the main thread publishes the report when it receives this one:
+        RingBufFromRtThread().Write(TimingUpdateMessage(TimingUpdateMessage::TKind::Cycle, 0, nullptr, windowNs, m_CycleHistogram), false);
+        m_CycleHistogram.Reset();
+    }
+
+    void Processor::UpdateTimingInMainThread(const TimingUpdateMessage &message)
+    {
+        auto histogram = message.Histogram();
+        if(message.Kind() == TimingUpdateMessage::TKind::Stage)
+        {
+            if(message.Stage() < sNumStages)
+            {
+                m_TimingReport.m_Stages[message.Stage()] = histogram.Stats();
+            }
+        }
+        else if(message.Kind() == TimingUpdateMessage::TKind::Instance)
+        {
+            m_TimingReport.m_Instances[message.Instance()] = histogram.Stats();
+        }
+        else
+        {
+            m_TimingReport.m_Cycle = histogram.Stats();
+            if( (message.WindowNs() > 0) && (histogram.Count() > 0) )
+            {
+                auto avgperiod = (double)message.WindowNs() / (double)histogram.Count();
+                m_TimingReport.m_DspLoad = (float)((double)histogram.SumNs() / (double)message.WindowNs());
+                m_TimingReport.m_PeakDspLoad = (float)((double)histogram.MaxNs() / avgperiod);
+            }
+            // forget instances that are no longer in use:
+            std::set<const lilvutils::Instance*> instances;
+            if(m_CurrentData)
+            {
+                for(const auto &plugin: m_CurrentData->Plugins())
+                {
+                    instances.insert(&plugin.PluginInstance());
+                }
+            }
+            std::erase_if(m_TimingReport.m_Instances, [&](const auto &item){
+                return !instances.contains(item.first);
+            });
+            m_OnTimingUpdate.Notify();
+        }
     }
 
     void Processor::SetDataFromMainThread(Data &&data)
     {
+        auto newgraph = std::make_unique<TCompiledGraph>(data, m_Bufsize, m_CurrentGraph.get());
         auto olddata = std::move(m_CurrentData);
+        auto oldgraph = std::move(m_CurrentGraph);
         m_CurrentData = std::make_unique<Data>(std::move(data));
-        RingBufToRtThread().Write(SetDataMessage(m_CurrentData.get()));
+        m_CurrentGraph = std::move(newgraph);
+        RingBufToRtThread().Write(SetDataMessage(m_CurrentData.get(), m_CurrentGraph.get()));
         auto ptr = olddata.release();
-        DeferredExecuteAfterRoundTrip([ptr](){
+        auto graphptr = oldgraph.release();
+        auto serial = ++m_DataSerial;
+        DeferredExecuteAfterRoundTrip([this, ptr, graphptr, serial](){
             delete ptr;
+            delete graphptr;
+            m_RetiredDataSerial = serial;
         });
     }
     void Processor::SendAtomPortEventFromMainThread(lilvutils::TConnection<lilvutils::TAtomPort>* connection, uint32_t frames, uint32_t subframes, LV2_URID type, uint32_t size, const void* body)
@@ -60,28 +348,56 @@ namespace realtimethread
             {
                 asyncfunctionmessage->Call();
             }
-            else if(auto cpchangedmessage = dynamic_cast<const realtimethread::ControlPortChangedMessage*>(message); cpchangedmessage)
+            else if(auto outputControlsChangedMessage = dynamic_cast<const OutputControlsChangedMessage*>(message))
             {
-                cpchangedmessage->Connection()->SetValueInMainThread(cpchangedmessage->NewValue(), true);
+                std::vector<lilvutils::TOutputControlChange> changes(outputControlsChangedMessage->NumChanges());
+                for(size_t i = 0; i < changes.size(); i++)
+                {
+                    changes[i] = outputControlsChangedMessage->Change(i);
+                }
+                outputControlsChangedMessage->Instance()->OnOutputControlsChanged(changes);
             }
-            else if(auto atomPortEventMessage = dynamic_cast<const AtomPortEventMessage*>(message))
+            else if(auto atomPortEventsMessage = dynamic_cast<const AtomPortEventsMessage*>(message))
             {
-                atomPortEventMessage->Connection()->instance().OnAtomPortMessage(*atomPortEventMessage->Connection(), atomPortEventMessage->Frames(), atomPortEventMessage->SubFrames(), atomPortEventMessage->Type(), atomPortEventMessage->AdditionalDataSize(), atomPortEventMessage->AdditionalDataBuf());
+                auto connection = atomPortEventsMessage->Connection();
+                atomPortEventsMessage->ForEachEvent([connection](uint32_t frames, LV2_URID type, uint32_t size, const void *body){
+                    connection->instance().OnAtomPortMessage(*connection, frames, 0, type, size, body);
+                });
             }
-            else if(auto auxMidiInMessage = dynamic_cast<const AuxMidiInMessage*>(message))
+            else if(auto levelMeterUpdateMessage = dynamic_cast<const LevelMeterUpdateMessage*>(message))
             {
-                auxMidiInMessage->Call();
+                UpdateLevelsInMainThread(*levelMeterUpdateMessage);
             }
-            else if(auto outputLevelUpdateMessage = dynamic_cast<const OutputLevelUpdateMessage*>(message))
+            else if(auto timingUpdateMessage = dynamic_cast<const TimingUpdateMessage*>(message))
             {
-                UpdateOutputLevelDbInMainThread(outputLevelUpdateMessage->AmplitudeSquared());
+                UpdateTimingInMainThread(*timingUpdateMessage);
+            }
+        }
+        if(m_CurrentData)
+        {
+            for(const auto &plugin: m_CurrentData->Plugins())
+            {
+                plugin.PluginInstance().ReportDroppedAtomEvents();
             }
         }
     }    
-    void Processor::UpdateOutputLevelDbInMainThread(float ampsquared)
+    void Processor::UpdateLevelsInMainThread(const LevelMeterUpdateMessage &message)
     {
-        m_OutputLevelDb = 10.0f * std::log10(ampsquared);
-        m_OnOutputLevelChange.Notify();
+        m_OutputLevel = message.Output();
+        for(auto &partlevel: m_PartLevels)
+        {
+            partlevel = TStereoLevel();
+        }
+        for(size_t i = 0; i < message.NumParts(); i++)
+        {
+            auto partlevel = message.Part(i);
+            if(partlevel.m_Part >= m_PartLevels.size())
+            {
+                m_PartLevels.resize(partlevel.m_Part + 1);
+            }
+            m_PartLevels[partlevel.m_Part] = partlevel.m_Level;
+        }
+        m_OutputLevelDb = std::max(m_OutputLevel.RmsDb(0), m_OutputLevel.RmsDb(1));
         auto now = std::chrono::steady_clock::now();
         m_LevelMeterHistory.emplace_back(now, m_OutputLevelDb);
         if(m_OutputLevelDb > m_OutputPeakLevelDb)
@@ -107,6 +423,7 @@ namespace realtimethread
             }
             m_OutputPeakLevelDb = newpeak;
         }
+        m_OnOutputLevelChange.Notify();
     }
 
     void Processor::ProcessMessagesInRealtimeThread(jack_nframes_t nframes)
@@ -117,7 +434,18 @@ namespace realtimethread
             if(!message) break;
             if(auto setdatamessage = dynamic_cast<const SetDataMessage*>(message))
             {
+                auto oldgraph = m_GraphInRtThread;
                 m_DataInRtThread = setdatamessage->data();
+                m_GraphInRtThread = setdatamessage->graph();
+                if(oldgraph && m_GraphInRtThread)
+                {
+                    m_GraphInRtThread->TakeOverActivity(*oldgraph);
+                }
+                // the plugin indices may have changed:
+                for(auto &histogram: m_InstanceHistograms)
+                {
+                    histogram.Reset();
+                }
             }
             else if(auto asyncfunctionmessage = dynamic_cast<const AsyncFunctionMessage*>(message))
             {
@@ -137,16 +465,38 @@ namespace realtimethread
             {
                 auto &bufferIterator = atomPortEventMessage->Connection()->BufferIterator();
                 lv2_evbuf_write(&bufferIterator, atomPortEventMessage->Frames(), atomPortEventMessage->SubFrames(), atomPortEventMessage->Type(), atomPortEventMessage->AdditionalDataSize(), atomPortEventMessage->AdditionalDataBuf());
+                if(m_DataInRtThread)
+                {
+                    const auto &plugins = m_DataInRtThread->Plugins();
+                    for(size_t pluginindex = 0; pluginindex < plugins.size(); ++pluginindex)
+                    {
+                        if(&plugins[pluginindex].PluginInstance() == &atomPortEventMessage->Connection()->instance())
+                        {
+                            WakePlugin(pluginindex, nullptr, 0);
+                        }
+                    }
+                }
             }                
             else if(auto midioutmessage = dynamic_cast<const realtimethread::AuxMidiOutMessage*>(message); midioutmessage)
             {
-                auto buf = jack_port_get_buffer(midioutmessage->Port(), nframes);
-                jack_midi_event_write(buf, 0, (const jack_midi_data_t*) midioutmessage->AdditionalDataBuf(), midioutmessage->AdditionalDataSize());
+                auto buf = m_PortIo->Buffer(midioutmessage->Port(), nframes);
+                m_PortIo->MidiEventWrite(buf, 0, (const jack_midi_data_t*) midioutmessage->AdditionalDataBuf(), midioutmessage->AdditionalDataSize());
 
             }
             else if(auto midiMessageToPlugin = dynamic_cast<const realtimethread::TMidiMessageToPlugin*>(message); midiMessageToPlugin)
             {
                 lv2_evbuf_write(midiMessageToPlugin->DestinationPort(), 0, 0, m_UridMidiEvent, midiMessageToPlugin->AdditionalDataSize(), midiMessageToPlugin->AdditionalDataBuf());
+                if(m_DataInRtThread)
+                {
+                    const auto &plugins = m_DataInRtThread->Plugins();
+                    for(size_t pluginindex = 0; pluginindex < plugins.size(); ++pluginindex)
+                    {
+                        if(plugins[pluginindex].MidiInBuf() == midiMessageToPlugin->DestinationPort())
+                        {
+                            WakePlugin(pluginindex, (const uint8_t*)midiMessageToPlugin->AdditionalDataBuf(), midiMessageToPlugin->AdditionalDataSize());
+                        }
+                    }
+                }
             }
         }
     }
@@ -181,78 +531,234 @@ namespace realtimethread
         const auto &data = *m_DataInRtThread;
         for(const auto &outport: data.MidiAuxOutPorts())
         {
-            auto buf = jack_port_get_buffer(outport.Port(), nframes);
-            jack_midi_clear_buffer(buf);            
+            auto buf = m_PortIo->Buffer(outport.Port(), nframes);
+            m_PortIo->MidiClearBuffer(buf);
         }
     }
 
-    void Processor::ProcessOutputPorts()
+    void Processor::ProcessOutputPorts(jack_nframes_t nframes)
     {
         if(!m_DataInRtThread) return;
         const auto &data = *m_DataInRtThread;
-        for(const auto &plugin: data.Plugins())
+        for(size_t pluginindex = 0; pluginindex < data.Plugins().size(); ++pluginindex)
         {
-            auto &instance = plugin.PluginInstance();
-            ProcessOutputPortsForInstance(instance);
+            // a plugin that did not run has nothing in its output buffers:
+            if(m_GraphInRtThread)
+            {
+                auto node = m_GraphInRtThread->NodeOfPlugin(pluginindex);
+                if(node && node->m_Activity.m_Asleep) continue;
+            }
+            auto &instance = data.Plugins()[pluginindex].PluginInstance();
+            ProcessOutputPortsForInstance(instance, nframes);
+        }
+    }
+
+    void Processor::ProcessOutputPortsForInstance(lilvutils::Instance &instance, jack_nframes_t nframes)
+    {
+        // input control ports are only written by us, so only the output ports need to be checked:
+        auto changes = instance.ScanOutputControlPorts(nframes);
+        if(!changes.empty())
+        {
+            RingBufFromRtThread().Write(OutputControlsChangedMessage(&instance, changes));
         }
-        if(data.ReverbInstance())
+        for(auto atomportconnection: instance.OutputAtomConnections())
         {
-            ProcessOutputPortsForInstance(*data.ReverbInstance());
+            if(atomportconnection->Forwarded())
+            {
+                ForwardAtomPortEvents(*atomportconnection);
+            }
         }
     }
-
-    void Processor::ProcessOutputPortsForInstance(lilvutils::Instance &instance)
+    void Processor::ForwardAtomPortEvents(lilvutils::TConnection<lilvutils::TAtomPort> &connection)
     {
-        for(auto &connection: instance.Connections())
+        // The events are contiguous in the sequence, so a run of them is sent as is. Runs are split where they would
+        // exceed the maximum packet size.
+        auto sequence = (const LV2_Atom_Sequence*)lv2_evbuf_get_buffer(connection.Buffer());
+        auto events = (const char*)LV2_ATOM_CONTENTS(const LV2_Atom_Sequence, sequence);
+        uint32_t size = lv2_evbuf_get_size(connection.Buffer());
+        const uint32_t maxrunsize = RingBufFromRtThread().MaxPacketSize() - (uint32_t)sizeof(AtomPortEventsMessage);
+        uint32_t runbegin = 0;
+        uint32_t runevents = 0;
+        auto flush = [&](uint32_t runend) {
+            if(runevents > 0)
+            {
+                if(!RingBufFromRtThread().Write(AtomPortEventsMessage(&connection, events + runbegin, runend - runbegin), false))
+                {
+                    connection.AddDropped(runevents);
+                }
+            }
+            runbegin = runend;
+            runevents = 0;
+        };
+        uint32_t offset = 0;
+        while(offset + sizeof(LV2_Atom_Event) <= size)
         {
-            if(auto controlportconnection = dynamic_cast<lilvutils::TConnection<lilvutils::TControlPort>*>(connection.get()); controlportconnection)
+            auto event = (const LV2_Atom_Event*)(events + offset);
+            uint32_t eventsize = lv2_atom_pad_size(sizeof(LV2_Atom_Event) + event->body.size);
+            if(eventsize > maxrunsize)
+            {
+                flush(offset);
+                connection.AddDropped(1);
+                runbegin = offset + eventsize;
+            }
+            else
             {
-                const auto &port = controlportconnection->Port();
-                //if(port.Direction() == lilvutils::TPortBase::TDirection::Output)
+                if(offset + eventsize - runbegin > maxrunsize)
                 {
-                    if(*controlportconnection->Buffer() != controlportconnection->OrigValue())
-                    {
-                        controlportconnection->OrigValue() = *controlportconnection->Buffer();
-                        RingBufFromRtThread().Write(ControlPortChangedMessage(controlportconnection, *controlportconnection->Buffer()));
-                    }
+                    flush(offset);
                 }
+                runevents++;
             }
-            else if(auto atomportconnection = dynamic_cast<lilvutils::TConnection<lilvutils::TAtomPort>*>(connection.get()); atomportconnection)
+            offset += eventsize;
+        }
+        flush(std::min(offset, size));
+    }
+    void Processor::RunGraph(jack_nframes_t nframes)
+    {
+        if(!m_GraphInRtThread) return;
+        m_NFramesInCycle = nframes;
+        m_WorkerPool.Run(m_GraphInRtThread->Schedule(), m_RunNodeFunc);
+    }
+    void Processor::RunNode(size_t nodeindex)
+    {
+        // called from the realtime thread and the worker threads, for different nodes at the same time. The inputs
+        // of the node have finished, so their activity can be read.
+        auto nframes = m_NFramesInCycle;
+        auto &nodes = m_GraphInRtThread->Nodes();
+        auto &node = nodes[nodeindex];
+        auto &activity = node.m_Activity;
+        bool inputsAsleep = true;
+        for(const auto &input: node.m_Inputs)
+        {
+            if(!nodes[input.Node()].m_Activity.m_Asleep)
             {
-                const auto &port = atomportconnection->Port();
-                if(port.Direction() == lilvutils::TPortBase::TDirection::Output)
+                inputsAsleep = false;
+            }
+        }
+        if(node.m_Instance && activity.m_Asleep)
+        {
+            if(inputsAsleep)
+            {
+                if(node.m_MeteredPart)
+                {
+                    node.m_LevelMeter.ProcessSilence(nframes, m_DataInRtThread->LevelMeterTimeConstant());
+                }
+                return;
+            }
+            activity.m_Asleep = false;
+            activity.m_SilentFrames = 0;
+        }
+        // connect_port is only called when the source changes, i.e. when it falls asleep or wakes up. A sleeping
+        // source is silent but its output is stale, so then the input buffer is connected again and cleared below:
+        bool direct = node.m_DirectSource && !nodes[*node.m_DirectSource].m_Activity.m_Asleep;
+        if(node.m_Instance)
+        {
+            for(size_t channel: {0,1})
+            {
+                if(node.m_InputConnections[channel])
+                {
+                    node.m_InputConnections[channel]->ConnectTo(direct? nodes[*node.m_DirectSource].m_OutputBuffers[channel] : nullptr);
+                }
+            }
+        }
+        if( (!direct) && ((!node.m_Inputs.empty()) || (!node.m_Instance)) )
+        {
+            for(size_t channel: {0,1})
+            {
+                auto destbuffer = node.m_InputBuffers[channel];
+                if(!destbuffer) continue;
+                bool first = true;
+                for(const auto &input: node.m_Inputs)
                 {
-                    while(lv2_evbuf_is_valid(atomportconnection->BufferIterator()))
+                    const auto &sourcenode = nodes[input.Node()];
+                    auto sourcebuffer = sourcenode.m_OutputBuffers[channel];
+                    // the output of a sleeping node is not updated, and silent anyway:
+                    if( (!sourcebuffer) || sourcenode.m_Activity.m_Asleep ) continue;
+                    auto gain = input.Gain();
+                    if(first)
                     {
-                        // Get event from LV2 buffer
-                        uint32_t frames    = 0;
-                        uint32_t subframes = 0;
-                        LV2_URID type      = 0;
-                        uint32_t size      = 0;
-                        void*    body      = NULL;
-                        lv2_evbuf_get(atomportconnection->BufferIterator(), &frames, &subframes, &type, &size, &body);
-
-                        RingBufFromRtThread().Write(AtomPortEventMessage(atomportconnection, frames, subframes, type, size, body), false);
-                        atomportconnection->BufferIterator() = lv2_evbuf_next(atomportconnection->BufferIterator());
+                        for(size_t i = 0; i < nframes; ++i)
+                        {
+                            destbuffer[i] = gain * sourcebuffer[i];
+                        }
+                        first = false;
+                    }
+                    else
+                    {
+                        for(size_t i = 0; i < nframes; ++i)
+                        {
+                            destbuffer[i] += gain * sourcebuffer[i];
+                        }
                     }
                 }
+                if(first)
+                {
+                    std::fill(destbuffer, destbuffer + nframes, 0.0f);
+                }
+            }
+        }
+        if(!node.m_Instance)
+        {
+            activity.m_Asleep = (!node.m_Inputs.empty()) && inputsAsleep;
+            return;
+        }
+        auto start = timing::NowNs();
+        node.m_Instance->Run(nframes);
+        if(node.m_PluginIndex < sMaxTimedInstances)
+        {
+            m_InstanceHistograms[node.m_PluginIndex].Add(timing::NowNs() - start);
+        }
+        auto sleeptail = m_SleepTailFrames.load(std::memory_order_relaxed);
+        if(node.m_CanSleep && (sleeptail > 0))
+        {
+            bool silent = inputsAsleep && (!activity.HoldsNotes());
+            for(size_t channel: {0,1})
+            {
+                if(silent && node.m_OutputBuffers[channel])
+                {
+                    silent = PeakAbs(node.m_OutputBuffers[channel], nframes) < sSilenceThreshold;
+                }
+            }
+            if(!silent)
+            {
+                activity.m_SilentFrames = 0;
+            }
+            else
+            {
+                activity.m_SilentFrames += nframes;
+                if(activity.m_SilentFrames >= sleeptail)
+                {
+                    activity.m_Asleep = true;
+                }
+            }
+        }
+        if(node.m_MeteredPart)
+        {
+            // while the output is still in the cache:
+            auto timeconstant = m_DataInRtThread->LevelMeterTimeConstant();
+            if(node.m_OutputBuffers[0])
+            {
+                node.m_LevelMeter.Process(node.m_OutputBuffers[0], node.m_OutputBuffers[1], nframes, timeconstant);
+            }
+            else
+            {
+                node.m_LevelMeter.ProcessSilence(nframes, timeconstant);
             }
         }
     }
-    void Processor::RunInstances(jack_nframes_t nframes)
+    void Processor::WakePlugin(size_t pluginindex, const uint8_t *data, size_t size)
     {
-        if(!m_DataInRtThread) return;
-        const auto &data = *m_DataInRtThread;
-        for(const auto &plugin: data.Plugins())
+        if(!m_GraphInRtThread) return;
+        if(auto node = m_GraphInRtThread->NodeOfPlugin(pluginindex))
         {
-            plugin.PluginInstance().Run(nframes);
+            node->m_Activity.OnMidi(data, size);
         }
     }
     void Processor::ProcessIncomingAudio(jack_nframes_t nframes)
     {
         if(!m_DataInRtThread) return;
         const auto &data = *m_DataInRtThread;
-        auto vocoderbuf = data.VocoderInPort()? (const float*)jack_port_get_buffer(data.VocoderInPort(), nframes) : (const float*) nullptr;
+        auto vocoderbuf = data.VocoderInPort()? (const float*)m_PortIo->Buffer(data.VocoderInPort(), nframes) : (const float*) nullptr;
         for(const auto &plugin: data.Plugins())
         {
             if(plugin.HasVocoderInput())
@@ -286,139 +792,105 @@ namespace realtimethread
             }
         }
     }
-    void Processor::RunReverbInstance(jack_nframes_t nframes)
-    {
-        if(!m_DataInRtThread) return;
-        const auto &data = *m_DataInRtThread;
-        if(data.ReverbInstance())
-        {
-            data.ReverbInstance()->Run(nframes);
-        }
-    }
     void Processor::ProcessOutputLevel(jack_nframes_t nframes)
     {
+        // the meters themselves are updated in RunNode() and ProcessOutgoingAudio(); here they are sent to the main thread
         if(!m_DataInRtThread) return;
         const auto &data = *m_DataInRtThread;
-        std::array<float*, 2> mixedAudioPorts = {
-            data.OutputAudioPorts()[0]? (float*)jack_port_get_buffer(data.OutputAudioPorts()[0], nframes) : nullptr,
-            data.OutputAudioPorts()[1]? (float*)jack_port_get_buffer(data.OutputAudioPorts()[1], nframes) : nullptr
-        };
-        bool hasoutputaudio = mixedAudioPorts[0] && mixedAudioPorts[1];
-        if(hasoutputaudio)
+        m_LevelMeterOutputSampleCounter += nframes;
+        if(m_LevelMeterOutputSampleCounter >= data.LevelMeterUpdateFrames())
         {
-            float y = m_LevelMeterOutputBuf[0];
-            float a = data.LevelMeterTimeConstant();
-            float b = 1.0f - a;
-            size_t index = 0;
-            for(size_t i = 0; i < nframes / 8; ++i)
+            m_LevelMeterOutputSampleCounter = 0;
+            if(m_GraphInRtThread)
             {
-                std::array<float, 8> sumsqaured;
-                for(size_t j = 0; j < 8; ++j)
-                {
-                    float sum = mixedAudioPorts[0][index] + mixedAudioPorts[1][index];
-                    sumsqaured[j] = sum * sum;
-                    index++;
-                }
-                for(size_t j = 0; j < 8; ++j)
+                auto &partlevels = m_GraphInRtThread->PartLevels();
+                size_t index = 0;
+                for(auto &node: m_GraphInRtThread->Nodes())
                 {
-                    float newy = b * sumsqaured[j] + a * y;
-                    y = newy;
+                    if(node.m_MeteredPart)
+                    {
+                        partlevels[index++] = TPartLevel {*node.m_MeteredPart, node.m_LevelMeter.TakeLevel(node.m_MeterGain)};
+                    }
                 }
+                RingBufFromRtThread().Write(LevelMeterUpdateMessage(m_OutputLevelMeter.TakeLevel(1.0f), partlevels));
+            }
+            else
+            {
+                RingBufFromRtThread().Write(LevelMeterUpdateMessage(m_OutputLevelMeter.TakeLevel(1.0f), {}));
             }
-            m_LevelMeterOutputBuf[0] = y;
         }
-        else
+    }
+
+    void TLevelMeter::Process(const float *left, const float *right, size_t nframes, float timeConstant)
+    {
+        for(size_t channel: {0,1})
         {
-            m_LevelMeterOutputBuf[0] = 0.0f;
+            const float *buffer = channel == 0? left : right;
+            m_MeanSquare[channel] = SmoothedMeanSquare(buffer, nframes, timeConstant, m_MeanSquare[channel]);
+            m_TruePeak[channel] = std::max(m_TruePeak[channel], TruePeak(buffer, nframes, m_History[channel]));
         }
-        m_LevelMeterOutputSampleCounter += nframes;
-        int update_hz = 30;
-        if(m_LevelMeterOutputSampleCounter >= 48000/update_hz)
+    }
+
+    void TLevelMeter::ProcessSilence(size_t nframes, float timeConstant)
+    {
+        auto decay = std::pow(timeConstant, (float)nframes);
+        for(size_t channel: {0,1})
         {
-            m_LevelMeterOutputSampleCounter = 0;
-            RingBufFromRtThread().Write(OutputLevelUpdateMessage(m_LevelMeterOutputBuf[0]));            
+            m_MeanSquare[channel] *= decay;
+            m_History[channel].fill(0.0f);
         }
     }
 
-    void Processor::AddReverb(jack_nframes_t nframes)
+    TStereoLevel TLevelMeter::TakeLevel(float gain)
     {
-        if(!m_DataInRtThread) return;
-        const auto &data = *m_DataInRtThread;
-        std::array<float*, 2> mixedAudioPorts = {
-            data.OutputAudioPorts()[0]? (float*)jack_port_get_buffer(data.OutputAudioPorts()[0], nframes) : nullptr,
-            data.OutputAudioPorts()[1]? (float*)jack_port_get_buffer(data.OutputAudioPorts()[1], nframes) : nullptr
-        };
-        bool hasoutputaudio = mixedAudioPorts[0] && mixedAudioPorts[1];
-        if(hasoutputaudio && data.ReverbInstance() && data.ReverbLevel() != 0.0f)
+        TStereoLevel result;
+        for(size_t channel: {0,1})
         {
-            // copy mixed audio to reverb input:
-            for(size_t channel: {0,1})
-            {
-                auto portindexOrNull = data.ReverbInstance()->plugin().OutputAudioPortIndices()[channel];
-                if(portindexOrNull)
-                {
-                    auto portindex = *portindexOrNull;
-                    auto outputAudioPort = dynamic_cast<lilvutils::TConnection<lilvutils::TAudioPort>*>(data.ReverbInstance()->Connections().at(portindex).get());
-                    auto reverbOutputBuffer = outputAudioPort->Buffer();
-                    auto mixedAudioBuffer = mixedAudioPorts[channel];
-                    for(size_t i = 0; i < nframes; ++i)
-                    {
-                        mixedAudioBuffer[i] += data.ReverbLevel() * reverbOutputBuffer[i];
-                    }
-                }
-            }
+            result.m_MeanSquare[channel] = m_MeanSquare[channel] * gain * gain;
+            result.m_TruePeak[channel] = m_TruePeak[channel] * std::abs(gain);
+            m_TruePeak[channel] = 0.0f;
         }
+        return result;
     }
-    void Processor::ProcessOutgoingAudio(jack_nframes_t nframes)
+
+    std::array<float*, 2> Processor::OutputAudioBuffers(jack_nframes_t nframes)
     {
-        if(!m_DataInRtThread) return;
         const auto &data = *m_DataInRtThread;
-        std::array<float*, 2> mixedAudioPorts = {
-            data.OutputAudioPorts()[0]? (float*)jack_port_get_buffer(data.OutputAudioPorts()[0], nframes) : nullptr,
-            data.OutputAudioPorts()[1]? (float*)jack_port_get_buffer(data.OutputAudioPorts()[1], nframes) : nullptr
+        return {
+            data.OutputAudioPorts()[0]? (float*)m_PortIo->Buffer(data.OutputAudioPorts()[0], nframes) : nullptr,
+            data.OutputAudioPorts()[1]? (float*)m_PortIo->Buffer(data.OutputAudioPorts()[1], nframes) : nullptr
         };
+    }
+
+    void Processor::ProcessOutgoingAudio(jack_nframes_t nframes)
+    {
+        if(!m_DataInRtThread) return;
+        auto mixedAudioPorts = OutputAudioBuffers(nframes);
         bool hasoutputaudio = mixedAudioPorts[0] && mixedAudioPorts[1];
-        if(hasoutputaudio)
+        if(!hasoutputaudio)
         {
-            for(size_t i = 0; i < nframes; ++i)
-            {
-                mixedAudioPorts[0][i] = 0.0f;
-                mixedAudioPorts[1][i] = 0.0f;
-            }
+            m_OutputLevelMeter.ProcessSilence(nframes, m_DataInRtThread->LevelMeterTimeConstant());
+            return;
         }
-        for(const auto &plugin: data.Plugins())
+        const float *outputnodebuffers[2] = {nullptr, nullptr};
+        if(m_GraphInRtThread && !m_GraphInRtThread->Nodes().empty())
         {
-            auto outputAudioPortIndices = plugin.PluginInstance().plugin().OutputAudioPortIndices();
-            auto multiplier = plugin.AmplitudeFactor();
-            if(hasoutputaudio && outputAudioPortIndices[0] && outputAudioPortIndices[1])
-            {
-                std::array<float*, 2> pluginOutputAudioPorts {
-                    dynamic_cast<lilvutils::TConnection<lilvutils::TAudioPort>*>(plugin.PluginInstance().Connections().at(*outputAudioPortIndices[0]).get())->Buffer(),
-                    dynamic_cast<lilvutils::TConnection<lilvutils::TAudioPort>*>(plugin.PluginInstance().Connections().at(*outputAudioPortIndices[1]).get())->Buffer()
-                };
-                for(size_t i = 0; i < nframes; ++i)
-                {
-                    mixedAudioPorts[0][i] += multiplier * pluginOutputAudioPorts[0][i];
-                    mixedAudioPorts[1][i] += multiplier * pluginOutputAudioPorts[1][i];
-                }
-            }
+            const auto &outputnode = m_GraphInRtThread->Nodes().back();
+            outputnodebuffers[0] = outputnode.m_OutputBuffers[0];
+            outputnodebuffers[1] = outputnode.m_OutputBuffers[1];
         }
-        if(hasoutputaudio && data.ReverbInstance())
+        for(size_t channel: {0,1})
         {
-            // copy mixed audio to reverb input:
-            for(size_t channel: {0,1})
+            if(outputnodebuffers[channel])
             {
-                auto portindexOrNull = data.ReverbInstance()->plugin().InputAudioPortIndices()[channel];
-                if(portindexOrNull)
-                {
-                    auto portindex = *portindexOrNull;
-                    auto inputAudioPort = dynamic_cast<lilvutils::TConnection<lilvutils::TAudioPort>*>(data.ReverbInstance()->Connections().at(portindex).get());
-                    auto reverbInputBuffer = inputAudioPort->Buffer();
-                    auto mixedAudioBuffer = mixedAudioPorts[channel];
-                    std::copy(mixedAudioBuffer, mixedAudioBuffer + nframes, reverbInputBuffer);
-                }
+                std::copy(outputnodebuffers[channel], outputnodebuffers[channel] + nframes, mixedAudioPorts[channel]);
+            }
+            else
+            {
+                std::fill(mixedAudioPorts[channel], mixedAudioPorts[channel] + nframes, 0.0f);
             }
         }
+        m_OutputLevelMeter.Process(mixedAudioPorts[0], mixedAudioPorts[1], nframes, m_DataInRtThread->LevelMeterTimeConstant());
     }
     
     void Processor::ProcessIncomingMidi(jack_nframes_t nframes)
@@ -429,12 +901,12 @@ namespace realtimethread
         {
             auto pluginindex = midiport.PluginIndex();
             auto jackport = &midiport.Port();
-            auto buf = jack_port_get_buffer(jackport, nframes);
-            auto evtcount = jack_midi_get_event_count(buf);
+            auto buf = m_PortIo->Buffer(jackport, nframes);
+            auto evtcount = m_PortIo->MidiEventCount(buf);
             for (uint32_t i = 0; i < evtcount; ++i) 
             {
                 jack_midi_event_t ev;
-                jack_midi_event_get(&ev, buf, i);
+                m_PortIo->MidiEventGet(ev, buf, i);
                 if(midi::SimpleEvent::IsSupported(ev.buffer, ev.size))
                 {
                     auto event = midi::SimpleEvent(ev.buffer, ev.size);
@@ -450,6 +922,7 @@ namespace realtimethread
                         if(modifiedevent && plugin.MidiInBuf())
                         {
                             lv2_evbuf_write(plugin.MidiInBuf(), ev.time, 0, m_UridMidiEvent, modifiedevent->Size(), modifiedevent->Buffer());
+                            WakePlugin(*pluginindex, (const uint8_t*)modifiedevent->Buffer(), modifiedevent->Size());
                         }
                     }
                 }
@@ -457,14 +930,21 @@ namespace realtimethread
         }
         for(const auto &auxinport: data.MidiAuxInPorts())
         {
-            auto buf = jack_port_get_buffer(auxinport.Port(), nframes);
-            auto evtcount = jack_midi_get_event_count(buf);
+            auto buf = m_PortIo->Buffer(auxinport.Port(), nframes);
+            auto evtcount = m_PortIo->MidiEventCount(buf);
+            if(evtcount == 0) continue;
+            auto &ring = auxinport.Ring();
+            ring.BeginBatch();
             for (uint32_t i = 0; i < evtcount; ++i) 
             {
                 jack_midi_event_t ev;
-                jack_midi_event_get(&ev, buf, i);
-                RingBufFromRtThread().Write(AuxMidiInMessage((const void *)ev.buffer, ev.size, auxinport.Callback()), false);
+                m_PortIo->MidiEventGet(ev, buf, i);
+                if(midi::TMidiOrSysexEvent::IsSupported(ev.buffer, ev.size))
+                {
+                    ring.Add(m_FrameTime + ev.time, ev.buffer, ev.size);
+                }
             }
+            ring.EndBatch();
         }
     }
     void Processor::SendMidiFromMainThread(const void *data, size_t size, jack_port_t *port)
@@ -475,17 +955,255 @@ namespace realtimethread
     {
         RingBufToRtThread().Write(TMidiMessageToPlugin(data, size, destinationPort));
     }
-    void AuxMidiInMessage::Call() const
+    void TMixGraph::AddChain(size_t instrumentPluginIndex, std::vector<size_t> &&insertPluginIndices, float gain, const std::optional<size_t> &part)
+    {
+        m_Chains.push_back(TChain{instrumentPluginIndex, std::move(insertPluginIndices), gain, part});
+    }
+    void TMixGraph::SetReverb(size_t reverbPluginIndex, float level)
+    {
+        m_ReverbPluginIndex = reverbPluginIndex;
+        m_ReverbLevel = level;
+    }
+    std::vector<Data::TNode> TMixGraph::Nodes() const
     {
-        //  called in main thread
-        if(m_Callback)
+        std::vector<Data::TNode> result;
+        std::vector<Data::TNode::TInput> dryinputs;
+        for(const auto &chain: m_Chains)
         {
-            if(midi::TMidiOrSysexEvent::IsSupported(this->AdditionalDataBuf(), AdditionalDataSize()))
+            bool hasinserts = !chain.m_InsertPluginIndices.empty();
+            result.emplace_back(chain.m_InstrumentPluginIndex, std::vector<Data::TNode::TInput>(), hasinserts? std::nullopt : chain.m_Part);
+            for(size_t i = 0; i < chain.m_InsertPluginIndices.size(); i++)
             {
-                midi::TMidiOrSysexEvent event(this->AdditionalDataBuf(), AdditionalDataSize());
-                (*m_Callback)(event);
+                bool last = i + 1 == chain.m_InsertPluginIndices.size();
+                result.emplace_back(chain.m_InsertPluginIndices[i], std::vector<Data::TNode::TInput> {Data::TNode::TInput(result.size() - 1, 1.0f)}, last? chain.m_Part : std::nullopt);
             }
+            dryinputs.emplace_back(result.size() - 1, chain.m_Gain);
+        }
+        result.emplace_back(std::nullopt, std::move(dryinputs));
+        if(m_ReverbPluginIndex)
+        {
+            auto drybus = result.size() - 1;
+            result.emplace_back(*m_ReverbPluginIndex, std::vector<Data::TNode::TInput> {Data::TNode::TInput(drybus, 1.0f)});
+            auto reverb = result.size() - 1;
+            result.emplace_back(std::nullopt, std::vector<Data::TNode::TInput> {Data::TNode::TInput(drybus, 1.0f), Data::TNode::TInput(reverb, m_ReverbLevel)});
+        }
+        return result;
+    }
+
+    TCompiledGraph::TCompiledGraph(const Data &data, jack_nframes_t bufsize, const TCompiledGraph *previous) : m_Schedule(Dependencies(data)), m_Previous(previous), m_Bufsize(bufsize)
+    {
+        // every bus channel starts on a cache line of its own, so the workers don't share cache lines:
+        size_t channelstride = (bufsize + 15) & ~(size_t)15;
+        size_t numbuses = 0;
+        for(const auto &node: data.Nodes())
+        {
+            if(!node.PluginIndex()) numbuses++;
+        }
+        if(numbuses > 0)
+        {
+            m_BusMemory.assign(numbuses * 2 * channelstride, 0.0f);
+        }
+        size_t busindex = 0;
+        auto audioconnection = [](lilvutils::Instance &instance, const std::optional<uint32_t> &portindex) -> lilvutils::TConnection<lilvutils::TAudioPort>* {
+            if(!portindex) return nullptr;
+            return dynamic_cast<lilvutils::TConnection<lilvutils::TAudioPort>*>(instance.Connections().at(*portindex).get());
+        };
+        auto audiobuffer = [&](lilvutils::Instance &instance, const std::optional<uint32_t> &portindex) -> float* {
+            auto connection = audioconnection(instance, portindex);
+            return connection? connection->Buffer() : nullptr;
+        };
+        for(const auto &datanode: data.Nodes())
+        {
+            TNode node;
+            node.m_Inputs = datanode.Inputs();
+            node.m_MeteredPart = datanode.MeteredPart();
+            if(node.m_MeteredPart)
+            {
+                m_PartLevels.push_back(TPartLevel {*node.m_MeteredPart, TStereoLevel()});
+            }
+            for(const auto &input: node.m_Inputs)
+            {
+                if(m_Nodes[input.Node()].m_MeteredPart)
+                {
+                    m_Nodes[input.Node()].m_MeterGain = input.Gain();
+                }
+            }
+            if(datanode.PluginIndex())
+            {
+                node.m_PluginIndex = *datanode.PluginIndex();
+                node.m_Instance = &data.Plugins().at(node.m_PluginIndex).PluginInstance();
+                node.m_CanSleep = data.Plugins()[node.m_PluginIndex].CanSleep();
+                if(m_NodeOfPlugin.size() <= node.m_PluginIndex)
+                {
+                    m_NodeOfPlugin.resize(node.m_PluginIndex + 1);
+                }
+                m_NodeOfPlugin[node.m_PluginIndex] = m_Nodes.size();
+                if(previous)
+                {
+                    const auto &previousnodes = previous->Nodes();
+                    auto it = std::find_if(previousnodes.begin(), previousnodes.end(), [&](const TNode &previousnode){
+                        return previousnode.m_Instance == node.m_Instance;
+                    });
+                    if(it != previousnodes.end())
+                    {
+                        node.m_PreviousNode = (size_t)(it - previousnodes.begin());
+                    }
+                }
+                const auto &plugin = node.m_Instance->plugin();
+                for(size_t channel: {0,1})
+                {
+                    node.m_InputConnections[channel] = audioconnection(*node.m_Instance, plugin.InputAudioPortIndices()[channel]);
+                    node.m_InputBuffers[channel] = node.m_InputConnections[channel]? node.m_InputConnections[channel]->Buffer() : nullptr;
+                    node.m_OutputBuffers[channel] = audiobuffer(*node.m_Instance, plugin.OutputAudioPortIndices()[channel]);
+                }
+                if(!node.m_OutputBuffers[1])
+                {
+                    node.m_OutputBuffers[1] = node.m_OutputBuffers[0];
+                }
+                // the vocoder input is written into the input buffers, so those must stay connected:
+                if( (node.m_Inputs.size() == 1) && (node.m_Inputs[0].Gain() == 1.0f) && !data.Plugins()[node.m_PluginIndex].HasVocoderInput() )
+                {
+                    const auto &sourcenode = m_Nodes[node.m_Inputs[0].Node()];
+                    if(sourcenode.m_OutputBuffers[0] && sourcenode.m_OutputBuffers[1])
+                    {
+                        node.m_DirectSource = node.m_Inputs[0].Node();
+                    }
+                }
+            }
+            else
+            {
+                for(size_t channel: {0,1})
+                {
+                    auto buffer = m_BusMemory.data() + (2 * busindex + channel) * channelstride;
+                    node.m_InputBuffers[channel] = buffer;
+                    node.m_OutputBuffers[channel] = buffer;
+                }
+                busindex++;
+            }
+            m_Nodes.push_back(std::move(node));
+        }
+    }
+    void TCompiledGraph::TakeOverActivity(const TCompiledGraph &previous)
+    {
+        if(&previous != m_Previous) return;
+        for(auto &node: m_Nodes)
+        {
+            if(node.m_PreviousNode)
+            {
+                node.m_Activity = previous.Nodes()[*node.m_PreviousNode].m_Activity;
+                node.m_LevelMeter = previous.Nodes()[*node.m_PreviousNode].m_LevelMeter;
+                if(!node.m_CanSleep)
+                {
+                    node.m_Activity.m_Asleep = false;
+                }
+            }
+        }
+    }
+    void TCompiledGraph::TActivity::OnMidi(const uint8_t *data, size_t size)
+    {
+        m_Asleep = false;
+        m_SilentFrames = 0;
+        if( (!data) || (size < 3) ) return;
+        auto status = data[0] & 0xF0;
+        auto note = data[1] & 0x7F;
+        auto bit = (uint64_t)1 << (note & 63);
+        if( (status == 0x90) && (data[2] != 0) )
+        {
+            m_HeldNotes[note >> 6] |= bit;
+        }
+        else if( (status == 0x80) || (status == 0x90) )
+        {
+            m_HeldNotes[note >> 6] &= ~bit;
+        }
+        else if(status == 0xB0)
+        {
+            if(data[1] == 64)
+            {
+                m_SustainPedal = data[2] >= 64;
+            }
+            else if( (data[1] == 120) || (data[1] == 123) )
+            {
+                // all sound off, all notes off:
+                m_HeldNotes = {0, 0};
+            }
+        }
+    }
+    std::vector<std::vector<size_t>> TCompiledGraph::Dependencies(const Data &data)
+    {
+        std::vector<std::vector<size_t>> result;
+        for(const auto &node: data.Nodes())
+        {
+            std::vector<size_t> dependencies;
+            for(const auto &input: node.Inputs())
+            {
+                // TSchedule checks the order:
+                dependencies.push_back(input.Node());
+            }
+            if(node.PluginIndex() && (*node.PluginIndex() >= data.Plugins().size()))
+            {
+                throw std::runtime_error("graph node refers to a plugin that does not exist");
+            }
+            result.push_back(std::move(dependencies));
+        }
+        return result;
+    }
+
+    TMidiInRing::TMidiInRing(uint32_t capacity) : m_Ring(zix_ring_new(nullptr, capacity))
+    {
+        if(!m_Ring)
+        {
+            throw std::bad_alloc();
+        }
+        zix_ring_mlock(m_Ring);
+        m_ReadBuffer.resize(capacity);
+    }
+    TMidiInRing::~TMidiInRing()
+    {
+        zix_ring_free(m_Ring);
+    }
+    void TMidiInRing::BeginBatch()
+    {
+        m_Transaction = zix_ring_begin_write(m_Ring);
+        m_BatchSpace = zix_ring_write_space(m_Ring);
+    }
+    void TMidiInRing::Add(uint64_t time, const uint8_t *data, size_t size)
+    {
+        TRecordHeader header {time, (uint32_t)size};
+        if(sizeof(header) + size > m_BatchSpace)
+        {
+            m_NumDropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        zix_ring_amend_write(m_Ring, &m_Transaction, &header, sizeof(header));
+        zix_ring_amend_write(m_Ring, &m_Transaction, data, (uint32_t)size);
+        m_BatchSpace -= (uint32_t)(sizeof(header) + size);
+    }
+    void TMidiInRing::EndBatch()
+    {
+        zix_ring_commit_write(m_Ring, &m_Transaction);
+    }
+    void TMidiInRing::Drain(const std::function<void(std::span<const TMidiInEvent> events)> &func)
+    {
+        auto numdropped = NumDropped();
+        if(numdropped != m_NumDroppedReported)
+        {
+            lilvutils::World::Static().HostLogger().Log(logger::TLevel::Warning, "Aux midi input: %llu events dropped", (unsigned long long)(numdropped - m_NumDroppedReported));
+            m_NumDroppedReported = numdropped;
+        }
+        // the writer commits whole batches, so this is a whole number of events:
+        auto size = zix_ring_read_space(m_Ring);
+        if(size == 0) return;
+        zix_ring_read(m_Ring, m_ReadBuffer.data(), size);
+        m_Events.clear();
+        for(size_t pos = 0; pos < size; )
+        {
+            TRecordHeader header;
+            std::memcpy(&header, m_ReadBuffer.data() + pos, sizeof(header));
+            pos += sizeof(header);
+            m_Events.push_back(TMidiInEvent {header.m_Time, std::span<const uint8_t>(m_ReadBuffer.data() + pos, header.m_Size)});
+            pos += header.m_Size;
         }
+        func(m_Events);
     }
 
 
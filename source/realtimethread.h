@@ -1,9 +1,19 @@
 #pragma once
 #include "lilvutils.h"
 #include "jackutils.h"
+#include "timing.h"
+#include "graph.h"
 // #include "ringbuf.h"
 #include <jack/midiport.h>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <numbers>
+#include <span>
+#include <atomic>
+#include "zix/ring.h"
 #include "lv2/midi/midi.h"
+#include "lv2/atom/util.h"
 
 import midi;
 
@@ -11,6 +21,110 @@ import ringbuf;
 
 namespace realtimethread
 {
+    // the stages of Processor::Process, in order:
+    enum class TStage
+    {
+        ClearOutputMidiBuffers,
+        ProcessMessages,
+        IncomingMidi,
+        IncomingAudio,
+        RunGraph,
+        OutgoingAudio,
+        OutputLevel,
+        OutputPorts,
+        ResetEvBufs,
+        SendAsyncMessages,
+        NumStages
+    };
+    constexpr size_t sNumStages = (size_t)TStage::NumStages;
+    const char* StageName(TStage stage);
+
+    // Timing statistics over the last measurement window (about one second), in the main thread.
+    class TTimingReport
+    {
+    public:
+        std::array<timing::TStats, sNumStages> m_Stages;
+        timing::TStats m_Cycle;
+        // Instance::Run() per plugin instance, including the reverb. Instances that are no longer in use are removed
+        // before OnTimingUpdate() is notified, so the keys can be dereferenced from there:
+        std::map<const lilvutils::Instance*, timing::TStats> m_Instances;
+        // fraction of the wall clock time spent in Process():
+        float m_DspLoad = 0.0f;
+        // longest cycle relative to the average period:
+        float m_PeakDspLoad = 0.0f;
+    };
+
+    // Access to the port buffers from Process(). This mirrors the jack port API, so the default implementation just
+    // forwards to jack. A headless host (benchmark, offline render) provides in-memory buffers instead; the
+    // jack_port_t pointers in Data are then opaque handles that are only interpreted by the TPortIo.
+    class TPortIo
+    {
+    public:
+        virtual ~TPortIo() = default;
+        virtual void* Buffer(jack_port_t *port, jack_nframes_t nframes) = 0;
+        virtual uint32_t MidiEventCount(void *buf) = 0;
+        virtual void MidiEventGet(jack_midi_event_t &event, void *buf, uint32_t index) = 0;
+        virtual void MidiClearBuffer(void *buf) = 0;
+        virtual void MidiEventWrite(void *buf, jack_nframes_t time, const jack_midi_data_t *data, size_t size) = 0;
+    };
+    class TJackPortIo : public TPortIo
+    {
+    public:
+        void* Buffer(jack_port_t *port, jack_nframes_t nframes) override { return jack_port_get_buffer(port, nframes); }
+        uint32_t MidiEventCount(void *buf) override { return jack_midi_get_event_count(buf); }
+        void MidiEventGet(jack_midi_event_t &event, void *buf, uint32_t index) override { jack_midi_event_get(&event, buf, index); }
+        void MidiClearBuffer(void *buf) override { jack_midi_clear_buffer(buf); }
+        void MidiEventWrite(void *buf, jack_nframes_t time, const jack_midi_data_t *data, size_t size) override { jack_midi_event_write(buf, time, data, size); }
+    };
+
+    // A midi event received on an aux input port. The data points into the read buffer of the TMidiInRing and is only
+    // valid during the callback.
+    class TMidiInEvent
+    {
+    public:
+        // in frames since the Processor started:
+        uint64_t m_Time;
+        std::span<const uint8_t> m_Data;
+    };
+
+    // Single producer, single consumer queue of the midi events of one aux input port. The realtime thread writes the
+    // events of a cycle as one batch; the main thread takes everything that has arrived in one go. Only events that
+    // midi::TMidiOrSysexEvent supports are written, so the reader does not need to check them again.
+    class TMidiInRing
+    {
+    public:
+        TMidiInRing(const TMidiInRing&) = delete;
+        TMidiInRing& operator=(const TMidiInRing&) = delete;
+        TMidiInRing(TMidiInRing&&) = delete;
+        TMidiInRing& operator=(TMidiInRing&&) = delete;
+        TMidiInRing(uint32_t capacity = 65536);
+        ~TMidiInRing();
+        // realtime thread. An event that does not fit is dropped:
+        void BeginBatch();
+        void Add(uint64_t time, const uint8_t *data, size_t size);
+        void EndBatch();
+        // main thread: calls func once with all events that have arrived, if any
+        void Drain(const std::function<void(std::span<const TMidiInEvent> events)> &func);
+        uint64_t NumDropped() const { return m_NumDropped.load(std::memory_order_relaxed); }
+
+    private:
+        class TRecordHeader
+        {
+        public:
+            uint64_t m_Time;
+            uint32_t m_Size;
+        };
+        ZixRing *m_Ring;
+        std::atomic<uint64_t> m_NumDropped = 0;
+        // realtime thread:
+        ZixRingTransaction m_Transaction;
+        uint32_t m_BatchSpace = 0;
+        // main thread:
+        std::vector<uint8_t> m_ReadBuffer;
+        std::vector<TMidiInEvent> m_Events;
+        uint64_t m_NumDroppedReported = 0;
+    };
+
     class Data
     {
     public:
@@ -18,17 +132,14 @@ namespace realtimethread
         {
         public:
             Plugin() = default;
-            Plugin(lilvutils::Instance *pluginInstance, float amplitudeFactor, bool doOverrideChannel, LV2_Evbuf_Iterator *midiInBuf, int transpose, bool hasVocoderInput) : m_PluginInstance(pluginInstance), m_AmplitudeFactor(amplitudeFactor), m_DoOverrideChannel(doOverrideChannel), m_MidiInBuf(midiInBuf), m_Transpose(transpose), m_HasVocoderInput(hasVocoderInput)
+            // canSleep: the plugin may be skipped while it is silent, see Processor::SetSleepTailFrames()
+            Plugin(lilvutils::Instance *pluginInstance, bool doOverrideChannel, LV2_Evbuf_Iterator *midiInBuf, int transpose, bool hasVocoderInput, bool canSleep) : m_PluginInstance(pluginInstance), m_DoOverrideChannel(doOverrideChannel), m_MidiInBuf(midiInBuf), m_Transpose(transpose), m_HasVocoderInput(hasVocoderInput), m_CanSleep(canSleep)
             {
             }
             lilvutils::Instance& PluginInstance() const
             {
                 return *m_PluginInstance;
             }
-            float AmplitudeFactor() const
-            {
-                return m_AmplitudeFactor;
-            }
             bool DoOverrideChannel() const
             {
                 return m_DoOverrideChannel;
@@ -45,14 +156,48 @@ namespace realtimethread
             {
                 return m_HasVocoderInput;
             }
+            bool CanSleep() const
+            {
+                return m_CanSleep && (!m_HasVocoderInput);
+            }
             auto operator<=>(const Plugin&) const = default;
         private:
             lilvutils::Instance *m_PluginInstance = nullptr;
-            float m_AmplitudeFactor = 0.0f;
-            bool m_DoOverrideChannel;
-            LV2_Evbuf_Iterator *m_MidiInBuf;
-            int m_Transpose;
-            bool m_HasVocoderInput;
+            bool m_DoOverrideChannel = false;
+            LV2_Evbuf_Iterator *m_MidiInBuf = nullptr;
+            int m_Transpose = 0;
+            bool m_HasVocoderInput = false;
+            bool m_CanSleep = false;
+        };
+        // A node in the audio graph: a plugin, or a mix bus if there is no plugin. The stereo audio input of the node
+        // is the sum of the outputs of its inputs, each scaled by a gain.
+        class TNode
+        {
+        public:
+            class TInput
+            {
+            public:
+                TInput(size_t node, float gain) : m_Node(node), m_Gain(gain) {}
+                size_t Node() const { return m_Node; }
+                float Gain() const { return m_Gain; }
+                auto operator<=>(const TInput&) const = default;
+            private:
+                size_t m_Node;
+                float m_Gain;
+            };
+            TNode(const std::optional<size_t> &pluginIndex, std::vector<TInput> &&inputs, const std::optional<size_t> &meteredPart = std::nullopt) : m_PluginIndex(pluginIndex), m_Inputs(std::move(inputs)), m_MeteredPart(meteredPart) {}
+            // index in Data::Plugins(), nullopt for a mix bus
+            const std::optional<size_t>& PluginIndex() const { return m_PluginIndex; }
+            // Inputs must come earlier in Data::Nodes(). A plugin node without inputs keeps whatever is in its input
+            // ports, i.e. silence or the vocoder input.
+            const std::vector<TInput>& Inputs() const { return m_Inputs; }
+            // the output of this node is the signal of a part, for the part level meters:
+            const std::optional<size_t>& MeteredPart() const { return m_MeteredPart; }
+            auto operator<=>(const TNode&) const = default;
+        private:
+            std::optional<size_t> m_PluginIndex;
+            std::vector<TInput> m_Inputs;
+            std::optional<size_t> m_MeteredPart;
         };
         class TMidiKeyboardPort
         {
@@ -81,17 +226,16 @@ namespace realtimethread
         };
         class TMidiAuxInPort
         {
-            // callback will be called in main thread, not in audio thread!
+            // the events are read from the ring in the main thread
         public:
-            using TCallback = std::function<void(const midi::TMidiOrSysexEvent &event)>;
-            TMidiAuxInPort(jack_port_t *port, const TCallback  *callback) : m_Port(port), m_Callback(std::move(callback)) {}
+            TMidiAuxInPort(jack_port_t *port, TMidiInRing *ring) : m_Port(port), m_Ring(ring) {}
             auto operator<=>(const TMidiAuxInPort&) const = default;
             jack_port_t* Port() const { return m_Port; }
-            const TCallback* Callback() const { return m_Callback; }
+            TMidiInRing& Ring() const { return *m_Ring; }
 
         private:
             jack_port_t *m_Port = nullptr;
-            const TCallback *m_Callback;
+            TMidiInRing *m_Ring = nullptr;
         };
         class TMidiAuxOutPort
         {
@@ -107,45 +251,223 @@ namespace realtimethread
 
     public:
         Data() = default;
-        Data(const std::vector<Plugin>& plugins, const std::vector<TMidiKeyboardPort>& midiPorts, const std::vector<TMidiAuxInPort> &midiAuxInPorts, const std::vector<TMidiAuxOutPort> &midiAuxOutPorts, const std::array<jack_port_t*, 2>& outputAudioPorts, lilvutils::Instance *reverbInstance,
-        float reverbLevel, jack_port_t* vocoderInPort, float levelMeterTimeConstant) : m_Plugins(plugins), m_MidiPorts(midiPorts), m_OutputAudioPorts(outputAudioPorts), m_MidiAuxInPorts(midiAuxInPorts), m_MidiAuxOutPorts(midiAuxOutPorts), m_ReverbInstance(reverbInstance), m_ReverbLevel(reverbLevel), m_VocoderInPort(vocoderInPort), m_LevelMeterTimeConstant(levelMeterTimeConstant) {}
+        static constexpr float sLevelMeterLowpassHz = 50.0f;
+        static constexpr uint32_t sLevelMeterUpdateHz = 30;
+        Data(const std::vector<Plugin>& plugins, const std::vector<TNode> &nodes, const std::vector<TMidiKeyboardPort>& midiPorts, const std::vector<TMidiAuxInPort> &midiAuxInPorts, const std::vector<TMidiAuxOutPort> &midiAuxOutPorts, const std::array<jack_port_t*, 2>& outputAudioPorts,
+        jack_port_t* vocoderInPort, uint32_t sampleRate) : m_Plugins(plugins), m_Nodes(nodes), m_MidiPorts(midiPorts), m_OutputAudioPorts(outputAudioPorts), m_MidiAuxInPorts(midiAuxInPorts), m_MidiAuxOutPorts(midiAuxOutPorts), m_VocoderInPort(vocoderInPort),
+        m_LevelMeterTimeConstant(std::exp(-2.0f * std::numbers::pi_v<float> * sLevelMeterLowpassHz / (float)sampleRate)), m_LevelMeterUpdateFrames(sampleRate / sLevelMeterUpdateHz) {}
+        // all plugin instances: instruments, insert effects and the reverb
         const std::vector<Plugin>& Plugins() const { return m_Plugins; }
+        // the audio graph in topological order; the output of the last node goes to OutputAudioPorts()
+        const std::vector<TNode>& Nodes() const { return m_Nodes; }
         const std::vector<TMidiKeyboardPort>& MidiPorts() const { return m_MidiPorts; }
         const std::array<jack_port_t*, 2>& OutputAudioPorts() const { return m_OutputAudioPorts; }
         const std::vector<TMidiAuxInPort>& MidiAuxInPorts() const { return m_MidiAuxInPorts; }
         const std::vector<TMidiAuxOutPort>& MidiAuxOutPorts() const { return m_MidiAuxOutPorts; }
         auto operator<=>(const Data&) const = default;
-        lilvutils::Instance *ReverbInstance() const { return m_ReverbInstance; }
-        float ReverbLevel() const { return m_ReverbLevel; }
         jack_port_t* VocoderInPort() const { return m_VocoderInPort; }
+        // of the one pole lowpass filter over the squared samples in the RMS meters:
         float LevelMeterTimeConstant() const {return m_LevelMeterTimeConstant;}
+        // frames between two LevelMeterUpdateMessages:
+        uint32_t LevelMeterUpdateFrames() const {return m_LevelMeterUpdateFrames;}
         
     private:
         std::vector<Plugin> m_Plugins;
+        std::vector<TNode> m_Nodes;
         std::vector<TMidiKeyboardPort> m_MidiPorts;
         std::vector<TMidiAuxInPort> m_MidiAuxInPorts;
         std::vector<TMidiAuxOutPort> m_MidiAuxOutPorts;
         std::array<jack_port_t*, 2> m_OutputAudioPorts = {nullptr, nullptr};
         jack_port_t* m_VocoderInPort = nullptr;
-        lilvutils::Instance *m_ReverbInstance = nullptr;
-        float m_ReverbLevel = 0.0f;
         float m_LevelMeterTimeConstant = 0.5f;
+        uint32_t m_LevelMeterUpdateFrames = 1600;
+    };
+
+    // Builds Data::Nodes() for the signal flow of a project: every instrument runs through the insert effects of its
+    // part into the dry bus, scaled by the amplitude of the part. The dry bus feeds the reverb, and the output is the
+    // dry bus plus the reverb output scaled by the reverb level. The chains of different parts run in parallel.
+    class TMixGraph
+    {
+    public:
+        // part: the part whose level meter shows the output of the chain, if any
+        void AddChain(size_t instrumentPluginIndex, std::vector<size_t> &&insertPluginIndices, float gain, const std::optional<size_t> &part);
+        void SetReverb(size_t reverbPluginIndex, float level);
+        std::vector<Data::TNode> Nodes() const;
+
+    private:
+        class TChain
+        {
+        public:
+            size_t m_InstrumentPluginIndex;
+            std::vector<size_t> m_InsertPluginIndices;
+            float m_Gain;
+            std::optional<size_t> m_Part;
+        };
+        std::vector<TChain> m_Chains;
+        std::optional<size_t> m_ReverbPluginIndex;
+        float m_ReverbLevel = 0.0f;
+    };
+
+    // Level of a stereo signal, as sent from the realtime thread to the main thread.
+    class TStereoLevel
+    {
+    public:
+        // lowpass filtered square of the samples:
+        std::array<float, 2> m_MeanSquare = {0.0f, 0.0f};
+        // largest true peak since the previous update:
+        std::array<float, 2> m_TruePeak = {0.0f, 0.0f};
+        float RmsDb(size_t channel) const { return 10.0f * std::log10(m_MeanSquare[channel]); }
+        float TruePeakDb(size_t channel) const { return 20.0f * std::log10(m_TruePeak[channel]); }
+    };
+    class TPartLevel
+    {
+    public:
+        size_t m_Part;
+        TStereoLevel m_Level;
+    };
+
+    // RMS and true peak meter for a stereo signal. The true peak is the peak of the signal oversampled 4x, as in
+    // ITU-R BS.1770, so it also catches the peaks between the samples. Realtime thread only.
+    class TLevelMeter
+    {
+    public:
+        static constexpr size_t sOversampling = 4;
+        static constexpr size_t sTapsPerPhase = 12;
+        // nframes must be a multiple of 8; right may be the same as left. timeConstant: Data::LevelMeterTimeConstant()
+        void Process(const float *left, const float *right, size_t nframes, float timeConstant);
+        // the same for a silent block, without looking at the samples:
+        void ProcessSilence(size_t nframes, float timeConstant);
+        // the current level; the true peak is reset, so the next call returns the peak from here on. gain: multiplies the
+        // signal that was measured
+        TStereoLevel TakeLevel(float gain);
+
+    private:
+        std::array<float, 2> m_MeanSquare = {0.0f, 0.0f};
+        std::array<float, 2> m_TruePeak = {0.0f, 0.0f};
+        // the last samples of the previous block, for the interpolation filter:
+        std::array<std::array<float, sTapsPerPhase - 1>, 2> m_History {};
+    };
+
+    // Data::Nodes() prepared for Processor::Process: the port buffers are looked up, the mix buses are allocated in
+    // one cache line aligned block and the task schedule is built. Created in the main thread along with the Data.
+    class TCompiledGraph
+    {
+    public:
+        // Whether a plugin is asleep, i.e. skipped in the cycle. Realtime thread only.
+        class TActivity
+        {
+        public:
+            // wakes the plugin; tracks held notes and the sustain pedal:
+            void OnMidi(const uint8_t *data, size_t size);
+            bool HoldsNotes() const { return m_SustainPedal || (m_HeldNotes[0] != 0) || (m_HeldNotes[1] != 0); }
+            // note numbers of all channels together:
+            std::array<uint64_t, 2> m_HeldNotes = {0, 0};
+            bool m_SustainPedal = false;
+            bool m_Asleep = false;
+            uint32_t m_SilentFrames = 0;
+        };
+        class TNode
+        {
+        public:
+            lilvutils::Instance *m_Instance = nullptr;
+            size_t m_PluginIndex = 0;
+            bool m_CanSleep = false;
+            // of a plugin node; a mix bus is asleep when all its inputs are:
+            TActivity m_Activity;
+            // the node of the same plugin in the graph this one replaces, to take over its activity:
+            std::optional<size_t> m_PreviousNode;
+            // plugin input ports, or the bus buffers for a mix bus. Null if the plugin has no such port:
+            std::array<float*, 2> m_InputBuffers = {nullptr, nullptr};
+            // the input ports of a plugin node, to connect them to m_OutputBuffers of m_DirectSource:
+            std::array<lilvutils::TConnection<lilvutils::TAudioPort>*, 2> m_InputConnections = {nullptr, nullptr};
+            // a plugin node with a single input at unity gain reads the output of that node directly instead of a copy:
+            std::optional<size_t> m_DirectSource;
+            // plugin output ports, or the bus buffers. A mono plugin has its single output on both channels:
+            std::array<const float*, 2> m_OutputBuffers = {nullptr, nullptr};
+            std::vector<Data::TNode::TInput> m_Inputs;
+            // Data::TNode::MeteredPart(); the meter shows the level after the gain with which the node is mixed into the bus:
+            std::optional<size_t> m_MeteredPart;
+            float m_MeterGain = 1.0f;
+            TLevelMeter m_LevelMeter;
+        };
+        TCompiledGraph(const TCompiledGraph&) = delete;
+        TCompiledGraph& operator=(const TCompiledGraph&) = delete;
+        TCompiledGraph(TCompiledGraph&&) = delete;
+        TCompiledGraph& operator=(TCompiledGraph&&) = delete;
+        // previous: the graph the realtime thread will be running when it switches to this one
+        TCompiledGraph(const Data &data, jack_nframes_t bufsize, const TCompiledGraph *previous);
+        const rtarena::TVector<TNode>& Nodes() const { return m_Nodes; }
+        rtarena::TVector<TNode>& Nodes() { return m_Nodes; }
+        graph::TSchedule& Schedule() { return m_Schedule; }
+        // null if the plugin is not in the graph
+        TNode* NodeOfPlugin(size_t pluginIndex) { return (pluginIndex < m_NodeOfPlugin.size()) && m_NodeOfPlugin[pluginIndex]? &m_Nodes[*m_NodeOfPlugin[pluginIndex]] : nullptr; }
+        // realtime thread, when switching from previous to this graph: sleeping plugins stay asleep and held notes are remembered,
+        // and the level meters continue where they were
+        void TakeOverActivity(const TCompiledGraph &previous);
+        // one entry per metered node, for the realtime thread to fill in before sending a LevelMeterUpdateMessage:
+        rtarena::TVector<TPartLevel>& PartLevels() { return m_PartLevels; }
+        // the longest cycle the bus buffers and the audio buffers of the plugins can hold:
+        jack_nframes_t Bufsize() const { return m_Bufsize; }
+
+    private:
+        static std::vector<std::vector<size_t>> Dependencies(const Data &data);
+
+    private:
+        rtarena::TVector<float> m_BusMemory;
+        rtarena::TVector<TNode> m_Nodes;
+        std::vector<std::optional<size_t>> m_NodeOfPlugin;
+        rtarena::TVector<TPartLevel> m_PartLevels;
+        const TCompiledGraph *m_Previous;
+        graph::TSchedule m_Schedule;
+        jack_nframes_t m_Bufsize;
     };
     class SetDataMessage : public ringbuf::PacketBase
     {
     public:
-        SetDataMessage(const Data *data) : m_Data(data) {}
+        SetDataMessage(const Data *data, TCompiledGraph *graph) : m_Data(data), m_Graph(graph) {}
         const Data* data() const { return m_Data; }
+        TCompiledGraph* graph() const { return m_Graph; }
     private:
         const Data *m_Data;
+        TCompiledGraph *m_Graph;
+    };
+    class TimingUpdateMessage : public ringbuf::PacketBase
+    {
+    public:
+        enum class TKind {Stage, Cycle, Instance};
+        // the histogram is sent as additional data
+        TimingUpdateMessage(TKind kind, size_t stage, const lilvutils::Instance *instance, uint64_t windowNs, const timing::THistogram &histogram) : ringbuf::PacketBase(sizeof(histogram), &histogram), m_Kind(kind), m_Stage(stage), m_Instance(instance), m_WindowNs(windowNs) {}
+        TKind Kind() const { return m_Kind; }
+        size_t Stage() const { return m_Stage; }
+        const lilvutils::Instance* Instance() const { return m_Instance; }
+        uint64_t WindowNs() const { return m_WindowNs; }
+        timing::THistogram Histogram() const
+        {
+            timing::THistogram result;
+            std::memcpy(&result, AdditionalDataBuf(), std::min(sizeof(result), AdditionalDataSize()));
+            return result;
+        }
+    private:
+        TKind m_Kind;
+        size_t m_Stage;
+        const lilvutils::Instance *m_Instance;
+        uint64_t m_WindowNs;
     };
-    class OutputLevelUpdateMessage : public ringbuf::PacketBase
+    // All level meters in one message, sent once per Data::LevelMeterUpdateFrames(). The part levels are sent as additional data.
+    class LevelMeterUpdateMessage : public ringbuf::PacketBase
     {
     public:
-        OutputLevelUpdateMessage(float amplitudeSquared) : m_AmplitudeSquared(amplitudeSquared) {}
-        float AmplitudeSquared() const { return m_AmplitudeSquared; }
+        LevelMeterUpdateMessage(const TStereoLevel &output, std::span<const TPartLevel> parts) : ringbuf::PacketBase(parts.size_bytes(), parts.data()), m_Output(output) {}
+        const TStereoLevel& Output() const { return m_Output; }
+        size_t NumParts() const { return AdditionalDataSize() / sizeof(TPartLevel); }
+        TPartLevel Part(size_t index) const
+        {
+            TPartLevel result;
+            std::memcpy(&result, (const char*)AdditionalDataBuf() + index * sizeof(TPartLevel), sizeof(result));
+            return result;
+        }
     private:
-        float m_AmplitudeSquared;
+        TStereoLevel m_Output;
     };
     
     class ControlPortChangedMessage : public ringbuf::PacketBase
@@ -158,6 +480,22 @@ namespace realtimethread
         lilvutils::TConnection<lilvutils::TControlPort> *m_Connection;
         float m_NewValue;
     };
+    // all output control ports of an instance that changed during a cycle:
+    class OutputControlsChangedMessage : public ringbuf::PacketBase
+    {
+    public:
+        OutputControlsChangedMessage(lilvutils::Instance *instance, std::span<const lilvutils::TOutputControlChange> changes) : ringbuf::PacketBase(changes.size_bytes(), changes.data()), m_Instance(instance) {}
+        lilvutils::Instance* Instance() const { return m_Instance; }
+        size_t NumChanges() const { return AdditionalDataSize() / sizeof(lilvutils::TOutputControlChange); }
+        lilvutils::TOutputControlChange Change(size_t index) const
+        {
+            lilvutils::TOutputControlChange result;
+            std::memcpy(&result, (const char*)AdditionalDataBuf() + index * sizeof(result), sizeof(result));
+            return result;
+        }
+    private:
+        lilvutils::Instance *m_Instance;
+    };
     class AtomPortEventMessage : public ringbuf::PacketBase
     {
     public:
@@ -174,6 +512,33 @@ namespace realtimethread
         LV2_URID m_Type;
         lilvutils::TConnection<lilvutils::TAtomPort>* m_Connection;
     };
+    // Consecutive events of the atom sequence of an output port, as written by the plugin (LV2_Atom_Event records,
+    // each padded to 8 bytes). Sent once per port per cycle, unless the events do not fit in a single packet.
+    class AtomPortEventsMessage : public ringbuf::PacketBase
+    {
+    public:
+        AtomPortEventsMessage(lilvutils::TConnection<lilvutils::TAtomPort>* connection, const void *events, uint32_t size) : ringbuf::PacketBase(size, events), m_Connection(connection)
+        {
+        }
+        lilvutils::TConnection<lilvutils::TAtomPort>* Connection() const { return m_Connection; }
+        // func(frames, type, size, body) for every event
+        template <class F>
+        void ForEachEvent(F &&func) const
+        {
+            auto data = (const char*)AdditionalDataBuf();
+            size_t offset = 0;
+            while(offset + sizeof(LV2_Atom_Event) <= AdditionalDataSize())
+            {
+                // the additional data is not necessarily aligned:
+                LV2_Atom_Event event;
+                std::memcpy(&event, data + offset, sizeof(event));
+                func((uint32_t)event.time.frames, event.body.type, event.body.size, (const void*)(data + offset + sizeof(event)));
+                offset += lv2_atom_pad_size(sizeof(LV2_Atom_Event) + event.body.size);
+            }
+        }
+    private:
+        lilvutils::TConnection<lilvutils::TAtomPort>* m_Connection;
+    };
     class AsyncFunctionMessage : public ringbuf::PacketBase
     {
         /*
@@ -230,15 +595,6 @@ namespace realtimethread
     private:
         LV2_Evbuf_Iterator* m_DestinationPort;
     };
-    class AuxMidiInMessage : public ringbuf::PacketBase
-    {
-    public:
-        AuxMidiInMessage(const void *data, size_t size, const Data::TMidiAuxInPort::TCallback *callback) : ringbuf::PacketBase(size, data), m_Callback(callback) {}
-        void Call() const;
-
-    private:
-        const Data::TMidiAuxInPort::TCallback *m_Callback;
-    };
     class AuxMidiOutMessage : public ringbuf::PacketBase
     {
     public:
@@ -263,8 +619,26 @@ namespace realtimethread
               SendControlValueFromMainThread(connection, value);
           };
         }
+        // The largest cycle the graphs are made for from now on. Main thread; the audio buffers of the plugins in the data
+        // sent afterwards must hold this many frames. Until the realtime thread has a graph for a larger jack buffer
+        // size, it only outputs silence.
+        void SetBufsize(jack_nframes_t bufsize) { m_Bufsize = bufsize; }
+        jack_nframes_t Bufsize() const { return m_Bufsize; }
         void Process(jack_nframes_t nframes);
+        // must be called before processing starts; the port io must outlive the Processor
+        void SetPortIo(TPortIo &portIo) { m_PortIo = &portIo; }
+        // must be called before processing starts. A headless host renders faster than realtime and may want
+        // statistics over the whole run instead of per second of wall clock time.
+        void SetTimingWindowNs(uint64_t windowNs) { m_TimingWindowNs = windowNs; }
+        // realtime thread: sends the timing statistics collected so far, without waiting for the end of the window
+        void FlushTiming();
         void SetDataFromMainThread(Data &&data);
+        // A plugin that may sleep (Data::Plugin::CanSleep()), holds no notes and whose inputs are asleep is put to sleep
+        // after its output has been silent for this long, and skipped until it receives midi. 0 to never sleep.
+        void SetSleepTailFrames(uint32_t frames) { m_SleepTailFrames = frames; }
+        // true once the realtime thread has switched to the data of the last SetDataFromMainThread, so plugins that are
+        // not in that data are no longer run:
+        bool PreviousDataRetired() const { return m_RetiredDataSerial == m_DataSerial; }
         void SendAtomPortEventFromMainThread(lilvutils::TConnection<lilvutils::TAtomPort>* connection, uint32_t frames, uint32_t subframes, LV2_URID type, uint32_t size, const void* body);
         void SendControlValueFromMainThread(lilvutils::TConnection<lilvutils::TControlPort>* connection, float value);
         void DeferredExecuteAfterRoundTrip(std::function<void()> &&function);
@@ -274,43 +648,86 @@ namespace realtimethread
         const lilvutils::RealtimeThreadInterface& realtimeThreadInterface() const { return m_RealtimeThreadInterface; }
         void SendMidiFromMainThread(const void *data, size_t size, jack_port_t *port);
         void SendMidiToPluginFromMainThread(const void *data, size_t size, LV2_Evbuf_Iterator* destinationPort);
+        // notified when the levels below have been updated, about 30 times per second:
         utils::NotifySource& OnOutputLevelChange() { return m_OnOutputLevelChange; }
+        // RMS of the loudest output channel:
         float OutputLevelDb() const { return m_OutputLevelDb; }
+        // the highest OutputLevelDb() of the last second:
         float OutputPeakLevelDb() const { return m_OutputPeakLevelDb; }
+        const TStereoLevel& OutputLevel() const { return m_OutputLevel; }
+        // indexed by part; zero for parts without a running instrument:
+        const std::vector<TStereoLevel>& PartLevels() const { return m_PartLevels; }
+        // updated about once per second:
+        const TTimingReport& TimingReport() const { return m_TimingReport; }
+        utils::NotifySource& OnTimingUpdate() { return m_OnTimingUpdate; }
         
     private:
         void ProcessMessagesInRealtimeThread(jack_nframes_t nframes);
         void SendPendingAsyncFunctionMessages();
         void ResetEvBufs();
-        void ProcessOutputPorts();
-        void ProcessOutputPortsForInstance(lilvutils::Instance &instance);
-        void RunInstances(jack_nframes_t nframes);
+        void ProcessOutputPorts(jack_nframes_t nframes);
+        void ProcessOutputPortsForInstance(lilvutils::Instance &instance, jack_nframes_t nframes);
+        void ForwardAtomPortEvents(lilvutils::TConnection<lilvutils::TAtomPort> &connection);
+        void RunGraph(jack_nframes_t nframes);
+        void RunNode(size_t nodeindex);
+        void WakePlugin(size_t pluginindex, const uint8_t *data, size_t size);
         void ProcessOutgoingAudio(jack_nframes_t nframes);
         void ProcessIncomingMidi(jack_nframes_t nframes);
         void ProcessIncomingAudio(jack_nframes_t nframes);
-        void RunReverbInstance(jack_nframes_t nframes);
-        void AddReverb(jack_nframes_t nframes);
         void ClearOutputMidiBuffers(jack_nframes_t nframes);
         void ProcessOutputLevel(jack_nframes_t nframes);
-        void UpdateOutputLevelDbInMainThread(float v);
+        void UpdateLevelsInMainThread(const LevelMeterUpdateMessage &message);
+        void SendTimingIfNeeded(uint64_t now);
+        void SendTiming(uint64_t now);
+        std::array<float*, 2> OutputAudioBuffers(jack_nframes_t nframes);
+        void UpdateTimingInMainThread(const TimingUpdateMessage &message);
 
     private:
         std::unique_ptr<Data> m_CurrentData;
+        std::unique_ptr<TCompiledGraph> m_CurrentGraph;
         const Data* m_DataInRtThread;
-        jack_nframes_t m_Bufsize;
+        TCompiledGraph* m_GraphInRtThread = nullptr;
+        std::atomic<uint32_t> m_SleepTailFrames = 0;
+        // main thread:
+        uint64_t m_DataSerial = 0;
+        uint64_t m_RetiredDataSerial = 0;
+        std::atomic<jack_nframes_t> m_Bufsize;
         ringbuf::RingBuf m_RingBufToRtThread {130000, 4096};
         ringbuf::RingBuf m_RingBufFromRtThread {1300000, 4096};
         LV2_URID m_UridMidiEvent;
-        std::array<AsyncFunctionMessage, 400> m_BufferForAsyncFunctionMessages;
+        rtarena::TVector<AsyncFunctionMessage> m_BufferForAsyncFunctionMessages = rtarena::TVector<AsyncFunctionMessage>(400);
         size_t m_NumStoredAsyncFunctionMessages = 0;
         lilvutils::RealtimeThreadInterface m_RealtimeThreadInterface;
-        std::array<float, 1> m_LevelMeterOutputBuf = {0.0f};
+        graph::TWorkerPool m_WorkerPool {graph::TWorkerPool::DefaultNumWorkers()};
+        // called for each node from the realtime thread and the workers:
+        graph::TWorkerPool::TTaskFunc m_RunNodeFunc = [this](size_t nodeindex){ RunNode(nodeindex); };
+        jack_nframes_t m_NFramesInCycle = 0;
+        // frames processed so far, the time base of TMidiInEvent:
+        uint64_t m_FrameTime = 0;
+        TJackPortIo m_JackPortIo;
+        TPortIo *m_PortIo = &m_JackPortIo;
+        TLevelMeter m_OutputLevelMeter;
         size_t m_LevelMeterOutputSampleCounter = 0;
-        float m_OutputLevelDb = -100.0f;
           // accessible in main thread
+        float m_OutputLevelDb = -100.0f;
         float m_OutputPeakLevelDb = -100.0f;
+        TStereoLevel m_OutputLevel;
+        std::vector<TStereoLevel> m_PartLevels;
         utils::NotifySource m_OnOutputLevelChange;
         std::deque<std::pair<std::chrono::steady_clock::time_point, float>> m_LevelMeterHistory;
         std::chrono::steady_clock::time_point m_LastPeakUpdate;
+
+        // realtime thread only:
+        static constexpr size_t sMaxTimedInstances = 64;
+        uint64_t m_TimingWindowNs = 1000000000;
+        std::array<timing::THistogram, sNumStages> m_StageHistograms;
+        timing::THistogram m_CycleHistogram;
+        // indexed by plugin index; each is only written by the thread running that plugin:
+        std::array<timing::THistogram, sMaxTimedInstances> m_InstanceHistograms;
+        uint64_t m_TimingWindowStart = 0;
+
+        // main thread only:
+        TTimingReport m_TimingReport;
+        utils::NotifySource m_OnTimingUpdate;
     };
 }
\ No newline at end of file
@@ -0,0 +1,454 @@
+#pragma once
+#include "utils.h"
+#include <vector>
+
+// The TTypedRegion implementation from before the regions were stored in flat arrays (one heap allocated vector per
+// band, every operation returns a new region), with the only change that TVerticalRange::Shift() fills the shifted
+// range instead of itself. jnlive_test checks TTypedRegion against it and jnlive_bench compares their speed; it is
+// not used by jnlive itself.
+
+namespace utils
+{
+
+template <typename T>
+class TReferenceRegion
+{
+public:
+  class THorizontalRange
+  {
+  public:
+    THorizontalRange(T left, T right)
+      : m_Left(left), m_Right(right)
+    {
+      nhAssert(left < right);
+    }
+    inline T Left() const { return m_Left; }
+    inline T Right() const { return m_Right; }
+    THorizontalRange Shift(T deltaX) const
+    {
+      return THorizontalRange(Left() + deltaX, Right() + deltaX);
+    }
+    auto operator<=>(const THorizontalRange&) const = default;
+
+  private:
+    T m_Left;
+    T m_Right;
+  };
+
+  class TVerticalRange
+  {
+  public:
+    TVerticalRange(T top, T bottom)
+      : m_Top(top), m_Bottom(bottom)
+    {
+      nhAssert(top < bottom);
+    }
+    TVerticalRange(T top, T bottom, const std::vector<THorizontalRange> &horzRanges)
+      : m_Top(top), m_Bottom(bottom), m_HorzRanges(horzRanges)
+    {
+      nhAssert(top < bottom);
+    }
+    void AppendHorzRange(const THorizontalRange &horzrange)
+    {
+      if (!m_HorzRanges.empty())
+      {
+        nhAssert(m_HorzRanges.back().Right() <= horzrange.Left());
+        if (m_HorzRanges.back().Right() == horzrange.Left())
+        {
+          m_HorzRanges.back() = THorizontalRange(m_HorzRanges.back().Left(), horzrange.Right());
+        }
+        else
+        {
+          m_HorzRanges.push_back(horzrange);
+        }
+      }
+      else
+      {
+        m_HorzRanges.push_back(horzrange);
+      }
+    }
+    inline T Top() const { return m_Top; }
+    inline T Bottom() const { return m_Bottom; }
+    inline void SetTop(const T &val) { m_Top = val; }
+    inline void SetBottom(const T &val) { m_Bottom = val; }
+    inline const std::vector<THorizontalRange>& HorzRanges() const { return m_HorzRanges; }
+    TVerticalRange Shift(const TTypedPoint<T> &delta) const
+    {
+      TVerticalRange result(Top() + delta.Y(), Bottom() + delta.Y());
+      for (const auto &hrange : m_HorzRanges)
+      {
+        result.AppendHorzRange(hrange.Shift(delta.X()));
+      }
+      return result;
+    }
+
+  private:
+    T m_Top;
+    T m_Bottom;
+    std::vector<THorizontalRange> m_HorzRanges;
+  };
+
+public:
+  inline TReferenceRegion() {}
+  inline TReferenceRegion(const TReferenceRegion& src) : m_VertRanges(src.m_VertRanges) {}
+  TReferenceRegion(const TTypedRect<T> &r)
+  {
+    if (!r.IsEmpty())
+    {
+      TVerticalRange newrange(r.Top(), r.Bottom());
+      newrange.AppendHorzRange({ r.Left(), r.Right() });
+      AppendRangeAtBottom(std::move(newrange));
+    }
+  }
+  inline TReferenceRegion(TReferenceRegion&& src) : m_VertRanges(std::move(src.m_VertRanges)) {}
+  inline TReferenceRegion<T>& operator=(const TReferenceRegion& src)
+  {
+    m_VertRanges = src.m_VertRanges;
+    return *this;
+  }
+  inline TReferenceRegion<T>& operator=(TReferenceRegion&& src)
+  {
+    if (this != &src)
+    {
+      m_VertRanges = std::move(src.m_VertRanges);
+    }
+    return *this;
+  }
+  inline bool empty() const
+  {
+    return m_VertRanges.empty();
+  }
+
+  TReferenceRegion Union(const TReferenceRegion<T> &other) const
+  {
+    TReferenceRegion result;
+    IterateVert(m_VertRanges, other.m_VertRanges, [&](T top, T bottom, const std::vector<THorizontalRange> &horzrange1, const std::vector<THorizontalRange> &horzrange2) {
+      TVerticalRange newvertrange(top, bottom);
+      IterateHorz(horzrange1, horzrange2, [&](T left, T right, bool /*has1*/, bool /*has2*/) {
+        newvertrange.AppendHorzRange({ left, right });
+      });
+      result.AppendRangeAtBottom(std::move(newvertrange));
+    });
+    return result;
+  }
+  TReferenceRegion Subtract(const TReferenceRegion<T> &other) const
+  {
+    TReferenceRegion result;
+    IterateVert(m_VertRanges, other.m_VertRanges, [&](T top, T bottom, const std::vector<THorizontalRange> &horzrange1, const std::vector<THorizontalRange> &horzrange2) {
+      TVerticalRange newvertrange(top, bottom);
+      IterateHorz(horzrange1, horzrange2, [&](T left, T right, bool has1, bool has2) {
+        if (has1 && (!has2))
+        {
+          newvertrange.AppendHorzRange({ left, right });
+        }
+      });
+      result.AppendRangeAtBottom(std::move(newvertrange));
+    });
+    return result;
+  }
+  TReferenceRegion Intersection(const TReferenceRegion<T> &other) const
+  {
+    TReferenceRegion result;
+    IterateVert(m_VertRanges, other.m_VertRanges, [&](T top, T bottom, const std::vector<THorizontalRange> &horzrange1, const std::vector<THorizontalRange> &horzrange2) {
+      TVerticalRange newvertrange(top, bottom);
+      IterateHorz(horzrange1, horzrange2, [&](T left, T right, bool has1, bool has2) {
+        if (has1 && has2)
+        {
+          newvertrange.AppendHorzRange({ left, right });
+        }
+      });
+      result.AppendRangeAtBottom(std::move(newvertrange));
+    });
+    return result;
+  }
+  bool Intersects(const TReferenceRegion<T> &other) const
+  {
+    bool result = false;
+    IterateVert(m_VertRanges, other.m_VertRanges, [&](T /*top*/, T /*bottom*/, const std::vector<THorizontalRange> &horzrange1, const std::vector<THorizontalRange> &horzrange2) {
+      IterateHorz(horzrange1, horzrange2, [&](T /*left*/, T /*right*/, bool has1, bool has2) {
+        if (has1 && has2) result = true;
+      });
+    });
+    return result;
+  }
+  bool Contains(const TReferenceRegion<T> &other) const
+  {
+    bool result = true;
+    IterateVert(m_VertRanges, other.m_VertRanges, [&](T /*top*/, T /*bottom*/, const std::vector<THorizontalRange> &horzrange1, const std::vector<THorizontalRange> &horzrange2) {
+      IterateHorz(horzrange1, horzrange2, [&](T /*left*/, T /*right*/, bool has1, bool has2) {
+        if ( (!has1) && has2) result = false;
+      });
+    });
+    return result;
+  }
+  bool Contains(const TTypedPoint<T> &other) const
+  {
+    bool result = false;
+    ForEach([&](const TTypedRect<T> &rect) {
+      if (rect.Contains(other)) result = true;
+    });
+    return result;
+  }
+  template <class Function>
+  void ForEach(const Function &func) const
+  {
+    for (const auto &vertrange : m_VertRanges)
+    {
+      for (const auto &horzrange : vertrange.HorzRanges())
+      {
+        auto r = TTypedRect<T>::FromTopLeftAndBottomRight({ horzrange.Left(), vertrange.Top() }, { horzrange.Right(), vertrange.Bottom() });
+        func(r);
+      }
+    }
+  }
+  TReferenceRegion<T> Shift(const TTypedPoint<T> &delta) const
+  {
+    TReferenceRegion<T> result;
+    for (const auto &vrange : m_VertRanges)
+    {
+      result.m_VertRanges.push_back(vrange.Shift(delta));
+    }
+    return result;
+  }
+  TTypedRect<T> OuterBounds() const
+  {
+    TTypedRect<T> result;
+    ForEach([&](const TTypedRect<T> &rect) {
+      result = result.Union(rect);
+    });
+    return result;
+  }
+  const std::vector<TVerticalRange> &VertRanges() const {return m_VertRanges;}
+
+private:
+  template <class Function>
+  static void IterateVert(const std::vector<TVerticalRange> &range1, const std::vector<TVerticalRange> &range2, const Function &func)
+  {
+    T y = 0;
+    auto it1 = range1.begin();
+    auto it2 = range2.begin();
+    bool atend1 = (it1 == range1.end());
+    bool atend2 = (it2 == range2.end());
+    if (atend1)
+    {
+      if (atend2)
+      {
+        return;
+      }
+      else
+      {
+        y = it2->Top();
+      }
+    }
+    else
+    {
+      y = it1->Top();
+      if (!atend2)
+      {
+        if (it2->Top() < y)
+        {
+          y = it2->Top();
+        }
+      }
+    }
+    while (true)
+    {
+      atend1 = (it1 == range1.end());
+      atend2 = (it2 == range2.end());
+      if (atend1 && atend2) break;
+      bool contains1 = (!atend1) && (y >= it1->Top());
+      bool contains2 = (!atend2) && (y >= it2->Top());
+      int nexty = 0;
+      if (!atend1)
+      {
+        if (contains1)
+        {
+          nexty = it1->Bottom();
+        }
+        else
+        {
+          nexty = it1->Top();
+        }
+      }
+      if (!atend2)
+      {
+        if (contains2)
+        {
+          if (!atend1)
+          {
+            nexty = std::min(nexty, it2->Bottom());
+          }
+          else
+          {
+            nexty = it2->Bottom();
+          }
+        }
+        else
+        {
+          if (!atend1)
+          {
+            nexty = std::min(nexty, it2->Top());
+          }
+          else
+          {
+            nexty = it2->Top();
+          }
+        }
+      }
+      nhAssert(nexty > y);
+      if (contains1)
+      {
+        if (contains2)
+        {
+          func(y, nexty, it1->HorzRanges(), it2->HorzRanges());
+        }
+        else
+        {
+          func(y, nexty, it1->HorzRanges(), std::vector<THorizontalRange>());
+        }
+      }
+      else if (contains2)
+      {
+        func(y, nexty, std::vector<THorizontalRange>(), it2->HorzRanges());
+      }
+      else
+      {
+        // nothing here
+      }
+      y = nexty;
+      if ((!atend1) && (y >= it1->Bottom())) it1++;
+      if ((!atend2) && (y >= it2->Bottom())) it2++;
+    } // while true  
+  }
+
+  template <class Function>
+  static void IterateHorz(const std::vector<THorizontalRange> &range1, const std::vector<THorizontalRange> &range2, const Function &func)
+  {
+    T x;
+    auto it1 = range1.begin();
+    auto it2 = range2.begin();
+    bool atend1 = (it1 == range1.end());
+    bool atend2 = (it2 == range2.end());
+    if (atend1)
+    {
+      if (atend2)
+      {
+        return;
+      }
+      else
+      {
+        x = it2->Left();
+      }
+    }
+    else
+    {
+      if (atend2)
+      {
+        x = it1->Left();
+      }
+      else
+      {
+        x = std::min(it1->Left(), it2->Left());
+      }
+    }
+    while (true)
+    {
+      atend1 = (it1 == range1.end());
+      atend2 = (it2 == range2.end());
+      if (atend1 && atend2) break;
+      bool contains1 = (!atend1) && (x >= it1->Left());
+      bool contains2 = (!atend2) && (x >= it2->Left());
+      int nextx = 0;
+      if (!atend1)
+      {
+        if (contains1)
+        {
+          nextx = it1->Right();
+        }
+        else
+        {
+          nextx = it1->Left();
+        }
+      }
+      if (!atend2)
+      {
+        if (contains2)
+        {
+          if (!atend1)
+          {
+            nextx = std::min(nextx, it2->Right());
+          }
+          else
+          {
+            nextx = it2->Right();
+          }
+        }
+        else
+        {
+          if (!atend1)
+          {
+            nextx = std::min(nextx, it2->Left());
+          }
+          else
+          {
+            nextx = it2->Left();
+          }
+        }
+      }
+      nhAssert(nextx > x);
+      if (contains1)
+      {
+        if (contains2)
+        {
+          func(x, nextx, true, true);
+        }
+        else
+        {
+          func(x, nextx, true, false);
+        }
+      }
+      else if (contains2)
+      {
+        func(x, nextx, false, true);
+      }
+      else
+      {
+        // nothing here
+      }
+      x = nextx;
+      if ((!atend1) && (x >= it1->Right())) it1++;
+      if ((!atend2) && (x >= it2->Right())) it2++;
+    } // while true
+  }
+  void AppendRangeAtBottom(TVerticalRange &&newvertrange)
+  {
+    if (!newvertrange.HorzRanges().empty())
+    {
+      bool done = false;
+      if (!m_VertRanges.empty())
+      {
+        auto &lastrange = m_VertRanges.back();
+        nhAssert(lastrange.Bottom() <= newvertrange.Top());
+        if (lastrange.Bottom() == newvertrange.Top())
+        {
+          // directly adjacent:
+          if (lastrange.HorzRanges() == newvertrange.HorzRanges())
+          {
+            // and same horzrange. Just extend:
+            lastrange.SetBottom(newvertrange.Bottom());
+            done = true;
+          }
+        }
+      }
+      if (!done)
+      {
+        m_VertRanges.push_back(std::move(newvertrange));
+      }
+    }
+  }
+
+private:
+  std::vector<TVerticalRange> m_VertRanges;
+};
+
+} // namespace utils
@@ -0,0 +1,217 @@
+#include "rtarena.h"
+#include "utils.h"
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <stdexcept>
+#include <algorithm>
+#include <sys/mman.h>
+
+namespace
+{
+    constexpr size_t sPageSize = 4096;
+    constexpr size_t sHugePageSize = 2 << 20;
+
+    // VmLck from /proc/self/status, in bytes:
+    size_t ProcessLockedBytes()
+    {
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while(std::getline(status, line))
+        {
+            if(line.starts_with("VmLck:"))
+            {
+                return (size_t)std::stoull(line.substr(6)) * 1024;
+            }
+        }
+        return 0;
+    }
+
+    std::string Megabytes(size_t bytes)
+    {
+        return std::to_string((bytes + (1 << 19)) >> 20) + " MB";
+    }
+}
+
+namespace rtarena
+{
+    TArena::TArena(bool hugepages) : m_HugePages(hugepages)
+    {
+    }
+
+    TArena& TArena::Static()
+    {
+        // never deleted, containers using it may be destroyed after static destruction has started:
+        static auto arena = new TArena([](){
+            auto env = getenv("JNLIVE_RT_HUGEPAGES");
+            return env && (std::string(env) == "1");
+        }());
+        return *arena;
+    }
+
+    size_t TArena::ClassSize(size_t sizeclass)
+    {
+        auto shift = 7 + sizeclass / 2;
+        return (sizeclass % 2)? (size_t)3 << (shift - 1) : (size_t)1 << shift;
+    }
+
+    size_t TArena::SizeClass(size_t size)
+    {
+        for(size_t sizeclass = 0; sizeclass < sNumSizeClasses; sizeclass++)
+        {
+            if(ClassSize(sizeclass) >= size) return sizeclass;
+        }
+        return SIZE_MAX;
+    }
+
+    char* TArena::Map(size_t size, bool &locked)
+    {
+        auto mapsize = m_HugePages? size + sHugePageSize : size;
+        auto mem = (char*)mmap(nullptr, mapsize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(mem == MAP_FAILED)
+        {
+            throw std::bad_alloc();
+        }
+        if(m_HugePages)
+        {
+            // align to a huge page and give back the rest:
+            auto aligned = (char*)(((uintptr_t)mem + sHugePageSize - 1) & ~(uintptr_t)(sHugePageSize - 1));
+            if(aligned > mem)
+            {
+                munmap(mem, (size_t)(aligned - mem));
+            }
+            if(mem + mapsize > aligned + size)
+            {
+                munmap(aligned + size, (size_t)(mem + mapsize - (aligned + size)));
+            }
+            mem = aligned;
+            madvise(mem, size, MADV_HUGEPAGE);
+        }
+        m_ReservedBytes += size;
+        // locking faults the pages in. Without permission (RLIMIT_MEMLOCK) at least fault them in by writing:
+        locked = mlock(mem, size) == 0;
+        if(locked)
+        {
+            m_LockedBytes += size;
+        }
+        else
+        {
+            std::memset(mem, 0, size);
+            if(!m_LockFailureReported)
+            {
+                m_LockFailureReported = true;
+                std::cerr << "RT arena: mlock failed, realtime buffers are not locked in memory" << '\n';
+            }
+        }
+        return mem;
+    }
+
+    void TArena::NewChunk()
+    {
+        // the rest of the current chunk goes to the free lists, largest blocks first:
+        for(size_t sizeclass = sNumSizeClasses; sizeclass-- > 0; )
+        {
+            auto blocksize = ClassSize(sizeclass);
+            while(m_ChunkRemaining >= blocksize)
+            {
+                m_FreeBlocks[sizeclass].push_back(m_ChunkPos);
+                m_ChunkPos += blocksize;
+                m_ChunkRemaining -= blocksize;
+            }
+        }
+        bool locked;
+        m_ChunkPos = Map(sChunkSize, locked);
+        m_ChunkRemaining = sChunkSize;
+    }
+
+    void* TArena::Allocate(size_t size)
+    {
+        std::lock_guard lock(m_Mutex);
+        auto sizeclass = SizeClass(std::max<size_t>(size, 1));
+        void *result;
+        TBlock block;
+        if(sizeclass == SIZE_MAX)
+        {
+            auto mapsize = (size + sPageSize - 1) & ~(sPageSize - 1);
+            bool locked;
+            result = Map(mapsize, locked);
+            block = TBlock {SIZE_MAX, mapsize, locked};
+        }
+        else
+        {
+            auto blocksize = ClassSize(sizeclass);
+            auto &freeblocks = m_FreeBlocks[sizeclass];
+            if(!freeblocks.empty())
+            {
+                result = freeblocks.back();
+                freeblocks.pop_back();
+            }
+            else
+            {
+                if(m_ChunkRemaining < blocksize)
+                {
+                    NewChunk();
+                }
+                result = m_ChunkPos;
+                m_ChunkPos += blocksize;
+                m_ChunkRemaining -= blocksize;
+            }
+            block = TBlock {sizeclass, blocksize, false};
+        }
+        m_Blocks[result] = block;
+        m_UsedBytes += block.m_Size;
+        return result;
+    }
+
+    void TArena::Free(void *ptr)
+    {
+        if(!ptr) return;
+        std::lock_guard lock(m_Mutex);
+        auto it = m_Blocks.find(ptr);
+        if(it == m_Blocks.end())
+        {
+            throw std::runtime_error("TArena::Free: not allocated here");
+        }
+        auto block = it->second;
+        m_Blocks.erase(it);
+        m_UsedBytes -= block.m_Size;
+        if(block.m_SizeClass == SIZE_MAX)
+        {
+            munmap(ptr, block.m_Size);
+            m_ReservedBytes -= block.m_Size;
+            if(block.m_Locked)
+            {
+                m_LockedBytes -= block.m_Size;
+            }
+        }
+        else
+        {
+            m_FreeBlocks[block.m_SizeClass].push_back(ptr);
+        }
+    }
+
+    size_t TArena::UsedBytes() const
+    {
+        std::lock_guard lock(m_Mutex);
+        return m_UsedBytes;
+    }
+
+    size_t TArena::ReservedBytes() const
+    {
+        std::lock_guard lock(m_Mutex);
+        return m_ReservedBytes;
+    }
+
+    size_t TArena::LockedBytes() const
+    {
+        std::lock_guard lock(m_Mutex);
+        return m_LockedBytes;
+    }
+
+    std::string Report()
+    {
+        const auto &arena = TArena::Static();
+        return "RT arena: " + Megabytes(arena.UsedBytes()) + " used, " + Megabytes(arena.ReservedBytes()) + " reserved, " + Megabytes(arena.LockedBytes()) + " locked. Process: RSS " + Megabytes(utils::ResidentSetSize()) + ", locked " + Megabytes(ProcessLockedBytes());
+    }
+}
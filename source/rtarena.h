@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+#include <array>
+#include <new>
+
+namespace rtarena
+{
+    // Memory for buffers the realtime thread touches: the pages are locked and faulted in before the memory is handed
+    // out, so using a buffer for the first time (after a preset load, say) does not page fault. Memory comes from
+    // chunks that are never returned to the system; freed blocks are kept per size class for reuse. Blocks are 64 byte
+    // aligned. Allocating and freeing take a lock and are not realtime safe.
+    class TArena
+    {
+    public:
+        TArena(const TArena&) = delete;
+        TArena& operator=(const TArena&) = delete;
+        TArena(TArena&&) = delete;
+        TArena& operator=(TArena&&) = delete;
+        // hugepages: ask for transparent huge pages for the chunks
+        TArena(bool hugepages);
+        // hugepages if the environment variable JNLIVE_RT_HUGEPAGES is set to 1
+        static TArena& Static();
+        void* Allocate(size_t size);
+        void Free(void *ptr);
+        // in allocated blocks, including the rounding up to the size class:
+        size_t UsedBytes() const;
+        // obtained from the system:
+        size_t ReservedBytes() const;
+        // the part of the reserved bytes that could be locked:
+        size_t LockedBytes() const;
+
+    private:
+        class TBlock
+        {
+        public:
+            // SIZE_MAX for a block larger than a chunk, which has a mapping of its own:
+            size_t m_SizeClass;
+            size_t m_Size;
+            bool m_Locked;
+        };
+        static constexpr size_t sChunkSize = 4 << 20;
+        // block sizes are powers of two and 1.5 times powers of two from 128 bytes up to the chunk size, so all are
+        // multiples of 64:
+        static constexpr size_t sNumSizeClasses = 31;
+        // SIZE_MAX if larger than a chunk:
+        static size_t SizeClass(size_t size);
+        static size_t ClassSize(size_t sizeclass);
+        // a mapping of size bytes (a multiple of the page size), locked and faulted in:
+        char* Map(size_t size, bool &locked);
+        void NewChunk();
+
+    private:
+        bool m_HugePages;
+        mutable std::mutex m_Mutex;
+        // protected by mutex:
+        std::array<std::vector<void*>, sNumSizeClasses> m_FreeBlocks;
+        // allocated blocks:
+        std::unordered_map<void*, TBlock> m_Blocks;
+        char *m_ChunkPos = nullptr;
+        size_t m_ChunkRemaining = 0;
+        size_t m_UsedBytes = 0;
+        size_t m_ReservedBytes = 0;
+        size_t m_LockedBytes = 0;
+        bool m_LockFailureReported = false;
+    };
+
+    // Standard allocator on top of TArena::Static(), for containers holding realtime buffers:
+    template <class T>
+    class TAllocator
+    {
+    public:
+        using value_type = T;
+        TAllocator() = default;
+        template <class U> TAllocator(const TAllocator<U> &) {}
+        T* allocate(size_t n)
+        {
+            static_assert(alignof(T) <= 64);
+            return (T*)TArena::Static().Allocate(n * sizeof(T));
+        }
+        void deallocate(T *ptr, size_t)
+        {
+            TArena::Static().Free(ptr);
+        }
+        template <class U> bool operator==(const TAllocator<U> &) const { return true; }
+    };
+    template <class T>
+    using TVector = std::vector<T, TAllocator<T>>;
+
+    // one line: the use of the arena and the resident and locked memory of the whole process
+    std::string Report();
+}
@@ -1,6 +1,7 @@
 #include "schedule.h"
 #include "lilvutils.h"
 #include <string.h>
+#include "threads.h"
 
 // https://lv2plug.in/c/html/group__worker.html#structLV2__Worker__Schedule
 
@@ -113,7 +114,7 @@ namespace schedule
             auto func = [this]() mutable {
                 WorkerThreadFunc();
             };
-            m_WorkerThread = std::thread(std::move(func));
+            m_WorkerThread = threads::Spawn(threads::TClass::Io, "lv2 worker", std::move(func));
         }
     }
 
@@ -11,8 +11,8 @@ namespace simplegui
     {
         if(!Equals(&other))
         {
-            region = region.Union(Rectangle() + offset);
-            region = region.Union(other.Rectangle() + otheroffset);
+            region.UnionWith(Rectangle() + offset);
+            region.UnionWith(other.Rectangle() + otheroffset);
         }
     }
 
@@ -24,8 +24,8 @@ namespace simplegui
             {
                 // if(other->Rectangle().TopLeft() != Rectangle().TopLeft())
                 // {
-                //     region = region.Union(Rectangle() + offset);
-                //     region = region.Union(other->Rectangle() + offset);
+                //     region.UnionWith(Rectangle() + offset);
+                //     region.UnionWith(other->Rectangle() + offset);
                 //     return;
                 // }
                 // else
@@ -35,7 +35,7 @@ namespace simplegui
             }
             else
             {
-                region = region.Union(Rectangle() + offset);
+                region.UnionWith(Rectangle() + offset);
                 return;
             }
         }
@@ -111,14 +111,14 @@ namespace simplegui
             {
                 if(win)
                 {
-                    region = region.Union(win->Rectangle() + childoffset);
+                    region.UnionWith(win->Rectangle() + childoffset);
                 }
             }
             for(const auto &win: otherchildren)
             {
                 if(win)
                 {
-                    region = region.Union(win->Rectangle() + otherchildoffset);
+                    region.UnionWith(win->Rectangle() + otherchildoffset);
                 }
             }
         }
@@ -167,7 +167,7 @@ namespace simplegui
                 utils::TIntRegion r1(Rectangle() + offset);
                 utils::TIntRegion r2(otherplainwindow->Rectangle() + otheroffset);
                 auto inverseintersection = r1.Union(r2).Subtract(r1.Intersection(r2));
-                region = region.Union(inverseintersection);
+                region.UnionWith(inverseintersection);
                 return;
             }
         }
@@ -219,8 +219,8 @@ namespace simplegui
                 return;
             }
             // only the actual painted region is dirty:
-            region = region.Union(m_TextClipRect + offset + Rectangle().TopLeft());
-            region = region.Union(othertextwindow->m_TextClipRect + otheroffset + othertextwindow->Rectangle().TopLeft());
+            region.UnionWith(m_TextClipRect + offset + Rectangle().TopLeft());
+            region.UnionWith(othertextwindow->m_TextClipRect + otheroffset + othertextwindow->Rectangle().TopLeft());
             return;
         }
         // fallback:
@@ -0,0 +1,498 @@
+#include "utils.h"
+#include "referenceregion.h"
+#include "graph.h"
+#include <iostream>
+#include <random>
+#include <vector>
+#include <array>
+#include <set>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <chrono>
+
+import project;
+
+// Randomized checks of data structures against a simple reference implementation, run by ctest.
+// The seed is fixed so a failure can be reproduced; pass another seed as the only argument to explore further.
+
+namespace
+{
+    void Check(bool condition, const std::string &what, uint64_t step)
+    {
+        if(!condition)
+        {
+            throw std::runtime_error("Check failed at step " + std::to_string(step) + ": " + what);
+        }
+    }
+
+    // regions are kept inside this square, so a bitmap of it is a third, trivially correct implementation:
+    constexpr int sGridSize = 64;
+    const utils::TIntRect sGridRect = utils::TIntRect::FromSize({sGridSize, sGridSize});
+
+    class TBitmap
+    {
+    public:
+        bool Get(int x, int y) const { return m_Bits[y * sGridSize + x]; }
+        void Set(int x, int y, bool value) { m_Bits[y * sGridSize + x] = value; }
+        template <class Function>
+        TBitmap Combine(const TBitmap &other, const Function &include) const
+        {
+            TBitmap result;
+            for(size_t i = 0; i < m_Bits.size(); i++) result.m_Bits[i] = include(m_Bits[i], other.m_Bits[i]);
+            return result;
+        }
+        bool Any() const { return std::ranges::any_of(m_Bits, [](bool b){ return b; }); }
+        bool operator==(const TBitmap&) const = default;
+
+    private:
+        std::array<bool, sGridSize * sGridSize> m_Bits {};
+    };
+
+    TBitmap ToBitmap(const utils::TIntRect &rect)
+    {
+        TBitmap result;
+        for(int y = std::max(0, rect.Top()); y < std::min(sGridSize, rect.Bottom()); y++)
+        {
+            for(int x = std::max(0, rect.Left()); x < std::min(sGridSize, rect.Right()); x++) result.Set(x, y, true);
+        }
+        return result;
+    }
+
+    template <class Region>
+    std::vector<utils::TIntRect> Rects(const Region &region)
+    {
+        std::vector<utils::TIntRect> result;
+        region.ForEach([&](const utils::TIntRect &r){ result.push_back(r); });
+        return result;
+    }
+
+    template <class Region>
+    TBitmap ToBitmap(const Region &region)
+    {
+        TBitmap result;
+        region.ForEach([&](const utils::TIntRect &r){
+            result = result.Combine(ToBitmap(r), [](bool a, bool b){ return a || b; });
+        });
+        return result;
+    }
+
+    utils::TIntRect RandomRect(std::mt19937 &rng)
+    {
+        // mostly small rectangles on a coarse grid, so edges often coincide:
+        std::uniform_int_distribution<int> coord(0, sGridSize / 4);
+        std::uniform_int_distribution<int> size(0, 6);
+        int left = 4 * coord(rng) - 4, top = 4 * coord(rng) - 4;
+        if(rng() % 4 == 0)
+        {
+            left += (int)(rng() % 4);
+            top += (int)(rng() % 4);
+        }
+        auto r = utils::TIntRect::FromTopLeftAndBottomRight({left, top}, {left + 4 * size(rng) + (int)(rng() % 3), top + 4 * size(rng) + (int)(rng() % 3)});
+        return r.Intersection(sGridRect);
+    }
+
+    // The same region in three implementations. Every operation is applied to all three and they must agree.
+    class TRegionTriple
+    {
+    public:
+        utils::TIntRegion m_Region;
+        utils::TReferenceRegion<int> m_Reference;
+        TBitmap m_Bitmap;
+
+        void Verify(uint64_t step) const
+        {
+            auto rects = Rects(m_Region);
+            Check(rects == Rects(m_Reference), "rectangles differ from the reference region", step);
+            Check(ToBitmap(m_Region) == m_Bitmap, "region differs from the bitmap", step);
+            Check(m_Region.empty() == m_Reference.empty(), "empty() differs", step);
+            Check(m_Region.empty() == rects.empty(), "empty() while ForEach() reports rectangles", step);
+            Check(m_Region.OuterBounds() == m_Reference.OuterBounds(), "OuterBounds() differs", step);
+            for(size_t i = 0; i < rects.size(); i++)
+            {
+                for(size_t j = i + 1; j < rects.size(); j++)
+                {
+                    Check(!rects[i].Intersects(rects[j]), "ForEach() reports overlapping rectangles", step);
+                }
+            }
+            size_t bandindex = 0;
+            m_Region.ForEachVertRange([&](const utils::TIntRegion::TVerticalRange &band) {
+                Check(bandindex < m_Reference.VertRanges().size(), "too many bands", step);
+                const auto &refband = m_Reference.VertRanges()[bandindex++];
+                Check( (band.Top() == refband.Top()) && (band.Bottom() == refband.Bottom()), "band bounds differ", step);
+                Check(band.HorzRanges().size() == refband.HorzRanges().size(), "band range count differs", step);
+                for(size_t i = 0; i < band.HorzRanges().size(); i++)
+                {
+                    Check( (band.HorzRanges()[i].Left() == refband.HorzRanges()[i].Left()) && (band.HorzRanges()[i].Right() == refband.HorzRanges()[i].Right()), "band ranges differ", step);
+                }
+            });
+            Check(bandindex == m_Reference.VertRanges().size(), "too few bands", step);
+        }
+    };
+
+    void TestRegion(uint32_t seed, uint64_t numsteps)
+    {
+        std::mt19937 rng(seed);
+        std::vector<TRegionTriple> regions(6);
+        for(uint64_t step = 0; step < numsteps; step++)
+        {
+            auto &a = regions[rng() % regions.size()];
+            auto &b = regions[rng() % regions.size()];  // may be the same as a
+            auto rect = RandomRect(rng);
+            switch(rng() % 13)
+            {
+            case 0:
+                a.m_Region = utils::TIntRegion(rect);
+                a.m_Reference = utils::TReferenceRegion<int>(rect);
+                a.m_Bitmap = ToBitmap(rect);
+                break;
+            case 1:
+            {
+                TRegionTriple r {a.m_Region.Union(b.m_Region), a.m_Reference.Union(b.m_Reference), a.m_Bitmap.Combine(b.m_Bitmap, [](bool x, bool y){ return x || y; })};
+                a = std::move(r);
+                break;
+            }
+            case 2:
+            {
+                TRegionTriple r {a.m_Region.Subtract(b.m_Region), a.m_Reference.Subtract(b.m_Reference), a.m_Bitmap.Combine(b.m_Bitmap, [](bool x, bool y){ return x && (!y); })};
+                a = std::move(r);
+                break;
+            }
+            case 3:
+            {
+                TRegionTriple r {a.m_Region.Intersection(b.m_Region), a.m_Reference.Intersection(b.m_Reference), a.m_Bitmap.Combine(b.m_Bitmap, [](bool x, bool y){ return x && y; })};
+                a = std::move(r);
+                break;
+            }
+            case 4:
+            case 5:
+            case 10:
+            case 11:
+            case 12:
+                // the pattern of the damage tracking: many small rectangles added to one region
+                a.m_Region.UnionWith(rect);
+                a.m_Reference = a.m_Reference.Union(utils::TReferenceRegion<int>(rect));
+                a.m_Bitmap = a.m_Bitmap.Combine(ToBitmap(rect), [](bool x, bool y){ return x || y; });
+                break;
+            case 6:
+                a.m_Region.UnionWith(b.m_Region);
+                a.m_Reference = a.m_Reference.Union(b.m_Reference);
+                a.m_Bitmap = a.m_Bitmap.Combine(b.m_Bitmap, [](bool x, bool y){ return x || y; });
+                break;
+            case 7:
+                a.m_Region.IntersectWith(b.m_Region.Union(rect));
+                a.m_Reference = a.m_Reference.Intersection(b.m_Reference.Union(utils::TReferenceRegion<int>(rect)));
+                a.m_Bitmap = a.m_Bitmap.Combine(b.m_Bitmap.Combine(ToBitmap(rect), [](bool x, bool y){ return x || y; }), [](bool x, bool y){ return x && y; });
+                break;
+            case 8:
+            {
+                // shift and clip back into the grid:
+                utils::TIntPoint delta((int)(rng() % 9) - 4, (int)(rng() % 9) - 4);
+                a.m_Region = a.m_Region.Shift(delta);
+                a.m_Region.IntersectWith(sGridRect);
+                a.m_Reference = a.m_Reference.Shift(delta).Intersection(utils::TReferenceRegion<int>(sGridRect));
+                TBitmap shifted;
+                for(int y = 0; y < sGridSize; y++)
+                {
+                    for(int x = 0; x < sGridSize; x++)
+                    {
+                        int fromx = x - delta.X(), fromy = y - delta.Y();
+                        shifted.Set(x, y, (fromx >= 0) && (fromy >= 0) && (fromx < sGridSize) && (fromy < sGridSize) && a.m_Bitmap.Get(fromx, fromy));
+                    }
+                }
+                a.m_Bitmap = shifted;
+                break;
+            }
+            case 9:
+                if(rng() % 2)
+                {
+                    a.m_Region.Clear();
+                    a.m_Reference = utils::TReferenceRegion<int>();
+                    a.m_Bitmap = TBitmap();
+                }
+                else
+                {
+                    auto copy = b;
+                    a = std::move(copy);
+                }
+                break;
+            }
+            a.Verify(step);
+            // queries, against the other implementations:
+            bool intersects = a.m_Bitmap.Combine(b.m_Bitmap, [](bool x, bool y){ return x && y; }).Any();
+            Check(a.m_Region.Intersects(b.m_Region) == intersects, "Intersects() differs from the bitmap", step);
+            Check(a.m_Reference.Intersects(b.m_Reference) == intersects, "reference Intersects() differs from the bitmap", step);
+            bool contains = !b.m_Bitmap.Combine(a.m_Bitmap, [](bool x, bool y){ return x && (!y); }).Any();
+            Check(a.m_Region.Contains(b.m_Region) == contains, "Contains(region) differs from the bitmap", step);
+            Check(a.m_Reference.Contains(b.m_Reference) == contains, "reference Contains(region) differs from the bitmap", step);
+            for(int i = 0; i < 8; i++)
+            {
+                utils::TIntPoint point((int)(rng() % sGridSize), (int)(rng() % sGridSize));
+                Check(a.m_Region.Contains(point) == a.m_Bitmap.Get(point.X(), point.Y()), "Contains(point) differs from the bitmap", step);
+            }
+        }
+    }
+
+    void TestSmallVector(uint32_t seed, uint64_t numsteps)
+    {
+        std::mt19937 rng(seed);
+        std::vector<utils::TSmallVector<int, 4>> vectors(4);
+        std::vector<std::vector<int>> references(vectors.size());
+        for(uint64_t step = 0; step < numsteps; step++)
+        {
+            auto i = rng() % vectors.size();
+            auto j = rng() % vectors.size();
+            auto &v = vectors[i];
+            auto &ref = references[i];
+            switch(rng() % 8)
+            {
+            case 0:
+            case 1:
+            case 2:
+            {
+                auto count = rng() % 12;
+                for(size_t n = 0; n < count; n++)
+                {
+                    int value = (int)rng();
+                    v.push_back(value);
+                    ref.push_back(value);
+                }
+                break;
+            }
+            case 3:
+                if(!ref.empty())
+                {
+                    // an element of the vector itself, which may move while the vector grows:
+                    auto index = rng() % ref.size();
+                    v.push_back(v[index]);
+                    ref.push_back(ref[index]);
+                }
+                break;
+            case 4:
+            {
+                auto size = ref.empty()? 0 : rng() % (ref.size() + 1);
+                v.truncate(size);
+                ref.resize(size);
+                break;
+            }
+            case 5:
+                if(rng() % 2)
+                {
+                    vectors[i] = vectors[j];
+                }
+                else
+                {
+                    auto copy = vectors[j];
+                    vectors[i] = std::move(copy);
+                }
+                references[i] = references[j];
+                break;
+            case 6:
+                vectors[i].swap(vectors[j]);
+                references[i].swap(references[j]);
+                break;
+            case 7:
+                if(rng() % 2)
+                {
+                    v.clear();
+                    ref.clear();
+                }
+                else
+                {
+                    v.reserve(rng() % 64);
+                }
+                break;
+            }
+            for(size_t k = 0; k < vectors.size(); k++)
+            {
+                Check(std::vector<int>(vectors[k].begin(), vectors[k].end()) == references[k], "TSmallVector differs from std::vector", step);
+                Check(vectors[k].empty() == references[k].empty(), "TSmallVector::empty() differs", step);
+            }
+        }
+    }
+    // Random edits of the instruments and presets of a project. Every element must keep its id until it is deleted,
+    // and a copied element must get a new id, wherever the copy is placed.
+    void TestProjectIds(uint32_t seed, uint64_t numsteps)
+    {
+        std::mt19937 rng(seed);
+        auto project = project::TestProject();
+        std::vector<uint64_t> instrumentIds;
+        std::vector<std::optional<uint64_t>> presetIds;
+        for(uint64_t step = 0; step < numsteps; step++)
+        {
+            const auto &instruments = project.Instruments();
+            const auto &presets = project.Presets();
+            switch(rng() % 6)
+            {
+            case 0:
+                project = project.AddInstrument(project::TInstrument("urn:test", false, "instrument", {}, false));
+                instrumentIds.push_back(project.Instruments().back().Id());
+                break;
+            case 1:
+                if(!instruments.empty())
+                {
+                    auto copy = instruments[rng() % instruments.size()];
+                    project = project.AddInstrument(std::move(copy));
+                    instrumentIds.push_back(project.Instruments().back().Id());
+                }
+                break;
+            case 2:
+                if(!instruments.empty())
+                {
+                    auto index = rng() % instruments.size();
+                    for(size_t i = 0; i < presets.size(); i++)
+                    {
+                        if(presets[i] && (presets[i]->InstrumentIndex() == index))
+                        {
+                            presetIds[i] = std::nullopt;
+                        }
+                    }
+                    project = project.DeleteInstrument(index);
+                    instrumentIds.erase(instrumentIds.begin() + index);
+                }
+                break;
+            case 3:
+                if(!instruments.empty())
+                {
+                    auto slot = rng() % 16;
+                    project = project.ChangePreset(slot, project::TPreset(rng() % instruments.size(), "preset", "", std::nullopt));
+                    presetIds.resize(project.Presets().size());
+                    presetIds[slot] = project.Presets()[slot]->Id();
+                }
+                break;
+            case 4:
+                if(!presets.empty())
+                {
+                    // copy a preset into another slot, which may come before the original:
+                    auto from = rng() % presets.size();
+                    auto slot = rng() % 16;
+                    if( (slot != from) && presets[from] )
+                    {
+                        auto copy = presets[from];
+                        project = project.ChangePreset(slot, std::move(copy));
+                        presetIds.resize(project.Presets().size());
+                        presetIds[slot] = project.Presets()[slot]->Id();
+                    }
+                }
+                break;
+            case 5:
+                if(!presets.empty())
+                {
+                    auto slot = rng() % presets.size();
+                    project = project.ChangePreset(slot, std::nullopt);
+                    presetIds[slot] = std::nullopt;
+                }
+                break;
+            }
+            std::set<uint64_t> ids;
+            Check(project.Instruments().size() == instrumentIds.size(), "number of instruments", step);
+            for(size_t i = 0; i < instrumentIds.size(); i++)
+            {
+                Check(project.Instruments()[i].Id() == instrumentIds[i], "instrument id changed", step);
+                Check(project.InstrumentIndexById(instrumentIds[i]) == i, "InstrumentIndexById", step);
+                Check(ids.insert(instrumentIds[i]).second && (instrumentIds[i] != 0), "instrument id not unique", step);
+            }
+            Check(project.Presets().size() == presetIds.size(), "number of preset slots", step);
+            for(size_t i = 0; i < presetIds.size(); i++)
+            {
+                Check(project.Presets()[i].has_value() == presetIds[i].has_value(), "preset slot", step);
+                if(presetIds[i])
+                {
+                    Check(project.Presets()[i]->Id() == *presetIds[i], "preset id changed", step);
+                    Check(project.PresetIndexById(*presetIds[i]) == i, "PresetIndexById", step);
+                    Check(ids.insert(*presetIds[i]).second && (*presetIds[i] != 0), "preset id not unique", step);
+                }
+            }
+        }
+    }
+    // Random graphs like the mix graph (chains into a bus, and more), run on the worker pool. Every task must run
+    // exactly once per cycle, after all its dependencies.
+    void TestWorkerPool(uint32_t seed, uint64_t numgraphs)
+    {
+        Check(graph::TSchedule({{}, {}, {}, {0, 1, 2}}).NumParallelChains() == 0, "single tasks into a bus are not parallel chains", 0);
+        Check(graph::TSchedule({{}, {0}, {}, {2}, {}, {1, 3, 4}}).NumParallelChains() == 2, "two chains of two tasks", 0);
+        Check(graph::TSchedule({{}, {0}, {1}, {2}}).NumParallelChains() == 1, "one long chain", 0);
+        std::mt19937 rng(seed);
+        graph::TWorkerPool pool(3);
+        bool usedWorkers = false;
+        for(uint64_t step = 0; step < numgraphs; step++)
+        {
+            std::vector<std::vector<size_t>> dependencies;
+            auto numchains = 1 + rng() % 6;
+            std::vector<size_t> chainends;
+            for(size_t chain = 0; chain < numchains; chain++)
+            {
+                auto length = 1 + rng() % 4;
+                for(size_t i = 0; i < length; i++)
+                {
+                    dependencies.push_back( (i == 0)? std::vector<size_t>() : std::vector<size_t>{dependencies.size() - 1} );
+                }
+                chainends.push_back(dependencies.size() - 1);
+            }
+            dependencies.push_back(chainends);
+            // a few extra tasks with random dependencies:
+            auto numextra = rng() % 4;
+            for(size_t i = 0; i < numextra; i++)
+            {
+                std::vector<size_t> extra;
+                for(size_t j = 0; j < dependencies.size(); j++)
+                {
+                    if(rng() % 4 == 0) extra.push_back(j);
+                }
+                dependencies.push_back(std::move(extra));
+            }
+            graph::TSchedule schedule(dependencies);
+            auto numtasks = dependencies.size();
+            auto finishedInCycle = std::make_unique<std::atomic<uint64_t>[]>(numtasks);
+            auto runsInCycle = std::make_unique<std::atomic<uint64_t>[]>(numtasks);
+            std::atomic<bool> ok = true;
+            for(uint64_t cycle = 1; cycle <= 50; cycle++)
+            {
+                if(cycle == 1)
+                {
+                    // like the audio thread waits for the next period, so the woken workers get to run:
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+                graph::TWorkerPool::TTaskFunc func = [&](size_t task){
+                    for(auto dependency: dependencies[task])
+                    {
+                        if(finishedInCycle[dependency].load(std::memory_order_relaxed) != cycle) ok = false;
+                    }
+                    if(runsInCycle[task].fetch_add(1, std::memory_order_relaxed) != cycle - 1) ok = false;
+                    finishedInCycle[task].store(cycle, std::memory_order_relaxed);
+                };
+                pool.Run(schedule, func);
+                usedWorkers = usedWorkers || (pool.LastNumWorkers() > 0);
+                for(size_t task = 0; task < numtasks; task++)
+                {
+                    Check(runsInCycle[task].load() == cycle, "task did not run exactly once", step);
+                }
+                Check(ok, "task started before its dependencies were finished", step);
+                Check( (schedule.NumParallelChains() >= 2) || (pool.LastNumWorkers() == 0), "workers woken for a graph without parallel chains", step);
+            }
+        }
+        Check(usedWorkers, "the workers were never used", numgraphs);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        uint32_t seed = (argc > 1)? (uint32_t)std::stoul(argv[1]) : 1;
+        TestSmallVector(seed, 100000);
+        std::cout << "TSmallVector: ok\n";
+        TestRegion(seed, 20000);
+        std::cout << "TTypedRegion: ok\n";
+        TestProjectIds(seed, 20000);
+        std::cout << "TProject ids: ok\n";
+        TestWorkerPool(seed, 100);
+        std::cout << "TWorkerPool: ok\n";
+    }
+    catch(std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
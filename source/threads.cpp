@@ -0,0 +1,277 @@
+#include "threads.h"
+#include "json/json.h"
+#include <mutex>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <iterator>
+#include <cerrno>
+#include <csignal>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+namespace
+{
+    class TThreadInfo
+    {
+    public:
+        pid_t m_Tid;
+        threads::TClass m_Class;
+        std::string m_Name;
+    };
+
+    class TRegistry
+    {
+    public:
+        std::mutex m_Mutex;
+        // protected by mutex:
+        std::vector<TThreadInfo> m_Threads;
+        threads::TSettings m_Settings;
+        std::array<std::atomic<bool>, threads::sNumClasses> m_HasRtPriority {};
+    };
+
+    // never deleted, threads may exit after static destruction has started:
+    TRegistry& Registry()
+    {
+        static auto registry = new TRegistry();
+        return *registry;
+    }
+
+    std::atomic<bool> sReportRequested = false;
+
+    // removes the thread from the registry when it exits:
+    class TRegistration
+    {
+    public:
+        TRegistration(pid_t tid) : m_Tid(tid) {}
+        ~TRegistration()
+        {
+            auto &registry = Registry();
+            std::lock_guard lock(registry.m_Mutex);
+            std::erase_if(registry.m_Threads, [this](const TThreadInfo &info){ return info.m_Tid == m_Tid; });
+        }
+    private:
+        pid_t m_Tid;
+    };
+    thread_local std::optional<TRegistration> tRegistration;
+
+    void Apply(const TThreadInfo &info, const threads::TClassSettings &settings)
+    {
+        // failures (typically a missing rtprio permission, or a cpu that does not exist) are not fatal:
+        if(!settings.m_Cpus.empty())
+        {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            for(auto cpu: settings.m_Cpus)
+            {
+                if( (cpu >= 0) && (cpu < CPU_SETSIZE) )
+                {
+                    CPU_SET(cpu, &cpus);
+                }
+            }
+            if(sched_setaffinity(info.m_Tid, sizeof(cpus), &cpus) != 0)
+            {
+                std::cerr << "Thread " << info.m_Name << ": could not set the cpu affinity" << '\n';
+            }
+        }
+        if(settings.m_RtPriority)
+        {
+            sched_param param {};
+            param.sched_priority = *settings.m_RtPriority;
+            if(sched_setscheduler(info.m_Tid, SCHED_FIFO, &param) != 0)
+            {
+                std::cerr << "Thread " << info.m_Name << ": could not set realtime priority " << *settings.m_RtPriority << '\n';
+            }
+        }
+        if(settings.m_Nice)
+        {
+            if(setpriority(PRIO_PROCESS, (id_t)info.m_Tid, *settings.m_Nice) != 0)
+            {
+                std::cerr << "Thread " << info.m_Name << ": could not set nice value " << *settings.m_Nice << '\n';
+            }
+        }
+    }
+
+    std::string CpuListToString(const cpu_set_t &cpus)
+    {
+        std::string result;
+        for(int cpu = 0; cpu < CPU_SETSIZE; )
+        {
+            if(!CPU_ISSET(cpu, &cpus))
+            {
+                cpu++;
+                continue;
+            }
+            int last = cpu;
+            while( (last + 1 < CPU_SETSIZE) && CPU_ISSET(last + 1, &cpus) ) last++;
+            if(!result.empty()) result += ",";
+            result += std::to_string(cpu);
+            if(last > cpu) result += "-" + std::to_string(last);
+            cpu = last + 1;
+        }
+        return result;
+    }
+
+    // the cpu the thread last ran on, from field 39 of /proc/self/task/<tid>/stat:
+    std::optional<int> LastCpu(pid_t tid)
+    {
+        std::ifstream ifs("/proc/self/task/" + std::to_string(tid) + "/stat");
+        std::string stat((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+        // the name in field 2 may contain spaces, the fields after it do not:
+        auto pos = stat.rfind(')');
+        if(pos == std::string::npos) return std::nullopt;
+        std::istringstream fields(stat.substr(pos + 1));
+        std::string field;
+        for(int fieldindex = 3; fields >> field; fieldindex++)
+        {
+            if(fieldindex == 39)
+            {
+                return std::stoi(field);
+            }
+        }
+        return std::nullopt;
+    }
+
+    threads::TClassSettings ClassSettingsFromJson(const Json::Value &v)
+    {
+        threads::TClassSettings result;
+        for(const auto &cpu: v["cpus"])
+        {
+            result.m_Cpus.push_back(cpu.asInt());
+        }
+        if(v.isMember("rtpriority"))
+        {
+            result.m_RtPriority = v["rtpriority"].asInt();
+        }
+        if(v.isMember("nice"))
+        {
+            result.m_Nice = v["nice"].asInt();
+        }
+        return result;
+    }
+}
+
+namespace threads
+{
+    std::string_view ClassName(TClass threadclass)
+    {
+        switch(threadclass)
+        {
+            case TClass::RtAudio: return "rtaudio";
+            case TClass::RtWorker: return "rtworker";
+            case TClass::Io: return "io";
+            case TClass::Background: return "background";
+        }
+        return "";
+    }
+
+    TSettings TSettings::FromFile(const std::string &filename)
+    {
+        Json::Value v;
+        std::ifstream ifs(filename);
+        if (!ifs)
+        {
+            throw std::runtime_error("Could not open file for reading: " + filename);
+        }
+        ifs >> v;
+        TSettings result;
+        for(size_t i = 0; i < sNumClasses; i++)
+        {
+            auto threadclass = (TClass)i;
+            auto name = std::string(ClassName(threadclass));
+            if(v.isMember(name))
+            {
+                result.Class(threadclass) = ClassSettingsFromJson(v[name]);
+            }
+        }
+        return result;
+    }
+
+    void SetSettings(TSettings &&settings)
+    {
+        auto &registry = Registry();
+        std::lock_guard lock(registry.m_Mutex);
+        registry.m_Settings = std::move(settings);
+        for(size_t i = 0; i < sNumClasses; i++)
+        {
+            registry.m_HasRtPriority[i] = registry.m_Settings.Class((TClass)i).m_RtPriority.has_value();
+        }
+        for(const auto &info: registry.m_Threads)
+        {
+            Apply(info, registry.m_Settings.Class(info.m_Class));
+        }
+    }
+
+    bool HasRtPriority(TClass threadclass)
+    {
+        return Registry().m_HasRtPriority[(size_t)threadclass].load(std::memory_order_relaxed);
+    }
+
+    void RegisterCurrentThread(TClass threadclass, std::string &&name)
+    {
+        pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+        auto tid = gettid();
+        TThreadInfo info {tid, threadclass, std::move(name)};
+        auto &registry = Registry();
+        std::lock_guard lock(registry.m_Mutex);
+        Apply(info, registry.m_Settings.Class(threadclass));
+        if(!tRegistration)
+        {
+            tRegistration.emplace(tid);
+            registry.m_Threads.push_back(std::move(info));
+        }
+    }
+
+    std::string PlacementReport()
+    {
+        std::vector<TThreadInfo> threadinfos;
+        {
+            auto &registry = Registry();
+            std::lock_guard lock(registry.m_Mutex);
+            threadinfos = registry.m_Threads;
+        }
+        std::string result;
+        for(const auto &info: threadinfos)
+        {
+            std::string cpus = "?";
+            cpu_set_t cpuset;
+            if(sched_getaffinity(info.m_Tid, sizeof(cpuset), &cpuset) == 0)
+            {
+                cpus = CpuListToString(cpuset);
+            }
+            auto lastcpu = LastCpu(info.m_Tid);
+            std::string scheduling;
+            auto policy = sched_getscheduler(info.m_Tid);
+            sched_param param {};
+            if( ((policy == SCHED_FIFO) || (policy == SCHED_RR)) && (sched_getparam(info.m_Tid, &param) == 0) )
+            {
+                scheduling = std::string(policy == SCHED_FIFO? "fifo " : "rr ") + std::to_string(param.sched_priority);
+            }
+            else
+            {
+                errno = 0;
+                auto nice = getpriority(PRIO_PROCESS, (id_t)info.m_Tid);
+                scheduling = errno? std::string("?") : "nice " + std::to_string(nice);
+            }
+            result += info.m_Name + " (" + std::string(ClassName(info.m_Class)) + ", tid " + std::to_string(info.m_Tid) + "): cpus " + cpus + ", on cpu " + (lastcpu? std::to_string(*lastcpu) : std::string("?")) + ", " + scheduling + "\n";
+        }
+        return result;
+    }
+
+    void InstallReportSignalHandler()
+    {
+        std::signal(SIGUSR1, [](int){
+            sReportRequested.store(true, std::memory_order_relaxed);
+        });
+    }
+
+    bool TakeReportRequest()
+    {
+        return sReportRequested.exchange(false, std::memory_order_relaxed);
+    }
+}
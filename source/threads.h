@@ -0,0 +1,75 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <array>
+#include <optional>
+#include <utility>
+
+namespace threads
+{
+    // Every thread we start belongs to one of these. The placement (cpus and priority) is configured per class.
+    enum class TClass {RtAudio, RtWorker, Io, Background};
+    constexpr size_t sNumClasses = 4;
+    // as used in the settings file: "rtaudio", "rtworker", "io", "background"
+    std::string_view ClassName(TClass threadclass);
+
+    // Fields that are not set leave the threads as they were created.
+    class TClassSettings
+    {
+    public:
+        // the cpus the threads may run on; empty for all:
+        std::vector<int> m_Cpus;
+        // SCHED_FIFO priority:
+        std::optional<int> m_RtPriority;
+        // for threads that are not realtime:
+        std::optional<int> m_Nice;
+    };
+
+    // Read from $XDG_CONFIG_HOME/jnlive/threads.json (by default ~/.config/jnlive/threads.json), a json file like:
+    // {
+    //     "rtaudio":    {"cpus": [2, 3], "rtpriority": 80},
+    //     "rtworker":   {"cpus": [2, 3], "rtpriority": 79},
+    //     "io":         {"cpus": [0, 1]},
+    //     "background": {"cpus": [0, 1], "nice": 10}
+    // }
+    class TSettings
+    {
+    public:
+        const TClassSettings& Class(TClass threadclass) const { return m_Classes[(size_t)threadclass]; }
+        TClassSettings& Class(TClass threadclass) { return m_Classes[(size_t)threadclass]; }
+        static TSettings FromFile(const std::string &filename);
+
+    private:
+        std::array<TClassSettings, sNumClasses> m_Classes;
+    };
+
+    // Applies the settings to all registered threads, and to the threads registered later.
+    void SetSettings(TSettings &&settings);
+    // Whether a realtime priority is configured for the class, i.e. the threads should keep the priority they were given.
+    // Realtime safe.
+    bool HasRtPriority(TClass threadclass);
+    // Names the calling thread (only the first 15 characters are kept), applies the settings of its class and keeps it in
+    // the placement report until it exits. For threads we do not start ourselves, like the jack process thread.
+    void RegisterCurrentThread(TClass threadclass, std::string &&name);
+
+    // Starts a registered thread:
+    template <class F>
+    std::thread Spawn(TClass threadclass, std::string &&name, F &&func)
+    {
+        return std::thread([threadclass, name = std::move(name), func = std::forward<F>(func)]() mutable {
+            RegisterCurrentThread(threadclass, std::move(name));
+            func();
+        });
+    }
+
+    // One line per registered thread: name, class, allowed cpus, the cpu it last ran on, scheduling policy and priority.
+    std::string PlacementReport();
+    // Sending SIGUSR1 to the process requests a placement report. The handler only sets a flag, the report is made by
+    // whoever polls TakeReportRequest().
+    void InstallReportSignalHandler();
+    // true once after each SIGUSR1:
+    bool TakeReportRequest();
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <time.h>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <algorithm>
+
+namespace timing
+{
+    // CLOCK_MONOTONIC_RAW is not slewed by NTP and is read through the vDSO, so it is cheap enough for the realtime thread.
+    inline uint64_t NowNs()
+    {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+    }
+
+    class TStats
+    {
+    public:
+        TStats() = default;
+        TStats(uint64_t count, double avgUs, double p99Us, double maxUs) : m_Count(count), m_AvgUs(avgUs), m_P99Us(p99Us), m_MaxUs(maxUs) {}
+        uint64_t Count() const { return m_Count; }
+        double AvgUs() const { return m_AvgUs; }
+        double P99Us() const { return m_P99Us; }
+        double MaxUs() const { return m_MaxUs; }
+        bool operator==(const TStats &other) const = default;
+
+    private:
+        uint64_t m_Count = 0;
+        double m_AvgUs = 0.0;
+        double m_P99Us = 0.0;
+        double m_MaxUs = 0.0;
+    };
+
+    // Histogram of durations in nanoseconds, with logarithmic buckets (4 per octave, so percentiles are accurate to
+    // within 25%). Add() does not allocate and the histogram is trivially copyable, so it can be filled in the
+    // realtime thread and sent to the main thread through the ring buffer.
+    class THistogram
+    {
+    public:
+        static constexpr size_t sSubBuckets = 4;
+        static constexpr size_t sMaxOctave = 31;
+        static constexpr size_t sNumBuckets = sSubBuckets * sMaxOctave;
+        void Add(uint64_t ns)
+        {
+            m_Buckets[BucketIndex(ns)]++;
+            m_Count++;
+            m_SumNs += ns;
+            m_MaxNs = std::max(m_MaxNs, ns);
+        }
+        void Reset()
+        {
+            *this = THistogram();
+        }
+        uint64_t Count() const { return m_Count; }
+        uint64_t SumNs() const { return m_SumNs; }
+        uint64_t MaxNs() const { return m_MaxNs; }
+        // upper bound of the bucket containing the given fraction of all samples
+        uint64_t PercentileNs(double fraction) const
+        {
+            uint64_t target = (uint64_t)(fraction * (double)m_Count + 0.5);
+            uint64_t accumulated = 0;
+            for(size_t i = 0; i < sNumBuckets; i++)
+            {
+                accumulated += m_Buckets[i];
+                if( (accumulated > 0) && (accumulated >= target) )
+                {
+                    return std::min(BucketUpperBound(i), m_MaxNs);
+                }
+            }
+            return m_MaxNs;
+        }
+        TStats Stats() const
+        {
+            if(m_Count == 0) return TStats();
+            return TStats(m_Count, (double)m_SumNs / (double)m_Count / 1000.0, (double)PercentileNs(0.99) / 1000.0, (double)m_MaxNs / 1000.0);
+        }
+
+    private:
+        static size_t BucketIndex(uint64_t ns)
+        {
+            if(ns < sSubBuckets) return (size_t)ns;
+            size_t octave = std::min((size_t)std::bit_width(ns) - 1, sMaxOctave);
+            size_t sub = (size_t)(ns >> (octave - 2)) & (sSubBuckets - 1);
+            return std::min(sSubBuckets * (octave - 1) + sub, sNumBuckets - 1);
+        }
+        static uint64_t BucketUpperBound(size_t index)
+        {
+            if(index < sSubBuckets) return index;
+            size_t octave = index / sSubBuckets + 1;
+            uint64_t sub = index % sSubBuckets;
+            return ((sSubBuckets + sub + 1) << (octave - 2)) - 1;
+        }
+
+    private:
+        uint64_t m_Count = 0;
+        uint64_t m_SumNs = 0;
+        uint64_t m_MaxNs = 0;
+        std::array<uint32_t, sNumBuckets> m_Buckets {};
+    };
+}
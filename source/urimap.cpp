@@ -0,0 +1,104 @@
+#include "urimap.h"
+#include <cstring>
+#include <stdexcept>
+#include "lv2/atom/atom.h"
+#include "lv2/buf-size/buf-size.h"
+#include "lv2/log/log.h"
+#include "lv2/midi/midi.h"
+#include "lv2/options/options.h"
+#include "lv2/parameters/parameters.h"
+#include "lv2/patch/patch.h"
+#include "lv2/state/state.h"
+#include "lv2/time/time.h"
+#include "lv2/ui/ui.h"
+
+namespace urimap
+{
+    UriMap::TEntry::TEntry(std::string_view uri, uint64_t hash, LV2_URID urid) : m_Hash(hash), m_Urid(urid), m_Storage(std::make_unique<char[]>(uri.size() + 1))
+    {
+        std::memcpy(m_Storage.get(), uri.data(), uri.size());
+        m_Storage[uri.size()] = 0;
+        m_Uri = std::string_view(m_Storage.get(), uri.size());
+    }
+
+    UriMap::UriMap()
+    {
+        m_Entries.reserve(1024);
+        // map the URIs that most plugins use right away, so their first lookup (possibly from the realtime thread) does not need to insert:
+        for(auto uri: {
+            LV2_ATOM__Atom, LV2_ATOM__Blank, LV2_ATOM__Bool, LV2_ATOM__Chunk, LV2_ATOM__Double, LV2_ATOM__Event,
+            LV2_ATOM__Float, LV2_ATOM__Int, LV2_ATOM__Long, LV2_ATOM__Object, LV2_ATOM__Path, LV2_ATOM__Property,
+            LV2_ATOM__Resource, LV2_ATOM__Sequence, LV2_ATOM__String, LV2_ATOM__Tuple, LV2_ATOM__URI, LV2_ATOM__URID,
+            LV2_ATOM__Vector, LV2_ATOM__beatTime, LV2_ATOM__frameTime, LV2_ATOM__eventTransfer, LV2_ATOM__atomTransfer,
+            LV2_MIDI__MidiEvent,
+            LV2_TIME__Position, LV2_TIME__bar, LV2_TIME__barBeat, LV2_TIME__beat, LV2_TIME__beatUnit, LV2_TIME__beatsPerBar,
+            LV2_TIME__beatsPerMinute, LV2_TIME__frame, LV2_TIME__framesPerSecond, LV2_TIME__speed,
+            LV2_PATCH__Get, LV2_PATCH__Set, LV2_PATCH__Put, LV2_PATCH__body, LV2_PATCH__property, LV2_PATCH__subject, LV2_PATCH__value,
+            LV2_LOG__Error, LV2_LOG__Note, LV2_LOG__Trace, LV2_LOG__Warning,
+            LV2_BUF_SIZE__minBlockLength, LV2_BUF_SIZE__maxBlockLength, LV2_BUF_SIZE__nominalBlockLength, LV2_BUF_SIZE__sequenceSize,
+            LV2_PARAMETERS__sampleRate, LV2_UI__updateRate, LV2_UI__scaleFactor, LV2_OPTIONS__options,
+            LV2_STATE__StateChanged,
+        })
+        {
+            Map(uri);
+        }
+    }
+
+    UriMap::~UriMap()
+    {
+    }
+
+    uint64_t UriMap::Hash(std::string_view uri)
+    {
+        // FNV-1a
+        uint64_t hash = 14695981039346656037ull;
+        for(auto c: uri)
+        {
+            hash ^= (unsigned char)c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    const UriMap::TEntry* UriMap::Find(std::string_view uri, uint64_t hash) const
+    {
+        for(size_t slot = hash & (sTableSize - 1); ; slot = (slot + 1) & (sTableSize - 1))
+        {
+            auto entry = m_Table[slot].load(std::memory_order_acquire);
+            if(!entry) return nullptr;
+            if( (entry->m_Hash == hash) && (entry->m_Uri == uri) ) return entry;
+        }
+    }
+
+    LV2_URID UriMap::Map(std::string_view uri)
+    {
+        auto hash = Hash(uri);
+        if(auto entry = Find(uri, hash))
+        {
+            return entry->m_Urid;
+        }
+        std::unique_lock<std::mutex> lock(m_InsertMutex);
+        // another thread may have inserted it in the meantime:
+        if(auto entry = Find(uri, hash))
+        {
+            return entry->m_Urid;
+        }
+        if(m_Entries.size() >= sMaxUrids)
+        {
+            // Map() is reached through the C map callback, an exception would terminate:
+            return 0;
+        }
+        auto urid = (LV2_URID)(m_Entries.size() + 1);
+        m_Entries.push_back(std::make_unique<TEntry>(uri, hash, urid));
+        auto entry = m_Entries.back().get();
+        m_Urid2Entry[urid - 1].store(entry, std::memory_order_release);
+        // The table is never more than half full, so there is a free slot. Only this thread writes to the table:
+        auto slot = hash & (sTableSize - 1);
+        while(m_Table[slot].load(std::memory_order_relaxed))
+        {
+            slot = (slot + 1) & (sTableSize - 1);
+        }
+        m_Table[slot].store(entry, std::memory_order_release);
+        return urid;
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+#include "lv2/urid/urid.h"
+
+namespace urimap
+{
+    // Interns URIs for the LV2 urid:map and urid:unmap features.
+    // Plugins may call map() from their run() function, so looking up a URI that has already been mapped is
+    // wait free: it hashes the string and probes an open addressing table of atomic pointers, without locking or
+    // allocating. Only adding a new URI takes a mutex. Entries are never moved or freed, so the strings returned by
+    // Unmap() remain valid for the lifetime of the map.
+    class UriMap
+    {
+    public:
+        static constexpr size_t sMaxUrids = 16384;
+        UriMap(const UriMap&) = delete;
+        UriMap& operator=(const UriMap&) = delete;
+        UriMap(UriMap&&) = delete;
+        UriMap& operator=(UriMap&&) = delete;
+        UriMap();
+        ~UriMap();
+        // 0 (the LV2 failure value) once sMaxUrids URIs have been mapped
+        LV2_URID Map(std::string_view uri);
+        LV2_URID Map(const char *uri)
+        {
+            return Map(std::string_view(uri));
+        }
+        // returns nullptr for unknown urids
+        const char* Unmap(LV2_URID urid) const
+        {
+            if( (urid == 0) || (urid > sMaxUrids) ) return nullptr;
+            auto entry = m_Urid2Entry[urid - 1].load(std::memory_order_acquire);
+            return entry? entry->m_Uri.data() : nullptr;
+        }
+
+    private:
+        class TEntry
+        {
+        public:
+            TEntry(std::string_view uri, uint64_t hash, LV2_URID urid);
+            uint64_t m_Hash;
+            LV2_URID m_Urid;
+            std::string_view m_Uri; // zero terminated, points into m_Storage
+            std::unique_ptr<char[]> m_Storage;
+        };
+        // power of 2, at most half full:
+        static constexpr size_t sTableSize = 2 * sMaxUrids;
+        static uint64_t Hash(std::string_view uri);
+        const TEntry* Find(std::string_view uri, uint64_t hash) const;
+
+    private:
+        std::array<std::atomic<const TEntry*>, sTableSize> m_Table {};
+        std::array<std::atomic<const TEntry*>, sMaxUrids> m_Urid2Entry {};
+        std::mutex m_InsertMutex;
+        // protected by m_InsertMutex:
+        std::vector<std::unique_ptr<TEntry>> m_Entries;
+    };
+}
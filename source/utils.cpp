@@ -1,8 +1,24 @@
 #include "utils.h"
+#include <fstream>
+#include <unistd.h>
+#include "threads.h"
 
 namespace {
     constexpr auto invalidmarker = (char32_t)0xfffd;
 
+    // the jnlive subdirectory of an XDG base directory
+    std::string XdgDir(const char *variable, const char *defaultRelativeToHome)
+    {
+        // relative paths in XDG variables must be ignored:
+        auto xdgdir = getenv(variable);
+        if(xdgdir && (xdgdir[0] == '/'))
+        {
+            return std::string(xdgdir) + "/jnlive";
+        }
+        auto home = getenv("HOME");
+        return std::string(home? home : "") + defaultRelativeToHome + "/jnlive";
+    }
+
     void u32u8single(std::string &utf8_str, char32_t c)
     {
         // 0xD800–0xDFFF are invalid in UTF-32:
@@ -188,6 +204,36 @@ namespace utils
         return std::string(tempdir);
     }
 
+    size_t ResidentSetSize()
+    {
+        // total program size and resident set size, in pages:
+        std::ifstream statm("/proc/self/statm");
+        size_t size = 0, resident = 0;
+        if(statm >> size >> resident)
+        {
+            return resident * (size_t)sysconf(_SC_PAGESIZE);
+        }
+        return 0;
+    }
+
+    size_t PhysicalMemorySize()
+    {
+        auto pages = sysconf(_SC_PHYS_PAGES);
+        auto pagesize = sysconf(_SC_PAGESIZE);
+        if( (pages <= 0) || (pagesize <= 0) ) return 0;
+        return (size_t)pages * (size_t)pagesize;
+    }
+
+    std::string CacheDir()
+    {
+        return XdgDir("XDG_CACHE_HOME", "/.cache");
+    }
+
+    std::string ConfigDir()
+    {
+        return XdgDir("XDG_CONFIG_HOME", "/.config");
+    }
+
     TEventLoop::TEventLoop() : m_OwningThreadId(std::this_thread::get_id())
     {
     }
@@ -203,16 +249,33 @@ namespace utils
     void TEventLoop::ActionAdded(TEventLoopAction *action)
     {
         CheckThreadId();
-        std::unique_lock<std::mutex> lock(m_Mutex);
         m_NumActions++;
     }
 
     void TEventLoop::ActionRemoved(TEventLoopAction *action)
     {
         CheckThreadId();
-        std::unique_lock<std::mutex> lock(m_Mutex);
         m_NumActions--;
-        m_SignaledActions.erase(action);
+        if(action->m_Signaled.load(std::memory_order_acquire))
+        {
+            // the action is still queued. Move everything to the pending list (which is only accessed by
+            // this thread) and unlink it from there:
+            TakeIncomingActions();
+            TEventLoopAction *prev = nullptr;
+            for(auto a = m_PendingHead; a; a = a->m_Next)
+            {
+                if(a == action)
+                {
+                    (prev? prev->m_Next : m_PendingHead) = a->m_Next;
+                    if(m_PendingTail == a)
+                    {
+                        m_PendingTail = prev;
+                    }
+                    break;
+                }
+                prev = a;
+            }
+        }
     }
 
     void TEventLoop::CheckThreadId() const
@@ -223,21 +286,73 @@ namespace utils
         }
     }
 
-    void TEventLoop::ProcessPendingMessages()
+    bool TEventLoop::Enqueue(TEventLoopAction *action)
     {
-        CheckThreadId();
-        while(true)
+        if(action->m_Signaled.exchange(true, std::memory_order_acq_rel))
+        {
+            // already queued
+            return false;
+        }
+        auto head = m_Incoming.load(std::memory_order_relaxed);
+        do
+        {
+            action->m_Next = head;
+        }
+        while(!m_Incoming.compare_exchange_weak(head, action, std::memory_order_release, std::memory_order_relaxed));
+        return head == nullptr;
+    }
+
+    void TEventLoop::TakeIncomingActions()
+    {
+        auto incoming = m_Incoming.exchange(nullptr, std::memory_order_acquire);
+        if(!incoming) return;
+        // incoming is in LIFO order, reverse it:
+        TEventLoopAction *first = nullptr;
+        auto last = incoming;
+        while(incoming)
+        {
+            auto next = incoming->m_Next;
+            incoming->m_Next = first;
+            first = incoming;
+            incoming = next;
+        }
+        if(m_PendingTail)
+        {
+            m_PendingTail->m_Next = first;
+        }
+        else
+        {
+            m_PendingHead = first;
+        }
+        m_PendingTail = last;
+    }
+
+    TEventLoopAction* TEventLoop::PopSignaledAction()
+    {
+        if(!m_PendingHead)
         {
-            TEventLoopAction* action = nullptr;
+            TakeIncomingActions();
+        }
+        auto action = m_PendingHead;
+        if(action)
+        {
+            m_PendingHead = action->m_Next;
+            if(!m_PendingHead)
             {
-                std::unique_lock<std::mutex> lock(m_Mutex);
-                if(m_SignaledActions.empty())
-                {
-                    break;
-                }
-                action = *m_SignaledActions.begin();
-                m_SignaledActions.erase(m_SignaledActions.begin());
+                m_PendingTail = nullptr;
             }
+            action->m_Next = nullptr;
+            // from here on the action can be signaled again:
+            action->m_Signaled.store(false, std::memory_order_release);
+        }
+        return action;
+    }
+
+    void TEventLoop::ProcessPendingMessages()
+    {
+        CheckThreadId();
+        while(auto action = PopSignaledAction())
+        {
             Call(action);
         }
     }
@@ -260,21 +375,7 @@ namespace utils
     TGtkAppEventLoop::TGtkAppEventLoop() : TEventLoop()
     {
         m_Dispatcher.connect([this](){
-            CheckThreadId();
-            while(true)
-            {
-                TEventLoopAction* action = nullptr;
-                {
-                    std::unique_lock<std::mutex> lock(m_Mutex);
-                    if(m_SignaledActions.empty())
-                    {
-                        break;
-                    }
-                    action = *m_SignaledActions.begin();
-                    m_SignaledActions.erase(m_SignaledActions.begin());
-                }
-                Call(action);
-            }
+            ProcessPendingMessages();
         });
     }
 
@@ -285,13 +386,7 @@ namespace utils
 
     void TGtkAppEventLoop::ActionSignaled(TEventLoopAction *action)
     {
-        bool mustwakeup = false;
-        {
-            std::unique_lock<std::mutex> lock(m_Mutex);
-            mustwakeup = m_SignaledActions.empty();
-            m_SignaledActions.insert(action);
-        }
-        if(mustwakeup)
+        if(Enqueue(action))
         {
             m_Dispatcher.emit();
         }
@@ -310,41 +405,31 @@ namespace utils
                 m_OwningThreadId = std::this_thread::get_id();
                 while(true)
                 {
-                    TEventLoopAction *action = nullptr;
-                    {
-                        std::unique_lock<std::mutex> lock(m_Mutex);
-                        //         std::condition_variable m_QueueCond:
-                        m_QueueCond.wait(lock, [this](){ 
-                            return m_RequestTerminate || !m_SignaledActions.empty(); 
-                        });
-                        if(!m_SignaledActions.empty())
-                        {
-                            action = *m_SignaledActions.begin();
-                            m_SignaledActions.erase(m_SignaledActions.begin());
-                        }
-                        else if(m_RequestTerminate)
-                        {
-                            break;
-                        }
-                    }
-                    if(action)
+                    // read the counter before draining the queue, so that a wakeup after draining is not lost:
+                    auto wakecounter = m_WakeCounter.load(std::memory_order_acquire);
+                    ProcessPendingMessages();
+                    if(m_RequestTerminate.load(std::memory_order_acquire))
                     {
-                        Call(action);
+                        break;
                     }
+                    m_WakeCounter.wait(wakecounter, std::memory_order_acquire);
                 }
             };
-            m_Thread = std::thread(func);
+            m_Thread = threads::Spawn(threads::TClass::Background, "event loop", func);
         }
     }
 
+    void TThreadWithEventLoop::Wake()
+    {
+        m_WakeCounter.fetch_add(1, std::memory_order_release);
+        m_WakeCounter.notify_one();
+    }
+
     void TThreadWithEventLoop::ActionSignaled(TEventLoopAction *action)
     {
-        std::unique_lock<std::mutex> lock(m_Mutex);
-        bool mustwakeup = m_SignaledActions.empty();
-        m_SignaledActions.insert(action);
-        if(mustwakeup)
+        if(Enqueue(action))
         {
-            m_QueueCond.notify_one();
+            Wake();
         }
     }
 
@@ -352,11 +437,8 @@ namespace utils
     {
         if(m_Thread.joinable())
         {
-            {
-                std::unique_lock<std::mutex> lock(m_Mutex);
-                m_RequestTerminate = true;
-                m_QueueCond.notify_one();
-            }
+            m_RequestTerminate.store(true, std::memory_order_release);
+            Wake();
             m_Thread.join();
             m_OwningThreadId = std::this_thread::get_id();
         }
@@ -1,4 +1,5 @@
 #pragma once
+#include <atomic>
 #include <functional>
 #include <set>
 #include <string>
@@ -7,6 +8,10 @@
 #include <gtkmm.h>
 #include <condition_variable>
 #include <regex>
+#include <span>
+#include <cstring>
+#include <cstdlib>
+#include <type_traits>
 
 #define nhAssert(_Expression) 							\
      (static_cast <bool> (_Expression)						\
@@ -131,6 +136,14 @@ namespace utils
     };
 
     std::string generate_random_tempdir();
+    // of the current process, in bytes, 0 if unknown:
+    size_t ResidentSetSize();
+    size_t PhysicalMemorySize();
+    // per user directory for data that can be regenerated: $XDG_CACHE_HOME/jnlive, by default ~/.cache/jnlive
+    std::string CacheDir();
+    // per user directory for settings that belong to the machine rather than to a project: $XDG_CONFIG_HOME/jnlive,
+    // by default ~/.config/jnlive
+    std::string ConfigDir();
     // make a regular expression from a string
     // '*' matches any substring
     // '?' matches any character
@@ -152,6 +165,10 @@ namespace utils
     private:
         std::function<void(void)> m_Func;
         TEventLoop &m_EventLoop;
+        // set while the action is queued; signaling an action that is already queued is a no-op:
+        std::atomic<bool> m_Signaled = false;
+        // intrusive link, used by the event loop's queue:
+        TEventLoopAction *m_Next = nullptr;
     };
 
     // Abstract base class. Use TGtkAppEventLoop or TThreadWithEventLoop
@@ -172,16 +189,27 @@ namespace utils
         void ActionAdded(TEventLoopAction *action);
         void ActionRemoved(TEventLoopAction *action);
         virtual void ActionSignaled(TEventLoopAction *action) = 0;
+        // Lock free, can be called from any thread. Returns true if the queue was empty, i.e. the owning thread needs a wakeup.
+        bool Enqueue(TEventLoopAction *action);
         void Call(TEventLoopAction *action)
         {
             action->m_Func();
         }
 
+    private:
+        TEventLoopAction* PopSignaledAction();
+        void TakeIncomingActions();
+
     protected:
         std::thread::id m_OwningThreadId;
         size_t m_NumActions = 0;
-        std::mutex m_Mutex;
-        std::set<TEventLoopAction*> m_SignaledActions;
+
+    private:
+        // Multiple producer, single consumer queue. Producers push onto m_Incoming (LIFO), the owning thread
+        // moves the whole stack to m_PendingHead/m_PendingTail (FIFO), which are only accessed by the owning thread.
+        std::atomic<TEventLoopAction*> m_Incoming = nullptr;
+        TEventLoopAction *m_PendingHead = nullptr;
+        TEventLoopAction *m_PendingTail = nullptr;
     };
 
     // Event loops which uses the GTK eventloop
@@ -210,10 +238,14 @@ namespace utils
     protected:
         virtual void ActionSignaled(TEventLoopAction *action) override;
 
+    private:
+        void Wake();
+
     private:
         std::thread m_Thread;
-        std::condition_variable m_QueueCond;
-        bool m_RequestTerminate = false;
+        // incremented on each wakeup, the thread sleeps in m_WakeCounter.wait() (futex based)
+        std::atomic<uint32_t> m_WakeCounter = 0;
+        std::atomic<bool> m_RequestTerminate = false;
     };
 
 
@@ -914,17 +946,140 @@ typedef TTypedRect<float> TFloatRect;
 typedef TTypedRect<int> TIntRect;
 typedef TTypedRect<double> TDoubleRect;
 
+// A vector of trivially copyable elements that keeps up to N of them inline. Shrinking keeps the capacity, so a
+// vector that is cleared and refilled stops allocating once it has grown large enough.
+template <typename E, size_t N>
+class TSmallVector
+{
+  static_assert(std::is_trivially_copyable_v<E>);
+public:
+  TSmallVector() {}
+  TSmallVector(const TSmallVector &src) { Assign(src.data(), src.size()); }
+  TSmallVector(TSmallVector &&src) noexcept { MoveFrom(src); }
+  TSmallVector& operator=(const TSmallVector &src)
+  {
+    if (this != &src) Assign(src.data(), src.size());
+    return *this;
+  }
+  TSmallVector& operator=(TSmallVector &&src) noexcept
+  {
+    if (this != &src)
+    {
+      FreeHeap();
+      MoveFrom(src);
+    }
+    return *this;
+  }
+  ~TSmallVector() { FreeHeap(); }
+  size_t size() const { return m_Size; }
+  bool empty() const { return m_Size == 0; }
+  E* data() { return m_Heap ? m_Heap : reinterpret_cast<E*>(m_Inline); }
+  const E* data() const { return m_Heap ? m_Heap : reinterpret_cast<const E*>(m_Inline); }
+  E& operator[](size_t index) { return data()[index]; }
+  const E& operator[](size_t index) const { return data()[index]; }
+  E& back() { return data()[m_Size - 1]; }
+  const E& back() const { return data()[m_Size - 1]; }
+  E* begin() { return data(); }
+  E* end() { return data() + m_Size; }
+  const E* begin() const { return data(); }
+  const E* end() const { return data() + m_Size; }
+  void clear() { m_Size = 0; }
+  // only shrinks:
+  void truncate(size_t size)
+  {
+    nhAssert(size <= m_Size);
+    m_Size = size;
+  }
+  void reserve(size_t capacity)
+  {
+    if (capacity > m_Capacity)
+    {
+      auto heap = (E*)std::malloc(capacity * sizeof(E));
+      if (!heap) throw std::bad_alloc();
+      std::memcpy((void*)heap, (const void*)data(), m_Size * sizeof(E));
+      FreeHeap();
+      m_Heap = heap;
+      m_Capacity = capacity;
+    }
+  }
+  void push_back(const E &element)
+  {
+    if (m_Size == m_Capacity)
+    {
+      // element may live in our own storage:
+      E copy = element;
+      reserve(2 * m_Capacity);
+      data()[m_Size++] = copy;
+    }
+    else
+    {
+      data()[m_Size++] = element;
+    }
+  }
+  void swap(TSmallVector &other) noexcept
+  {
+    TSmallVector temp(std::move(other));
+    other = std::move(*this);
+    *this = std::move(temp);
+  }
+
+private:
+  void Assign(const E *src, size_t size)
+  {
+    clear();
+    reserve(size);
+    std::memcpy((void*)data(), (const void*)src, size * sizeof(E));
+    m_Size = size;
+  }
+  void MoveFrom(TSmallVector &src)
+  {
+    if (src.m_Heap)
+    {
+      m_Heap = src.m_Heap;
+      m_Capacity = src.m_Capacity;
+      src.m_Heap = nullptr;
+      src.m_Capacity = N;
+    }
+    else
+    {
+      std::memcpy((void*)m_Inline, (const void*)src.m_Inline, src.m_Size * sizeof(E));
+      m_Capacity = N;
+    }
+    m_Size = src.m_Size;
+    src.m_Size = 0;
+  }
+  void FreeHeap()
+  {
+    if (m_Heap)
+    {
+      std::free(m_Heap);
+      m_Heap = nullptr;
+      m_Capacity = N;
+    }
+  }
+
+private:
+  E *m_Heap = nullptr;
+  size_t m_Size = 0;
+  size_t m_Capacity = N;
+  alignas(E) unsigned char m_Inline[N * sizeof(E)];
+};
+
 /*
 
 TTypedRegion<int> emptyregion;
 TTypedRegion<int> region1(TIntRect::FromTopLeftAndBottomRight({10,20},{200,300}));
-We can do Union(), Intersection() and Difference(). These return a new TTypedRegion.
-Get the rectangles using forEach():
+We can do Union(), Intersection() and Subtract(). These return a new TTypedRegion; UnionWith() and IntersectWith()
+modify the region itself and do not allocate once the region has grown to its working size.
+Get the rectangles using ForEach():
 
-region1.forEach([&](const TIntRect &r}{
+region1.ForEach([&](const TIntRect &r}{
  // do something
 });
 
+The region is stored as a list of bands from top to bottom. Each band has the same horizontal ranges on all its rows;
+the ranges of all bands are kept in one array. Small regions fit inline, without any heap allocation.
+
 */
 
 template <typename T>
@@ -952,136 +1107,91 @@ public:
     T m_Right;
   };
 
+  // a band of the region, as passed to ForEachVertRange()
   class TVerticalRange
   {
   public:
-    TVerticalRange(T top, T bottom)
-      : m_Top(top), m_Bottom(bottom)
-    {
-      nhAssert(top < bottom);
-    }
-    TVerticalRange(T top, T bottom, const std::vector<THorizontalRange> &horzRanges)
+    TVerticalRange(T top, T bottom, std::span<const THorizontalRange> horzRanges)
       : m_Top(top), m_Bottom(bottom), m_HorzRanges(horzRanges)
     {
       nhAssert(top < bottom);
     }
-    void AppendHorzRange(const THorizontalRange &horzrange)
-    {
-      if (!m_HorzRanges.empty())
-      {
-        nhAssert(m_HorzRanges.back().Right() <= horzrange.Left());
-        if (m_HorzRanges.back().Right() == horzrange.Left())
-        {
-          m_HorzRanges.back() = THorizontalRange(m_HorzRanges.back().Left(), horzrange.Right());
-        }
-        else
-        {
-          m_HorzRanges.push_back(horzrange);
-        }
-      }
-      else
-      {
-        m_HorzRanges.push_back(horzrange);
-      }
-    }
     inline T Top() const { return m_Top; }
     inline T Bottom() const { return m_Bottom; }
-    inline void SetTop(const T &val) { m_Top = val; }
-    inline void SetBottom(const T &val) { m_Bottom = val; }
-    inline const std::vector<THorizontalRange>& HorzRanges() const { return m_HorzRanges; }
-    TVerticalRange Shift(const TTypedPoint<T> &delta) const
-    {
-      TVerticalRange result(Top() + delta.Y(), Bottom() + delta.Y());
-      for (const auto &hrange : m_HorzRanges)
-      {
-        m_HorzRanges.push_back(hrange.Shift(delta.X()));
-      }
-      return result;
-    }
+    inline std::span<const THorizontalRange> HorzRanges() const { return m_HorzRanges; }
 
   private:
     T m_Top;
     T m_Bottom;
-    std::vector<THorizontalRange> m_HorzRanges;
+    std::span<const THorizontalRange> m_HorzRanges;
   };
 
 public:
-  inline TTypedRegion() {}
-  inline TTypedRegion(const TTypedRegion& src) : m_VertRanges(src.m_VertRanges) {}
+  TTypedRegion() {}
   TTypedRegion(const TTypedRect<T> &r)
   {
     if (!r.IsEmpty())
     {
-      TVerticalRange newrange(r.Top(), r.Bottom());
-      newrange.AppendHorzRange({ r.Left(), r.Right() });
-      AppendRangeAtBottom(std::move(newrange));
+      m_HorzRanges.push_back({ r.Left(), r.Right() });
+      m_Bands.push_back({ r.Top(), r.Bottom(), 0, 1 });
     }
   }
-  inline TTypedRegion(TTypedRegion&& src) : m_VertRanges(std::move(src.m_VertRanges)) {}
-  inline TTypedRegion<T>& operator=(const TTypedRegion& src)
-  {
-    m_VertRanges = src.m_VertRanges;
-    return *this;
-  }
-  inline TTypedRegion<T>& operator=(TTypedRegion&& src)
-  {
-    if (this != &src)
-    {
-      m_VertRanges = std::move(src.m_VertRanges);
-    }
-    return *this;
-  }
   inline bool empty() const
   {
-    return m_VertRanges.empty();
+    return m_Bands.empty();
   }
 
   TTypedRegion Union(const TTypedRegion<T> &other) const
   {
     TTypedRegion result;
-    IterateVert(m_VertRanges, other.m_VertRanges, [&](T top, T bottom, const std::vector<THorizontalRange> &horzrange1, const std::vector<THorizontalRange> &horzrange2) {
-      TVerticalRange newvertrange(top, bottom);
-      IterateHorz(horzrange1, horzrange2, [&](T left, T right, bool /*has1*/, bool /*has2*/) {
-        newvertrange.AppendHorzRange({ left, right });
-      });
-      result.AppendRangeAtBottom(std::move(newvertrange));
-    });
+    Combine(*this, other, [](bool has1, bool has2) { return has1 || has2; }, result);
     return result;
   }
   TTypedRegion Subtract(const TTypedRegion<T> &other) const
   {
     TTypedRegion result;
-    IterateVert(m_VertRanges, other.m_VertRanges, [&](T top, T bottom, const std::vector<THorizontalRange> &horzrange1, const std::vector<THorizontalRange> &horzrange2) {
-      TVerticalRange newvertrange(top, bottom);
-      IterateHorz(horzrange1, horzrange2, [&](T left, T right, bool has1, bool has2) {
-        if (has1 && (!has2))
-        {
-          newvertrange.AppendHorzRange({ left, right });
-        }
-      });
-      result.AppendRangeAtBottom(std::move(newvertrange));
-    });
+    Combine(*this, other, [](bool has1, bool has2) { return has1 && (!has2); }, result);
     return result;
   }
   TTypedRegion Intersection(const TTypedRegion<T> &other) const
   {
     TTypedRegion result;
-    IterateVert(m_VertRanges, other.m_VertRanges, [&](T top, T bottom, const std::vector<THorizontalRange> &horzrange1, const std::vector<THorizontalRange> &horzrange2) {
-      TVerticalRange newvertrange(top, bottom);
-      IterateHorz(horzrange1, horzrange2, [&](T left, T right, bool has1, bool has2) {
-        if (has1 && has2)
-        {
-          newvertrange.AppendHorzRange({ left, right });
-        }
-      });
-      result.AppendRangeAtBottom(std::move(newvertrange));
-    });
+    Combine(*this, other, [](bool has1, bool has2) { return has1 && has2; }, result);
     return result;
   }
+  void UnionWith(const TTypedRegion<T> &other)
+  {
+    if (other.empty()) return;
+    if (empty())
+    {
+      *this = other;
+      return;
+    }
+    auto &scratch = Scratch();
+    Combine(*this, other, [](bool has1, bool has2) { return has1 || has2; }, scratch);
+    Swap(scratch);
+  }
+  void IntersectWith(const TTypedRegion<T> &other)
+  {
+    if (empty()) return;
+    if (other.empty())
+    {
+      Clear();
+      return;
+    }
+    auto &scratch = Scratch();
+    Combine(*this, other, [](bool has1, bool has2) { return has1 && has2; }, scratch);
+    Swap(scratch);
+  }
+  void Clear()
+  {
+    m_Bands.clear();
+    m_HorzRanges.clear();
+  }
   bool Intersects(const TTypedRegion<T> &other) const
   {
     bool result = false;
-    IterateVert(m_VertRanges, other.m_VertRanges, [&](T /*top*/, T /*bottom*/, const std::vector<THorizontalRange> &horzrange1, const std::vector<THorizontalRange> &horzrange2) {
+    IterateVert(*this, other, [&](T /*top*/, T /*bottom*/, std::span<const THorizontalRange> horzrange1, std::span<const THorizontalRange> horzrange2) {
       IterateHorz(horzrange1, horzrange2, [&](T /*left*/, T /*right*/, bool has1, bool has2) {
         if (has1 && has2) result = true;
       });
@@ -1091,7 +1201,7 @@ public:
   bool Contains(const TTypedRegion<T> &other) const
   {
     bool result = true;
-    IterateVert(m_VertRanges, other.m_VertRanges, [&](T /*top*/, T /*bottom*/, const std::vector<THorizontalRange> &horzrange1, const std::vector<THorizontalRange> &horzrange2) {
+    IterateVert(*this, other, [&](T /*top*/, T /*bottom*/, std::span<const THorizontalRange> horzrange1, std::span<const THorizontalRange> horzrange2) {
       IterateHorz(horzrange1, horzrange2, [&](T /*left*/, T /*right*/, bool has1, bool has2) {
         if ( (!has1) && has2) result = false;
       });
@@ -1109,21 +1219,35 @@ public:
   template <class Function>
   void ForEach(const Function &func) const
   {
-    for (const auto &vertrange : m_VertRanges)
+    for (const auto &band : m_Bands)
     {
-      for (const auto &horzrange : vertrange.HorzRanges())
+      for (const auto &horzrange : HorzRangesOfBand(band))
       {
-        auto r = TTypedRect<T>::FromTopLeftAndBottomRight({ horzrange.Left(), vertrange.Top() }, { horzrange.Right(), vertrange.Bottom() });
+        auto r = TTypedRect<T>::FromTopLeftAndBottomRight({ horzrange.Left(), band.m_Top }, { horzrange.Right(), band.m_Bottom });
         func(r);
       }
     }
   }
+  // func(const TVerticalRange&), from top to bottom
+  template <class Function>
+  void ForEachVertRange(const Function &func) const
+  {
+    for (const auto &band : m_Bands)
+    {
+      func(TVerticalRange(band.m_Top, band.m_Bottom, HorzRangesOfBand(band)));
+    }
+  }
   TTypedRegion<T> Shift(const TTypedPoint<T> &delta) const
   {
-    TTypedRegion<T> result;
-    for (const auto &vrange : m_VertRanges)
+    TTypedRegion<T> result(*this);
+    for (auto &band : result.m_Bands)
     {
-      result.m_VertRanges.push_back(vrange.Shift(delta));
+      band.m_Top += delta.Y();
+      band.m_Bottom += delta.Y();
+    }
+    for (auto &horzrange : result.m_HorzRanges)
+    {
+      horzrange = horzrange.Shift(delta.X());
     }
     return result;
   }
@@ -1135,12 +1259,56 @@ public:
     });
     return result;
   }
-  const std::vector<TVerticalRange> &VertRanges() const {return m_VertRanges;}
 
 private:
+  class TBand
+  {
+  public:
+    T m_Top;
+    T m_Bottom;
+    // range in m_HorzRanges:
+    uint32_t m_Begin;
+    uint32_t m_End;
+  };
+
+  std::span<const THorizontalRange> HorzRangesOfBand(const TBand &band) const
+  {
+    return { m_HorzRanges.data() + band.m_Begin, band.m_End - band.m_Begin };
+  }
+  void Swap(TTypedRegion &other)
+  {
+    m_Bands.swap(other.m_Bands);
+    m_HorzRanges.swap(other.m_HorzRanges);
+  }
+  // reused by UnionWith() and IntersectWith(), so they keep the storage of the previous call:
+  static TTypedRegion& Scratch()
+  {
+    thread_local TTypedRegion scratch;
+    return scratch;
+  }
+
+  // result must be a different region than r1 and r2. include(has1, has2) decides which parts end up in the result.
+  template <class Include>
+  static void Combine(const TTypedRegion &r1, const TTypedRegion &r2, const Include &include, TTypedRegion &result)
+  {
+    result.Clear();
+    IterateVert(r1, r2, [&](T top, T bottom, std::span<const THorizontalRange> horzrange1, std::span<const THorizontalRange> horzrange2) {
+      auto begin = result.m_HorzRanges.size();
+      IterateHorz(horzrange1, horzrange2, [&](T left, T right, bool has1, bool has2) {
+        if (include(has1, has2))
+        {
+          result.AppendHorzRange(begin, left, right);
+        }
+      });
+      result.AppendBandAtBottom(top, bottom, begin);
+    });
+  }
+
   template <class Function>
-  static void IterateVert(const std::vector<TVerticalRange> &range1, const std::vector<TVerticalRange> &range2, const Function &func)
+  static void IterateVert(const TTypedRegion &region1, const TTypedRegion &region2, const Function &func)
   {
+    const auto &range1 = region1.m_Bands;
+    const auto &range2 = region2.m_Bands;
     T y = 0;
     auto it1 = range1.begin();
     auto it2 = range2.begin();
@@ -1154,17 +1322,17 @@ private:
       }
       else
       {
-        y = it2->Top();
+        y = it2->m_Top;
       }
     }
     else
     {
-      y = it1->Top();
+      y = it1->m_Top;
       if (!atend2)
       {
-        if (it2->Top() < y)
+        if (it2->m_Top < y)
         {
-          y = it2->Top();
+          y = it2->m_Top;
         }
       }
     }
@@ -1173,73 +1341,31 @@ private:
       atend1 = (it1 == range1.end());
       atend2 = (it2 == range2.end());
       if (atend1 && atend2) break;
-      bool contains1 = (!atend1) && (y >= it1->Top());
-      bool contains2 = (!atend2) && (y >= it2->Top());
-      int nexty = 0;
+      bool contains1 = (!atend1) && (y >= it1->m_Top);
+      bool contains2 = (!atend2) && (y >= it2->m_Top);
+      T nexty = 0;
       if (!atend1)
       {
-        if (contains1)
-        {
-          nexty = it1->Bottom();
-        }
-        else
-        {
-          nexty = it1->Top();
-        }
+        nexty = contains1 ? it1->m_Bottom : it1->m_Top;
       }
       if (!atend2)
       {
-        if (contains2)
-        {
-          if (!atend1)
-          {
-            nexty = std::min(nexty, it2->Bottom());
-          }
-          else
-          {
-            nexty = it2->Bottom();
-          }
-        }
-        else
-        {
-          if (!atend1)
-          {
-            nexty = std::min(nexty, it2->Top());
-          }
-          else
-          {
-            nexty = it2->Top();
-          }
-        }
+        T next2 = contains2 ? it2->m_Bottom : it2->m_Top;
+        nexty = atend1 ? next2 : std::min(nexty, next2);
       }
       nhAssert(nexty > y);
-      if (contains1)
-      {
-        if (contains2)
-        {
-          func(y, nexty, it1->HorzRanges(), it2->HorzRanges());
-        }
-        else
-        {
-          func(y, nexty, it1->HorzRanges(), std::vector<THorizontalRange>());
-        }
-      }
-      else if (contains2)
-      {
-        func(y, nexty, std::vector<THorizontalRange>(), it2->HorzRanges());
-      }
-      else
+      if (contains1 || contains2)
       {
-        // nothing here
+        func(y, nexty, contains1 ? region1.HorzRangesOfBand(*it1) : std::span<const THorizontalRange>(), contains2 ? region2.HorzRangesOfBand(*it2) : std::span<const THorizontalRange>());
       }
       y = nexty;
-      if ((!atend1) && (y >= it1->Bottom())) it1++;
-      if ((!atend2) && (y >= it2->Bottom())) it2++;
-    } // while true  
+      if ((!atend1) && (y >= it1->m_Bottom)) it1++;
+      if ((!atend2) && (y >= it2->m_Bottom)) it2++;
+    } // while true
   }
 
   template <class Function>
-  static void IterateHorz(const std::vector<THorizontalRange> &range1, const std::vector<THorizontalRange> &range2, const Function &func)
+  static void IterateHorz(std::span<const THorizontalRange> range1, std::span<const THorizontalRange> range2, const Function &func)
   {
     T x;
     auto it1 = range1.begin();
@@ -1275,97 +1401,61 @@ private:
       if (atend1 && atend2) break;
       bool contains1 = (!atend1) && (x >= it1->Left());
       bool contains2 = (!atend2) && (x >= it2->Left());
-      int nextx = 0;
+      T nextx = 0;
       if (!atend1)
       {
-        if (contains1)
-        {
-          nextx = it1->Right();
-        }
-        else
-        {
-          nextx = it1->Left();
-        }
+        nextx = contains1 ? it1->Right() : it1->Left();
       }
       if (!atend2)
       {
-        if (contains2)
-        {
-          if (!atend1)
-          {
-            nextx = std::min(nextx, it2->Right());
-          }
-          else
-          {
-            nextx = it2->Right();
-          }
-        }
-        else
-        {
-          if (!atend1)
-          {
-            nextx = std::min(nextx, it2->Left());
-          }
-          else
-          {
-            nextx = it2->Left();
-          }
-        }
+        T next2 = contains2 ? it2->Right() : it2->Left();
+        nextx = atend1 ? next2 : std::min(nextx, next2);
       }
       nhAssert(nextx > x);
-      if (contains1)
+      if (contains1 || contains2)
       {
-        if (contains2)
-        {
-          func(x, nextx, true, true);
-        }
-        else
-        {
-          func(x, nextx, true, false);
-        }
-      }
-      else if (contains2)
-      {
-        func(x, nextx, false, true);
-      }
-      else
-      {
-        // nothing here
+        func(x, nextx, contains1, contains2);
       }
       x = nextx;
       if ((!atend1) && (x >= it1->Right())) it1++;
       if ((!atend2) && (x >= it2->Right())) it2++;
     } // while true
   }
-  void AppendRangeAtBottom(TVerticalRange &&newvertrange)
+  // appends to the band whose ranges start at begin, joining directly adjacent ranges:
+  void AppendHorzRange(size_t begin, T left, T right)
   {
-    if (!newvertrange.HorzRanges().empty())
+    if ( (m_HorzRanges.size() > begin) && (m_HorzRanges.back().Right() == left) )
     {
-      bool done = false;
-      if (!m_VertRanges.empty())
-      {
-        auto &lastrange = m_VertRanges.back();
-        nhAssert(lastrange.Bottom() <= newvertrange.Top());
-        if (lastrange.Bottom() == newvertrange.Top())
-        {
-          // directly adjacent:
-          if (lastrange.HorzRanges() == newvertrange.HorzRanges())
-          {
-            // and same horzrange. Just extend:
-            lastrange.SetBottom(newvertrange.Bottom());
-            done = true;
-          }
-        }
-      }
-      if (!done)
+      m_HorzRanges.back() = THorizontalRange(m_HorzRanges.back().Left(), right);
+    }
+    else
+    {
+      m_HorzRanges.push_back({ left, right });
+    }
+  }
+  // closes the band of the ranges from begin; it is merged into the band above if that is directly adjacent and equal
+  void AppendBandAtBottom(T top, T bottom, size_t begin)
+  {
+    auto end = m_HorzRanges.size();
+    if (end == begin) return;
+    if (!m_Bands.empty())
+    {
+      auto &lastband = m_Bands.back();
+      nhAssert(lastband.m_Bottom <= top);
+      if ( (lastband.m_Bottom == top) && (lastband.m_End - lastband.m_Begin == end - begin)
+        && std::equal(m_HorzRanges.begin() + lastband.m_Begin, m_HorzRanges.begin() + lastband.m_End, m_HorzRanges.begin() + begin) )
       {
-        m_VertRanges.push_back(std::move(newvertrange));
+        lastband.m_Bottom = bottom;
+        m_HorzRanges.truncate(begin);
+        return;
       }
     }
+    m_Bands.push_back({ top, bottom, (uint32_t)begin, (uint32_t)end });
   }
 
 private:
-  std::vector<TVerticalRange> m_VertRanges;
+  TSmallVector<TBand, 4> m_Bands;
+  TSmallVector<THorizontalRange, 8> m_HorzRanges;
 };
 
 typedef TTypedRegion<float> TFloatRegion;
@@ -0,0 +1,121 @@
+#include "wavfile.h"
+#include <stdexcept>
+#include <vector>
+#include <cstring>
+#include <iostream>
+#include <bit>
+
+namespace
+{
+    void Put16(std::vector<uint8_t> &buf, uint16_t v)
+    {
+        buf.push_back((uint8_t)v);
+        buf.push_back((uint8_t)(v >> 8));
+    }
+    void Put32(std::vector<uint8_t> &buf, uint32_t v)
+    {
+        Put16(buf, (uint16_t)v);
+        Put16(buf, (uint16_t)(v >> 16));
+    }
+    void PutTag(std::vector<uint8_t> &buf, const char *tag)
+    {
+        buf.insert(buf.end(), tag, tag + 4);
+    }
+}
+
+namespace wavfile
+{
+    TWriter::TWriter(const std::string &filename, uint32_t sampleRate, uint16_t numChannels) : m_Filename(filename), m_SampleRate(sampleRate), m_NumChannels(numChannels)
+    {
+        if(numChannels == 0)
+        {
+            throw std::runtime_error("WAV file needs at least one channel");
+        }
+        m_File = fopen(filename.c_str(), "wb");
+        if(!m_File)
+        {
+            throw std::runtime_error("Could not open file for writing: " + filename);
+        }
+        WriteHeader();
+    }
+    TWriter::~TWriter()
+    {
+        try
+        {
+            Close();
+        }
+        catch(std::exception &e)
+        {
+            std::cerr << e.what() << '\n';
+        }
+    }
+    void TWriter::Write(const float* const* channels, size_t nframes)
+    {
+        if(!m_File)
+        {
+            throw std::runtime_error("WAV file is closed: " + m_Filename);
+        }
+        // WAV is little endian, like every platform we run on:
+        static_assert(std::endian::native == std::endian::little);
+        std::vector<float> interleaved(nframes * m_NumChannels);
+        for(size_t frame = 0; frame < nframes; frame++)
+        {
+            for(size_t channel = 0; channel < m_NumChannels; channel++)
+            {
+                interleaved[frame * m_NumChannels + channel] = channels[channel][frame];
+            }
+        }
+        if(fwrite(interleaved.data(), sizeof(float), interleaved.size(), m_File) != interleaved.size())
+        {
+            throw std::runtime_error("Could not write to file: " + m_Filename);
+        }
+        m_NumFrames += nframes;
+    }
+    void TWriter::Close()
+    {
+        if(!m_File) return;
+        auto file = m_File;
+        if(fseek(file, 0, SEEK_SET) == 0)
+        {
+            WriteHeader();
+        }
+        m_File = nullptr;
+        if(fclose(file) != 0)
+        {
+            throw std::runtime_error("Could not write to file: " + m_Filename);
+        }
+    }
+    void TWriter::WriteHeader()
+    {
+        uint64_t datasize = m_NumFrames * m_NumChannels * sizeof(float);
+        if(datasize > 0xffffffffu - 50)
+        {
+            throw std::runtime_error("WAV file too large: " + m_Filename);
+        }
+        uint16_t blockalign = (uint16_t)(m_NumChannels * sizeof(float));
+        std::vector<uint8_t> header;
+        PutTag(header, "RIFF");
+        Put32(header, (uint32_t)(4 + 26 + 12 + 8 + datasize));
+        PutTag(header, "WAVE");
+        PutTag(header, "fmt ");
+        Put32(header, 18);
+        Put16(header, 3); // WAVE_FORMAT_IEEE_FLOAT
+        Put16(header, m_NumChannels);
+        Put32(header, m_SampleRate);
+        Put32(header, m_SampleRate * blockalign);
+        Put16(header, blockalign);
+        Put16(header, 32);
+        Put16(header, 0);
+        // non-PCM formats need a fact chunk:
+        PutTag(header, "fact");
+        Put32(header, 4);
+        Put32(header, (uint32_t)m_NumFrames);
+        PutTag(header, "data");
+        Put32(header, (uint32_t)datasize);
+        if(fwrite(header.data(), 1, header.size(), m_File) != header.size())
+        {
+            throw std::runtime_error("Could not write to file: " + m_Filename);
+        }
+        fseek(m_File, 0, SEEK_END);
+    }
+}
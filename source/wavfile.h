@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstdio>
+
+namespace wavfile
+{
+    // Writes 32 bit float WAV files. Samples are stored unmodified, so two renders can be compared bit for bit.
+    class TWriter
+    {
+    public:
+        TWriter(const TWriter&) = delete;
+        TWriter& operator=(const TWriter&) = delete;
+        TWriter(TWriter&&) = delete;
+        TWriter& operator=(TWriter&&) = delete;
+        TWriter(const std::string &filename, uint32_t sampleRate, uint16_t numChannels);
+        ~TWriter();
+        // channels points to numChannels buffers of nframes samples each
+        void Write(const float* const* channels, size_t nframes);
+        // writes the final sizes into the header and closes the file
+        void Close();
+        uint64_t NumFrames() const { return m_NumFrames; }
+
+    private:
+        void WriteHeader();
+
+    private:
+        std::string m_Filename;
+        FILE *m_File = nullptr;
+        uint32_t m_SampleRate;
+        uint16_t m_NumChannels;
+        uint64_t m_NumFrames = 0;
+    };
+}